@@ -25,19 +25,114 @@
 #include "alert.h"
 
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 #include "log.h"
+#include "memory.h"
+
+static const char *severity_names[ALERT_SEVERITIES] = {
+   "unknown", "minor", "moderate", "severe", "extreme"
+};
+
+/*
+   same_string(a, b) Returns true if a and b are equal (or both NULL).
+*/
+static bool same_string(const char *a, const char *b)
+{
+   return a == b || (a && b && strcmp(a, b) == 0);
+}// End of same_string method
+
+/*
+   same_time(a, b) Returns true if every field of a and b is equal.
+*/
+static bool same_time(const struct tm *a, const struct tm *b)
+{
+   return a->tm_year == b->tm_year && a->tm_mon == b->tm_mon && a->tm_mday == b->tm_mday
+      && a->tm_hour == b->tm_hour && a->tm_min == b->tm_min && a->tm_sec == b->tm_sec
+      && a->tm_wday == b->tm_wday && a->tm_yday == b->tm_yday && a->tm_isdst == b->tm_isdst;
+}// End of same_time method
+
+// IMPLEMENTATION: See header for details
+Alert * retain_alert(Alert *alert)
+{
+   if (alert) __atomic_add_fetch(&alert->references, 1, __ATOMIC_RELAXED);
+
+   return alert;
+}// End of retain_alert method
+
+/*
+   local_time(tm) Returns tm as a time, without modifying it (alerts are
+                  shared between threads).
+*/
+static time_t local_time(const struct tm *tm)
+{
+   struct tm copy = *tm;
+   copy.tm_isdst = -1;
+
+   return mktime(&copy);
+}// End of local_time method
+
+// IMPLEMENTATION: See header for details
+time_t alert_expiry(const Alert *alert)
+{
+   return local_time(&alert->expires);
+}// End of alert_expiry method
+
+// IMPLEMENTATION: See header for details
+bool same_alert(const Alert *a, const Alert *b)
+{
+   if (a == b) return true;
+
+   if (!same_string(a->identifier, b->identifier) || !same_string(a->headline, b->headline)
+         || !same_string(a->description, b->description) || !same_string(a->instruction, b->instruction)
+         || !same_string(a->issuer, b->issuer) || !same_string(a->event, b->event)
+         || a->severity != b->severity || a->area_count != b->area_count
+         || !same_time(&a->effective, &b->effective) || !same_time(&a->expires, &b->expires)) return false;
+
+   for (int x = 0; x < a->area_count; ++x)
+   {
+      const AlertArea *first = a->areas[x];
+      const AlertArea *second = b->areas[x];
+
+      if (!same_string(first->name, second->name) || first->geocode_count != second->geocode_count
+            || memcmp(first->geocodes, second->geocodes, first->geocode_count * sizeof(int)) != 0) return false;
+   }// End of for
+
+   return true;
+}// End of same_alert method
+
+// IMPLEMENTATION: See header for details
+AlertSeverity parse_alert_severity(const char *name)
+{
+   for (int x = ALERT_SEVERITY_MINOR; name && x < ALERT_SEVERITIES; ++x)
+   {
+      if (strcasecmp(name, severity_names[x]) == 0) return (AlertSeverity)x;
+   }// End of for
+
+   return ALERT_SEVERITY_UNKNOWN;
+}// End of parse_alert_severity method
+
+// IMPLEMENTATION: See header for details
+const char * alert_severity_name(AlertSeverity severity)
+{
+   return severity_names[severity];
+}// End of alert_severity_name method
 
 // IMPLEMENTATION: See header for details
 void free_alert(Alert *alert)
 {
    if (!alert) return;
 
+   if (__atomic_sub_fetch(&alert->references, 1, __ATOMIC_ACQ_REL) > 0) return;
+
    zlog_debug(alog, "Entering");
 
-   free(alert->headline);
-   free(alert->description);
-   free(alert->instruction);
-   free(alert->issuer);
+   account_free(MEMORY_STRINGS, alert->identifier);
+   account_free(MEMORY_STRINGS, alert->headline);
+   account_free(MEMORY_STRINGS, alert->description);
+   account_free(MEMORY_STRINGS, alert->instruction);
+   account_free(MEMORY_STRINGS, alert->issuer);
+   account_free(MEMORY_STRINGS, alert->event);
 
    if (alert->areas)
    {
@@ -45,13 +140,64 @@ void free_alert(Alert *alert)
       {
          free_alert_area(alert->areas[x]);
       }// End of for
+
+      account_free(MEMORY_ALERTS, alert->areas);
    }// End of if
 
-   free(alert);
+   account_free(MEMORY_ALERTS, alert);
 
    zlog_debug(alog, "Exiting");
 }// End of free_alert method
 
+// IMPLEMENTATION: See header for details
+unsigned long hash_identifier(const char *identifier)
+{
+   unsigned long hash = 2166136261UL;
+
+   while (identifier && *identifier)
+   {
+      hash ^= (unsigned char)*identifier++;
+      hash *= 16777619UL;
+   }// End of while
+
+   return hash;
+}// End of hash_identifier method
+
+// IMPLEMENTATION: See header for details
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t length)
+{
+   const unsigned char *bytes = data;
+
+   for (size_t x = 0; x < length; ++x)
+   {
+      hash ^= bytes[x];
+      hash *= 1099511628211ULL;
+   }// End of for
+
+   return hash;
+}// End of hash_bytes method
+
+// IMPLEMENTATION: See header for details
+unsigned long identifier_table_mask(int count)
+{
+   unsigned long mask = 1;
+   while (mask + 1 < (unsigned long)count * 2) mask = (mask << 1) | 1;
+
+   return mask;
+}// End of identifier_table_mask method
+
+// IMPLEMENTATION: See header for details
+void * find_identifier_slot(const void *table, size_t size, unsigned long mask, const char *identifier, IdentifierKey key)
+{
+   for (unsigned long slot = hash_identifier(identifier) & mask; ; slot = (slot + 1) & mask)
+   {
+      const char *entry = (const char *)table + slot * size;
+      const char *other = key(entry);
+
+      if (!other || strcmp(other, identifier) == 0) return (void *)entry;
+   }// End of for
+}// End of find_identifier_slot method
+
 // IMPLEMENTATION: See header for details
 void free_alert_area(AlertArea *area)
 {
@@ -59,10 +205,10 @@ void free_alert_area(AlertArea *area)
 
    zlog_debug(alog, "Entering");
 
-   free(area->name);
-   free(area->geocodes);
+   account_free(MEMORY_STRINGS, area->name);
+   account_free(MEMORY_ALERTS, area->geocodes);
 
-   free(area);
+   account_free(MEMORY_ALERTS, area);
 
    zlog_debug(alog, "Exiting");
 }// End of free_alert method
@@ -26,15 +26,33 @@
 #define _ALERT
 
 #include <time.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 struct AlertArea;
 typedef struct AlertArea AlertArea;
 
+enum AlertSeverity {
+   ALERT_SEVERITY_UNKNOWN,
+   ALERT_SEVERITY_MINOR,
+   ALERT_SEVERITY_MODERATE,
+   ALERT_SEVERITY_SEVERE,
+   ALERT_SEVERITY_EXTREME,
+   ALERT_SEVERITIES
+};
+typedef enum AlertSeverity AlertSeverity;
+
 struct Alert {
+   int references;
+
+   char *identifier;
    char *headline;
    char *description;
    char *instruction;
    char *issuer;
+   char *event;               // CAP event type ("rainfall", "tornado", ...)
+   AlertSeverity severity;
 
    struct tm effective;
    struct tm expires;
@@ -52,12 +70,92 @@ struct AlertArea {
 };
 
 /*
-   free_alert(alert) Frees the memory allocted for the alert.
+   retain_alert(alert) Adds a reference to the alert, so that it can be shared
+                         by several Alerts objects.
       PRE:  Valid alert pointer
-      POST: Memory allocated for the alert and its values are freed.
+      POST: The reference count is incremented and alert is returned.
+*/
+Alert * retain_alert(Alert *alert);
+
+/*
+   free_alert(alert) Releases a reference to the alert, and frees the memory
+                       allocted for it once the last reference is released.
+      PRE:  Valid alert pointer
+      POST: Memory allocated for the alert and its values are freed if no
+            reference is left.
 */
 void free_alert(Alert *alert);
 
+/*
+   alert_expiry(alert) Returns when the alert expires.
+      PRE:  Valid alert pointer
+      POST: The expiry time (local time), or a time in the past if the alert
+            has none.
+*/
+time_t alert_expiry(const Alert *alert);
+
+/*
+   same_alert(a, b) Returns true if a and b have the same contents.
+      PRE:  Valid alert pointers
+      POST: true if both are the same object or every field is equal (the
+            fields of the times and the geocodes of the areas included).
+*/
+bool same_alert(const Alert *a, const Alert *b);
+
+/*
+   parse_alert_severity(name) Returns the severity named by a CAP severity
+                              ("Extreme", "Severe", "Moderate", "Minor").
+      PRE:  true
+      POST: Case is ignored, anything else (or NULL) is ALERT_SEVERITY_UNKNOWN.
+*/
+AlertSeverity parse_alert_severity(const char *name);
+
+/*
+   alert_severity_name(severity) Returns the lower case name of severity.
+      PRE:  severity < ALERT_SEVERITIES
+      POST: "unknown", "minor", "moderate", "severe" or "extreme".
+*/
+const char * alert_severity_name(AlertSeverity severity);
+
+/*
+   Alerts are looked up by identifier in open addressed tables: mask + 1
+   entries (a power of two) probed linearly from hash_identifier. The key
+   of a table returns the identifier of an entry, or NULL if it is free.
+*/
+typedef const char * (*IdentifierKey)(const void *entry);
+
+#define HASH_SEED 14695981039346656037ULL  // hash_bytes of nothing
+
+/*
+   hash_identifier(identifier) Returns the FNV-1a hash of identifier.
+      PRE:  identifier is NULL (hashed as "") or a string
+*/
+unsigned long hash_identifier(const char *identifier);
+
+/*
+   hash_bytes(hash, data, length) Returns the 64 bit FNV-1a hash of length
+                                  bytes of data, continued from hash
+                                  (HASH_SEED to start).
+*/
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t length);
+
+/*
+   identifier_table_mask(count) Returns the mask of an identifier table that
+                                comfortably holds count entries.
+*/
+unsigned long identifier_table_mask(int count);
+
+/*
+   find_identifier_slot(table, size, mask, identifier, key) Returns the entry
+                                                             of identifier in
+                                                             table, or the
+                                                             free entry to
+                                                             put it in.
+      PRE:  table has mask + 1 entries of size bytes, at least one free.
+            Valid identifier and key.
+*/
+void * find_identifier_slot(const void *table, size_t size, unsigned long mask, const char *identifier, IdentifierKey key);
+
 /*
    free_alert_area(alert) Frees the memory allocted for the alert area.
       PRE:  Valid alert area pointer
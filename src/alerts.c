@@ -25,19 +25,18 @@
 #include "alerts.h"
 
 #include "log.h"
+#include "fetch.h"
+#include "stats.h"
+#include "metrics.h"
+#include "memory.h"
 
 #include <string.h>
 #include <time.h>
 #include <curl/curl.h>
 #include <stdbool.h>
 
-/*
-   parse_time(str, time) Parses the time string and places the corresponding
-                           struct tm in tm.
-      PRE:  Valid str, time pointers.
-      POST: time is updated with the time specified in str.
-*/
-static void parse_time(const char *str, struct tm *tm)
+// IMPLEMENTATION: See header for details
+void parse_alert_time(const char *str, struct tm *tm)
 {
    zlog_debug(alog, "Entering");
 
@@ -47,7 +46,7 @@ static void parse_time(const char *str, struct tm *tm)
    strptime(str, "%Y-%m-%dT%H:%M:%S", tm);
 
    zlog_debug(alog, "Exiting");
-}// End of format_time
+}// End of parse_alert_time method
 
 /*
    keep_alert(js_alert) Returns true if the alert should be kept.
@@ -85,11 +84,112 @@ static bool keep_alert_info(json_value *js_info)
    return true;
 }// End of keep_alert method
 
-// IMPLEMENTATION: See header for details
-Alerts * load_alerts_from_json(json_value *json)
+/*
+   copy_json_string(json, name) Returns a copy of the string value of name in
+                                the json object ("" if it has none).
+      PRE:  json is NULL or a valid pointer
+      POST: The copy is counted as MEMORY_STRINGS, NULL if it could not be
+            allocated.
+*/
+static char * copy_json_string(const json_value *json, const char *name)
+{
+   json_value *value = json_object_value(json, name);
+
+   if (!value || value->type != json_string) return account_strndup(MEMORY_STRINGS, "", 0);
+
+   return account_strndup(MEMORY_STRINGS, value->u.string.ptr, value->u.string.length);
+}// End of copy_json_string method
+
+/*
+   json_string_value(json, name) Returns the string value of name in the json
+                                 object ("" if it has none), without copying.
+*/
+static const char * json_string_value(const json_value *json, const char *name)
+{
+   json_value *value = json_object_value(json, name);
+
+   return value && value->type == json_string ? value->u.string.ptr : "";
+}// End of json_string_value method
+
+/*
+   fill_alert(alert, js_alert, js_info) Fills alert from a CAP alert and one
+                                        of its infos.
+      PRE:  Valid pointers, alert is zeroed
+      POST: Returns false if memory could not be allocated (what was filled
+            is freed with the alert).
+*/
+static bool fill_alert(Alert *alert, const json_value *js_alert, const json_value *js_info)
+{
+   alert->references = 1;
+   alert->identifier = copy_json_string(js_alert, "identifier");
+   alert->headline = copy_json_string(js_info, "headline");
+   alert->description = copy_json_string(js_info, "description");
+   alert->instruction = copy_json_string(js_info, "instruction");
+   alert->issuer = copy_json_string(js_info, "sender_name");
+   alert->event = copy_json_string(js_info, "event");
+   alert->severity = parse_alert_severity(json_string_value(js_info, "severity"));
+
+   if (!alert->identifier || !alert->headline || !alert->description || !alert->instruction
+         || !alert->issuer || !alert->event) return false;
+
+   parse_alert_time(json_string_value(js_info, "effective"), &alert->effective);
+   parse_alert_time(json_string_value(js_info, "expires"), &alert->expires);
+
+   // Get alert areas
+   json_value *js_areas = json_object_value(js_info, "areas");
+   if (!js_areas || js_areas->type != json_array || js_areas->u.array.length == 0) return true;
+
+   alert->areas = account_calloc(MEMORY_ALERTS, js_areas->u.array.length, sizeof(AlertArea *));
+   if (!alert->areas) return false;
+
+   alert->area_count = js_areas->u.array.length;
+
+   for (int x = 0; x < alert->area_count; ++x)
+   {
+      json_value *js_area = js_areas->u.array.values[x];
+
+      AlertArea *area = account_calloc(MEMORY_ALERTS, 1, sizeof(AlertArea));
+      if (!area) return false;
+
+      alert->areas[x] = area;
+
+      area->name = copy_json_string(js_area, "description");
+      if (!area->name) return false;
+
+      json_value *js_geocodes = json_object_value(js_area, "geocodes");
+      if (!js_geocodes || js_geocodes->type != json_array || !js_geocodes->u.array.length) continue;
+
+      area->geocodes = account_calloc(MEMORY_ALERTS, js_geocodes->u.array.length, sizeof(int));
+      if (!area->geocodes) return false;
+
+      // Geocodes are usually strings ("061110") but accept bare numbers too
+      for (int y = 0; y < js_geocodes->u.array.length; ++y)
+      {
+         json_value *js_geocode = js_geocodes->u.array.values[y];
+
+         if (js_geocode->type == json_string)
+         {
+            area->geocodes[area->geocode_count++] = atoi(js_geocode->u.string.ptr);
+         }// End of if
+         else if (js_geocode->type == json_integer)
+         {
+            area->geocodes[area->geocode_count++] = (int)js_geocode->u.integer;
+         }// End of else if
+      }// End of for (y)
+   }// End of for (x)
+
+   return true;
+}// End of fill_alert method
+
+/*
+   load_alerts_from_json_array(json) Loads alerts from a JSON array of CAP alerts.
+      PRE:  json is NULL or a valid pointer
+      POST: Alerts are extracted from the array and returned in a Alerts object,
+            NULL is returned if json is not an array.
+*/
+static Alerts * load_alerts_from_json_array(json_value *json)
 {
    zlog_debug(alog, "Entering");
-   json = json_object_value(json, "alerts");
 
    if (!json || json->type != json_array)
    {
@@ -120,7 +220,7 @@ Alerts * load_alerts_from_json(json_value *json)
       }// End of for (ii)
    }// End of for (i)
 
-   alerts = malloc(sizeof(Alerts));
+   alerts = account_calloc(MEMORY_ALERTS, 1, sizeof(Alerts));
 
    if (!alerts)
    {
@@ -128,7 +228,7 @@ Alerts * load_alerts_from_json(json_value *json)
       return NULL;
    }// End of if
 
-   alerts->alerts = malloc(sizeof(Alert *) * count);
+   alerts->alerts = account_calloc(MEMORY_ALERTS, count > 0 ? count : 1, sizeof(Alert *));
 
    if (!alerts->alerts)
    {
@@ -153,80 +253,79 @@ Alerts * load_alerts_from_json(json_value *json)
          json_value *js_info = js_information->u.array.values[ii];
          if (!keep_alert_info(js_info)) continue;
 
-         Alert *alert = malloc(sizeof(Alert));
+         Alert *alert = account_calloc(MEMORY_ALERTS, 1, sizeof(Alert));
          alerts->alerts[index] = alert;
          ++index;
 
-         if (!alert)
+         if (!alert || !fill_alert(alert, js_alert, js_info))
          {
             zlog_warn(alog, "Failed to allocate memory for alert");
             free_alerts(alerts);
             return NULL;
          }// End of if
+      }// End of for (ii)
+   }// End of for (i)
 
-         alert->headline = json_string_or_default(js_info, "headline", "");
-         alert->description = json_string_or_default(js_info, "description", "");
-         alert->instruction = json_string_or_default(js_info, "instruction", "");
-         alert->issuer = json_string_or_default(js_info, "sender_name", "");
-
-         char *effective = json_string_or_default(js_info, "effective", "");
-         char *expires = json_string_or_default(js_info, "expires", "");
-
-         parse_time(effective, &alert->effective);
-         parse_time(expires, &alert->expires);
-
-         free(effective);
-         free(expires);
+   zlog_debug(alog, "Exiting");
+   return alerts;
+}// End of load_alerts_from_json_array method
 
-         // Get alert areas
-         zlog_debug(alog, "Getting a list of all alert areas");
+// IMPLEMENTATION: See header for details
+Alerts * load_alerts_from_json(json_value *json)
+{
+   if (!json) return NULL;
 
-         json_value *js_areas = json_object_value(js_info, "areas");
-         if (!js_areas) continue;
+   uint64_t start = stats_clock();
+   Alerts *alerts = load_alerts_from_json_array(json_object_value(json, "alerts"));
 
-         alert->area_count = js_areas->u.array.length;
-         alert->areas = malloc(sizeof(AlertArea *) * alert->area_count);
+   record_stat_since(STATS_CONVERT, start);
+   if (alerts) count_metric(METRICS_CONVERTED, alerts->count);
+   return alerts;
+}// End of load_alerts_from_json method
 
-         for (int iii = 0; iii < alert->area_count; ++iii)
-         {
-            json_value *js_area = js_areas->u.array.values[iii];
-            if (!js_area) continue;
+// IMPLEMENTATION: See header for details
+Alerts * load_alerts_from_json_buffer(const char *buffer, size_t length)
+{
+   zlog_debug(alog, "Entering");
 
-            AlertArea *area = malloc(sizeof(AlertArea));
+   if (!buffer)
+   {
+      zlog_warn(alog, "NULL buffer provided");
+      return NULL;
+   }// End of if
 
-            if (!area)
-            {
-               zlog_warn(alog, "Failed to allocate memory for AlertArea");
-               continue;
-            }// End of if
+   // Declare and initalize variables
+   Alerts *alerts = NULL;
+   json_value *json = NULL;
 
-            alert->areas[iii] = area;
+   // Parse the JSON
+   zlog_info(alog, "Parsing JSON (%zu bytes)", length);
 
-            area->name = json_string_or_default(js_area, "description", "");
+   char error[json_error_max] = { 0 };
+   json_settings settings = accounted_json_settings();
+   uint64_t start = stats_clock();
+   json = json_parse_ex(&settings, buffer, length, error);
+   record_stat_since(STATS_PARSE, start);
+   count_metric(METRICS_PARSE_BYTES, length);
 
-            json_value *js_geocodes = json_object_value(js_area, "geocodes");
-            if (!js_geocodes) continue;
+   if (!json)
+   {
+      zlog_warn(alog, "JSON Parse Error");
+      zlog_warn(alog, "%s", error);
 
-            area->geocode_count = 0; //js_geocodes->u.array.length;
-            area->geocodes = calloc(area->geocode_count, sizeof(int));
+      return NULL;
+   }// End of if
 
-            if (!area->geocodes)
-            {
-               zlog_warn(alog, "Failed to allocate memory for geocodes");
-               continue;
-            }// End of if
+   // Get the alerts from the json object
+   zlog_debug(alog, "Loading alerts from parsed JSON");
+   alerts = load_alerts_from_json(json);
 
-            for (int iiii = 0; iiii < area->geocode_count; ++iiii)
-            {
-               area->geocodes[iiii] = atoi(js_geocodes->u.array.values[iiii]->u.string.ptr);
-            }// End of for (iiii)
-         }// End of for (iii)
-      }// End of for (ii)
-   }// End of for (i)
+   // Cleanup
+   json_value_free_ex(&settings, json);
 
    zlog_debug(alog, "Exiting");
    return alerts;
-}// End of load_alerts_from_json method
+}// End of load_alerts_from_json_buffer method
 
 // IMPLEMENTATION: See header for details
 Alerts * load_alerts_from_json_file(FILE *file)
@@ -240,70 +339,43 @@ Alerts * load_alerts_from_json_file(FILE *file)
    }// End of if
 
    // Declare and initalize variables
-   int file_length = 0;
+   long file_length = 0;
    char *contents = NULL;
    Alerts * alerts = NULL;
 
-   json_value *json = NULL;
-
    // Read contents of the file
    zlog_debug(alog, "Reading JSON file");
 
    fseek(file, 0, SEEK_END);
    file_length = ftell(file);
-   contents = calloc(file_length + 1, sizeof(char));
-   zlog_debug(alog, "File size: %d bytes", file_length);
 
-   if (!contents)
+   if (file_length < 0)
    {
-      zlog_warn(alog, "Failed to allocate memory for file contents");
+      zlog_warn(alog, "Failed to determine file size");
       return NULL;
    }// End of if
 
-   rewind(file);
-   fread(contents, file_length, file_length, file);
-
-   // Parse the JSON
-   zlog_info(alog, "Parsing JSON");
-
-   char error[json_error_max] = { 0 };
-   json_settings settings = { 0 };
-   json = json_parse_ex(&settings, contents, file_length, error);
+   contents = calloc(file_length + 1, sizeof(char));
+   zlog_debug(alog, "File size: %ld bytes", file_length);
 
-   if (!json)
+   if (!contents)
    {
-      zlog_warn(alog, "JSON Parse Error");
-      zlog_warn(alog, "%s", error);
-      free(contents);
-
+      zlog_warn(alog, "Failed to allocate memory for file contents");
       return NULL;
    }// End of if
 
-   // Cleanup
-   free(contents);
+   rewind(file);
+   file_length = fread(contents, 1, file_length, file);
 
-   // Get the alerts from the json object
-   zlog_debug(alog, "Loading alerts from parsed JSON");
-   alerts = load_alerts_from_json(json);
+   alerts = load_alerts_from_json_buffer(contents, file_length);
 
    // Cleanup
-   json_value_free(json);
+   free(contents);
 
    zlog_debug(alog, "Exiting");
    return alerts;
 }// End of load_alerts_from_json_file method
 
-/*
-   curl_write_response(ptr, size, nmemb, stream) Writes the response to stream.
-      PRE:  Valid pointers
-      POST: Response written to the stream.
-
-   // Adpated from: http://stackoverflow.com/questions/1636333/download-file-using-libcurl-in-c-c
-*/
-static size_t curl_write_response(void *ptr, size_t size, size_t nmemb, FILE *stream) {
-   return fwrite(ptr, size, nmemb, stream);
-}
-
 // IMPLEMENTATION: See header for details
 Alerts * load_alerts_from_http_json_file(const char *url)
 {
@@ -317,50 +389,254 @@ Alerts * load_alerts_from_http_json_file(const char *url)
 
    // Declare and initalize variables
    Alerts *alerts = NULL;
+   FetchStats stats;
+   FetchBuffer buffer = { 0 };
 
-   FILE *ftmp = tmpfile();
+   double start = fetch_clock();
    CURL *curl = curl_easy_init();
    CURLcode res;
 
-   if (!ftmp)
-   {
-      zlog_warn(alog, "Failed to create temp file");
-      if (curl) curl_easy_cleanup(curl);
-      return NULL;
-   }// End of if
+   memset(&stats, 0, sizeof(FetchStats));
 
    if (!curl)
    {
       zlog_warn(alog, "Failed to create curl object");
-      fclose(ftmp);
       return NULL;
    }// End of if
 
    // Configure curl
    zlog_debug(alog, "Configuring curl");
    curl_easy_setopt(curl, CURLOPT_URL, url);
-   curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_write_response);
-   curl_easy_setopt(curl, CURLOPT_WRITEDATA, ftmp);
+   configure_fetch(curl, &buffer, &stats);
 
    zlog_info(alog, "Performing HTTP request");
    res = curl_easy_perform(curl);
+   collect_fetch_stats(curl, &buffer, &stats);
    curl_easy_cleanup(curl);
 
    if (res == CURLE_OK)
    {
-      alerts = load_alerts_from_json_file(ftmp);
+      alerts = load_alerts_from_json_buffer(buffer.data, buffer.length);
    }// End of if
    else
    {
-      zlog_warn(alog, "HTTP request failed");
+      zlog_warn(alog, "HTTP request failed: %s", curl_easy_strerror(res));
    }// End of if
 
-   fclose(ftmp);
+   free_fetch_buffer(&buffer);
+
+   zlog_info(alog, "Fetched %llu bytes (%llu decoded, %s) in %.3fs",
+             stats.wire_bytes, stats.body_bytes, stats.encoding, fetch_clock() - start);
 
    zlog_debug(alog, "Exiting");
    return alerts;
 }// End of load_alerts_from_http_json_file method
 
+static const char * string_key(const void *entry)
+{
+   return *(const char * const *)entry;
+}// End of string_key method
+
+/*
+   identifier_seen(table, mask, identifier, insert) Looks identifier up in the
+                                                     identifier table.
+      PRE:  Valid pointers, table has mask + 1 slots and at least one free slot
+      POST: Returns true if identifier is in the table. If it is not and insert
+            is true, it is added.
+*/
+static bool identifier_seen(const char **table, unsigned long mask, const char *identifier, bool insert)
+{
+   const char **slot = find_identifier_slot(table, sizeof(const char *), mask, identifier, string_key);
+
+   if (*slot) return true;
+
+   if (insert) *slot = identifier;
+   return false;
+}// End of identifier_seen method
+
+// IMPLEMENTATION: See header for details
+Alerts * merge_alerts(Alerts * const *sets, int count)
+{
+   zlog_debug(alog, "Entering");
+
+   // Declare and initalize variables
+   Alerts *merged = account_calloc(MEMORY_ALERTS, 1, sizeof(Alerts));
+   const char **seen = NULL;
+   unsigned long mask = 0;
+   int total = 0;
+   int duplicates = 0;
+
+   for (int i = 0; i < count; ++i)
+   {
+      if (sets[i]) total += sets[i]->count;
+   }// End of for
+
+   mask = identifier_table_mask(total);
+
+   if (merged)
+   {
+      merged->alerts = account_calloc(MEMORY_ALERTS, total > 0 ? total : 1, sizeof(Alert *));
+      seen = calloc(mask + 1, sizeof(char *));
+   }// End of if
+
+   if (!merged || !merged->alerts || !seen)
+   {
+      zlog_warn(alog, "Failed to allocate memory for merged alerts");
+
+      free(seen);
+      free_alerts(merged);
+      return NULL;
+   }// End of if
+
+   for (int i = 0; i < count; ++i)
+   {
+      Alerts *set = sets[i];
+      if (!set) continue;
+
+      // Identifiers are only registered once the whole set has been taken, so
+      // several infos of the same alert within one feed are all kept.
+      int first = merged->count;
+
+      for (int x = 0; x < set->count; ++x)
+      {
+         Alert *alert = set->alerts[x];
+         if (!alert) continue;
+
+         if (alert->identifier && alert->identifier[0]
+               && identifier_seen(seen, mask, alert->identifier, false))
+         {
+            ++duplicates;
+            continue;
+         }// End of if
+
+         merged->alerts[merged->count++] = retain_alert(alert);
+      }// End of for (x)
+
+      for (int x = first; x < merged->count; ++x)
+      {
+         const char *identifier = merged->alerts[x]->identifier;
+         if (identifier && identifier[0]) identifier_seen(seen, mask, identifier, true);
+      }// End of for (x)
+   }// End of for (i)
+
+   free(seen);
+
+   zlog_info(alog, "Merged %d feeds into %d alerts (%d duplicates dropped)",
+             count, merged->count, duplicates);
+
+   zlog_debug(alog, "Exiting");
+   return merged;
+}// End of merge_alerts method
+
+// IMPLEMENTATION: See header for details
+Alerts * apply_alerts_delta(const Alerts *alerts, json_value *delta)
+{
+   zlog_debug(alog, "Entering");
+
+   if (!alerts || !delta || delta->type != json_object)
+   {
+      zlog_warn(alog, "Invalid delta provided");
+      return NULL;
+   }// End of if
+
+   uint64_t start = stats_clock();
+
+   // Declare and initalize variables
+   json_value *js_added = json_object_value(delta, "added");
+   json_value *js_updated = json_object_value(delta, "updated");
+   json_value *js_removed = json_object_value(delta, "removed");
+
+   if ((js_added && js_added->type != json_array)
+         || (js_updated && js_updated->type != json_array)
+         || (js_removed && js_removed->type != json_array)
+         || (!js_added && !js_updated && !js_removed))
+   {
+      zlog_warn(alog, "Malformed delta");
+      return NULL;
+   }// End of if
+
+   int removed_count = js_removed ? js_removed->u.array.length : 0;
+   Alerts *added = js_added ? load_alerts_from_json_array(js_added)
+                            : account_calloc(MEMORY_ALERTS, 1, sizeof(Alerts));
+   Alerts *updated = js_updated ? load_alerts_from_json_array(js_updated)
+                                : account_calloc(MEMORY_ALERTS, 1, sizeof(Alerts));
+   Alerts *result = account_calloc(MEMORY_ALERTS, 1, sizeof(Alerts));
+   const char **dropped = NULL;
+   unsigned long mask = 0;
+
+   if (added && updated && result)
+   {
+      mask = identifier_table_mask(removed_count + updated->count);
+      dropped = calloc(mask + 1, sizeof(char *));
+      result->alerts = account_calloc(MEMORY_ALERTS, alerts->count + added->count + updated->count + 1, sizeof(Alert *));
+   }// End of if
+
+   if (!added || !updated || !result || !dropped || !result->alerts)
+   {
+      zlog_warn(alog, "Failed to allocate memory for delta");
+
+      free_alerts(added);
+      free_alerts(updated);
+      free_alerts(result);
+      free(dropped);
+      return NULL;
+   }// End of if
+
+   // Every previous version of a removed or updated alert is dropped
+   for (int x = 0; x < removed_count; ++x)
+   {
+      json_value *js_identifier = js_removed->u.array.values[x];
+
+      if (js_identifier->type == json_string)
+      {
+         identifier_seen(dropped, mask, js_identifier->u.string.ptr, true);
+      }// End of if
+   }// End of for
+
+   for (int x = 0; x < updated->count; ++x)
+   {
+      const char *identifier = updated->alerts[x]->identifier;
+      if (identifier) identifier_seen(dropped, mask, identifier, true);
+   }// End of for
+
+   // Unchanged alerts are shared with the previous set
+   for (int x = 0; x < alerts->count; ++x)
+   {
+      Alert *alert = alerts->alerts[x];
+
+      if (!alert || (alert->identifier && identifier_seen(dropped, mask, alert->identifier, false))) continue;
+
+      result->alerts[result->count++] = retain_alert(alert);
+   }// End of for
+
+   // The new versions take over the references held by the loaded sets
+   for (int x = 0; x < updated->count; ++x)
+   {
+      result->alerts[result->count++] = updated->alerts[x];
+   }// End of for
+
+   for (int x = 0; x < added->count; ++x)
+   {
+      result->alerts[result->count++] = added->alerts[x];
+   }// End of for
+
+   zlog_info(alog, "Applied delta: %d added, %d updated, %d removed, %d alerts",
+             added->count, updated->count, removed_count, result->count);
+
+   count_metric(METRICS_CONVERTED, added->count + updated->count);
+
+   free(dropped);
+   account_free(MEMORY_ALERTS, added->alerts);
+   account_free(MEMORY_ALERTS, added);
+   account_free(MEMORY_ALERTS, updated->alerts);
+   account_free(MEMORY_ALERTS, updated);
+
+   record_stat_since(STATS_CONVERT, start);
+
+   zlog_debug(alog, "Exiting");
+   return result;
+}// End of apply_alerts_delta method
+
 // IMPLEMENTATION: See header for details
 void free_alerts(Alerts *alerts)
 {
@@ -373,8 +649,8 @@ void free_alerts(Alerts *alerts)
       free_alert(alerts->alerts[x]);
    }// End of for
 
-   free(alerts->alerts);
-   free(alerts);
+   account_free(MEMORY_ALERTS, alerts->alerts);
+   account_free(MEMORY_ALERTS, alerts);
 
    zlog_debug(alog, "Exiting");
 }// End of free_alerts method
@@ -24,13 +24,17 @@
 
 #include "json.h"
 #include "alert.h"
+#include "fetch.h"
 
 #include <stdio.h>
+#include <time.h>
 
 #ifndef _ALERTS
 #define _ALERTS
 
 struct Alerts {
+   unsigned long generation;
+
    int count;
    Alert **alerts;
 };
@@ -43,6 +47,14 @@ typedef struct Alerts Alerts;
 */
 Alerts * load_alerts_from_json(json_value *json);
 
+/*
+   load_alerts_from_json_buffer(buffer, length) Parses the JSON document in buffer
+                                                  and loads the alerts from it.
+      PRE:  Valid buffer pointer holding length bytes
+      POST: Alerts are read from the JSON document, and an Alerts object is returned.
+*/
+Alerts * load_alerts_from_json_buffer(const char *buffer, size_t length);
+
 /*
    load_alerts_from_json_file(file) Loads alerts from a JSON file.
       PRE:  Valid file pointer.
@@ -54,12 +66,47 @@ Alerts * load_alerts_from_json_file(FILE *file);
    load_alerts_from_http_json_file(url) Loads alerts by performing an HTTP request
                                           for the JSON file at url.
       PRE:  Valid url string (valid pointer and NULL terminated)
-      POST: HTTP request made and JSON read, and an Alerts object is returned.
+      POST: HTTP request made with a compressed transfer negotiated, the body is
+            decoded straight into the parse buffer and an Alerts object is returned.
 
    CURL Code adapted from http://stackoverflow.com/questions/1636333/download-file-using-libcurl-in-c-c
 */
 Alerts * load_alerts_from_http_json_file(const char *url);
 
+/*
+   merge_alerts(sets, count) Merges count Alerts objects into one, dropping
+                               alerts whose CAP identifier was already provided
+                               by an earlier set.
+      PRE:  Valid sets array of count elements (elements may be NULL)
+      POST: The merged Alerts object is returned (sharing the alerts of the
+            sets), or NULL if memory could not be allocated. The sets are
+            left untouched.
+*/
+Alerts * merge_alerts(Alerts * const *sets, int count);
+
+/*
+   apply_alerts_delta(alerts, delta) Applies a delta document to alerts.
+      PRE:  Valid alerts pointer, delta is NULL or a valid pointer.
+      POST: Returns a new Alerts object holding the alerts of alerts that were
+            neither removed nor updated (shared, not copied), followed by the
+            updated and added alerts of delta. alerts itself is unchanged.
+            NULL is returned if delta is malformed or memory could not be
+            allocated.
+
+            The delta is an object with optional "added" and "updated" arrays of
+            CAP alerts (same format as the feed) and an optional "removed" array
+            of CAP identifiers.
+*/
+Alerts * apply_alerts_delta(const Alerts *alerts, json_value *delta);
+
+/*
+   parse_alert_time(str, tm) Parses a CAP time (2014-02-26T15:41:00-05:00) and
+                             places the corresponding struct tm in tm.
+      PRE:  str is NULL or a string, valid tm pointer
+      POST: tm is updated with the time specified in str.
+*/
+void parse_alert_time(const char *str, struct tm *tm);
+
 /*
    free_alerts(alerts) Frees the alerts object.
       PRE:  Valid alerts pointer
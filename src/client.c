@@ -0,0 +1,275 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "client.h"
+
+#include "log.h"
+#include "loop.h"
+#include "wire.h"
+#include "snapshot.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+
+#define CLIENT_READ_SIZE 65536
+
+static int socket_fd = -1;
+static int timer_fd = -1;
+static struct sockaddr_un address = { .sun_family = AF_UNIX };
+
+// Bytes received that do not form a whole frame yet
+static unsigned char *input = NULL;
+static size_t input_length = 0;
+static size_t input_capacity = 0;
+
+static bool greeted = false;           // The daemon's hello was received
+static Alerts *received = NULL;        // Alerts of the last frame received
+
+static void handle_socket(int fd, uint32_t events, void *data);
+
+/*
+   disconnect() Closes the connection and retries it later.
+*/
+static void disconnect(void)
+{
+   zlog_info(alog, "Disconnected from the daemon");
+
+   remove_event_source(socket_fd);
+   close(socket_fd);
+   socket_fd = -1;
+
+   input_length = 0;
+   greeted = false;
+   free_alerts(received);
+   received = NULL;
+
+   struct itimerspec spec = { { CLIENT_RECONNECT_DELAY, 0 }, { CLIENT_RECONNECT_DELAY, 0 } };
+   timerfd_settime(timer_fd, 0, &spec, NULL);
+}// End of disconnect method
+
+/*
+   connect_socket() Connects to the daemon.
+      POST: Returns false if the daemon could not be reached.
+*/
+static bool connect_socket(void)
+{
+   socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+   if (socket_fd < 0 || connect(socket_fd, (struct sockaddr *)&address, sizeof(address)) != 0
+         || !add_event_source(socket_fd, EPOLLIN, handle_socket, NULL))
+   {
+      if (socket_fd >= 0) close(socket_fd);
+      socket_fd = -1;
+      return false;
+   }// End of if
+
+   zlog_info(alog, "Connected to the daemon at %s", address.sun_path);
+   return true;
+}// End of connect_socket method
+
+/*
+   process_frame(type, reader) Handles a frame received from the daemon.
+      POST: Returns false if the connection has to be closed.
+*/
+static bool process_frame(WireType type, WireReader *reader)
+{
+   if (type == WIRE_HELLO)
+   {
+      uint64_t version = get_wire_varint(reader);
+
+      if (version != WIRE_VERSION)
+      {
+         zlog_warn(alog, "Daemon speaks protocol version %lu, not %d", (unsigned long)version, WIRE_VERSION);
+         return false;
+      }// End of if
+
+      greeted = true;
+      return true;
+   }// End of if
+
+   if (type != WIRE_ALERTS || !greeted) return true;
+
+   Alerts *alerts = get_wire_alerts(reader, received);
+   if (!alerts) return false;
+
+   // The snapshot store owns what is published, keep a copy to decode the next delta
+   Alerts *published = merge_alerts(&alerts, 1);
+
+   if (!published)
+   {
+      free_alerts(alerts);
+      return false;
+   }// End of if
+
+   free_alerts(received);
+   received = alerts;
+
+   zlog_info(alog, "Received generation %lu of the daemon (%d alerts)", alerts->generation, alerts->count);
+   publish_snapshot(published);
+
+   return true;
+}// End of process_frame method
+
+static void handle_socket(int fd, uint32_t events, void *data)
+{
+   zlog_debug(alog, "Entering");
+
+   (void)events; (void)data;
+
+   // Grow geometrically, a full frame of a large feed takes many reads
+   if (input_capacity - input_length < CLIENT_READ_SIZE)
+   {
+      size_t capacity = input_capacity * 2 > input_length + CLIENT_READ_SIZE
+                          ? input_capacity * 2 : input_length + CLIENT_READ_SIZE;
+      unsigned char *buffer = realloc(input, capacity);
+
+      if (!buffer)
+      {
+         zlog_warn(alog, "Failed to allocate memory for the daemon's frames");
+         disconnect();
+         return;
+      }// End of if
+
+      input = buffer;
+      input_capacity = capacity;
+   }// End of if
+
+   ssize_t bytes = recv(fd, input + input_length, input_capacity - input_length, MSG_DONTWAIT);
+
+   if (bytes < 0 && (errno == EAGAIN || errno == EINTR)) return;
+
+   if (bytes <= 0)
+   {
+      disconnect();
+      return;
+   }// End of if
+
+   input_length += bytes;
+
+   // Process every complete frame, keep the rest for the next read
+   size_t offset = 0;
+   WireType type;
+   WireReader reader;
+   long length;
+
+   while ((length = read_wire_frame(input + offset, input_length - offset, &type, &reader)) > 0)
+   {
+      if (!process_frame(type, &reader))
+      {
+         disconnect();
+         return;
+      }// End of if
+
+      offset += length;
+   }// End of while
+
+   if (length < 0)
+   {
+      disconnect();
+      return;
+   }// End of if
+
+   input_length -= offset;
+   memmove(input, input + offset, input_length);
+
+   zlog_debug(alog, "Exiting");
+}// End of handle_socket method
+
+static void handle_reconnect(int fd, uint32_t events, void *data)
+{
+   (void)events; (void)data;
+
+   uint64_t expirations = 0;
+   if (read(fd, &expirations, sizeof(expirations)) < 0) return;
+
+   if (socket_fd < 0 && connect_socket())
+   {
+      struct itimerspec spec = { { 0, 0 }, { 0, 0 } };
+      timerfd_settime(timer_fd, 0, &spec, NULL);
+   }// End of if
+}// End of handle_reconnect method
+
+// IMPLEMENTATION: See header for details
+bool attach_daemon(const char *path)
+{
+   zlog_debug(alog, "Entering");
+
+   if (strlen(path) >= sizeof(address.sun_path)) return false;
+   strcpy(address.sun_path, path);
+
+   timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+   if (timer_fd < 0 || !add_event_source(timer_fd, EPOLLIN, handle_reconnect, NULL) || !connect_socket())
+   {
+      detach_daemon();
+      return false;
+   }// End of if
+
+   zlog_debug(alog, "Exiting");
+   return true;
+}// End of attach_daemon method
+
+// IMPLEMENTATION: See header for details
+void request_daemon_refresh(void)
+{
+   if (socket_fd < 0) return;
+
+   unsigned char frame[WIRE_HEADER_SIZE] = { 0, 0, 0, 0, WIRE_REFRESH };
+
+   if (send(socket_fd, frame, sizeof(frame), MSG_NOSIGNAL | MSG_DONTWAIT) != sizeof(frame))
+   {
+      zlog_warn(alog, "Failed to ask the daemon for a refresh");
+   }// End of if
+}// End of request_daemon_refresh method
+
+// IMPLEMENTATION: See header for details
+void detach_daemon(void)
+{
+   if (socket_fd >= 0)
+   {
+      remove_event_source(socket_fd);
+      close(socket_fd);
+   }// End of if
+
+   if (timer_fd >= 0)
+   {
+      remove_event_source(timer_fd);
+      close(timer_fd);
+   }// End of if
+
+   socket_fd = timer_fd = -1;
+
+   free(input);
+   input = NULL;
+   input_length = input_capacity = 0;
+
+   free_alerts(received);
+   received = NULL;
+   greeted = false;
+}// End of detach_daemon method
@@ -0,0 +1,61 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef _CLIENT
+#define _CLIENT
+
+#include <stdbool.h>
+
+/*
+   A client attaches to a daemon (see daemon.h) instead of loading the feeds
+   itself. Every alerts frame received is published with publish_snapshot,
+   so the rest of the program sees the daemon's alerts as if it had loaded
+   them. A lost connection is retried every CLIENT_RECONNECT_DELAY seconds,
+   the last alerts received stay published meanwhile.
+*/
+
+#define CLIENT_RECONNECT_DELAY 2
+
+/*
+   attach_daemon(path) Connects to the daemon listening at path.
+      PRE:  Created event loop
+      POST: The connection is watched by the event loop. Returns false if
+            the daemon could not be reached.
+*/
+bool attach_daemon(const char *path);
+
+/*
+   request_daemon_refresh() Asks the daemon to reload the feeds now.
+      PRE:  true
+      POST: Nothing is done while disconnected.
+*/
+void request_daemon_refresh(void);
+
+/*
+   detach_daemon() Closes the connection.
+      POST: The client's memory is freed, published snapshots are kept.
+*/
+void detach_daemon(void);
+
+#endif
@@ -0,0 +1,478 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "daemon.h"
+
+#include "log.h"
+#include "loop.h"
+#include "wire.h"
+#include "snapshot.h"
+#include "refresh.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+
+#define DAEMON_INPUT_SIZE 256
+
+/*
+   DaemonFrame is an encoded frame shared by the clients it is queued to.
+*/
+struct DaemonFrame {
+   int references;
+   size_t length;
+   unsigned char data[];
+};
+typedef struct DaemonFrame DaemonFrame;
+
+struct DaemonClient {
+   int fd;                    // -1 for a free slot
+   bool writable;             // Not waiting for EPOLLOUT
+
+   // Frames waiting to be sent, queue[head] is sent from offset
+   DaemonFrame *queue[DAEMON_CLIENT_BACKLOG];
+   int head;
+   int queued;
+   size_t offset;
+
+   unsigned char input[DAEMON_INPUT_SIZE];
+   size_t input_length;
+};
+typedef struct DaemonClient DaemonClient;
+
+static int listen_fd = -1;
+static int snapshot_fd = -1;
+static int reader = -1;
+static char socket_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+static DaemonClient clients[DAEMON_MAX_CLIENTS];
+static int client_count = 0;
+
+static Alerts *sent = NULL;            // Alerts of the last frame sent to everyone
+static DaemonFrame *full = NULL;       // sent in full, encoded when first needed
+
+static void release_frame(DaemonFrame *frame)
+{
+   if (frame && --frame->references == 0) free(frame);
+}// End of release_frame method
+
+/*
+   create_frame(buffer) Copies the frames in buffer into a shared frame.
+      POST: Returns the frame (one reference), or NULL on failure.
+*/
+static DaemonFrame * create_frame(const WireBuffer *buffer)
+{
+   if (buffer->failed) return NULL;
+
+   DaemonFrame *frame = malloc(sizeof(DaemonFrame) + buffer->length);
+
+   if (!frame)
+   {
+      zlog_warn(alog, "Failed to allocate memory for a frame");
+      return NULL;
+   }// End of if
+
+   frame->references = 1;
+   frame->length = buffer->length;
+   memcpy(frame->data, buffer->data, buffer->length);
+
+   return frame;
+}// End of create_frame method
+
+/*
+   full_frame() Returns the frame holding sent in full.
+      POST: The frame is encoded on the first call after sent changed. NULL
+            is returned if nothing was sent yet or encoding failed.
+*/
+static DaemonFrame * full_frame(void)
+{
+   if (!full && sent)
+   {
+      WireBuffer buffer = { 0 };
+
+      if (put_wire_alerts(&buffer, sent, NULL) >= 0) full = create_frame(&buffer);
+      free_wire_buffer(&buffer);
+   }// End of if
+
+   return full;
+}// End of full_frame method
+
+static void drop_client(DaemonClient *client)
+{
+   zlog_info(alog, "Client %d disconnected", client->fd);
+
+   remove_event_source(client->fd);
+   close(client->fd);
+   client->fd = -1;
+
+   for (int x = 0; x < client->queued; ++x)
+   {
+      release_frame(client->queue[(client->head + x) % DAEMON_CLIENT_BACKLOG]);
+   }// End of for
+
+   client->queued = 0;
+   --client_count;
+}// End of drop_client method
+
+/*
+   send_queued(client) Sends as much of the client's queue as the socket takes.
+      POST: Returns false if the client was dropped.
+*/
+static bool send_queued(DaemonClient *client)
+{
+   while (client->queued > 0)
+   {
+      DaemonFrame *frame = client->queue[client->head];
+      ssize_t bytes = send(client->fd, frame->data + client->offset, frame->length - client->offset,
+                           MSG_NOSIGNAL | MSG_DONTWAIT);
+
+      if (bytes < 0)
+      {
+         if (errno == EINTR) continue;
+         if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+
+         drop_client(client);
+         return false;
+      }// End of if
+
+      client->offset += bytes;
+      if (client->offset < frame->length) continue;
+
+      release_frame(frame);
+      client->head = (client->head + 1) % DAEMON_CLIENT_BACKLOG;
+      client->offset = 0;
+      --client->queued;
+   }// End of while
+
+   // Only wait for the socket to drain while something is left to send
+   bool writable = client->queued == 0;
+
+   if (writable != client->writable)
+   {
+      watch_event_source(client->fd, writable ? EPOLLIN : EPOLLIN | EPOLLOUT);
+      client->writable = writable;
+   }// End of if
+
+   return true;
+}// End of send_queued method
+
+/*
+   queue_frame(client, frame) Queues frame to the client.
+      POST: If the client's queue is full, the frames that were not started
+            are replaced by the current alerts in full.
+*/
+static void queue_frame(DaemonClient *client, DaemonFrame *frame)
+{
+   if (client->queued == DAEMON_CLIENT_BACKLOG)
+   {
+      zlog_warn(alog, "Client %d fell behind, sending the alerts in full", client->fd);
+
+      // The frame being sent has to complete, the receiver is in the middle of it
+      int kept = client->offset > 0 ? 1 : 0;
+
+      for (int x = kept; x < client->queued; ++x)
+      {
+         release_frame(client->queue[(client->head + x) % DAEMON_CLIENT_BACKLOG]);
+      }// End of for
+
+      client->queued = kept;
+      frame = full_frame();
+      if (!frame) return;
+   }// End of if
+
+   ++frame->references;
+   client->queue[(client->head + client->queued) % DAEMON_CLIENT_BACKLOG] = frame;
+   ++client->queued;
+}// End of queue_frame method
+
+static void handle_client(int fd, uint32_t events, void *data)
+{
+   DaemonClient *client = data;
+   (void)fd;
+
+   if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+   {
+      ssize_t bytes = recv(client->fd, client->input + client->input_length,
+                           DAEMON_INPUT_SIZE - client->input_length, MSG_DONTWAIT);
+
+      if (bytes == 0 || (bytes < 0 && errno != EAGAIN && errno != EINTR))
+      {
+         drop_client(client);
+         return;
+      }// End of if
+
+      if (bytes > 0) client->input_length += bytes;
+
+      // Clients only send small requests
+      WireType type;
+      WireReader request;
+      long length;
+
+      while ((length = read_wire_frame(client->input, client->input_length, &type, &request)) > 0)
+      {
+         if (type == WIRE_REFRESH)
+         {
+            zlog_info(alog, "Client %d requested a refresh", client->fd);
+            request_refresh();
+         }// End of if
+
+         client->input_length -= length;
+         memmove(client->input, client->input + length, client->input_length);
+      }// End of while
+
+      if (length < 0 || client->input_length == DAEMON_INPUT_SIZE)
+      {
+         zlog_warn(alog, "Client %d sent a malformed request", client->fd);
+         drop_client(client);
+         return;
+      }// End of if
+   }// End of if
+
+   if (events & EPOLLOUT) send_queued(client);
+}// End of handle_client method
+
+static void handle_connection(int fd, uint32_t events, void *data)
+{
+   (void)events; (void)data;
+
+   int client_fd;
+
+   while ((client_fd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+   {
+      DaemonClient *client = NULL;
+
+      for (int x = 0; x < DAEMON_MAX_CLIENTS && !client; ++x)
+      {
+         if (clients[x].fd < 0) client = &clients[x];
+      }// End of for
+
+      if (!client || !add_event_source(client_fd, EPOLLIN, handle_client, client))
+      {
+         zlog_warn(alog, "Refusing client, too many clients");
+         close(client_fd);
+         continue;
+      }// End of if
+
+      memset(client, 0, sizeof(DaemonClient));
+      client->fd = client_fd;
+      client->writable = true;
+      ++client_count;
+
+      zlog_info(alog, "Client %d connected (%d clients)", client_fd, client_count);
+
+      // Say hello, then the current alerts in full
+      WireBuffer buffer = { 0 };
+
+      begin_wire_frame(&buffer, WIRE_HELLO);
+      put_wire_varint(&buffer, WIRE_VERSION);
+      end_wire_frame(&buffer, 0);
+
+      DaemonFrame *hello = create_frame(&buffer);
+      free_wire_buffer(&buffer);
+
+      if (!hello)
+      {
+         drop_client(client);
+         continue;
+      }// End of if
+
+      queue_frame(client, hello);
+      release_frame(hello);
+
+      if (full_frame()) queue_frame(client, full_frame());
+
+      send_queued(client);
+   }// End of while
+}// End of handle_connection method
+
+static void handle_snapshot(int fd, uint32_t events, void *data)
+{
+   zlog_debug(alog, "Entering");
+
+   (void)events; (void)data;
+
+   uint64_t published = 0;
+   if (read(fd, &published, sizeof(published)) < 0) return;
+
+   Alerts *snapshot = acquire_snapshot(reader);
+
+   if (!snapshot || (sent && snapshot->generation == sent->generation))
+   {
+      release_snapshot(reader);
+      return;
+   }// End of if
+
+   // Encode the changes once, for every client
+   WireBuffer buffer = { 0 };
+   int changed = put_wire_alerts(&buffer, snapshot, sent);
+   DaemonFrame *frame = changed >= 0 ? create_frame(&buffer) : NULL;
+
+   free_wire_buffer(&buffer);
+
+   // Keep the alerts of the frame (the snapshot is only pinned for now)
+   Alerts *copy = frame ? merge_alerts(&snapshot, 1) : NULL;
+   if (copy) copy->generation = snapshot->generation;
+
+   release_snapshot(reader);
+
+   if (!copy)
+   {
+      // Clients would no longer follow, start them over
+      zlog_warn(alog, "Failed to encode the alerts, disconnecting the clients");
+
+      for (int x = 0; x < DAEMON_MAX_CLIENTS; ++x)
+      {
+         if (clients[x].fd >= 0) drop_client(&clients[x]);
+      }// End of for
+
+      release_frame(frame);
+      return;
+   }// End of if
+
+   free_alerts(sent);
+   sent = copy;
+   release_frame(full);
+   full = NULL;
+
+   zlog_info(alog, "Sending generation %lu (%d of %d alerts changed, %zu bytes) to %d clients",
+             sent->generation, changed, sent->count, frame->length, client_count);
+
+   for (int x = 0; x < DAEMON_MAX_CLIENTS; ++x)
+   {
+      if (clients[x].fd < 0) continue;
+
+      queue_frame(&clients[x], frame);
+      send_queued(&clients[x]);
+   }// End of for
+
+   release_frame(frame);
+
+   zlog_debug(alog, "Exiting");
+}// End of handle_snapshot method
+
+// IMPLEMENTATION: See header for details
+bool start_daemon(const char *path, int notifier)
+{
+   zlog_debug(alog, "Entering");
+
+   struct sockaddr_un address = { .sun_family = AF_UNIX };
+
+   if (strlen(path) >= sizeof(address.sun_path))
+   {
+      zlog_warn(alog, "Socket path %s is too long", path);
+      return false;
+   }// End of if
+
+   strcpy(address.sun_path, path);
+
+   for (int x = 0; x < DAEMON_MAX_CLIENTS; ++x) clients[x].fd = -1;
+
+   listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+   if (listen_fd < 0) return false;
+
+   // A socket file nobody answers on is left over from a previous daemon
+   if (connect(listen_fd, (struct sockaddr *)&address, sizeof(address)) == 0 || errno == EAGAIN)
+   {
+      zlog_warn(alog, "Another daemon is listening on %s", path);
+      close(listen_fd);
+      listen_fd = -1;
+      return false;
+   }// End of if
+
+   close(listen_fd);
+   listen_fd = -1;
+
+   // Only ever remove a socket, a mistyped path must not cost a file
+   struct stat status;
+
+   if (lstat(path, &status) == 0)
+   {
+      if (!S_ISSOCK(status.st_mode))
+      {
+         zlog_warn(alog, "%s exists and is not a socket", path);
+         return false;
+      }// End of if
+
+      unlink(path);
+   }// End of if
+
+   listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+   if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0
+         || listen(listen_fd, SOMAXCONN) != 0)
+   {
+      zlog_warn(alog, "Failed to listen on %s", path);
+      if (listen_fd >= 0) close(listen_fd);
+      listen_fd = -1;
+      return false;
+   }// End of if
+
+   strcpy(socket_path, path);
+   reader = register_snapshot_reader();
+   snapshot_fd = notifier;
+
+   if (reader < 0 || !add_event_source(listen_fd, EPOLLIN, handle_connection, NULL)
+         || !add_event_source(snapshot_fd, EPOLLIN, handle_snapshot, NULL))
+   {
+      stop_daemon();
+      return false;
+   }// End of if
+
+   zlog_info(alog, "Listening on %s", path);
+   zlog_debug(alog, "Exiting");
+   return true;
+}// End of start_daemon method
+
+// IMPLEMENTATION: See header for details
+void stop_daemon(void)
+{
+   zlog_debug(alog, "Entering");
+
+   if (listen_fd < 0) return;
+
+   for (int x = 0; x < DAEMON_MAX_CLIENTS; ++x)
+   {
+      if (clients[x].fd >= 0) drop_client(&clients[x]);
+   }// End of for
+
+   remove_event_source(listen_fd);
+   remove_event_source(snapshot_fd);
+   close(listen_fd);
+   unlink(socket_path);
+   listen_fd = -1;
+
+   unregister_snapshot_reader(reader);
+   reader = -1;
+
+   release_frame(full);
+   free_alerts(sent);
+   full = NULL;
+   sent = NULL;
+
+   zlog_debug(alog, "Exiting");
+}// End of stop_daemon method
@@ -0,0 +1,58 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef _DAEMON
+#define _DAEMON
+
+#include <stdbool.h>
+
+/*
+   The daemon serves the published snapshots to local clients over a Unix
+   domain socket (see wire.h). A client is sent the current alerts in full
+   when it connects, and then one delta per published snapshot. Each delta
+   is encoded once and the same frame is queued to every client, so a
+   snapshot costs the same whatever the number of clients. A client that
+   falls DAEMON_CLIENT_BACKLOG frames behind is sent the current alerts in
+   full instead of its backlog.
+*/
+
+#define DAEMON_MAX_CLIENTS 240
+#define DAEMON_CLIENT_BACKLOG 64
+
+/*
+   start_daemon(path, notifier) Listens for clients at path.
+      PRE:  Created event loop, notifier is the snapshot notifier.
+      POST: The listening socket and notifier are watched by the event
+            loop. Returns false if path could not be listened on (or another
+            daemon is listening on it).
+*/
+bool start_daemon(const char *path, int notifier);
+
+/*
+   stop_daemon() Disconnects the clients and stops listening.
+      POST: The socket file is removed and the daemon's memory is freed.
+*/
+void stop_daemon(void);
+
+#endif
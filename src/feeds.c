@@ -0,0 +1,751 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "feeds.h"
+
+#include "log.h"
+#include "stats.h"
+#include "metrics.h"
+#include "memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <curl/curl.h>
+
+#define HEDGE_MIN_SAMPLES 8
+#define HEDGE_MIN_DELAY 10
+#define MAX_POLL_WAIT 1000
+
+/*
+   FeedAttempt is one request for a feed, sent to one of its urls.
+*/
+struct FeedAttempt {
+   int feed;
+   int url;
+   bool delta;                // Asks for the changes since the feed version
+   char *request_url;
+   struct curl_slist *headers;
+   CURL *curl;
+   FetchBuffer buffer;
+   FetchStats stats;
+   bool active;
+};
+typedef struct FeedAttempt FeedAttempt;
+
+/*
+   FeedProgress tracks a feed during one refresh.
+*/
+struct FeedProgress {
+   int next_url;              // Next url to try (hedge or fail over)
+   int active;                // Attempts in flight
+   bool done;                 // Answered, or out of options
+   bool full;                 // Deltas failed, only full documents will do
+   bool changed;              // The feed's alerts were replaced
+   double last_started;       // When the latest attempt started
+   long hedge_delay;          // Milliseconds without a first byte before hedging
+};
+typedef struct FeedProgress FeedProgress;
+
+/*
+   Refresh is the state of one load_alerts_from_feed_set call.
+*/
+struct Refresh {
+   FeedSet *set;
+   CURLM *multi;
+   double start;
+
+   FeedAttempt *attempts;
+   int attempt_count;
+
+   FeedProgress *progress;
+};
+typedef struct Refresh Refresh;
+
+/*
+   compare_longs(a, b) qsort comparator for longs.
+*/
+static int compare_longs(const void *a, const void *b)
+{
+   long x = *(const long *)a;
+   long y = *(const long *)b;
+
+   return (x > y) - (x < y);
+}// End of compare_longs method
+
+/*
+   feed_hedge_delay(feed, policy) Returns how long an attempt on feed may go
+                                    without a first byte before it is hedged.
+      PRE:  Valid pointers
+      POST: p95 of the recent first byte latencies, or the policy default if
+            not enough samples are known.
+*/
+static long feed_hedge_delay(const Feed *feed, const FetchPolicy *policy)
+{
+   if (feed->latency_count < HEDGE_MIN_SAMPLES) return policy->hedge_delay;
+
+   long sorted[FEED_LATENCY_SAMPLES];
+   memcpy(sorted, feed->latencies, feed->latency_count * sizeof(long));
+   qsort(sorted, feed->latency_count, sizeof(long), compare_longs);
+
+   long p95 = sorted[(feed->latency_count * 95 + 99) / 100 - 1];
+   return p95 > HEDGE_MIN_DELAY ? p95 : HEDGE_MIN_DELAY;
+}// End of feed_hedge_delay method
+
+/*
+   record_latency(feed, latency) Adds a first byte latency sample to feed.
+*/
+static void record_latency(Feed *feed, long latency)
+{
+   feed->latencies[feed->latency_next] = latency;
+   feed->latency_next = (feed->latency_next + 1) % FEED_LATENCY_SAMPLES;
+   if (feed->latency_count < FEED_LATENCY_SAMPLES) ++feed->latency_count;
+}// End of record_latency method
+
+/*
+   remaining_time(refresh, now) Returns the milliseconds left before the
+                                  total deadline (LONG_MAX if unbounded).
+*/
+static long remaining_time(const Refresh *refresh, double now)
+{
+   long total = refresh->set->policy.total_timeout;
+   if (total <= 0) return LONG_MAX;
+
+   long remaining = total - (long)((now - refresh->start) * 1000);
+   return remaining > 0 ? remaining : 0;
+}// End of remaining_time method
+
+/*
+   start_attempt(refresh, feed, now) Sends the request for feed to its next url.
+      PRE:  Valid refresh, feed has an untried url.
+      POST: Returns true if the attempt was started.
+*/
+static bool start_attempt(Refresh *refresh, int feed, double now)
+{
+   Feed *source = &refresh->set->feeds[feed];
+   FeedProgress *progress = &refresh->progress[feed];
+   FeedAttempt *attempt = &refresh->attempts[refresh->attempt_count];
+   const FetchPolicy *policy = &refresh->set->policy;
+
+   long timeout = remaining_time(refresh, now);
+   if (policy->attempt_timeout > 0 && policy->attempt_timeout < timeout) timeout = policy->attempt_timeout;
+
+   memset(attempt, 0, sizeof(FeedAttempt));
+   attempt->feed = feed;
+   attempt->url = progress->next_url++;
+   attempt->delta = source->alerts && source->version > 0 && !progress->full;
+   attempt->curl = curl_easy_init();
+
+   if (!attempt->curl)
+   {
+      zlog_warn(alog, "Failed to create curl object for %s", source->urls[attempt->url]);
+      return false;
+   }// End of if
+
+   // Ask for the changes since the version we hold, or for the whole document
+   // unless it still matches the one we hold
+   const char *url = source->urls[attempt->url];
+
+   if (attempt->delta)
+   {
+      if (asprintf(&attempt->request_url, "%s%csince=%ld", url, strchr(url, '?') ? '&' : '?',
+                   source->version) < 0)
+      {
+         attempt->request_url = NULL;
+         curl_easy_cleanup(attempt->curl);
+         return false;
+      }// End of if
+
+      url = attempt->request_url;
+   }// End of if
+   else if (source->alerts && source->etag[0])
+   {
+      char header[sizeof(source->etag) + 32];
+      snprintf(header, sizeof(header), "If-None-Match: %s", source->etag);
+      attempt->headers = curl_slist_append(NULL, header);
+   }// End of else if
+
+   curl_easy_setopt(attempt->curl, CURLOPT_URL, url);
+   curl_easy_setopt(attempt->curl, CURLOPT_HTTPHEADER, attempt->headers);
+   curl_easy_setopt(attempt->curl, CURLOPT_PRIVATE, attempt);
+   configure_fetch(attempt->curl, &attempt->buffer, &attempt->stats);
+
+   if (timeout != LONG_MAX) curl_easy_setopt(attempt->curl, CURLOPT_TIMEOUT_MS, timeout);
+   if (policy->connect_timeout > 0) curl_easy_setopt(attempt->curl, CURLOPT_CONNECTTIMEOUT_MS, policy->connect_timeout);
+
+   if (policy->low_speed_limit > 0 && policy->low_speed_time > 0)
+   {
+      curl_easy_setopt(attempt->curl, CURLOPT_LOW_SPEED_LIMIT, policy->low_speed_limit);
+      curl_easy_setopt(attempt->curl, CURLOPT_LOW_SPEED_TIME, policy->low_speed_time);
+   }// End of if
+
+   curl_multi_add_handle(refresh->multi, attempt->curl);
+
+   attempt->active = true;
+   ++refresh->attempt_count;
+   ++progress->active;
+   progress->last_started = now;
+
+   zlog_info(alog, "Requesting %s (attempt %d)", url, attempt->url + 1);
+   return true;
+}// End of start_attempt method
+
+/*
+   end_attempt(refresh, attempt) Removes the attempt from the multi handle and
+                                   releases its resources.
+*/
+static void end_attempt(Refresh *refresh, FeedAttempt *attempt)
+{
+   curl_multi_remove_handle(refresh->multi, attempt->curl);
+   curl_easy_cleanup(attempt->curl);
+   curl_slist_free_all(attempt->headers);
+   free(attempt->request_url);
+   free_fetch_buffer(&attempt->buffer);
+
+   attempt->curl = NULL;
+   attempt->headers = NULL;
+   attempt->request_url = NULL;
+   attempt->active = false;
+   --refresh->progress[attempt->feed].active;
+}// End of end_attempt method
+
+/*
+   cancel_attempts(refresh, feed) Aborts the attempts in flight for feed
+                                    (all feeds if feed is -1).
+*/
+static void cancel_attempts(Refresh *refresh, int feed)
+{
+   for (int x = 0; x < refresh->attempt_count; ++x)
+   {
+      FeedAttempt *attempt = &refresh->attempts[x];
+      if (!attempt->active || (feed >= 0 && attempt->feed != feed)) continue;
+
+      zlog_info(alog, "Cancelling %s", refresh->set->feeds[attempt->feed].urls[attempt->url]);
+      end_attempt(refresh, attempt);
+   }// End of for
+}// End of cancel_attempts method
+
+/*
+   json_long(json, name) Returns the integer member name of json (0 if missing).
+*/
+static long json_long(const json_value *json, const char *name)
+{
+   json_value *value = json_object_value(json, name);
+   return value && value->type == json_integer ? (long)value->u.integer : 0;
+}// End of json_long method
+
+/*
+   json_array_length(json, name) Returns the length of the array member name
+                                   of json (0 if missing).
+*/
+static int json_array_length(const json_value *json, const char *name)
+{
+   json_value *value = json_object_value(json, name);
+   return value && value->type == json_array ? (int)value->u.array.length : 0;
+}// End of json_array_length method
+
+/*
+   apply_response(feed, attempt, changed, resync) Loads the response of a
+                                                    successful attempt into feed.
+      PRE:  Valid pointers, the attempt completed with a success status.
+      POST: Returns true if the feed is up to date. Sets changed if
+            feed->alerts was replaced, and resync if a delta could not be
+            applied and the whole document has to be fetched.
+*/
+static bool apply_response(Feed *feed, FeedAttempt *attempt, bool *changed, bool *resync)
+{
+   zlog_debug(alog, "Entering");
+
+   *changed = false;
+   *resync = false;
+
+   if (attempt->stats.status == 304)
+   {
+      zlog_info(alog, "Feed %s not modified", feed->urls[attempt->url]);
+      return true;
+   }// End of if
+
+   char error[json_error_max] = { 0 };
+   json_settings settings = accounted_json_settings();
+   uint64_t start = stats_clock();
+   json_value *json = json_parse_ex(&settings, attempt->buffer.data, attempt->buffer.length, error);
+   record_stat_since(STATS_PARSE, start);
+   count_metric(METRICS_PARSE_BYTES, attempt->buffer.length);
+   Alerts *alerts = NULL;
+
+   if (!json || json->type != json_object)
+   {
+      zlog_warn(alog, "JSON Parse Error: %s", error);
+      if (json) json_value_free_ex(&settings, json);
+      *resync = attempt->delta;
+      return false;
+   }// End of if
+
+   long version = json_long(json, "version");
+
+   if (json_object_value(json, "alerts"))
+   {
+      // Whole document, either asked for or the server does not do deltas
+      alerts = load_alerts_from_json(json);
+   }// End of if
+   else if (attempt->delta && json_long(json, "since") != feed->version)
+   {
+      zlog_warn(alog, "Delta for %s does not follow version %ld", feed->urls[attempt->url], feed->version);
+      *resync = true;
+   }// End of else if
+   else if (attempt->delta && version == feed->version
+            && json_array_length(json, "added") + json_array_length(json, "updated")
+               + json_array_length(json, "removed") == 0)
+   {
+      zlog_info(alog, "Feed %s unchanged at version %ld", feed->urls[attempt->url], version);
+      json_value_free_ex(&settings, json);
+      return true;
+   }// End of else if
+   else if (attempt->delta)
+   {
+      alerts = apply_alerts_delta(feed->alerts, json);
+      *resync = !alerts;
+   }// End of else if
+
+   json_value_free_ex(&settings, json);
+
+   if (!alerts) return false;
+
+   free_alerts(feed->alerts);
+   feed->alerts = alerts;
+   feed->version = version;
+   snprintf(feed->etag, sizeof(feed->etag), "%s", attempt->stats.etag);
+   *changed = true;
+
+   zlog_debug(alog, "Exiting");
+   return true;
+}// End of apply_response method
+
+/*
+   finish_attempt(refresh, attempt, result) Handles a completed attempt.
+      PRE:  Valid pointers, attempt completed with result.
+      POST: The response is applied to the feed if the attempt succeeded. The
+            first attempt of a feed to succeed wins and its siblings are
+            cancelled. A delta that cannot be applied is retried as a full
+            request to the same url.
+*/
+static void finish_attempt(Refresh *refresh, FeedAttempt *attempt, CURLcode result)
+{
+   zlog_debug(alog, "Entering");
+
+   Feed *feed = &refresh->set->feeds[attempt->feed];
+   FeedProgress *progress = &refresh->progress[attempt->feed];
+   bool answered = false;
+   bool changed = false;
+   bool resync = false;
+
+   collect_fetch_stats(attempt->curl, &attempt->buffer, &attempt->stats);
+
+   if (attempt->stats.first_byte_time > 0)
+   {
+      record_latency(feed, (long)(attempt->stats.first_byte_time * 1000));
+   }// End of if
+
+   if (result != CURLE_OK)
+   {
+      zlog_warn(alog, "HTTP request for %s failed: %s", feed->urls[attempt->url], curl_easy_strerror(result));
+   }// End of if
+   else if (attempt->delta && (attempt->stats.status == 410 || attempt->stats.status == 404))
+   {
+      zlog_info(alog, "Feed %s cannot send changes since %ld", feed->urls[attempt->url], feed->version);
+      resync = true;
+   }// End of else if
+   else if (attempt->stats.status >= 400)
+   {
+      zlog_warn(alog, "HTTP request for %s failed: status %ld", feed->urls[attempt->url],
+                attempt->stats.status);
+   }// End of else if
+   else if (!progress->done)
+   {
+      answered = apply_response(feed, attempt, &changed, &resync);
+   }// End of else if
+
+   int url = attempt->url;
+   end_attempt(refresh, attempt);
+
+   if (answered)
+   {
+      progress->done = true;
+      progress->changed = changed;
+
+      feed->source = url;
+      feed->stats = attempt->stats;
+      feed->stats.refresh_time = fetch_clock() - refresh->start;
+      note_feed_loaded(attempt->feed, feed->urls[0], &feed->stats);
+
+      zlog_info(alog, "Feed %s: %d alerts, %llu bytes in %.3fs", feed->urls[url],
+                feed->alerts ? feed->alerts->count : 0, feed->stats.wire_bytes, feed->stats.refresh_time);
+
+      cancel_attempts(refresh, attempt->feed);
+   }// End of if
+   else if (!progress->done)
+   {
+      feed->stats = attempt->stats;
+
+      if (resync && !progress->full)
+      {
+         // Fall back to the whole document from the same server
+         progress->full = true;
+         progress->next_url = url;
+         start_attempt(refresh, attempt->feed, fetch_clock());
+      }// End of if
+   }// End of else if
+
+   zlog_debug(alog, "Exiting");
+}// End of finish_attempt method
+
+/*
+   advance_feeds(refresh, now) Starts hedge and fail over attempts.
+      PRE:  Valid refresh
+      POST: Returns the milliseconds until the next hedge is due.
+*/
+static long advance_feeds(Refresh *refresh, double now)
+{
+   long wait = MAX_POLL_WAIT;
+   bool out_of_time = remaining_time(refresh, now) == 0;
+
+   for (int f = 0; f < refresh->set->count; ++f)
+   {
+      Feed *feed = &refresh->set->feeds[f];
+      FeedProgress *progress = &refresh->progress[f];
+
+      if (progress->done) continue;
+
+      bool untried = progress->next_url < feed->url_count;
+
+      // Fail over: nothing left in flight for this feed
+      if (progress->active == 0)
+      {
+         if (!untried || out_of_time || !start_attempt(refresh, f, now))
+         {
+            zlog_warn(alog, "Feed %s failed", feed->urls[0]);
+            progress->done = true;
+         }// End of if
+
+         continue;
+      }// End of if
+
+      if (!untried || out_of_time) continue;
+
+      // Hedge: send the request to a mirror if no attempt has a first byte yet
+      bool answered = false;
+
+      for (int x = 0; x < refresh->attempt_count && !answered; ++x)
+      {
+         FeedAttempt *attempt = &refresh->attempts[x];
+         long status = 0;
+
+         if (!attempt->active || attempt->feed != f) continue;
+
+         curl_easy_getinfo(attempt->curl, CURLINFO_RESPONSE_CODE, &status);
+         answered = status != 0;
+      }// End of for
+
+      if (answered) continue;
+
+      long waited = (long)((now - progress->last_started) * 1000);
+
+      if (waited >= progress->hedge_delay)
+      {
+         zlog_info(alog, "No first byte for %s after %ldms, hedging to %s",
+                   feed->urls[0], waited, feed->urls[progress->next_url]);
+         start_attempt(refresh, f, now);
+      }// End of if
+      else if (progress->hedge_delay - waited < wait)
+      {
+         wait = progress->hedge_delay - waited;
+      }// End of else if
+   }// End of for
+
+   return wait;
+}// End of advance_feeds method
+
+// IMPLEMENTATION: See header for details
+FetchPolicy default_fetch_policy(void)
+{
+   FetchPolicy policy;
+
+   policy.connect_timeout = 10000;
+   policy.attempt_timeout = 30000;
+   policy.total_timeout = 45000;
+   policy.low_speed_limit = 1024;
+   policy.low_speed_time = 15;
+   policy.hedge_delay = 2000;
+
+   return policy;
+}// End of default_fetch_policy method
+
+// IMPLEMENTATION: See header for details
+FeedSet * create_feed_set(const char * const *specs, int count, const FetchPolicy *policy)
+{
+   zlog_debug(alog, "Entering");
+
+   FeedSet *set = calloc(1, sizeof(FeedSet));
+
+   if (!set || !(set->feeds = calloc(count > 0 ? count : 1, sizeof(Feed))))
+   {
+      zlog_warn(alog, "Failed to allocate memory for feed set");
+      free(set);
+      return NULL;
+   }// End of if
+
+   pthread_mutex_init(&set->lock, NULL);
+
+   set->count = count;
+   set->policy = policy ? *policy : default_fetch_policy();
+
+   for (int f = 0; f < count; ++f)
+   {
+      Feed *feed = &set->feeds[f];
+      int url_count = 1;
+
+      for (const char *c = specs[f]; *c; ++c)
+      {
+         if (*c == ',') ++url_count;
+      }// End of for
+
+      feed->urls = calloc(url_count, sizeof(char *));
+
+      if (!feed->urls)
+      {
+         zlog_warn(alog, "Failed to allocate memory for feed urls");
+         free_feed_set(set);
+         return NULL;
+      }// End of if
+
+      // Split "primary,mirror,..."
+      const char *start = specs[f];
+
+      for (int u = 0; u < url_count; ++u)
+      {
+         const char *end = strchr(start, ',');
+         size_t length = end ? (size_t)(end - start) : strlen(start);
+
+         if (length > 0 && !(feed->urls[feed->url_count++] = strndup(start, length)))
+         {
+            zlog_warn(alog, "Failed to allocate memory for feed url");
+            free_feed_set(set);
+            return NULL;
+         }// End of if
+
+         start = end ? end + 1 : start + length;
+      }// End of for (u)
+   }// End of for (f)
+
+   zlog_debug(alog, "Exiting");
+   return set;
+}// End of create_feed_set method
+
+// IMPLEMENTATION: See header for details
+Alerts * load_alerts_from_feed_set(FeedSet *set)
+{
+   zlog_debug(alog, "Entering");
+
+   if (!set || set->count <= 0)
+   {
+      zlog_warn(alog, "No feeds provided");
+      return NULL;
+   }// End of if
+
+   // Declare and initalize variables
+   Refresh refresh;
+   Alerts *alerts = NULL;
+   int attempt_capacity = 0;
+   int running = 0;
+
+   memset(&refresh, 0, sizeof(Refresh));
+   refresh.set = set;
+   refresh.start = fetch_clock();
+
+   for (int f = 0; f < set->count; ++f)
+   {
+      // Each url may be asked for a delta and then for the whole document
+      attempt_capacity += set->feeds[f].url_count * 2;
+   }// End of for
+
+   refresh.attempts = calloc(attempt_capacity > 0 ? attempt_capacity : 1, sizeof(FeedAttempt));
+   refresh.progress = calloc(set->count, sizeof(FeedProgress));
+   refresh.multi = curl_multi_init();
+
+   if (!refresh.attempts || !refresh.progress || !refresh.multi)
+   {
+      zlog_warn(alog, "Failed to allocate feed transfers");
+      free(refresh.attempts);
+      free(refresh.progress);
+      if (refresh.multi) curl_multi_cleanup(refresh.multi);
+      return NULL;
+   }// End of if
+
+   pthread_mutex_lock(&set->lock);
+   set->multi = refresh.multi;
+   pthread_mutex_unlock(&set->lock);
+
+   for (int f = 0; f < set->count; ++f)
+   {
+      refresh.progress[f].hedge_delay = feed_hedge_delay(&set->feeds[f], &set->policy);
+      memset(&set->feeds[f].stats, 0, sizeof(FetchStats));
+
+      if (set->feeds[f].url_count == 0 || !start_attempt(&refresh, f, refresh.start))
+      {
+         refresh.progress[f].done = true;
+      }// End of if
+   }// End of for
+
+   // Drive the transfers, parsing each feed as soon as it is complete
+   for (;;)
+   {
+      CURLMsg *message = NULL;
+      int queued = 0;
+
+      if (__atomic_load_n(&set->cancelled, __ATOMIC_ACQUIRE))
+      {
+         zlog_info(alog, "Refresh cancelled");
+         break;
+      }// End of if
+
+      if (curl_multi_perform(refresh.multi, &running) != CURLM_OK) break;
+
+      while ((message = curl_multi_info_read(refresh.multi, &queued)))
+      {
+         if (message->msg != CURLMSG_DONE) continue;
+
+         char *private = NULL;
+         curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &private);
+         finish_attempt(&refresh, (FeedAttempt *)private, message->data.result);
+      }// End of while
+
+      double now = fetch_clock();
+      long wait = advance_feeds(&refresh, now);
+      long remaining = remaining_time(&refresh, now);
+
+      bool pending = false;
+      for (int f = 0; f < set->count; ++f) pending = pending || !refresh.progress[f].done;
+
+      if (!pending) break;
+
+      if (remaining == 0)
+      {
+         zlog_warn(alog, "Refresh deadline of %ldms reached", set->policy.total_timeout);
+         cancel_attempts(&refresh, -1);
+         break;
+      }// End of if
+
+      curl_multi_poll(refresh.multi, NULL, 0, (int)(wait < remaining ? wait : remaining), NULL);
+   }// End of for
+
+   // Cleanup
+   pthread_mutex_lock(&set->lock);
+   set->multi = NULL;
+   set->cancelled = false;
+   pthread_mutex_unlock(&set->lock);
+
+   cancel_attempts(&refresh, -1);
+   curl_multi_cleanup(refresh.multi);
+
+   set->changed = 0;
+   set->failed = 0;
+
+   for (int f = 0; f < set->count; ++f)
+   {
+      if (refresh.progress[f].changed) ++set->changed;
+      if (!refresh.progress[f].done || !set->feeds[f].alerts) ++set->failed;
+   }// End of for
+
+   // Feeds that failed keep contributing the last alerts they provided
+   if (set->changed > 0)
+   {
+      alerts = merge_feed_set(set);
+   }// End of if
+   else if (set->failed == set->count)
+   {
+      zlog_warn(alog, "All %d feeds failed", set->count);
+   }// End of else if
+
+   free(refresh.progress);
+   free(refresh.attempts);
+
+   zlog_info(alog, "Refreshed %d of %d feeds (%d changed) in %.3fs", set->count - set->failed,
+             set->count, set->changed, fetch_clock() - refresh.start);
+
+   zlog_debug(alog, "Exiting");
+   return alerts;
+}// End of load_alerts_from_feed_set method
+
+// IMPLEMENTATION: See header for details
+void cancel_feed_set(FeedSet *set, bool pending)
+{
+   pthread_mutex_lock(&set->lock);
+
+   if (set->multi || pending)
+   {
+      __atomic_store_n(&set->cancelled, true, __ATOMIC_RELEASE);
+      if (set->multi) curl_multi_wakeup(set->multi);
+   }// End of if
+
+   pthread_mutex_unlock(&set->lock);
+}// End of cancel_feed_set method
+
+// IMPLEMENTATION: See header for details
+Alerts * merge_feed_set(const FeedSet *set)
+{
+   Alerts *sets[set->count > 0 ? set->count : 1];
+
+   for (int f = 0; f < set->count; ++f)
+   {
+      sets[f] = set->feeds[f].alerts;
+   }// End of for
+
+   return merge_alerts(sets, set->count);
+}// End of merge_feed_set method
+
+// IMPLEMENTATION: See header for details
+void free_feed_set(FeedSet *set)
+{
+   if (!set) return;
+
+   zlog_debug(alog, "Entering");
+
+   for (int f = 0; f < set->count; ++f)
+   {
+      for (int u = 0; u < set->feeds[f].url_count; ++u)
+      {
+         free(set->feeds[f].urls[u]);
+      }// End of for (u)
+
+      free(set->feeds[f].urls);
+      free_alerts(set->feeds[f].alerts);
+   }// End of for (f)
+
+   free(set->feeds);
+   pthread_mutex_destroy(&set->lock);
+   free(set);
+
+   zlog_debug(alog, "Exiting");
+}// End of free_feed_set method
@@ -0,0 +1,154 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef _FEEDS
+#define _FEEDS
+
+#include "alerts.h"
+#include "fetch.h"
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#define FEED_LATENCY_SAMPLES 32
+
+/*
+   FetchPolicy bounds how long a refresh may take. All times are in
+   milliseconds, 0 disables the corresponding limit.
+*/
+struct FetchPolicy {
+   long connect_timeout;      // Per attempt, to establish the connection (incl. TLS)
+   long attempt_timeout;      // Per attempt, for the whole transfer
+   long total_timeout;        // For the whole refresh, across all attempts
+   long low_speed_limit;      // Abort an attempt slower than this many bytes per second...
+   long low_speed_time;       // ...for this many seconds
+   long hedge_delay;          // Hedge delay until enough first byte latencies are known
+};
+typedef struct FetchPolicy FetchPolicy;
+
+/*
+   Feed is one alert source, reachable through a primary url and optional
+   mirrors serving the same document.
+*/
+struct Feed {
+   int url_count;
+   char **urls;               // urls[0] is the primary, the rest are mirrors
+
+   // Recent first byte latencies (ms), used to pick the hedge delay
+   long latencies[FEED_LATENCY_SAMPLES];
+   int latency_count;
+   int latency_next;
+
+   int source;                // Index of the url that answered the last refresh
+   FetchStats stats;          // Transfer that answered the last refresh
+
+   Alerts *alerts;            // Alerts currently provided by the feed
+   long version;              // Version of alerts (0 if the server has none)
+   char etag[128];            // ETag of alerts (empty if the server has none)
+};
+typedef struct Feed Feed;
+
+struct FeedSet {
+   int count;
+   Feed *feeds;
+   FetchPolicy policy;
+
+   int changed;               // Feeds whose alerts changed in the last refresh
+   int failed;                // Feeds that failed in the last refresh
+
+   pthread_mutex_t lock;      // Guards multi and cancelled against cancel_feed_set
+   CURLM *multi;              // Transfers of the refresh in flight
+   bool cancelled;            // The refresh in flight (or the next one) is aborted
+};
+typedef struct FeedSet FeedSet;
+
+/*
+   default_fetch_policy() Returns the default fetch policy.
+      PRE:  true
+      POST: Policy with bounded connect, attempt and total times is returned.
+*/
+FetchPolicy default_fetch_policy(void);
+
+/*
+   create_feed_set(specs, count, policy) Creates a set of feeds.
+      PRE:  Valid specs array of count strings, each a primary url optionally
+            followed by comma separated mirror urls. policy is NULL (default
+            policy) or a valid pointer.
+      POST: Returns the feed set, or NULL if memory could not be allocated.
+*/
+FeedSet * create_feed_set(const char * const *specs, int count, const FetchPolicy *policy);
+
+/*
+   load_alerts_from_feed_set(set) Refreshes every feed of the set concurrently
+                                    and merges their alerts.
+      PRE:  Valid set pointer
+      POST: All feeds are fetched on the calling thread through one curl multi
+            handle, each feed is parsed as soon as its transfer completes, and
+            the results are merged (de-duplicated by CAP identifier, earlier
+            feeds win) into the returned Alerts object.
+
+            Once a feed's version is known, only the changes since that version
+            are asked for ("?since=VERSION") and applied to the feed's alerts;
+            the whole document is fetched again if the server cannot send them
+            or the delta does not follow our version. Without a version, the
+            whole document is asked for conditionally on its ETag.
+
+            A feed attempt that has not produced its first byte within the p95
+            of the feed's recent first byte latencies is hedged: the same
+            request is sent to the next mirror and whichever answers first is
+            kept. A failed attempt fails over to the next mirror. The refresh
+            never takes longer than policy.total_timeout.
+
+            Feeds that fail keep contributing the alerts they last provided.
+            NULL is returned if no feed changed (set->changed is 0) or every
+            feed failed (set->failed is set->count). Feeds still in flight
+            when the refresh is cancelled have failed.
+*/
+Alerts * load_alerts_from_feed_set(FeedSet *set);
+
+/*
+   cancel_feed_set(set, pending) Aborts the refresh of set in flight.
+      PRE:  Valid set pointer (may be called from any thread)
+      POST: The refresh in flight is woken and abandons its transfers. With
+            pending, a refresh that is about to start is aborted as well
+            (for stopping); otherwise nothing happens without one in flight.
+*/
+void cancel_feed_set(FeedSet *set, bool pending);
+
+/*
+   merge_feed_set(set) Merges the alerts currently provided by every feed.
+      PRE:  Valid set pointer
+      POST: Returns the merged Alerts object (see merge_alerts), or NULL if
+            memory could not be allocated.
+*/
+Alerts * merge_feed_set(const FeedSet *set);
+
+/*
+   free_feed_set(set) Frees the feed set.
+      PRE:  Valid set pointer
+      POST: Memory allocated for the set is freed.
+*/
+void free_feed_set(FeedSet *set);
+
+#endif
@@ -0,0 +1,242 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "fetch.h"
+
+#include "log.h"
+#include "stats.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <time.h>
+
+#define FETCH_BUFFER_INITIAL_SIZE (64 * 1024)
+
+/*
+   fetch_write_body(ptr, size, nmemb, buffer) Appends the (already decoded)
+                                                response data to buffer.
+      PRE:  Valid pointers
+      POST: Data is appended to buffer. Returns the number of bytes consumed,
+            anything else tells curl to abort the transfer.
+*/
+static size_t fetch_write_body(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+   FetchBuffer *buffer = userdata;
+   size_t bytes = size * nmemb;
+
+   if (buffer->length + bytes + 1 > buffer->capacity)
+   {
+      size_t capacity = buffer->capacity ? buffer->capacity : FETCH_BUFFER_INITIAL_SIZE;
+      while (buffer->length + bytes + 1 > capacity) capacity *= 2;
+
+      char *data = realloc(buffer->data, capacity);
+
+      if (!data)
+      {
+         zlog_warn(alog, "Failed to grow response buffer to %zu bytes", capacity);
+         return 0;
+      }// End of if
+
+      buffer->data = data;
+      buffer->capacity = capacity;
+   }// End of if
+
+   memcpy(buffer->data + buffer->length, ptr, bytes);
+   buffer->length += bytes;
+   buffer->data[buffer->length] = '\0';
+
+   return bytes;
+}// End of fetch_write_body method
+
+/*
+   header_value(ptr, bytes, name, value, size) Copies the value of the header
+                                                 line in ptr to value if the
+                                                 header is called name.
+      PRE:  Valid pointers, ptr holds bytes bytes
+      POST: Returns true if the header matched and value was updated.
+*/
+static bool header_value(const char *ptr, size_t bytes, const char *name, char *value, size_t size)
+{
+   size_t length = strlen(name);
+
+   if (bytes <= length || strncasecmp(ptr, name, length) != 0 || ptr[length] != ':') return false;
+
+   const char *start = ptr + length + 1;
+   const char *end = ptr + bytes;
+
+   while (start < end && isspace((unsigned char)*start)) ++start;
+   while (end > start && isspace((unsigned char)end[-1])) --end;
+
+   snprintf(value, size, "%.*s", (int)(end - start), start);
+   return true;
+}// End of header_value method
+
+/*
+   fetch_write_header(ptr, size, nmemb, stats) Records interesting response
+                                                 headers in stats.
+      PRE:  Valid pointers
+      POST: stats->encoding and stats->etag are set from the headers.
+*/
+static size_t fetch_write_header(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+   FetchStats *stats = userdata;
+   size_t bytes = size * nmemb;
+
+   if (!header_value(ptr, bytes, "Content-Encoding", stats->encoding, sizeof(stats->encoding)))
+   {
+      header_value(ptr, bytes, "ETag", stats->etag, sizeof(stats->etag));
+   }// End of if
+
+   return bytes;
+}// End of fetch_write_header method
+
+// IMPLEMENTATION: See header for details
+void configure_fetch(CURL *curl, FetchBuffer *buffer, FetchStats *stats)
+{
+   zlog_debug(alog, "Entering");
+
+   // An empty string asks curl to offer every encoding it was built with
+   // (gzip and deflate, plus br and zstd when available) and to decode the
+   // body on the fly before it reaches the write callback.
+   curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+   curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, fetch_write_body);
+   curl_easy_setopt(curl, CURLOPT_WRITEDATA, buffer);
+   curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, fetch_write_header);
+   curl_easy_setopt(curl, CURLOPT_HEADERDATA, stats);
+   curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+
+   snprintf(stats->encoding, sizeof(stats->encoding), "identity");
+
+   zlog_debug(alog, "Exiting");
+}// End of configure_fetch method
+
+/*
+   trace_fetch(status, lookup, connect, handshake, first_byte, total) Traces
+      a request that just finished from the times curl reports (microseconds
+      from its start). Decoding the body happens during the transfer.
+*/
+static void trace_fetch(long status, curl_off_t lookup, curl_off_t connect, curl_off_t handshake,
+                        curl_off_t first_byte, curl_off_t total)
+{
+   uint64_t end = stats_clock();
+   uint64_t start = end - (uint64_t)total * 1000;
+   curl_off_t connected = handshake > 0 ? handshake : connect;
+
+   record_span("fetch", start, end);
+
+   if (status == 0) return;
+
+   if (lookup > 0) record_span("dns", start, start + lookup * 1000);
+   if (connect > lookup) record_span("connect", start + lookup * 1000, start + connect * 1000);
+   if (handshake > connect) record_span("tls", start + connect * 1000, start + handshake * 1000);
+   if (first_byte >= connected) record_span("first-byte", start + connected * 1000, start + first_byte * 1000);
+   if (total >= first_byte) record_span("transfer", start + first_byte * 1000, end);
+}// End of trace_fetch method
+
+// IMPLEMENTATION: See header for details
+void collect_fetch_stats(CURL *curl, const FetchBuffer *buffer, FetchStats *stats)
+{
+   zlog_debug(alog, "Entering");
+
+   curl_off_t wire_bytes = 0;
+   curl_off_t lookup_time = 0;
+   curl_off_t connect_time = 0;
+   curl_off_t handshake_time = 0;
+   curl_off_t first_byte_time = 0;
+   curl_off_t total_time = 0;
+
+   curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &stats->status);
+   curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &wire_bytes);
+   curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &lookup_time);
+   curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect_time);
+   curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &handshake_time);
+   curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &first_byte_time);
+   curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total_time);
+
+   // The times are microseconds from the start of the request, each phase
+   // ends where the next one starts. A reused connection skips the first
+   // three, which then end at 0.
+   if (stats->status > 0)
+   {
+      curl_off_t connected = handshake_time > 0 ? handshake_time : connect_time;
+
+      if (lookup_time > 0) record_stat(STATS_DNS, lookup_time * 1000);
+      if (connect_time > lookup_time) record_stat(STATS_CONNECT, (connect_time - lookup_time) * 1000);
+      if (handshake_time > connect_time) record_stat(STATS_TLS, (handshake_time - connect_time) * 1000);
+      if (first_byte_time >= connected) record_stat(STATS_FIRST_BYTE, (first_byte_time - connected) * 1000);
+      if (total_time >= first_byte_time) record_stat(STATS_TRANSFER, (total_time - first_byte_time) * 1000);
+   }// End of if
+
+   if (trace_active()) trace_fetch(stats->status, lookup_time, connect_time, handshake_time, first_byte_time, total_time);
+
+   count_metric(METRICS_FETCHES, 1);
+   count_metric(METRICS_FETCH_BYTES, wire_bytes);
+   if (stats->status == 0 || stats->status >= 400) count_metric(METRICS_FETCH_FAILURES, 1);
+
+   stats->wire_bytes = wire_bytes;
+   stats->body_bytes = buffer->length;
+   stats->first_byte_time = first_byte_time / 1000000.0;
+   stats->transfer_time = total_time / 1000000.0;
+   stats->wire_rate = stats->transfer_time > 0 ? stats->wire_bytes / stats->transfer_time : 0;
+
+   zlog_debug(alog, "Exiting");
+}// End of collect_fetch_stats method
+
+// IMPLEMENTATION: See header for details
+void print_fetch_stats(FILE *file, const FetchStats *stats)
+{
+   double ratio = stats->wire_bytes ? (double)stats->body_bytes / stats->wire_bytes : 0;
+
+   fprintf(file, "HTTP %ld, %s, %llu bytes received (%llu decoded, %.1fx), "
+                 "%.1f KiB/s, first byte %.3fs, transfer %.3fs, refresh %.3fs\n",
+           stats->status, stats->encoding, stats->wire_bytes, stats->body_bytes, ratio,
+           stats->wire_rate / 1024, stats->first_byte_time, stats->transfer_time,
+           stats->refresh_time);
+}// End of print_fetch_stats method
+
+// IMPLEMENTATION: See header for details
+void free_fetch_buffer(FetchBuffer *buffer)
+{
+   if (!buffer) return;
+
+   free(buffer->data);
+
+   buffer->data = NULL;
+   buffer->length = 0;
+   buffer->capacity = 0;
+}// End of free_fetch_buffer method
+
+// IMPLEMENTATION: See header for details
+double fetch_clock(void)
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+
+   return now.tv_sec + now.tv_nsec / 1000000000.0;
+}// End of fetch_clock method
@@ -0,0 +1,98 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef _FETCH
+#define _FETCH
+
+#include <stdio.h>
+#include <stddef.h>
+#include <curl/curl.h>
+
+/*
+   FetchBuffer holds a response body as it is received. Compressed responses
+   are decoded by curl as they arrive, so the buffer only ever contains the
+   decoded body and can be handed directly to the JSON parser.
+*/
+struct FetchBuffer {
+   char *data;
+   size_t length;
+   size_t capacity;
+};
+typedef struct FetchBuffer FetchBuffer;
+
+/*
+   FetchStats describes a single feed refresh.
+*/
+struct FetchStats {
+   long status;                     // HTTP status code of the response
+   char encoding[32];               // Content-Encoding chosen by the server
+   char etag[128];                  // ETag of the response (empty if none)
+   unsigned long long wire_bytes;   // Body bytes received over the network
+   unsigned long long body_bytes;   // Body bytes after decompression
+   double first_byte_time;          // Seconds from request start to first byte
+   double transfer_time;            // Seconds from request start to last byte
+   double refresh_time;             // Seconds from request start to loaded alerts
+   double wire_rate;                // Network bytes per second for the transfer
+};
+typedef struct FetchStats FetchStats;
+
+/*
+   configure_fetch(curl, buffer, stats) Configures the curl handle to negotiate
+                                          a compressed transfer and stream the
+                                          decoded body into buffer.
+      PRE:  Valid curl, buffer and stats pointers
+      POST: curl is set up to write into buffer and record headers into stats.
+*/
+void configure_fetch(CURL *curl, FetchBuffer *buffer, FetchStats *stats);
+
+/*
+   collect_fetch_stats(curl, buffer, stats) Records the transfer statistics of
+                                              a completed request in stats.
+      PRE:  Valid pointers, curl has completed a transfer into buffer.
+      POST: stats is updated with the status, sizes and timings of the transfer.
+*/
+void collect_fetch_stats(CURL *curl, const FetchBuffer *buffer, FetchStats *stats);
+
+/*
+   print_fetch_stats(file, stats) Writes a one line summary of stats to file.
+      PRE:  Valid file and stats pointers
+      POST: Summary is written to file.
+*/
+void print_fetch_stats(FILE *file, const FetchStats *stats);
+
+/*
+   free_fetch_buffer(buffer) Frees the memory held by buffer.
+      PRE:  Valid buffer pointer
+      POST: Buffer contents are freed and the buffer is empty.
+*/
+void free_fetch_buffer(FetchBuffer *buffer);
+
+/*
+   fetch_clock() Returns the current monotonic time in seconds.
+      PRE:  true
+      POST: Monotonic time is returned.
+*/
+double fetch_clock(void);
+
+#endif
@@ -0,0 +1,1355 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "history.h"
+
+#include "log.h"
+#include "wire.h"
+#include "snapshot.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#define HISTORY_MAGIC 0x53484c41     // "ALHS"
+#define HISTORY_FORMAT 3             // Version of the wire format alerts
+#define HISTORY_HEADER_SIZE 8        // Of a segment: magic, format
+#define HISTORY_RECORD_HEADER 8      // Of a record: payload length, CRC-32
+#define HISTORY_READ_BUFFER (256 * 1024)
+#define HISTORY_MIN_IDENTIFIERS 1024
+
+// Offset of a record in a segment, every HISTORY_INDEX_INTERVAL records
+struct HistoryMark {
+   time_t recorded;
+   uint32_t offset;
+};
+typedef struct HistoryMark HistoryMark;
+
+struct HistorySegment {
+   unsigned int number;
+   uint32_t size;             // Up to the end of the last valid record
+   time_t first;              // Recorded times of the first and last records
+   time_t last;
+   int record_count;
+
+   HistoryMark *marks;
+   int mark_count;
+   int mark_capacity;
+
+   uint64_t bloom[HISTORY_BLOOM_BITS / 64];     // Geocodes of its alerts
+};
+typedef struct HistorySegment HistorySegment;
+
+struct HistoryVersion {
+   unsigned int segment;      // Number of the segment
+   uint32_t offset;
+   int previous;              // Earlier record of the identifier, -1 if none
+};
+typedef struct HistoryVersion HistoryVersion;
+
+struct HistoryIdentifier {
+   char *identifier;          // NULL for a free slot
+   int latest;                // Last record of the identifier (in versions)
+   uint64_t hash;             // Of the alert in the last record
+   bool removed;              // The last record is a removal
+   Alert *current;            // Retained, the alert last seen (NULL after a restart)
+   unsigned long seen;        // Stamp of the last snapshot it was in
+};
+typedef struct HistoryIdentifier HistoryIdentifier;
+
+// Everything is protected by history_lock
+static pthread_mutex_t history_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool opened = false;
+static bool recording = false;
+static char *directory = NULL;
+static int retention = HISTORY_DEFAULT_RETENTION;
+static int lock_fd = -1;
+static int append_fd = -1;            // The last segment, when recording
+static unsigned int next_number = 1;
+static time_t last_recorded = 0;
+static time_t compacted = 0;
+
+static HistorySegment *segments = NULL;
+static int segment_count = 0;
+static int segment_capacity = 0;
+
+static HistoryVersion *versions = NULL;
+static int version_count = 0;
+static int version_capacity = 0;
+
+static HistoryIdentifier *identifiers = NULL;
+static unsigned long identifier_mask = 0;
+static unsigned long identifier_count = 0;
+
+// Identifiers of the last recorded snapshot (owned by identifiers)
+static const char **live = NULL;
+static int live_count = 0;
+static unsigned long stamp = 0;
+
+static WireBuffer batch = { 0 };
+static unsigned char *record_data = NULL;
+static size_t record_capacity = 0;
+static uint32_t crc_table[256];
+
+static void build_crc_table(void)
+{
+   for (uint32_t x = 0; x < 256; ++x)
+   {
+      uint32_t crc = x;
+
+      for (int bit = 0; bit < 8; ++bit)
+      {
+         crc = crc & 1 ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+      }// End of for (bit)
+
+      crc_table[x] = crc;
+   }// End of for (x)
+}// End of build_crc_table method
+
+static uint32_t crc32(const unsigned char *data, size_t length)
+{
+   uint32_t crc = 0xffffffff;
+
+   for (size_t x = 0; x < length; ++x)
+   {
+      crc = crc_table[(crc ^ data[x]) & 0xff] ^ (crc >> 8);
+   }// End of for
+
+   return crc ^ 0xffffffff;
+}// End of crc32 method
+
+static void put_u32(unsigned char *data, uint32_t value)
+{
+   for (int x = 0; x < 4; ++x) data[x] = (value >> (8 * x)) & 0xff;
+}// End of put_u32 method
+
+static uint32_t get_u32(const unsigned char *data)
+{
+   return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}// End of get_u32 method
+
+/*
+   geocode_bit(geocode, which) Returns one of the two bloom filter bits of
+                               geocode.
+*/
+static unsigned int geocode_bit(int geocode, int which)
+{
+   uint64_t hash = (uint64_t)(uint32_t)geocode * 0x9e3779b97f4a7c15ULL;
+   hash ^= hash >> 29;
+
+   return (which ? hash >> 32 : hash & 0xffffffff) % HISTORY_BLOOM_BITS;
+}// End of geocode_bit method
+
+static bool bloom_contains(const HistorySegment *segment, int geocode)
+{
+   for (int which = 0; which < 2; ++which)
+   {
+      unsigned int bit = geocode_bit(geocode, which);
+      if (!(segment->bloom[bit / 64] & (1ULL << (bit % 64)))) return false;
+   }// End of for
+
+   return true;
+}// End of bloom_contains method
+
+static bool alert_in_geocode(const Alert *alert, int geocode)
+{
+   for (int x = 0; x < alert->area_count; ++x)
+   {
+      const AlertArea *area = alert->areas[x];
+
+      for (int y = 0; area && y < area->geocode_count; ++y)
+      {
+         if (area->geocodes[y] == geocode) return true;
+      }// End of for (y)
+   }// End of for (x)
+
+   return false;
+}// End of alert_in_geocode method
+
+static void segment_path(char *path, size_t size, unsigned int number, const char *extension)
+{
+   snprintf(path, size, "%s/%08u.%s", directory, number, extension);
+}// End of segment_path method
+
+/*
+   find_segment(number) Returns the index of the segment number, or -1.
+*/
+static int find_segment(unsigned int number)
+{
+   int low = 0;
+   int high = segment_count - 1;
+
+   while (low <= high)
+   {
+      int middle = (low + high) / 2;
+
+      if (segments[middle].number == number) return middle;
+      if (segments[middle].number < number) low = middle + 1;
+      else high = middle - 1;
+   }// End of while
+
+   return -1;
+}// End of find_segment method
+
+/*
+   add_segment(number, size) Appends an empty segment to the index.
+      POST: Returns its index, or -1 if memory could not be allocated.
+*/
+static int add_segment(unsigned int number, uint32_t size)
+{
+   if (segment_count == segment_capacity)
+   {
+      int capacity = segment_capacity ? segment_capacity * 2 : 16;
+      HistorySegment *grown = realloc(segments, capacity * sizeof(HistorySegment));
+
+      if (!grown) return -1;
+
+      segments = grown;
+      segment_capacity = capacity;
+   }// End of if
+
+   HistorySegment *segment = &segments[segment_count];
+   memset(segment, 0, sizeof(HistorySegment));
+
+   segment->number = number;
+   segment->size = size;
+   if (number >= next_number) next_number = number + 1;
+
+   return segment_count++;
+}// End of add_segment method
+
+static const char * identifier_key(const void *entry)
+{
+   return ((const HistoryIdentifier *)entry)->identifier;
+}// End of identifier_key method
+
+/*
+   find_identifier(identifier) Returns the slot of identifier, or the free
+                               slot to put it in.
+      PRE:  The table is allocated
+*/
+static HistoryIdentifier * find_identifier(const char *identifier)
+{
+   return find_identifier_slot(identifiers, sizeof(HistoryIdentifier), identifier_mask, identifier, identifier_key);
+}// End of find_identifier method
+
+/*
+   add_identifier(identifier) Returns the slot of identifier, adding it if
+                              it is new.
+      POST: Returns NULL if memory could not be allocated.
+*/
+static HistoryIdentifier * add_identifier(const char *identifier)
+{
+   HistoryIdentifier *entry = identifiers ? find_identifier(identifier) : NULL;
+   if (entry && entry->identifier) return entry;
+
+   // Slots only move when an identifier is added
+   if (!identifiers || (identifier_count + 1) * 2 > identifier_mask + 1)
+   {
+      unsigned long mask = identifier_mask ? identifier_mask * 2 + 1 : HISTORY_MIN_IDENTIFIERS - 1;
+      HistoryIdentifier *table = calloc(mask + 1, sizeof(HistoryIdentifier));
+
+      if (!table) return NULL;
+
+      HistoryIdentifier *old = identifiers;
+      unsigned long old_mask = identifier_mask;
+
+      identifiers = table;
+      identifier_mask = mask;
+
+      for (unsigned long x = 0; old && x <= old_mask; ++x)
+      {
+         if (old[x].identifier) *find_identifier(old[x].identifier) = old[x];
+      }// End of for
+
+      free(old);
+   }// End of if
+
+   entry = find_identifier(identifier);
+   entry->identifier = strdup(identifier);
+   if (!entry->identifier) return NULL;
+
+   entry->latest = -1;
+   ++identifier_count;
+
+   return entry;
+}// End of add_identifier method
+
+/*
+   index_record(segment, offset, kind, recorded, hash, alert) Adds a record
+                                                             to the indexes.
+      POST: Returns false if memory could not be allocated.
+*/
+static bool index_record(int segment, uint32_t offset, HistoryKind kind, time_t recorded, uint64_t hash, const Alert *alert)
+{
+   HistorySegment *entry = &segments[segment];
+   HistoryIdentifier *slot = add_identifier(alert->identifier ? alert->identifier : "");
+
+   if (!slot) return false;
+
+   if (entry->record_count % HISTORY_INDEX_INTERVAL == 0)
+   {
+      if (entry->mark_count == entry->mark_capacity)
+      {
+         int capacity = entry->mark_capacity ? entry->mark_capacity * 2 : 64;
+         HistoryMark *marks = realloc(entry->marks, capacity * sizeof(HistoryMark));
+
+         if (!marks) return false;
+
+         entry->marks = marks;
+         entry->mark_capacity = capacity;
+      }// End of if
+
+      entry->marks[entry->mark_count].recorded = recorded;
+      entry->marks[entry->mark_count].offset = offset;
+      ++entry->mark_count;
+   }// End of if
+
+   if (version_count == version_capacity)
+   {
+      int capacity = version_capacity ? version_capacity * 2 : 4096;
+      HistoryVersion *grown = realloc(versions, capacity * sizeof(HistoryVersion));
+
+      if (!grown) return false;
+
+      versions = grown;
+      version_capacity = capacity;
+   }// End of if
+
+   if (entry->record_count == 0) entry->first = recorded;
+   if (recorded > entry->last) entry->last = recorded;
+   if (recorded > last_recorded) last_recorded = recorded;
+   ++entry->record_count;
+
+   for (int x = 0; x < alert->area_count; ++x)
+   {
+      const AlertArea *area = alert->areas[x];
+
+      for (int y = 0; area && y < area->geocode_count; ++y)
+      {
+         for (int which = 0; which < 2; ++which)
+         {
+            unsigned int bit = geocode_bit(area->geocodes[y], which);
+            entry->bloom[bit / 64] |= 1ULL << (bit % 64);
+         }// End of for (which)
+      }// End of for (y)
+   }// End of for (x)
+
+   versions[version_count].segment = entry->number;
+   versions[version_count].offset = offset;
+   versions[version_count].previous = slot->latest;
+
+   slot->latest = version_count++;
+   slot->hash = hash;
+   slot->removed = kind == HISTORY_REMOVED;
+
+   return true;
+}// End of index_record method
+
+/*
+   RecordHandler is called with every record read by scan_segment, with a
+   reader over the alert. Returning false stops the scan at that record.
+*/
+typedef bool (*RecordHandler)(int segment, uint32_t offset, HistoryKind kind, time_t recorded,
+                              WireReader *alert, void *data);
+
+/*
+   scan_segment(segment, offset, handler, data) Reads the records of a
+                                                segment from offset.
+      PRE:  offset is the start of a record
+      POST: Returns the offset of the record the handler stopped at, or the
+            end of the last valid record. Returns 0 if the segment could not
+            be opened or is not a segment.
+*/
+static uint32_t scan_segment(int segment, uint32_t offset, RecordHandler handler, void *data)
+{
+   char path[PATH_MAX];
+   segment_path(path, sizeof(path), segments[segment].number, "seg");
+
+   FILE *file = fopen(path, "rbe");
+   if (!file) return 0;
+
+   setvbuf(file, NULL, _IOFBF, HISTORY_READ_BUFFER);
+
+   unsigned char header[HISTORY_RECORD_HEADER];
+
+   if (fread(header, 1, HISTORY_HEADER_SIZE, file) != HISTORY_HEADER_SIZE
+       || get_u32(header) != HISTORY_MAGIC || get_u32(header + 4) != HISTORY_FORMAT)
+   {
+      fclose(file);
+      return 0;
+   }// End of if
+
+   if (offset > HISTORY_HEADER_SIZE && fseek(file, offset, SEEK_SET) != 0)
+   {
+      fclose(file);
+      return 0;
+   }// End of if
+
+   if (offset < HISTORY_HEADER_SIZE) offset = HISTORY_HEADER_SIZE;
+
+   while (fread(header, 1, HISTORY_RECORD_HEADER, file) == HISTORY_RECORD_HEADER)
+   {
+      uint32_t length = get_u32(header);
+      if (length == 0 || length > HISTORY_MAX_RECORD) break;
+
+      if (length > record_capacity)
+      {
+         unsigned char *data = realloc(record_data, length);
+         if (!data) break;
+
+         record_data = data;
+         record_capacity = length;
+      }// End of if
+
+      if (fread(record_data, 1, length, file) != length) break;
+      if (crc32(record_data, length) != get_u32(header + 4)) break;
+
+      WireReader reader = { record_data, length, 0, false };
+      uint64_t kind = get_wire_varint(&reader);
+      time_t recorded = get_wire_varint(&reader);
+
+      if (reader.failed || (kind != HISTORY_VERSION && kind != HISTORY_REMOVED)) break;
+
+      WireReader alert = { record_data + reader.offset, length - reader.offset, 0, false };
+      if (!handler(segment, offset, kind, recorded, &alert, data)) break;
+
+      offset += HISTORY_RECORD_HEADER + length;
+   }// End of while
+
+   fclose(file);
+   return offset;
+}// End of scan_segment method
+
+static bool index_handler(int segment, uint32_t offset, HistoryKind kind, time_t recorded,
+                          WireReader *reader, void *data)
+{
+   bool *failed = data;
+   uint64_t hash = hash_bytes(HASH_SEED, reader->data, reader->length);
+   Alert *alert = get_wire_alert(reader);
+
+   // A record that cannot be decoded is treated as corrupt
+   if (!alert) return false;
+
+   *failed = !index_record(segment, offset, kind, recorded, hash, alert);
+   free_alert(alert);
+
+   return !*failed;
+}// End of index_handler method
+
+static int compare_numbers(const void *a, const void *b)
+{
+   unsigned int x = *(const unsigned int *)a;
+   unsigned int y = *(const unsigned int *)b;
+
+   return x < y ? -1 : x > y;
+}// End of compare_numbers method
+
+/*
+   index_directory() Indexes the segments in the history directory.
+      POST: Returns false if the directory could not be read or memory could
+            not be allocated. When recording, the torn tail of the last
+            segment is cut off.
+*/
+static bool index_directory(void)
+{
+   zlog_debug(alog, "Entering");
+
+   DIR *dir = opendir(directory);
+   if (!dir) return false;
+
+   unsigned int *numbers = NULL;
+   int count = 0;
+   int capacity = 0;
+   struct dirent *entry = NULL;
+
+   while ((entry = readdir(dir)))
+   {
+      unsigned int number = 0;
+      int length = 0;
+
+      if (sscanf(entry->d_name, "%8u.seg%n", &number, &length) != 1 || length != 12 || entry->d_name[12]) continue;
+
+      if (count == capacity)
+      {
+         capacity = capacity ? capacity * 2 : 64;
+         unsigned int *grown = realloc(numbers, capacity * sizeof(unsigned int));
+
+         if (!grown)
+         {
+            free(numbers);
+            closedir(dir);
+            return false;
+         }// End of if
+
+         numbers = grown;
+      }// End of if
+
+      numbers[count++] = number;
+   }// End of while
+
+   closedir(dir);
+   qsort(numbers, count, sizeof(unsigned int), compare_numbers);
+
+   bool failed = false;
+
+   for (int x = 0; x < count && !failed; ++x)
+   {
+      int segment = add_segment(numbers[x], 0);
+
+      if (segment < 0)
+      {
+         failed = true;
+         break;
+      }// End of if
+
+      char path[PATH_MAX];
+      struct stat info;
+
+      segment_path(path, sizeof(path), numbers[x], "seg");
+      uint32_t end = scan_segment(segment, HISTORY_HEADER_SIZE, index_handler, &failed);
+
+      if (end == 0 || stat(path, &info) != 0)
+      {
+         zlog_warn(alog, "Ignoring history segment %s, it is not a segment", path);
+         --segment_count;
+         continue;
+      }// End of if
+
+      segments[segment].size = end;
+
+      if (end == info.st_size || failed) continue;
+
+      // The last segment may end with a record that was being written
+      if (recording && x == count - 1)
+      {
+         zlog_warn(alog, "Cutting %s at %u, its last record is incomplete", path, end);
+         if (truncate(path, end) != 0) failed = true;
+      }// End of if
+      else
+      {
+         zlog_warn(alog, "Ignoring %s after %u, a record is corrupt", path, end);
+      }// End of else
+   }// End of for
+
+   free(numbers);
+
+   zlog_info(alog, "Indexed %d history segments, %d records of %lu alerts", segment_count, version_count, identifier_count);
+   zlog_debug(alog, "Exiting");
+   return !failed;
+}// End of index_directory method
+
+static void free_indexes(void)
+{
+   for (int x = 0; x < segment_count; ++x) free(segments[x].marks);
+
+   for (unsigned long x = 0; identifiers && x <= identifier_mask; ++x)
+   {
+      free(identifiers[x].identifier);
+      if (identifiers[x].current) free_alert(identifiers[x].current);
+   }// End of for
+
+   free(segments);
+   free(versions);
+   free(identifiers);
+   free(live);
+
+   segments = NULL;
+   versions = NULL;
+   identifiers = NULL;
+   live = NULL;
+   segment_count = segment_capacity = 0;
+   version_count = version_capacity = 0;
+   identifier_mask = identifier_count = 0;
+   live_count = 0;
+}// End of free_indexes method
+
+/*
+   start_segment() Creates the next segment and appends to it.
+      POST: Returns false if it could not be created.
+*/
+static bool start_segment(void)
+{
+   char path[PATH_MAX];
+   unsigned char header[HISTORY_HEADER_SIZE];
+
+   segment_path(path, sizeof(path), next_number, "seg");
+   put_u32(header, HISTORY_MAGIC);
+   put_u32(header + 4, HISTORY_FORMAT);
+
+   int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0644);
+
+   if (fd < 0 || write(fd, header, sizeof(header)) != sizeof(header) || add_segment(next_number, sizeof(header)) < 0)
+   {
+      zlog_warn(alog, "Failed to create the history segment %s", path);
+      if (fd >= 0) close(fd);
+      unlink(path);
+      return false;
+   }// End of if
+
+   if (append_fd >= 0) close(append_fd);
+   append_fd = fd;
+
+   zlog_info(alog, "Started history segment %s", path);
+   return true;
+}// End of start_segment method
+
+/*
+   copy_records(fd, number, from, to) Appends bytes from to to of the
+                                      segment number to fd.
+*/
+static bool copy_records(int fd, unsigned int number, uint32_t from, uint32_t to)
+{
+   char path[PATH_MAX];
+   segment_path(path, sizeof(path), number, "seg");
+
+   int source = open(path, O_RDONLY | O_CLOEXEC);
+   if (source < 0) return false;
+
+   static unsigned char buffer[HISTORY_READ_BUFFER];
+   bool copied = lseek(source, from, SEEK_SET) == from;
+
+   while (copied && from < to)
+   {
+      size_t wanted = to - from < sizeof(buffer) ? to - from : sizeof(buffer);
+      ssize_t bytes = read(source, buffer, wanted);
+
+      if (bytes <= 0 || write(fd, buffer, bytes) != bytes) copied = false;
+      else from += bytes;
+   }// End of while
+
+   close(source);
+   return copied;
+}// End of copy_records method
+
+struct CompactedPart {
+   unsigned int number;
+   uint32_t from;             // The records kept
+   uint32_t to;
+};
+typedef struct CompactedPart CompactedPart;
+
+/*
+   write_compacted(parts, count) Writes the records of parts, in order, into
+                                 the segment of the last part and removes
+                                 the others.
+      POST: Returns false if it could not be written (nothing is changed).
+*/
+static bool write_compacted(const CompactedPart *parts, int count)
+{
+   char path[PATH_MAX];
+   char temporary[PATH_MAX];
+   unsigned char header[HISTORY_HEADER_SIZE];
+
+   segment_path(path, sizeof(path), parts[count - 1].number, "seg");
+   segment_path(temporary, sizeof(temporary), parts[count - 1].number, "tmp");
+   put_u32(header, HISTORY_MAGIC);
+   put_u32(header + 4, HISTORY_FORMAT);
+
+   int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   bool written = fd >= 0 && write(fd, header, sizeof(header)) == sizeof(header);
+
+   for (int x = 0; x < count && written; ++x)
+   {
+      written = copy_records(fd, parts[x].number, parts[x].from, parts[x].to);
+   }// End of for
+
+   // The merged segment replaces the last part atomically, if the others
+   // are not removed (a crash) their records are listed twice
+   written = written && fsync(fd) == 0;
+   if (fd >= 0) close(fd);
+
+   if (!written || rename(temporary, path) != 0)
+   {
+      zlog_warn(alog, "Failed to compact the history into %s", path);
+      unlink(temporary);
+      return false;
+   }// End of if
+
+   for (int x = 0; x < count - 1; ++x)
+   {
+      segment_path(path, sizeof(path), parts[x].number, "seg");
+      unlink(path);
+   }// End of for
+
+   return true;
+}// End of write_compacted method
+
+static bool cutoff_handler(int segment, uint32_t offset, HistoryKind kind, time_t recorded,
+                           WireReader *reader, void *data)
+{
+   (void)segment; (void)offset; (void)kind; (void)reader;
+
+   return recorded < *(time_t *)data;
+}// End of cutoff_handler method
+
+/*
+   first_mark(segment, from) Returns the offset to read segment from to find
+                             the records recorded at or after from.
+*/
+static uint32_t first_mark(const HistorySegment *segment, time_t from)
+{
+   uint32_t offset = HISTORY_HEADER_SIZE;
+
+   for (int x = 0; x < segment->mark_count && segment->marks[x].recorded < from; ++x)
+   {
+      offset = segment->marks[x].offset;
+   }// End of for
+
+   return offset;
+}// End of first_mark method
+
+/*
+   compact_history(sealed, now) Drops the records older than the retention
+                                and merges small segments, among the first
+                                sealed segments, then indexes the history
+                                again if anything changed.
+      POST: Returns false if the history could not be indexed again.
+*/
+static bool compact_history(int sealed, time_t now)
+{
+   zlog_debug(alog, "Entering");
+
+   time_t cutoff = now - (time_t)retention * 24 * 60 * 60;
+   CompactedPart *parts = calloc(sealed > 0 ? sealed : 1, sizeof(CompactedPart));
+   int part_count = 0;
+   uint32_t part_size = 0;
+   bool changed = false;
+
+   if (!parts) return true;
+
+   compacted = now;
+
+   for (int x = 0; x <= sealed; ++x)
+   {
+      CompactedPart part = { 0, 0, 0 };
+
+      if (x < sealed)
+      {
+         HistorySegment *segment = &segments[x];
+         char path[PATH_MAX];
+
+         part.number = segment->number;
+         part.from = HISTORY_HEADER_SIZE;
+         part.to = segment->size;
+
+         if (segment->record_count == 0 || segment->last < cutoff)
+         {
+            segment_path(path, sizeof(path), segment->number, "seg");
+            zlog_info(alog, "Removing history segment %s", path);
+            unlink(path);
+            changed = true;
+            continue;
+         }// End of if
+
+         if (segment->first < cutoff)
+         {
+            part.from = scan_segment(x, first_mark(segment, cutoff), cutoff_handler, &cutoff);
+            if (part.from == 0) part.from = HISTORY_HEADER_SIZE;
+         }// End of if
+
+         // Small segments are merged with the next ones
+         if (part_count > 0 && part_size < HISTORY_SEGMENT_SIZE / 2
+             && part_size + (part.to - part.from) <= HISTORY_SEGMENT_SIZE)
+         {
+            parts[part_count++] = part;
+            part_size += part.to - part.from;
+            continue;
+         }// End of if
+      }// End of if
+
+      // Write the parts collected so far if they are not a segment as it is
+      if (part_count > 1 || (part_count == 1 && parts[0].from != HISTORY_HEADER_SIZE))
+      {
+         if (write_compacted(parts, part_count)) changed = true;
+      }// End of if
+
+      parts[0] = part;
+      part_count = 1;
+      part_size = HISTORY_HEADER_SIZE + (part.to - part.from);
+   }// End of for
+
+   free(parts);
+
+   if (!changed) return true;
+
+   // Index the history again, keeping what is known of the alerts seen
+   HistoryIdentifier *old = identifiers;
+   unsigned long old_mask = identifier_mask;
+   const char **old_live = live;
+   int old_live_count = live_count;
+
+   for (int x = 0; x < segment_count; ++x) free(segments[x].marks);
+   free(segments);
+   free(versions);
+
+   segments = NULL;
+   versions = NULL;
+   identifiers = NULL;
+   live = NULL;
+   segment_count = segment_capacity = 0;
+   version_count = version_capacity = 0;
+   identifier_mask = identifier_count = live_count = 0;
+
+   bool indexed = index_directory();
+   live = calloc(old_live_count > 0 ? old_live_count : 1, sizeof(char *));
+
+   for (unsigned long x = 0; old && x <= old_mask; ++x)
+   {
+      HistoryIdentifier *slot = identifiers && old[x].identifier ? find_identifier(old[x].identifier) : NULL;
+
+      if (slot && slot->identifier)
+      {
+         slot->current = old[x].current;
+         slot->seen = old[x].seen;
+      }// End of if
+      else if (old[x].current)
+      {
+         free_alert(old[x].current);
+      }// End of else if
+   }// End of for
+
+   for (int x = 0; live && identifiers && x < old_live_count; ++x)
+   {
+      HistoryIdentifier *slot = find_identifier(old_live[x]);
+      if (slot->identifier) live[live_count++] = slot->identifier;
+   }// End of for
+
+   for (unsigned long x = 0; old && x <= old_mask; ++x) free(old[x].identifier);
+   free(old);
+   free(old_live);
+
+   zlog_debug(alog, "Exiting");
+   return indexed && live;
+}// End of compact_history method
+
+/*
+   append_record(kind, recorded, alert, hash) Appends a record to the batch.
+      POST: Returns the offset of the record in the batch. hash is set to
+            the hash of the alert.
+*/
+static size_t append_record(HistoryKind kind, time_t recorded, const Alert *alert, uint64_t *hash)
+{
+   size_t start = batch.length;
+
+   put_wire_bytes(&batch, NULL, HISTORY_RECORD_HEADER);
+   put_wire_varint(&batch, kind);
+   put_wire_varint(&batch, recorded);
+
+   size_t contents = batch.length;
+   put_wire_alert(&batch, alert);
+
+   if (batch.failed) return start;
+
+   unsigned char *record = batch.data + start;
+   size_t length = batch.length - start - HISTORY_RECORD_HEADER;
+
+   *hash = hash_bytes(HASH_SEED, batch.data + contents, batch.length - contents);
+   put_u32(record, length);
+   put_u32(record + 4, crc32(record + HISTORY_RECORD_HEADER, length));
+
+   return start;
+}// End of append_record method
+
+static bool alert_handler(int segment, uint32_t offset, HistoryKind kind, time_t recorded,
+                          WireReader *reader, void *data)
+{
+   (void)segment; (void)offset; (void)kind; (void)recorded;
+
+   *(Alert **)data = get_wire_alert(reader);
+   return false;
+}// End of alert_handler method
+
+/*
+   read_alert(version) Returns the alert of a record (NULL if it could not
+                       be read).
+*/
+static Alert * read_alert(const HistoryVersion *version)
+{
+   Alert *alert = NULL;
+   int segment = find_segment(version->segment);
+
+   if (segment >= 0) scan_segment(segment, version->offset, alert_handler, &alert);
+
+   return alert;
+}// End of read_alert method
+
+/*
+   record_snapshot(alerts, data) Appends the alerts that are new or changed
+                                 and the ones that are gone since the last
+                                 snapshot.
+      PRE:  Called by publish_snapshot
+*/
+static void record_snapshot(const Alerts *alerts, void *data)
+{
+   zlog_debug(alog, "Entering");
+
+   (void)data;
+
+   pthread_mutex_lock(&history_lock);
+
+   if (!recording)
+   {
+      pthread_mutex_unlock(&history_lock);
+      return;
+   }// End of if
+
+   // Recorded times never go back, so segments stay in time order
+   time_t now = time(NULL);
+   if (now < last_recorded) now = last_recorded;
+
+   if (segments[segment_count - 1].size >= HISTORY_SEGMENT_SIZE)
+   {
+      bool indexed = true;
+
+      if (now - compacted >= HISTORY_COMPACT_INTERVAL) indexed = compact_history(segment_count, now);
+
+      if (!indexed || !start_segment())
+      {
+         zlog_warn(alog, "Stopped recording the history");
+         recording = false;
+         pthread_mutex_unlock(&history_lock);
+         return;
+      }// End of if
+   }// End of if
+
+   const char **seen = calloc(alerts->count > 0 ? alerts->count : 1, sizeof(char *));
+   int seen_count = 0;
+   int segment = segment_count - 1;
+   uint32_t base = segments[segment].size;
+   int changes = 0;
+
+   if (!seen)
+   {
+      zlog_warn(alog, "Failed to allocate memory for the history");
+      pthread_mutex_unlock(&history_lock);
+      return;
+   }// End of if
+
+   batch.length = 0;
+   ++stamp;
+
+   for (int x = 0; x < alerts->count && !batch.failed; ++x)
+   {
+      Alert *alert = alerts->alerts[x];
+      HistoryIdentifier *slot = add_identifier(alert->identifier ? alert->identifier : "");
+
+      if (!slot || slot->seen == stamp) continue;        // Listed twice
+
+      slot->seen = stamp;
+      seen[seen_count++] = slot->identifier;
+
+      // Alerts are immutable, the same object has not changed. A full
+      // document gives every alert a new object, which is compared with the
+      // last one before anything is written.
+      if (slot->current == alert) continue;
+
+      if (slot->current && same_alert(slot->current, alert))
+      {
+         free_alert(slot->current);
+         slot->current = retain_alert(alert);
+         continue;
+      }// End of if
+
+      uint64_t hash = 0;
+      size_t start = append_record(HISTORY_VERSION, now, alert, &hash);
+
+      if (batch.failed) break;
+
+      if (!slot->removed && slot->latest >= 0 && slot->hash == hash)
+      {
+         batch.length = start;
+      }// End of if
+      else if (index_record(segment, base + start, HISTORY_VERSION, now, hash, alert))
+      {
+         ++changes;
+      }// End of else if
+
+      if (slot->current) free_alert(slot->current);
+      slot->current = retain_alert(alert);
+   }// End of for (x)
+
+   // The alerts of the last snapshot that are not in this one are gone
+   for (int x = 0; x < live_count && !batch.failed; ++x)
+   {
+      HistoryIdentifier *slot = find_identifier(live[x]);
+      if (!slot->identifier || slot->seen == stamp || slot->removed) continue;
+
+      Alert *last = slot->current ? retain_alert(slot->current) : read_alert(&versions[slot->latest]);
+      Alert stub = { 1, slot->identifier };
+      uint64_t hash = 0;
+      size_t start = append_record(HISTORY_REMOVED, now, last ? last : &stub, &hash);
+
+      if (!batch.failed && index_record(segment, base + start, HISTORY_REMOVED, now, hash, last ? last : &stub))
+      {
+         ++changes;
+      }// End of if
+
+      if (last) free_alert(last);
+      if (slot->current) free_alert(slot->current);
+      slot->current = NULL;
+   }// End of for (x)
+
+   free(live);
+   live = seen;
+   live_count = seen_count;
+
+   // One write per snapshot, a crash can only leave a torn last record
+   size_t written = 0;
+
+   while (!batch.failed && written < batch.length)
+   {
+      ssize_t bytes = write(append_fd, batch.data + written, batch.length - written);
+
+      if (bytes < 0 && errno == EINTR) continue;
+      if (bytes <= 0) break;
+
+      written += bytes;
+   }// End of while
+
+   if (written < batch.length || batch.failed)
+   {
+      zlog_warn(alog, "Failed to write the history, stopped recording");
+
+      if (ftruncate(append_fd, base) != 0) zlog_warn(alog, "Failed to cut the history segment");
+      recording = false;
+   }// End of if
+   else
+   {
+      segments[segment].size += batch.length;
+   }// End of else
+
+   pthread_mutex_unlock(&history_lock);
+
+   zlog_info(alog, "Recorded %d history changes for generation %lu", changes, alerts->generation);
+   zlog_debug(alog, "Exiting");
+}// End of record_snapshot method
+
+// IMPLEMENTATION: See header for details
+bool open_history(const char *path, int retention_days, bool record)
+{
+   zlog_debug(alog, "Entering");
+
+   pthread_mutex_lock(&history_lock);
+
+   if (opened || retention_days <= 0)
+   {
+      pthread_mutex_unlock(&history_lock);
+      return false;
+   }// End of if
+
+   build_crc_table();
+
+   directory = strdup(path);
+   retention = retention_days;
+   recording = record;
+   next_number = 1;
+   last_recorded = 0;
+
+   bool ready = directory && (mkdir(path, 0755) == 0 || errno == EEXIST);
+
+   // Only one process records into a history
+   if (ready && record)
+   {
+      char lock_path[PATH_MAX];
+      snprintf(lock_path, sizeof(lock_path), "%s/lock", path);
+
+      lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+      ready = lock_fd >= 0 && flock(lock_fd, LOCK_EX | LOCK_NB) == 0;
+
+      if (!ready) zlog_warn(alog, "The history in %s is recorded by another process", path);
+   }// End of if
+
+   ready = ready && index_directory();
+
+   if (ready && record)
+   {
+      // Records older than the retention are dropped now and then as the
+      // history grows, the last segment is appended to while it is small
+      int sealed = segment_count;
+      if (segment_count > 0 && segments[segment_count - 1].size < HISTORY_SEGMENT_SIZE) --sealed;
+
+      ready = compact_history(sealed, time(NULL));
+
+      if (ready && segment_count > 0 && segments[segment_count - 1].size < HISTORY_SEGMENT_SIZE)
+      {
+         char segment[PATH_MAX];
+         segment_path(segment, sizeof(segment), segments[segment_count - 1].number, "seg");
+
+         append_fd = open(segment, O_WRONLY | O_APPEND | O_CLOEXEC);
+         ready = append_fd >= 0;
+      }// End of if
+      else if (ready)
+      {
+         ready = start_segment();
+      }// End of else if
+
+      // After a restart, the alerts that are not gone are compared with the
+      // first snapshot
+      free(live);
+      live_count = 0;
+      live = calloc(identifier_count > 0 ? identifier_count : 1, sizeof(char *));
+      ready = ready && live;
+
+      for (unsigned long x = 0; ready && identifiers && x <= identifier_mask; ++x)
+      {
+         if (identifiers[x].identifier && !identifiers[x].removed) live[live_count++] = identifiers[x].identifier;
+      }// End of for
+   }// End of if
+
+   if (ready && record && !add_snapshot_listener(record_snapshot, NULL)) ready = false;
+
+   if (!ready)
+   {
+      zlog_warn(alog, "Failed to open the history in %s", path);
+
+      free_indexes();
+      free(directory);
+      directory = NULL;
+      recording = false;
+
+      if (append_fd >= 0) close(append_fd);
+      if (lock_fd >= 0) close(lock_fd);
+      append_fd = lock_fd = -1;
+
+      pthread_mutex_unlock(&history_lock);
+      return false;
+   }// End of if
+
+   opened = true;
+   pthread_mutex_unlock(&history_lock);
+
+   zlog_debug(alog, "Exiting");
+   return true;
+}// End of open_history method
+
+/*
+   parse_time(str, time) Parses a local time, YYYY-MM-DD[THH:MM[:SS]].
+*/
+static bool parse_time(const char *str, time_t *time)
+{
+   static const char *formats[] = { "%Y-%m-%dT%H:%M:%S", "%Y-%m-%dT%H:%M", "%Y-%m-%d" };
+
+   for (size_t x = 0; x < sizeof(formats) / sizeof(formats[0]); ++x)
+   {
+      struct tm tm;
+      memset(&tm, 0, sizeof(tm));
+
+      const char *end = strptime(str, formats[x], &tm);
+      if (!end || *end) continue;
+
+      tm.tm_isdst = -1;
+      *time = mktime(&tm);
+      return *time != -1;
+   }// End of for
+
+   return false;
+}// End of parse_time method
+
+// IMPLEMENTATION: See header for details
+bool parse_history_query(char *spec, HistoryQuery *query)
+{
+   memset(query, 0, sizeof(HistoryQuery));
+
+   for (char *saved = NULL, *term = strtok_r(spec, ",", &saved); term; term = strtok_r(NULL, ",", &saved))
+   {
+      char *value = strchr(term, '=');
+      if (!value || !value[1]) return false;
+
+      *value++ = '\0';
+
+      if (strcmp(term, "from") == 0)
+      {
+         if (!parse_time(value, &query->from)) return false;
+      }// End of if
+      else if (strcmp(term, "to") == 0)
+      {
+         if (!parse_time(value, &query->to)) return false;
+      }// End of else if
+      else if (strcmp(term, "identifier") == 0)
+      {
+         query->identifier = value;
+      }// End of else if
+      else if (strcmp(term, "geocode") == 0)
+      {
+         char *end = NULL;
+
+         query->by_geocode = true;
+         query->geocode = strtol(value, &end, 10);
+         if (*end) return false;
+      }// End of else if
+      else
+      {
+         return false;
+      }// End of else
+   }// End of for
+
+   return true;
+}// End of parse_history_query method
+
+struct QueryState {
+   const HistoryQuery *query;
+   HistoryVisitor visitor;
+   void *data;
+   long matched;
+   bool single;               // Only the record at the offset is read
+   bool stopped;
+   bool failed;
+};
+typedef struct QueryState QueryState;
+
+static bool query_handler(int segment, uint32_t offset, HistoryKind kind, time_t recorded,
+                          WireReader *reader, void *data)
+{
+   (void)segment; (void)offset;
+
+   QueryState *state = data;
+   const HistoryQuery *query = state->query;
+
+   // Time only goes forward, nothing after the range is read
+   if (query->to && recorded >= query->to) return false;
+   if (recorded < query->from) return true;
+
+   Alert *alert = get_wire_alert(reader);
+
+   if (!alert)
+   {
+      state->failed = true;
+      return false;
+   }// End of if
+
+   bool matches = !query->by_geocode || alert_in_geocode(alert, query->geocode);
+
+   if (matches && query->identifier)
+   {
+      matches = strcmp(alert->identifier ? alert->identifier : "", query->identifier) == 0;
+   }// End of if
+
+   if (matches)
+   {
+      HistoryRecord record = { kind, recorded, alert };
+
+      ++state->matched;
+      state->stopped = !state->visitor(&record, state->data);
+   }// End of if
+
+   free_alert(alert);
+   return !state->stopped && !state->single;
+}// End of query_handler method
+
+// IMPLEMENTATION: See header for details
+long query_history(const HistoryQuery *query, HistoryVisitor visitor, void *data)
+{
+   zlog_debug(alog, "Entering");
+
+   QueryState state = { query, visitor, data, 0, query->identifier != NULL, false, false };
+
+   pthread_mutex_lock(&history_lock);
+
+   if (!opened)
+   {
+      pthread_mutex_unlock(&history_lock);
+      return -1;
+   }// End of if
+
+   if (query->identifier)
+   {
+      // Only the records of the identifier are read, oldest first
+      HistoryIdentifier *slot = identifiers ? find_identifier(query->identifier) : NULL;
+      int count = 0;
+
+      for (int x = slot && slot->identifier ? slot->latest : -1; x >= 0; x = versions[x].previous) ++count;
+
+      int *chain = calloc(count > 0 ? count : 1, sizeof(int));
+      state.failed = !chain;
+
+      for (int x = slot && chain && slot->identifier ? slot->latest : -1, y = count; x >= 0; x = versions[x].previous)
+      {
+         chain[--y] = x;
+      }// End of for
+
+      for (int x = 0; chain && x < count && !state.stopped && !state.failed; ++x)
+      {
+         int segment = find_segment(versions[chain[x]].segment);
+         if (segment >= 0) scan_segment(segment, versions[chain[x]].offset, query_handler, &state);
+      }// End of for
+
+      free(chain);
+   }// End of if
+   else
+   {
+      // Only the segments (and the part of them) that may hold matches are read
+      for (int x = 0; x < segment_count && !state.stopped && !state.failed; ++x)
+      {
+         const HistorySegment *segment = &segments[x];
+
+         if (segment->record_count == 0 || segment->last < query->from) continue;
+         if (query->to && segment->first >= query->to) break;
+         if (query->by_geocode && !bloom_contains(segment, query->geocode)) continue;
+
+         scan_segment(x, first_mark(segment, query->from), query_handler, &state);
+      }// End of for
+   }// End of else
+
+   pthread_mutex_unlock(&history_lock);
+
+   zlog_debug(alog, "Exiting");
+   return state.failed ? -1 : state.matched;
+}// End of query_history method
+
+// IMPLEMENTATION: See header for details
+void close_history(void)
+{
+   remove_snapshot_listener(record_snapshot, NULL);
+
+   pthread_mutex_lock(&history_lock);
+
+   if (opened)
+   {
+      free_indexes();
+      free_wire_buffer(&batch);
+      free(record_data);
+      free(directory);
+
+      if (append_fd >= 0) close(append_fd);
+      if (lock_fd >= 0) close(lock_fd);
+
+      record_data = NULL;
+      record_capacity = 0;
+      directory = NULL;
+      append_fd = lock_fd = -1;
+      opened = recording = false;
+   }// End of if
+
+   pthread_mutex_unlock(&history_lock);
+}// End of close_history method
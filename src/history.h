@@ -0,0 +1,132 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef _HISTORY
+#define _HISTORY
+
+#include <stdbool.h>
+#include <time.h>
+
+#include "alerts.h"
+
+/*
+   The history keeps every version of every alert seen, so that alerts can
+   be looked up after they left the feed. It is a directory of append-only
+   segment files (NNNNNNNN.seg). Each published snapshot appends one record
+   per alert that is new or changed and one per alert that is gone, so a
+   refresh costs as much as its changes (an alert that did not change is
+   compared with its last version, not written). A record is a 4 byte little endian
+   payload length, the CRC-32 of the payload and the payload: the kind, the
+   time it was recorded and the alert in the wire format (as it was last
+   seen for a removal).
+
+   A segment is sealed once it reaches HISTORY_SEGMENT_SIZE and a new one is
+   started. Nothing is read back to append, the indexes are kept in memory
+   and rebuilt from the segments when the history is opened:
+
+      - per segment, the range of recorded times, a sparse index of the
+        offset of every HISTORY_INDEX_INTERVAL-th record and a bloom filter
+        of the geocodes of its alerts
+      - a hash table of identifiers, each with the chain of its versions
+
+   so a query by time or geocode only reads the segments (and the part of
+   them) that may hold matches, and one by identifier reads its records.
+   Records that fail their checksum end a segment, the torn tail of the
+   last one is cut off when recording. At most once per
+   HISTORY_COMPACT_INTERVAL, sealing a segment compacts the history: the
+   records older than the retention are dropped and sealed segments smaller
+   than half of HISTORY_SEGMENT_SIZE are merged with the next one.
+*/
+
+#define HISTORY_SEGMENT_SIZE (8 * 1024 * 1024)
+#define HISTORY_INDEX_INTERVAL 64
+#define HISTORY_BLOOM_BITS 8192
+#define HISTORY_COMPACT_INTERVAL (24 * 60 * 60)    // Seconds
+#define HISTORY_DEFAULT_RETENTION 365              // Days
+#define HISTORY_MAX_RECORD (16 * 1024 * 1024)
+
+enum HistoryKind {
+   HISTORY_VERSION = 1,       // The alert appeared or changed
+   HISTORY_REMOVED = 2        // The alert left the feed
+};
+typedef enum HistoryKind HistoryKind;
+
+struct HistoryRecord {
+   HistoryKind kind;
+   time_t recorded;
+   const Alert *alert;        // As last seen for HISTORY_REMOVED
+};
+typedef struct HistoryRecord HistoryRecord;
+
+struct HistoryQuery {
+   time_t from;               // Recorded at or after (0 for no bound)
+   time_t to;                 // Recorded before (0 for no bound)
+   const char *identifier;    // NULL for every alert
+   bool by_geocode;
+   int geocode;               // Only alerts with an area in geocode (and their removals)
+};
+typedef struct HistoryQuery HistoryQuery;
+
+/*
+   HistoryVisitor is called with every record that matches a query, in the
+   order they were recorded. Returning false ends the query.
+*/
+typedef bool (*HistoryVisitor)(const HistoryRecord *record, void *data);
+
+/*
+   open_history(directory, retention_days, record) Opens the history in
+                                                   directory and indexes it.
+      PRE:  Valid directory, no history is open.
+      POST: Returns false if the directory could not be created or read, or
+            (when recording) another process records into it. If record,
+            every published snapshot is recorded until close_history and
+            records older than retention_days are compacted away.
+*/
+bool open_history(const char *directory, int retention_days, bool record);
+
+/*
+   parse_history_query(spec, query) Fills query from spec, comma separated
+                                    from=TIME, to=TIME, identifier=ID and
+                                    geocode=CODE (TIME is local,
+                                    YYYY-MM-DD[THH:MM[:SS]]).
+      POST: Returns false if spec is malformed. The identifier points into
+            spec.
+*/
+bool parse_history_query(char *spec, HistoryQuery *query);
+
+/*
+   query_history(query, visitor, data) Calls visitor with every record that
+                                       matches query.
+      PRE:  The history is open, valid pointers.
+      POST: Returns the number of matching records, or -1 if the history is
+            not open or memory could not be allocated.
+*/
+long query_history(const HistoryQuery *query, HistoryVisitor visitor, void *data);
+
+/*
+   close_history() Stops recording and frees the indexes.
+*/
+void close_history(void);
+
+#endif
@@ -0,0 +1,740 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "hooks.h"
+
+#include "log.h"
+#include "fetch.h"
+#include "output.h"
+#include "snapshot.h"
+#include "metrics.h"
+#include "trace.h"
+#include "match.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define HOOK_POLL_INTERVAL 100       // Milliseconds between checks for stop_hooks
+
+extern char **environ;
+
+enum HookType {
+   HOOK_EXEC,
+   HOOK_SOCKET
+};
+typedef enum HookType HookType;
+
+struct HookEvent {
+   Alert *alert;              // Retained
+   const char *event;         // "add" or "update"
+};
+typedef struct HookEvent HookEvent;
+
+struct Hook {
+   HookType type;
+   char *target;              // Command or socket path
+
+   int word_count;
+   char **words;
+   int subscription;          // In matcher, of its geocode: and event: terms
+
+   // Protected by hooks_lock
+   HookEvent *pending;        // HOOK_MAX_PENDING events
+   int pending_count;
+   double due;                // When the pending events are sent
+   bool running;
+   unsigned long dropped;
+};
+typedef struct Hook Hook;
+
+static Hook hooks[HOOK_MAX];
+static int hook_count = 0;
+
+// Alerts are matched to hooks by geocode and event type, publisher only
+static Matcher *matcher = NULL;
+static MatchResult matched;
+static Hook *subscribers[HOOK_MAX];    // Hook of each subscription
+
+static pthread_t workers[HOOK_WORKERS];
+static int worker_count = 0;
+static pthread_mutex_t hooks_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t hooks_wakeup;
+static bool stopping = false;
+
+// Alerts of the previous snapshot by identifier (retained), publisher only
+static Alert **previous = NULL;
+static unsigned long previous_mask = 0;
+
+/*
+   subscribe_hook(hook) Takes the geocode:CODE and event:TYPE terms out of
+                        the words of hook and subscribes it to them.
+      POST: Returns false if a term is malformed or the subscription could
+            not be added. The words left are searched for in the alerts.
+*/
+static bool subscribe_hook(Hook *hook)
+{
+   if (!matcher && !(matcher = create_matcher())) return false;
+
+   int *geocodes = malloc((hook->word_count + 1) * sizeof(int));
+   char **events = malloc((hook->word_count + 1) * sizeof(char *));
+   int geocode_count = 0, event_count = 0, word_count = 0;
+   bool valid = geocodes && events;
+
+   for (int x = 0; geocodes && events && x < hook->word_count; ++x)
+   {
+      char *word = hook->words[x];
+
+      if (strncasecmp(word, "geocode:", 8) == 0)
+      {
+         char *end;
+         geocodes[geocode_count++] = strtol(word + 8, &end, 10);
+
+         valid = valid && word[8] >= '0' && word[8] <= '9' && !*end;
+         free(word);
+      }// End of if
+      else if (strncasecmp(word, "event:", 6) == 0)
+      {
+         valid = valid && word[6];
+         memmove(word, word + 6, strlen(word + 6) + 1);
+         events[event_count++] = word;
+      }// End of else if
+      else
+      {
+         hook->words[word_count++] = word;
+      }// End of else
+   }// End of for
+
+   if (!geocodes || !events) word_count = hook->word_count;
+
+   hook->subscription = valid ? add_subscription(matcher, geocodes, geocode_count, (const char * const *)events, event_count) : -1;
+
+   if (hook->subscription >= HOOK_MAX)
+   {
+      remove_subscription(matcher, hook->subscription);
+      hook->subscription = -1;
+   }// End of if
+
+   for (int x = 0; x < event_count; ++x) free(events[x]);
+
+   free(geocodes);
+   free(events);
+
+   hook->word_count = word_count;
+   return hook->subscription >= 0;
+}// End of subscribe_hook method
+
+// IMPLEMENTATION: See header for details
+bool add_hook(const char *spec)
+{
+   zlog_debug(alog, "Entering");
+
+   if (hook_count == HOOK_MAX) return false;
+
+   // The filter is optional, a command may contain '='
+   const char *target = spec;
+
+   if (strncmp(spec, "exec:", 5) != 0 && strncmp(spec, "unix:", 5) != 0)
+   {
+      target = strchr(spec, '=');
+      if (!target) return false;
+      ++target;
+   }// End of if
+
+   Hook *hook = &hooks[hook_count];
+   memset(hook, 0, sizeof(Hook));
+
+   if (strncmp(target, "exec:", 5) == 0) hook->type = HOOK_EXEC;
+   else if (strncmp(target, "unix:", 5) == 0) hook->type = HOOK_SOCKET;
+   else return false;
+
+   if (!target[5]) return false;
+
+   hook->target = strdup(target + 5);
+   hook->pending = calloc(HOOK_MAX_PENDING, sizeof(HookEvent));
+   hook->words = calloc(target - spec + 1, sizeof(char *));
+
+   bool copied = hook->words != NULL;
+
+   for (const char *word = spec; copied && word < target - 1; )
+   {
+      size_t length = strcspn(word, ", =");
+
+      if (length > 0)
+      {
+         // A missing word would make the filter match more alerts
+         char *copy = strndup(word, length);
+         copied = copy != NULL;
+
+         if (copy) hook->words[hook->word_count++] = copy;
+      }// End of if
+
+      word += length + 1;
+   }// End of for
+
+   if (!hook->target || !hook->pending || !copied || !subscribe_hook(hook))
+   {
+      zlog_warn(alog, "Failed to add the hook %s", spec);
+
+      for (int x = 0; x < hook->word_count; ++x) free(hook->words[x]);
+      free(hook->words);
+      free(hook->pending);
+      free(hook->target);
+      return false;
+   }// End of if
+
+   subscribers[hook->subscription] = hook;
+   ++hook_count;
+
+   zlog_debug(alog, "Exiting");
+   return true;
+}// End of add_hook method
+
+/*
+   hook_matches(hook, alert) Returns true if every word of the hook is in the
+                             headline, issuer or an area of alert (the
+                             matcher already checked its geocodes and event).
+*/
+static bool hook_matches(const Hook *hook, const Alert *alert)
+{
+   for (int x = 0; x < hook->word_count; ++x)
+   {
+      const char *word = hook->words[x];
+      bool found = (alert->headline && strcasestr(alert->headline, word))
+                     || (alert->issuer && strcasestr(alert->issuer, word));
+
+      for (int y = 0; y < alert->area_count && !found; ++y)
+      {
+         found = alert->areas[y]->name && strcasestr(alert->areas[y]->name, word);
+      }// End of for (y)
+
+      if (!found) return false;
+   }// End of for (x)
+
+   return true;
+}// End of hook_matches method
+
+/*
+   queue_event(hook, alert, event, now) Queues the event to the hook.
+      PRE:  hooks_lock is held
+*/
+static void queue_event(Hook *hook, Alert *alert, const char *event, double now)
+{
+   // An alert updated before its last event was sent is only sent once
+   if (strcmp(event, "update") == 0)
+   {
+      for (int x = 0; x < hook->pending_count; ++x)
+      {
+         Alert *pending = hook->pending[x].alert;
+
+         if (pending->identifier && alert->identifier && strcmp(pending->identifier, alert->identifier) == 0)
+         {
+            hook->pending[x].alert = retain_alert(alert);
+            free_alert(pending);
+            return;
+         }// End of if
+      }// End of for
+   }// End of if
+
+   if (hook->pending_count == HOOK_MAX_PENDING)
+   {
+      ++hook->dropped;
+      return;
+   }// End of if
+
+   // The first event of a batch waits a little for the rest of the burst
+   if (hook->pending_count == 0 && !hook->running) hook->due = now + HOOK_BATCH_DELAY / 1000.0;
+
+   hook->pending[hook->pending_count].alert = retain_alert(alert);
+   hook->pending[hook->pending_count].event = event;
+   ++hook->pending_count;
+
+   count_metric(METRICS_HOOK_EVENTS, 1);
+   adjust_metric(METRICS_HOOK_QUEUE, 1);
+}// End of queue_event method
+
+static const char * alert_key(const void *entry)
+{
+   const Alert *alert = *(Alert * const *)entry;
+   return alert ? (alert->identifier ? alert->identifier : "") : NULL;
+}// End of alert_key method
+
+/*
+   find_slot(table, mask, identifier) Returns the slot of identifier in table,
+                                      or the free slot to put it in.
+*/
+static Alert ** find_slot(Alert **table, unsigned long mask, const char *identifier)
+{
+   return find_identifier_slot(table, sizeof(Alert *), mask, identifier, alert_key);
+}// End of find_slot method
+
+/*
+   match_snapshot(alerts, data) Queues the events between the previous
+                                snapshot and alerts to the matching hooks.
+      PRE:  Called by publish_snapshot
+*/
+static void match_snapshot(const Alerts *alerts, void *data)
+{
+   zlog_debug(alog, "Entering");
+
+   (void)data;
+
+   unsigned long mask = identifier_table_mask(alerts->count);
+   Alert **table = calloc(mask + 1, sizeof(Alert *));
+
+   if (!table)
+   {
+      zlog_warn(alog, "Failed to allocate memory for matching hooks");
+      return;
+   }// End of if
+
+   double now = fetch_clock();
+   int queued = 0;
+
+   pthread_mutex_lock(&hooks_lock);
+
+   for (int x = 0; x < alerts->count; ++x)
+   {
+      Alert *alert = alerts->alerts[x];
+      const char *identifier = alert->identifier ? alert->identifier : "";
+      Alert **slot = find_slot(table, mask, identifier);
+
+      if (*slot) continue;             // Listed twice
+      *slot = retain_alert(alert);
+
+      // Nothing is reported for the alerts that were there at startup
+      if (!previous) continue;
+
+      Alert *before = *find_slot(previous, previous_mask, identifier);
+      const char *event = !before ? "add" : !same_alert(before, alert) ? "update" : NULL;
+
+      if (!event) continue;
+
+      // Only the hooks subscribed to a geocode and the event type of the alert
+      if (match_alert(matcher, alert, &matched) < 0)
+      {
+         zlog_warn(alog, "Failed to allocate memory for matching hooks");
+         continue;
+      }// End of if
+
+      for (int y = 0; y < matched.count; ++y)
+      {
+         Hook *hook = subscribers[matched.subscriptions[y]];
+         if (!hook_matches(hook, alert)) continue;
+
+         queue_event(hook, alert, event, now);
+         ++queued;
+      }// End of for (y)
+   }// End of for (x)
+
+   if (queued > 0) pthread_cond_broadcast(&hooks_wakeup);
+
+   pthread_mutex_unlock(&hooks_lock);
+
+   for (unsigned long x = 0; previous && x <= previous_mask; ++x) free_alert(previous[x]);
+   free(previous);
+
+   previous = table;
+   previous_mask = mask;
+
+   zlog_info(alog, "Queued %d hook events for generation %lu", queued, alerts->generation);
+   zlog_debug(alog, "Exiting");
+}// End of match_snapshot method
+
+static bool hooks_stopping(void)
+{
+   return __atomic_load_n(&stopping, __ATOMIC_RELAXED);
+}// End of hooks_stopping method
+
+/*
+   write_all(fd, data, length, deadline) Writes data to the non-blocking fd.
+      POST: Returns false if it failed, the deadline passed or the hooks are
+            stopping.
+*/
+static bool write_all(int fd, const char *data, size_t length, double deadline)
+{
+   while (length > 0)
+   {
+      ssize_t bytes = write(fd, data, length);
+
+      if (bytes >= 0)
+      {
+         data += bytes;
+         length -= bytes;
+         continue;
+      }// End of if
+
+      if (errno != EAGAIN && errno != EINTR) return false;
+      if (hooks_stopping() || fetch_clock() >= deadline) return false;
+
+      struct pollfd ready = { fd, POLLOUT, 0 };
+      poll(&ready, 1, HOOK_POLL_INTERVAL);
+   }// End of while
+
+   return true;
+}// End of write_all method
+
+/*
+   run_command(hook, out, count) Runs the hook's command with out on its
+                                 standard input.
+      POST: Returns false if it could not be run, failed or timed out.
+*/
+static bool run_command(const Hook *hook, const OutputBuffer *out, int count)
+{
+   int input[2];
+   if (pipe2(input, O_CLOEXEC) != 0) return false;
+
+   // The child gets the default signal dispositions and mask (the program
+   // blocks the signals it handles), and neither the terminal nor stdout
+   posix_spawn_file_actions_t actions;
+   posix_spawn_file_actions_init(&actions);
+   posix_spawn_file_actions_adddup2(&actions, input[0], STDIN_FILENO);
+   posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+   posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+
+   sigset_t none, defaults;
+   sigemptyset(&none);
+   sigemptyset(&defaults);
+   sigaddset(&defaults, SIGPIPE);
+   sigaddset(&defaults, SIGINT);
+   sigaddset(&defaults, SIGTERM);
+   sigaddset(&defaults, SIGWINCH);
+
+   posix_spawnattr_t attributes;
+   posix_spawnattr_init(&attributes);
+   posix_spawnattr_setsigmask(&attributes, &none);
+   posix_spawnattr_setsigdefault(&attributes, &defaults);
+   posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+   int environment_count = 0;
+   while (environ[environment_count]) ++environment_count;
+
+   char **environment = calloc(environment_count + 2, sizeof(char *));
+   char events[32];
+   snprintf(events, sizeof(events), "ALERTS_EVENTS=%d", count);
+
+   char *arguments[] = { "sh", "-c", hook->target, NULL };
+   pid_t pid = -1;
+   int status = -1;
+
+   if (environment)
+   {
+      memcpy(environment, environ, environment_count * sizeof(char *));
+      environment[environment_count] = events;
+
+      status = posix_spawn(&pid, "/bin/sh", &actions, &attributes, arguments, environment);
+   }// End of if
+
+   free(environment);
+   posix_spawnattr_destroy(&attributes);
+   posix_spawn_file_actions_destroy(&actions);
+   close(input[0]);
+
+   if (status != 0)
+   {
+      zlog_warn(alog, "Failed to run hook %s", hook->target);
+      close(input[1]);
+      return false;
+   }// End of if
+
+   double deadline = fetch_clock() + HOOK_TIMEOUT;
+
+   fcntl(input[1], F_SETFL, O_NONBLOCK);
+   write_all(input[1], out->data, out->length, deadline);
+   close(input[1]);
+
+   // Wait for the command through a pidfd, so that it can be killed in time.
+   // Without pidfds (before Linux 5.3, or refused by a seccomp filter) it is
+   // polled instead.
+   int pidfd = syscall(SYS_pidfd_open, pid, 0);
+   pid_t waited = 0;
+
+   while (!hooks_stopping() && fetch_clock() < deadline)
+   {
+      if (pidfd >= 0)
+      {
+         struct pollfd exited = { pidfd, POLLIN, 0 };
+         if (poll(&exited, 1, HOOK_POLL_INTERVAL) > 0) break;
+      }// End of if
+      else
+      {
+         if ((waited = waitpid(pid, &status, WNOHANG)) != 0) break;
+         poll(NULL, 0, HOOK_POLL_INTERVAL);
+      }// End of else
+   }// End of while
+
+   if (pidfd >= 0) close(pidfd);
+   if (waited == 0) waited = waitpid(pid, &status, WNOHANG);
+
+   if (waited == 0)
+   {
+      zlog_warn(alog, "Hook %s timed out", hook->target);
+      kill(pid, SIGKILL);
+      waitpid(pid, &status, 0);
+      return false;
+   }// End of if
+
+   return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}// End of run_command method
+
+/*
+   send_socket(hook, out) Writes out to the hook's socket.
+      POST: Returns false if it could not be written.
+*/
+static bool send_socket(const Hook *hook, const OutputBuffer *out)
+{
+   struct sockaddr_un address = { .sun_family = AF_UNIX };
+
+   if (strlen(hook->target) >= sizeof(address.sun_path)) return false;
+   strcpy(address.sun_path, hook->target);
+
+   int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+   bool sent = fd >= 0 && connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0
+                 && write_all(fd, out->data, out->length, fetch_clock() + HOOK_TIMEOUT);
+
+   if (fd >= 0) close(fd);
+
+   return sent;
+}// End of send_socket method
+
+/*
+   run_hook(hook, events, count) Sends the events to the hook.
+*/
+static void run_hook(const Hook *hook, const HookEvent *events, int count)
+{
+   zlog_debug(alog, "Entering");
+
+   static const OutputOptions options = { OUTPUT_NDJSON, true, false, 8,
+                                          { OUTPUT_IDENTIFIER, OUTPUT_HEADLINE, OUTPUT_ISSUER,
+                                            OUTPUT_EFFECTIVE, OUTPUT_EXPIRES, OUTPUT_AREAS,
+                                            OUTPUT_DESCRIPTION, OUTPUT_INSTRUCTION } };
+
+   uint64_t start = stats_clock();
+   OutputBuffer out = { NULL, 0, 0, -1, false };
+
+   for (int x = 0; x < count; ++x) write_record(&out, &options, events[x].event, events[x].alert);
+
+   bool done = !out.failed && (hook->type == HOOK_EXEC ? run_command(hook, &out, count) : send_socket(hook, &out));
+
+   if (done)
+   {
+      zlog_info(alog, "Ran hook %s with %d events", hook->target, count);
+   }// End of if
+   else
+   {
+      zlog_warn(alog, "Hook %s failed (%d events)", hook->target, count);
+      count_metric(METRICS_HOOK_FAILURES, 1);
+   }// End of else
+
+   free_output_buffer(&out);
+
+   trace_span("hook", start);
+
+   zlog_debug(alog, "Exiting");
+}// End of run_hook method
+
+/*
+   worker_main(arg) Body of a hook worker.
+      POST: Runs the hooks whose events are due until stop_hooks is called.
+*/
+static void * worker_main(void *arg)
+{
+   zlog_debug(alog, "Entering");
+
+   (void)arg;
+
+   name_trace_thread("hooks");
+
+   // A hook that exits early must not kill the program with SIGPIPE
+   sigset_t pipe_signal;
+   sigemptyset(&pipe_signal);
+   sigaddset(&pipe_signal, SIGPIPE);
+   pthread_sigmask(SIG_BLOCK, &pipe_signal, NULL);
+
+   HookEvent *batch = malloc(HOOK_MAX_PENDING * sizeof(HookEvent));
+
+   pthread_mutex_lock(&hooks_lock);
+
+   while (batch && !stopping)
+   {
+      double now = fetch_clock();
+      double next = 0;
+      Hook *hook = NULL;
+
+      for (int x = 0; x < hook_count && !hook; ++x)
+      {
+         if (hooks[x].running || hooks[x].pending_count == 0) continue;
+
+         if (hooks[x].due <= now) hook = &hooks[x];
+         else if (next == 0 || hooks[x].due < next) next = hooks[x].due;
+      }// End of for
+
+      if (!hook)
+      {
+         if (next == 0)
+         {
+            pthread_cond_wait(&hooks_wakeup, &hooks_lock);
+            continue;
+         }// End of if
+
+         // Sleep until the next batch is due
+         struct timespec deadline;
+         clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+         long delay = (long)((next - now) * 1000000000) + 1;
+         deadline.tv_sec += (deadline.tv_nsec + delay) / 1000000000;
+         deadline.tv_nsec = (deadline.tv_nsec + delay) % 1000000000;
+
+         pthread_cond_timedwait(&hooks_wakeup, &hooks_lock, &deadline);
+         continue;
+      }// End of if
+
+      // Take the whole batch, events that arrive meanwhile go in the next one
+      int count = hook->pending_count;
+
+      memcpy(batch, hook->pending, count * sizeof(HookEvent));
+      hook->pending_count = 0;
+      hook->running = true;
+
+      adjust_metric(METRICS_HOOK_QUEUE, -count);
+
+      if (hook->dropped > 0)
+      {
+         zlog_warn(alog, "Hook %s dropped %lu events", hook->target, hook->dropped);
+         hook->dropped = 0;
+      }// End of if
+
+      pthread_mutex_unlock(&hooks_lock);
+
+      run_hook(hook, batch, count);
+
+      for (int x = 0; x < count; ++x) free_alert(batch[x].alert);
+
+      pthread_mutex_lock(&hooks_lock);
+
+      // What queued up while the hook ran is sent right away
+      hook->running = false;
+      hook->due = fetch_clock();
+
+      pthread_cond_broadcast(&hooks_wakeup);
+   }// End of while
+
+   pthread_mutex_unlock(&hooks_lock);
+
+   free(batch);
+
+   zlog_debug(alog, "Exiting");
+   return NULL;
+}// End of worker_main method
+
+// IMPLEMENTATION: See header for details
+bool start_hooks(void)
+{
+   zlog_debug(alog, "Entering");
+
+   if (hook_count == 0 || worker_count > 0) return true;
+
+   pthread_condattr_t attributes;
+   pthread_condattr_init(&attributes);
+   pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+   pthread_cond_init(&hooks_wakeup, &attributes);
+   pthread_condattr_destroy(&attributes);
+
+   stopping = false;
+
+   if (!add_snapshot_listener(match_snapshot, NULL)) return false;
+
+   // A hook runs once at a time, more workers than hooks would only wait
+   int count = hook_count < HOOK_WORKERS ? hook_count : HOOK_WORKERS;
+
+   while (worker_count < count)
+   {
+      if (pthread_create(&workers[worker_count], NULL, worker_main, NULL) != 0)
+      {
+         zlog_warn(alog, "Failed to start a hook worker");
+         stop_hooks();
+         return false;
+      }// End of if
+
+      ++worker_count;
+   }// End of while
+
+   zlog_debug(alog, "Exiting");
+   return true;
+}// End of start_hooks method
+
+// IMPLEMENTATION: See header for details
+void stop_hooks(void)
+{
+   zlog_debug(alog, "Entering");
+
+   remove_snapshot_listener(match_snapshot, NULL);
+
+   pthread_mutex_lock(&hooks_lock);
+   __atomic_store_n(&stopping, true, __ATOMIC_RELAXED);
+   pthread_cond_broadcast(&hooks_wakeup);
+   pthread_mutex_unlock(&hooks_lock);
+
+   for (int x = 0; x < worker_count; ++x) pthread_join(workers[x], NULL);
+   worker_count = 0;
+
+   for (int x = 0; x < hook_count; ++x)
+   {
+      Hook *hook = &hooks[x];
+
+      for (int y = 0; y < hook->pending_count; ++y) free_alert(hook->pending[y].alert);
+      for (int y = 0; y < hook->word_count; ++y) free(hook->words[y]);
+
+      adjust_metric(METRICS_HOOK_QUEUE, -hook->pending_count);
+
+      free(hook->pending);
+      free(hook->words);
+      free(hook->target);
+   }// End of for
+
+   hook_count = 0;
+
+   free_matcher(matcher);
+   free_match_result(&matched);
+   matcher = NULL;
+
+   for (unsigned long x = 0; previous && x <= previous_mask; ++x) free_alert(previous[x]);
+   free(previous);
+   previous = NULL;
+
+   zlog_debug(alog, "Exiting");
+}// End of stop_hooks method
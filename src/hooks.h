@@ -0,0 +1,84 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef _HOOKS
+#define _HOOKS
+
+#include <stdbool.h>
+
+/*
+   Hooks notify external programs of alerts that appear or change. Every
+   published snapshot is compared with the previous one and each alert that
+   was added or updated is matched against the filters of the hooks (through
+   a Matcher of their geocodes and event types, see match.h, so an alert only
+   looks at the hooks subscribed to it). Matching events are queued to the
+   hook, which runs on a small pool of workers:
+
+      - exec:COMMAND runs COMMAND with /bin/sh, with the events as NDJSON
+        lines on its standard input (and their number in ALERTS_EVENTS)
+      - unix:PATH connects to the Unix domain socket at PATH and writes the
+        events as NDJSON lines
+
+   A hook is never run more than once at a time. Events that arrive while it
+   runs, or within HOOK_BATCH_DELAY of the first one, are sent together in
+   the next run (an alert updated again before that is only sent once), so a
+   burst of alerts costs a few runs. Queuing never waits for a hook: at most
+   HOOK_MAX_PENDING events wait per hook and further ones are dropped. The
+   alerts of the first snapshot are not reported.
+*/
+
+#define HOOK_MAX 16
+#define HOOK_WORKERS 4
+#define HOOK_MAX_PENDING 4096
+#define HOOK_BATCH_DELAY 250         // Milliseconds
+#define HOOK_TIMEOUT 30              // Seconds a run may take before it is killed
+
+/*
+   add_hook(spec) Adds the hook described by spec, "[WORDS=]exec:COMMAND" or
+                  "[WORDS=]unix:PATH". WORDS are comma or space separated
+                  terms: geocode:CODE and event:TYPE terms restrict the hook
+                  to alerts in one of the geocodes and of one of the event
+                  types, every other word must be found (ignoring case) in
+                  the headline, issuer or an area of an alert for it to match.
+      PRE:  Valid spec, hooks are not started.
+      POST: Returns false if spec is malformed, memory could not be
+            allocated or HOOK_MAX hooks were added.
+*/
+bool add_hook(const char *spec);
+
+/*
+   start_hooks() Starts matching published snapshots and running the hooks.
+      PRE:  true
+      POST: Returns false if the workers could not be started. Nothing is
+            started if no hook was added.
+*/
+bool start_hooks(void);
+
+/*
+   stop_hooks() Stops the workers and frees the hooks.
+      POST: Runs in progress are killed and waiting events are dropped.
+*/
+void stop_hooks(void);
+
+#endif
@@ -869,6 +869,25 @@ e_failed:
          strcpy (error_buf, "Unknown error");
    }
 
+   /* A value is only attached to its parent once it is complete, so the
+    * values still being parsed (top and its parents up to root) each hold
+    * their own part of the tree. The value that failed to allocate has no
+    * buffer for its length yet.
+    */
+   if (!state.first_pass && top)
+   {
+      if ((top->type == json_array && !top->u.array.values)
+            || (top->type == json_object && !top->u.object.values))
+         top->u.array.length = 0;
+
+      while (top)
+      {
+         json_value * parent = top->parent;
+         json_value_free_ex (&state.settings, top);
+         top = parent;
+      }
+   }
+
    if (state.first_pass)
       alloc = root;
 
@@ -879,9 +898,6 @@ e_failed:
       alloc = top;
    }
 
-   if (!state.first_pass)
-      json_value_free_ex (&state.settings, root);
-
    return 0;
 }
 
@@ -0,0 +1,124 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "list.h"
+
+#include "log.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+struct ListRow {
+   Alert *alert;              // Retained
+   char *text;
+};
+typedef struct ListRow ListRow;
+
+static ListRow rows[LIST_ROW_CACHE];
+static int row_width = 0;
+
+/*
+   format_row(alert, width) Returns the text of the row of alert.
+      PRE:  Valid alert pointer, width > 0
+      POST: Returns the cached text (formatting it on a miss), or NULL if
+            memory could not be allocated.
+*/
+static const char * format_row(Alert *alert, int width)
+{
+   if (width != row_width)
+   {
+      free_alert_list();
+      row_width = width;
+   }// End of if
+
+   // Direct mapped by object address
+   ListRow *row = &rows[((uintptr_t)alert / sizeof(void *)) % LIST_ROW_CACHE];
+   if (row->alert == alert) return row->text;
+
+   char *text = malloc(width + 1);
+   if (!text) return NULL;
+
+   char effective[18];
+   strftime(effective, sizeof(effective), "%Y-%m-%d %H:%M", &alert->effective);
+
+   int length = snprintf(text, width + 1, "%s  %s", effective, alert->headline ? alert->headline : "");
+
+   if (length < width && alert->area_count > 0)
+   {
+      length += snprintf(text + length, width + 1 - length, " - %s", alert->areas[0]->name);
+
+      if (length < width && alert->area_count > 1)
+      {
+         snprintf(text + length, width + 1 - length, " (+%d)", alert->area_count - 1);
+      }// End of if
+   }// End of if
+
+   free(row->text);
+   free_alert(row->alert);
+
+   row->alert = retain_alert(alert);
+   row->text = text;
+
+   return text;
+}// End of format_row method
+
+// IMPLEMENTATION: See header for details
+void draw_alert_list(WINDOW *window, const Alerts *alerts, const int *view, int count, int top, int selected)
+{
+   zlog_debug(alog, "Entering");
+
+   int height = 0;
+   int width = 0;
+   getmaxyx(window, height, width);
+
+   werase(window);
+
+   for (int y = 0; y < height && top + y < count; ++y)
+   {
+      int row = top + y;
+      const char *text = format_row(alerts->alerts[view ? view[row] : row], width);
+      if (!text) continue;
+
+      mvwaddnstr(window, y, 0, text, width);
+      if (top + y == selected) mvwchgat(window, y, 0, -1, A_REVERSE, 0, NULL);
+   }// End of for
+
+   wnoutrefresh(window);
+
+   zlog_debug(alog, "Exiting");
+}// End of draw_alert_list method
+
+// IMPLEMENTATION: See header for details
+void free_alert_list(void)
+{
+   for (int x = 0; x < LIST_ROW_CACHE; ++x)
+   {
+      free(rows[x].text);
+      free_alert(rows[x].alert);
+   }// End of for
+
+   memset(rows, 0, sizeof(rows));
+   row_width = 0;
+}// End of free_alert_list method
@@ -0,0 +1,58 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef _LIST
+#define _LIST
+
+#include <ncurses.h>
+
+#include "alerts.h"
+
+#define LIST_ROW_CACHE 1024
+
+/*
+   The alert list is virtualized: only the rows that are visible are
+   formatted, and the text of each row is cached by alert object (unchanged
+   alerts keep their object across snapshots) for the current width. Drawing
+   a list of any length costs O(visible rows).
+*/
+
+/*
+   draw_alert_list(window, alerts, view, count, top, selected) Draws the
+                  rows from top that fit in window. Row n shows the alert
+                  view[n] of alerts (alert n if view is NULL).
+      PRE:  Valid window and alerts pointers, count rows, 0 <= top < count.
+      POST: One row per alert is drawn (selected is highlighted) and the
+            window is marked for the next doupdate.
+*/
+void draw_alert_list(WINDOW *window, const Alerts *alerts, const int *view, int count, int top, int selected);
+
+/*
+   free_alert_list() Frees the cached rows.
+      PRE:  true
+      POST: Cached rows are freed and their alerts released.
+*/
+void free_alert_list(void);
+
+#endif
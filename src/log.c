@@ -24,14 +24,254 @@
 
 #include "log.h"
 
-FILE *alog;
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 
-void configure_log(void)
+#define LOG_BATCH_SIZE 65536
+
+/*
+   LogSlot holds one line. Its sequence is the position it can be claimed
+   at, the position + 1 once the line is written and the position of the
+   next round once it was read (a bounded MPMC queue, with one reader).
+*/
+struct LogSlot {
+   unsigned long sequence;
+   unsigned int length;
+   char line[LOG_LINE_MAX];
+};
+typedef struct LogSlot LogSlot;
+
+int log_threshold = LOG_OFF;
+
+static LogSlot ring[LOG_RING_SIZE];  // Never freed, a thread may be writing a line while the log closes
+static unsigned long head = 0;       // Next position claimed by a thread
+static unsigned long tail = 0;       // Next position read, writer only
+static unsigned long dropped = 0;
+static unsigned int wakeups = 0;     // Futex the writer sleeps on
+static bool stopping = false;
+static bool running = false;
+static int log_fd = -1;
+static pthread_t writer;
+
+static __thread time_t prefix_second = -1;
+static __thread char prefix[32];
+
+static void wake_writer(void)
+{
+   __atomic_add_fetch(&wakeups, 1, __ATOMIC_RELEASE);
+   syscall(SYS_futex, &wakeups, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}// End of wake_writer method
+
+// IMPLEMENTATION: See header for details
+void write_log(const char *fmt, ...)
+{
+   unsigned long position = __atomic_load_n(&head, __ATOMIC_RELAXED);
+   LogSlot *slot = NULL;
+
+   // Claim the next free slot, or drop the line if the ring is full
+   for (;;)
+   {
+      slot = &ring[position & (LOG_RING_SIZE - 1)];
+      long difference = (long)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - position);
+
+      if (difference == 0)
+      {
+         if (__atomic_compare_exchange_n(&head, &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+      }// End of if
+      else if (difference < 0)
+      {
+         __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+         return;
+      }// End of else if
+      else
+      {
+         position = __atomic_load_n(&head, __ATOMIC_RELAXED);
+      }// End of else
+   }// End of for
+
+   // The date only changes once a second, it is formatted once per thread
+   struct timespec now;
+   clock_gettime(CLOCK_REALTIME, &now);
+
+   if (now.tv_sec != prefix_second)
+   {
+      struct tm tm;
+      localtime_r(&now.tv_sec, &tm);
+      strftime(prefix, sizeof(prefix), "%Y-%m-%dT%H:%M:%S", &tm);
+      prefix_second = now.tv_sec;
+   }// End of if
+
+   int length = snprintf(slot->line, LOG_LINE_MAX, "%s.%03ld ", prefix, now.tv_nsec / 1000000);
+
+   va_list args;
+   va_start(args, fmt);
+   length += vsnprintf(slot->line + length, LOG_LINE_MAX - length, fmt, args);
+   va_end(args);
+
+   if (length > LOG_LINE_MAX - 1) length = LOG_LINE_MAX - 1;
+
+   slot->line[length] = '\n';
+   slot->length = length + 1;
+
+   __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+
+   // The writer is woken early when the ring fills up
+   if ((position & (LOG_RING_SIZE / 2 - 1)) == 0) wake_writer();
+}// End of write_log method
+
+static void write_batch(const char *data, size_t length)
 {
+   while (length > 0)
+   {
+      ssize_t bytes = write(log_fd, data, length);
+
+      if (bytes < 0 && errno == EINTR) continue;
+      if (bytes <= 0) return;
+
+      data += bytes;
+      length -= bytes;
+   }// End of while
+}// End of write_batch method
+
+/*
+   drain_ring() Writes out the lines queued so far.
+*/
+static void drain_ring(void)
+{
+   static char batch[LOG_BATCH_SIZE];
+   size_t length = 0;
+
+   for (;;)
+   {
+      LogSlot *slot = &ring[tail & (LOG_RING_SIZE - 1)];
+      if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != tail + 1) break;
+
+      if (length + slot->length > sizeof(batch))
+      {
+         write_batch(batch, length);
+         length = 0;
+      }// End of if
+
+      memcpy(batch + length, slot->line, slot->length);
+      length += slot->length;
 
-}
+      __atomic_store_n(&slot->sequence, tail + LOG_RING_SIZE, __ATOMIC_RELEASE);
+      ++tail;
+   }// End of for
 
+   unsigned long lost = __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED);
+
+   if (lost > 0 && length + 96 <= sizeof(batch))
+   {
+      time_t now = time(NULL);
+      struct tm tm;
+      char date[32];
+
+      localtime_r(&now, &tm);
+      strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &tm);
+      length += snprintf(batch + length, 96, "%s.000 [WARN] %lu log lines dropped, the log was full\n", date, lost);
+   }// End of if
+
+   write_batch(batch, length);
+}// End of drain_ring method
+
+static void * writer_main(void *data)
+{
+   (void)data;
+
+   struct timespec interval = { LOG_FLUSH_INTERVAL / 1000, (LOG_FLUSH_INTERVAL % 1000) * 1000000L };
+
+   for (;;)
+   {
+      unsigned int seen = __atomic_load_n(&wakeups, __ATOMIC_ACQUIRE);
+      bool stop = __atomic_load_n(&stopping, __ATOMIC_ACQUIRE);
+
+      drain_ring();
+      if (stop) break;
+
+      syscall(SYS_futex, &wakeups, FUTEX_WAIT_PRIVATE, seen, &interval, NULL, 0);
+   }// End of for
+
+   return NULL;
+}// End of writer_main method
+
+// IMPLEMENTATION: See header for details
+bool parse_log_level(const char *name, LogLevel *level)
+{
+   static const char *names[] = { "debug", "info", "warn", "off" };
+
+   for (int x = LOG_DEBUG; x <= LOG_OFF; ++x)
+   {
+      if (strcmp(name, names[x]) != 0) continue;
+
+      *level = x;
+      return true;
+   }// End of for
+
+   return false;
+}// End of parse_log_level method
+
+// IMPLEMENTATION: See header for details
+bool configure_log(const char *path, LogLevel level)
+{
+   if (running) return false;
+   if (level == LOG_OFF) return true;
+
+   log_fd = strcmp(path, "-") == 0 ? fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 0)
+                                   : open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+   if (log_fd < 0) return false;
+
+   for (unsigned long x = 0; x < LOG_RING_SIZE; ++x) ring[x].sequence = x;
+
+   head = tail = dropped = 0;
+   stopping = false;
+
+   // The writer takes no signal, they are handled by the event loop
+   sigset_t all;
+   sigset_t previous;
+
+   sigfillset(&all);
+   pthread_sigmask(SIG_SETMASK, &all, &previous);
+   running = pthread_create(&writer, NULL, writer_main, NULL) == 0;
+   pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+   if (!running)
+   {
+      close(log_fd);
+      log_fd = -1;
+      return false;
+   }// End of if
+
+   atexit(close_log);
+   __atomic_store_n(&log_threshold, level, __ATOMIC_RELEASE);
+
+   return true;
+}// End of configure_log method
+
+// IMPLEMENTATION: See header for details
 void close_log(void)
 {
+   if (!running) return;
+
+   __atomic_store_n(&log_threshold, LOG_OFF, __ATOMIC_RELEASE);
+   __atomic_store_n(&stopping, true, __ATOMIC_RELEASE);
+   wake_writer();
+
+   pthread_join(writer, NULL);
+   close(log_fd);
 
-}
+   log_fd = -1;
+   running = false;
+}// End of close_log method
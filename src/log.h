@@ -22,26 +22,74 @@
    THE SOFTWARE.
 */
 
-#include <stdio.h>
+#ifndef _LOG
+#define _LOG
 
-#define DEBUG 0
+#include <stdbool.h>
 
-extern FILE *alog;
+/*
+   The log is leveled and asynchronous. A line below the configured level
+   costs one load and one branch at the call site, nothing is formatted. A
+   line that is kept is formatted straight into a slot of a lock-free ring
+   (threads claim slots with a compare and swap) and a background thread
+   writes the lines out in batches to a file kept open. If the ring is full
+   the line is dropped and counted rather than waited for, so logging never
+   blocks a thread.
+
+   The first argument of the zlog_* macros (alog) names the category, it is
+   kept for the call sites and ignored.
+*/
+
+enum LogLevel {
+   LOG_DEBUG,
+   LOG_INFO,
+   LOG_WARN,
+   LOG_OFF
+};
+typedef enum LogLevel LogLevel;
+
+#define LOG_RING_SIZE 4096           // Lines, a power of two
+#define LOG_LINE_MAX 256             // Bytes of a line, longer ones are cut
+#define LOG_FLUSH_INTERVAL 100       // Milliseconds between writes
+#define LOG_DEFAULT_PATH "alerts.log"
 
-void configure_log(void);
+extern int log_threshold;            // Lines below it are not logged
+
+#define zlog_debug(a, fmt, args...) zlog(LOG_DEBUG, "DEBUG", fmt, ## args)
+#define zlog_info(a, fmt, args...) zlog(LOG_INFO, "INFO", fmt, ## args)
+#define zlog_warn(a, fmt, args...) zlog(LOG_WARN, "WARN", fmt, ## args)
+
+#define zlog(level, name, fmt, args...) \
+   do { \
+      if (__builtin_expect((level) >= __atomic_load_n(&log_threshold, __ATOMIC_RELAXED), 0)) \
+         write_log("[" name "] %s(%d) %s: " fmt, __FILE__, __LINE__, __func__, ## args); \
+   } while (0)
+
+/*
+   configure_log(path, level) Starts logging the lines of level and above to
+                              the file at path ("-" for stderr).
+      PRE:  The log is not configured
+      POST: Returns false if the file could not be opened or the writer could
+            not be started (nothing is logged). Nothing is started for
+            LOG_OFF. The log is closed at exit.
+*/
+bool configure_log(const char *path, LogLevel level);
+
+/*
+   parse_log_level(name, level) Sets level from its name ("debug", "info",
+                                "warn" or "off").
+      POST: Returns false if name is not a level.
+*/
+bool parse_log_level(const char *name, LogLevel *level);
+
+/*
+   write_log(fmt, ...) Queues a line, use the zlog_* macros instead.
+*/
+void write_log(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/*
+   close_log() Writes the queued lines out and stops the writer.
+*/
 void close_log(void);
 
-#define zlog_debug(a,b, args...) zlog("[DEBUG] " b "\n", ## args);
-#define zlog_warn(a,b, args...) zlog("[WARN] " b "\n", ## args);
-#define zlog_info(a,b, args...) zlog("[INFO] " b "\n", ## args);
-
-#if DEBUG
-   #define zlog(fmt, args...) { \
-         FILE *alog = fopen("alerts.log", "a"); \
-         fprintf(alog, "%s(%d) %s\n" fmt "\n", __FILE__, __LINE__, __func__, ## args); \
-         fclose(alog); \
-         fprintf(stderr, "%s(%d) %s\n" fmt "\n", __FILE__, __LINE__, __func__, ## args); \
-      }
-#else
-   #define zlog(fmt, args...)
 #endif
@@ -0,0 +1,164 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "loop.h"
+
+#include "log.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+struct EventSource {
+   int fd;                 // -1 for a free slot
+   EventHandler handler;
+   void *data;
+};
+typedef struct EventSource EventSource;
+
+static int epoll_fd = -1;
+static bool stopping = false;
+static EventSource sources[LOOP_MAX_SOURCES];
+
+// IMPLEMENTATION: See header for details
+bool create_event_loop(void)
+{
+   zlog_debug(alog, "Entering");
+
+   epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+   if (epoll_fd < 0)
+   {
+      zlog_warn(alog, "Failed to create the event loop");
+      return false;
+   }// End of if
+
+   for (int x = 0; x < LOOP_MAX_SOURCES; ++x) sources[x].fd = -1;
+
+   zlog_debug(alog, "Exiting");
+   return true;
+}// End of create_event_loop method
+
+// IMPLEMENTATION: See header for details
+bool add_event_source(int fd, uint32_t events, EventHandler handler, void *data)
+{
+   zlog_debug(alog, "Entering");
+
+   if (fd < 0 || !handler) return false;
+
+   for (int x = 0; x < LOOP_MAX_SOURCES; ++x)
+   {
+      if (sources[x].fd >= 0) continue;
+
+      struct epoll_event event = { .events = events, .data.u32 = x };
+
+      if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+      {
+         zlog_warn(alog, "Failed to watch descriptor %d", fd);
+         return false;
+      }// End of if
+
+      sources[x].fd = fd;
+      sources[x].handler = handler;
+      sources[x].data = data;
+
+      return true;
+   }// End of for
+
+   zlog_warn(alog, "Too many event sources");
+   return false;
+}// End of add_event_source method
+
+// IMPLEMENTATION: See header for details
+bool watch_event_source(int fd, uint32_t events)
+{
+   for (int x = 0; x < LOOP_MAX_SOURCES; ++x)
+   {
+      if (sources[x].fd != fd) continue;
+
+      struct epoll_event event = { .events = events, .data.u32 = x };
+      return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event) == 0;
+   }// End of for
+
+   return false;
+}// End of watch_event_source method
+
+// IMPLEMENTATION: See header for details
+void remove_event_source(int fd)
+{
+   for (int x = 0; x < LOOP_MAX_SOURCES; ++x)
+   {
+      if (sources[x].fd != fd) continue;
+
+      epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+      sources[x].fd = -1;
+   }// End of for
+}// End of remove_event_source method
+
+// IMPLEMENTATION: See header for details
+bool run_event_loop(void)
+{
+   zlog_debug(alog, "Entering");
+
+   struct epoll_event events[LOOP_MAX_SOURCES];
+   stopping = false;
+
+   while (!stopping)
+   {
+      int count = epoll_wait(epoll_fd, events, LOOP_MAX_SOURCES, -1);
+
+      if (count < 0)
+      {
+         if (errno == EINTR) continue;
+
+         zlog_warn(alog, "Waiting for events failed");
+         return false;
+      }// End of if
+
+      for (int x = 0; x < count && !stopping; ++x)
+      {
+         EventSource *source = &sources[events[x].data.u32];
+
+         // The source may have been removed by an earlier handler
+         if (source->fd < 0) continue;
+
+         source->handler(source->fd, events[x].events, source->data);
+      }// End of for
+   }// End of while
+
+   zlog_debug(alog, "Exiting");
+   return true;
+}// End of run_event_loop method
+
+// IMPLEMENTATION: See header for details
+void stop_event_loop(void)
+{
+   stopping = true;
+}// End of stop_event_loop method
+
+// IMPLEMENTATION: See header for details
+void free_event_loop(void)
+{
+   if (epoll_fd >= 0) close(epoll_fd);
+   epoll_fd = -1;
+}// End of free_event_loop method
@@ -0,0 +1,97 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef _LOOP
+#define _LOOP
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+
+/*
+   The event loop waits in epoll_wait for any of the registered file
+   descriptors (the terminal, timers, signals, notifications from other
+   threads) and dispatches each ready one to its handler. Nothing runs while
+   no descriptor is ready, so an idle program uses no CPU.
+*/
+
+#define LOOP_MAX_SOURCES 256
+
+/*
+   EventHandler is called with the ready descriptor, the epoll events that
+   occurred (EPOLLIN, ...) and the data given to add_event_source.
+*/
+typedef void (*EventHandler)(int fd, uint32_t events, void *data);
+
+/*
+   create_event_loop() Creates the event loop.
+      PRE:  The loop is not created yet.
+      POST: Returns false if the epoll instance could not be created.
+*/
+bool create_event_loop(void);
+
+/*
+   add_event_source(fd, events, handler, data) Dispatches fd to handler
+                                                whenever one of events occurs.
+      PRE:  Created loop, valid descriptor and handler.
+      POST: Returns false if fd could not be watched (or LOOP_MAX_SOURCES
+            are watched already).
+*/
+bool add_event_source(int fd, uint32_t events, EventHandler handler, void *data);
+
+/*
+   watch_event_source(fd, events) Changes the events fd is watched for.
+      PRE:  Created loop, fd was added with add_event_source.
+      POST: Returns false if the events could not be changed.
+*/
+bool watch_event_source(int fd, uint32_t events);
+
+/*
+   remove_event_source(fd) Stops watching fd.
+      PRE:  Created loop
+      POST: The handler of fd is no longer called (also from the current
+            dispatch round).
+*/
+void remove_event_source(int fd);
+
+/*
+   run_event_loop() Dispatches events until stop_event_loop is called.
+      PRE:  Created loop
+      POST: Returns false if waiting failed.
+*/
+bool run_event_loop(void);
+
+/*
+   stop_event_loop() Makes run_event_loop return after the current dispatch.
+      PRE:  Called from a handler (on the loop's thread).
+*/
+void stop_event_loop(void);
+
+/*
+   free_event_loop() Closes the loop (not the watched descriptors).
+      PRE:  The loop is not running.
+*/
+void free_event_loop(void);
+
+#endif
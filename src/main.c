@@ -27,18 +27,92 @@
 #include <string.h>
 #include <ncurses.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <curl/curl.h>
 
 /* PROJECT */
 #include "log.h"
+#include "stats.h"
+#include "memory.h"
 #include "alerts.h"
+#include "snapshot.h"
+#include "feeds.h"
+#include "refresh.h"
+#include "loop.h"
+#include "page.h"
+#include "list.h"
+#include "search.h"
+#include "output.h"
+#include "daemon.h"
+#include "client.h"
+#include "shm.h"
+#include "hooks.h"
+#include "history.h"
+#include "metrics.h"
+#include "trace.h"
 
 /* DEFINES */
-#define HEADLINE_COLOUR 1
+#define DEFAULT_FEED_URL "https://alerts.zacharyseguin.ca/api/alerts.json"
+#define DEFAULT_REFRESH_INTERVAL 60
+#define CLOCK_INTERVAL 60
+
+#define DIRTY_ALERT 1
+#define DIRTY_STATUS 2
+#define DIRTY_LIST 4
+
+#define KEY_ESCAPE 27
+#define SEARCH_ESCAPE_DELAY 25
 
 /* INSTANCE VARIABLES */
-static Alerts *alerts = NULL;
+static Alerts *alerts = NULL;          // Snapshot pinned while rendering
+static int alert_count = 0;
 static int active_alert = 0;
-
+static int alert_scroll = 0;           // First line of the alert shown
+static int alert_lines = 0;            // Lines of the alert shown
+static bool alert_expired = false;
+
+static bool list_visible = true;
+static int list_rows = 0;              // Rows of the list (0 when hidden)
+static int list_top = 0;               // First alert in the list
+static int detail_rows = 0;            // Rows the alert is shown in
+static int jump_index = 0;             // Number typed before g/G
+
+// Search (typed after /), the list only shows the alerts in the view
+static bool searching = false;
+static char search_text[SEARCH_MAX_QUERY + 1] = "";
+static SearchIndex *search_index = NULL;
+static Search *search = NULL;
+static unsigned long search_generation = 0;
+static const int *view = NULL;
+
+static unsigned long expiry_generation = 0;
+static time_t next_expiry = 0;
+
+static int ui_reader = -1;
+static int timer_fd = -1;
+static bool attached = false;          // Alerts come from a daemon
+static const char *trace_path = NULL;  // Spans are dumped to it
+static bool interrupted = false;       // A signal ended the event loop
+
+// What is on screen, so that only the parts that changed are drawn again
+static int dirty = DIRTY_ALERT | DIRTY_STATUS | DIRTY_LIST;
+static Alert *shown_alert = NULL;      // Retained, alerts are immutable
+static int shown_active = 0;
+static int shown_scroll = 0;
+static bool shown_loading = false;
+static char shown_status[256] = "";
+static unsigned long shown_generation = 0;
+static int shown_top = -1;
+static int shown_selected = -1;
+
+static WINDOW *list_window = NULL;
 static WINDOW *alert_window = NULL;
 static WINDOW *stats_window = NULL;
 static WINDOW *input_window = NULL;
@@ -46,25 +120,91 @@ static WINDOW *input_window = NULL;
 static int winrows = 0;
 static int wincols = 0;
 
-static void str_uppercase(char *str)
+/*
+   find_alert(alert) Returns the position in the list (the view while
+                     searching) of the alert with the identifier of alert, or -1.
+*/
+static int find_alert(const Alert *alert)
 {
-   while (*str)
+   if (!alerts || !alert || !alert->identifier) return -1;
+
+   for (int i = 0; i < alert_count; i++)
    {
-      if (*str >= 'a' && *str <= 'z')
-      {
-         *str = *str - 'a' + 'A';
-      }// End of if
+      const Alert *other = alerts->alerts[view ? view[i] : i];
+      if (other->identifier && strcmp(other->identifier, alert->identifier) == 0) return i;
+   }// End of for (i)
 
-      ++str;
-   }// End of while
-}// End of str_uppercase
+   return -1;
+}// End of find_alert method
 
-static void process_input(const int ch)
+static void clear_search(void)
 {
-   if (!alerts) return;
+   // The selection is a position in the view, make it one in the whole list
+   int selected = view && active_alert >= 0 && active_alert < alert_count ? view[active_alert] : -1;
+
+   free_search(search);
+   free_search_index(search_index);
+
+   search = NULL;
+   search_index = NULL;
+   search_text[0] = '\0';
+   searching = false;
+   view = NULL;
+
+   // The view was dropped for a new snapshot, look for the alert shown in it
+   if (selected < 0 && alerts)
+   {
+      alert_count = alerts->count;
+      selected = find_alert(shown_alert);
+   }// End of if
+
+   active_alert = selected >= 0 ? selected : 0;
+   list_top = 0;
+   dirty |= DIRTY_LIST;
+}// End of clear_search method
+
+/*
+   process_search_input(ch) Edits the search text while searching.
+      PRE:  searching
+      POST: Returns false if ch is not a search key.
+*/
+static bool process_search_input(const int ch)
+{
+   size_t length = strlen(search_text);
+
+   switch (ch)
+   {
+      case KEY_ESCAPE:        clear_search();
+                              break;
+
+      case '\n':
+      case KEY_ENTER:         searching = false;
+                              break;
+
+      case KEY_BACKSPACE:
+      case 127:
+      case '\b':              if (length == 0) clear_search();
+                              else search_text[length - 1] = '\0';
+                              break;
 
+      default:                if (ch < ' ' || ch > 255 || ch == 127) return false;
+                              if (length < SEARCH_MAX_QUERY)
+                              {
+                                 search_text[length] = ch;
+                                 search_text[length + 1] = '\0';
+                              }// End of if
+                              break;
+   }// End of switch
+
+   return true;
+}// End of process_search_input method
+
+static void process_input(const int ch)
+{
    zlog_debug(alog, "Entering");
 
+   if (searching && process_search_input(ch)) return;
+
    switch (ch)
    {
       case KEY_LEFT:
@@ -75,7 +215,63 @@ static void process_input(const int ch)
 
       case KEY_RIGHT:
       case KEY_DOWN:
-      case '\n':              if (active_alert < alerts->count - 1) ++active_alert;
+      case '\n':              if (active_alert < alert_count - 1) ++active_alert;
+                              break;
+
+      case 'k':               --alert_scroll;
+                              break;
+
+      case 'j':               ++alert_scroll;
+                              break;
+
+      case 'b':               alert_scroll -= detail_rows - 1;
+                              break;
+
+      case ' ':               alert_scroll += detail_rows - 1;
+                              break;
+
+      // Page through the list (or the alert when the list is hidden)
+      case KEY_PPAGE:         if (list_rows > 0) active_alert -= list_rows;
+                              else alert_scroll -= detail_rows - 1;
+                              if (active_alert < 0) active_alert = 0;
+                              break;
+
+      case KEY_NPAGE:         if (list_rows > 0) active_alert += list_rows;
+                              else alert_scroll += detail_rows - 1;
+                              if (active_alert >= alert_count) active_alert = alert_count > 0 ? alert_count - 1 : 0;
+                              break;
+
+      // Jump to the first, last or typed (123g) alert
+      case '0': case '1': case '2': case '3': case '4':
+      case '5': case '6': case '7': case '8': case '9':
+                              if (jump_index < alert_count) jump_index = jump_index * 10 + (ch - '0');
+                              return;
+
+      case KEY_HOME:
+      case 'g':               active_alert = jump_index > 0 ? jump_index - 1 : 0;
+                              if (active_alert >= alert_count) active_alert = alert_count > 0 ? alert_count - 1 : 0;
+                              break;
+
+      case KEY_END:
+      case 'G':               active_alert = jump_index > 0 ? jump_index - 1 : alert_count - 1;
+                              if (active_alert >= alert_count) active_alert = alert_count - 1;
+                              if (active_alert < 0) active_alert = 0;
+                              break;
+
+      case '/':               searching = true;
+                              break;
+
+      case KEY_ESCAPE:        clear_search();
+                              break;
+
+      case '\t':
+      case 'v':
+      case 'V':               list_visible = !list_visible;
+                              break;
+
+      case 'r':
+      case 'R':               if (attached) request_daemon_refresh();
+                              else request_refresh();
                               break;
 
       case KEY_EXIT:
@@ -86,188 +282,1157 @@ static void process_input(const int ch)
                               break;
    }// End of switch
 
+   jump_index = 0;
+
    zlog_debug(alog, "Exiting");
 }// End of process_input method
 
-static void configure_alert_window(void)
+static void configure_alert_window(const AlertPage *page)
 {
    zlog_debug(alog, "Entering");
 
-   if (!alert_window)
-   {
-      zlog_info(alog, "Setting up alert window");
-
-      alert_window = newwin(winrows - 1, wincols, 0, 0);
-      scrollok(alert_window, true);
-   }// End of window
+   int detail_top = winrows - 1 - detail_rows;
 
-   if (!alerts || alerts->count == 0) return;
+   if (!alert_window) return;
 
-   // Declare variables
-   zlog_info(alog, "Showing alert #%d", active_alert);
-   Alert *alert = alerts->alerts[active_alert];
+   // Configure window (werase, unlike wclear, does not force a full repaint)
+   werase(alert_window);
+   dirty |= DIRTY_ALERT;
 
-   // Configure window
-   wclear(alert_window);
+   if (list_rows > 0) mvwhline(alert_window, 0, 0, ACS_HLINE, wincols);
+   wmove(alert_window, detail_top - list_rows, 0);
 
-   if (!alert)
+   if (!alerts)
    {
-      zlog_warn(alog, "Error getting alert (NULL pointer)");
-      wprintw(alert_window, "SORRY! An error occurred.\n");
-      wrefresh(alert_window);
-      return;
+      wprintw(alert_window, "Loading alerts...\n");
    }// End of if
+   else if (alerts->count > 0 && alert_count == 0)
+   {
+      wprintw(alert_window, "No matching alerts.\n");
+   }// End of else if
+   else if (alert_count > 0 && !page)
+   {
+      zlog_warn(alog, "Error laying out alert #%d", active_alert);
+      wprintw(alert_window, "SORRY! An error occurred.\n");
+   }// End of else if
+
+   wnoutrefresh(alert_window);
 
-   zlog_debug(alog, "Declaring and initializing variables for output");
-   char headline[strlen(alert->headline) + 1];
-   char tm[18];
+   // The alert is already laid out, showing it only copies the visible lines
+   if (page && detail_rows > 0)
+   {
+      zlog_info(alog, "Showing alert #%d from line %d", active_alert, alert_scroll);
+      pnoutrefresh(page->pad, alert_scroll, 0, detail_top, 0, winrows - 2, wincols - 1);
+   }// End of if
 
-   zlog_debug(alog, "Upper-casing headline");
-   snprintf(headline, sizeof(headline), "%s", alert->headline);
-   str_uppercase(headline);
+   zlog_debug(alog, "Exiting");
+}// End of configure_alert_window method
 
-   zlog_debug(alog, "Printing headline");
-   wattron(alert_window, COLOR_PAIR(HEADLINE_COLOUR));
-   wprintw(alert_window, " *** %s *** \n", headline);
-   wattroff(alert_window, COLOR_PAIR(HEADLINE_COLOUR));
+static void configure_stats_window(void)
+{
+   zlog_debug(alog, "Entering");
 
-   zlog_debug(alog, "Printing issuer");
-   wprintw(alert_window, "Issued by ");
-   wattron(alert_window, A_BOLD);
-   wprintw(alert_window, "%s", alert->issuer);
-   wattroff(alert_window, A_BOLD);
+   if (!stats_window) return;
 
-   zlog_debug(alog, "Printing effective time");
-   wprintw(alert_window, " on ");
-   wattron(alert_window, A_BOLD);
-   strftime(tm, sizeof(tm) - 1, "%Y-%m-%d %H:%M", &alert->effective);
-   wprintw(alert_window, "%s", tm);
-   wattroff(alert_window, A_BOLD);
+   // Compose the status line
+   char status[sizeof(shown_status)];
+   int length = 0;
 
-   zlog_debug(alog, "Printing expires time");
-   wprintw(alert_window, "\nEffective until ");
-   wattron(alert_window, A_BOLD);
-   strftime(tm, sizeof(tm) - 1, "%Y-%m-%d %H:%M", &alert->expires);
-   wprintw(alert_window, "%s", tm);
-   wattroff(alert_window, A_BOLD);
-   wprintw(alert_window, ".\n\n");
+   if (searching)
+   {
+      length = snprintf(status, sizeof(status), "/%s_", search_text);
+   }// End of if
+   else
+   {
+      length = snprintf(status, sizeof(status), "Alerts Canada");
+   }// End of else
 
-   zlog_debug(alog, "Printing areas");
-   wprintw(alert_window, "For ");
-   for (int x = 0; x < alert->area_count; ++x)
+   if (!alerts)
+   {
+      length += snprintf(status + length, sizeof(status) - length, " | Loading");
+   }// End of if
+   else if (alerts->count == 0)
    {
-      if (x > 0) wprintw(alert_window, ", ");
+      length += snprintf(status + length, sizeof(status) - length, " | No active alerts");
+   }// End of else if
+   else
+   {
+      if (search)
+      {
+         length += snprintf(status + length, sizeof(status) - length, " | %d match%s", alert_count,
+                            alert_count == 1 ? "" : "es");
+      }// End of if
+
+      if (alert_count > 0)
+      {
+         length += snprintf(status + length, sizeof(status) - length, " | %d of %d", active_alert + 1, alert_count);
+      }// End of if
+
+      if (alert_expired)
+      {
+         length += snprintf(status + length, sizeof(status) - length, " | Expired");
+      }// End of if
+
+      if (alert_lines > detail_rows)
+      {
+         length += snprintf(status + length, sizeof(status) - length, " | Lines %d-%d of %d", alert_scroll + 1,
+                            alert_scroll + detail_rows < alert_lines ? alert_scroll + detail_rows : alert_lines,
+                            alert_lines);
+      }// End of if
+   }// End of else
 
-      wattron(alert_window, A_BOLD);
-      wprintw(alert_window, "%s", alert->areas[x]->name);
-      wattroff(alert_window, A_BOLD);
-   }// End of for
-   wprintw(alert_window, ".\n\n\n\n");
+   if (length >= (int)sizeof(status)) length = sizeof(status) - 1;
 
-   zlog_debug(alog, "Printing description");
-   wprintw(alert_window, "%s\n\n", alert->description);
+   time_t now = time(NULL);
+   strftime(status + length, sizeof(status) - length, " | %H:%M", localtime(&now));
 
-   zlog_debug(alog, "Printing instruction");
-   wattron(alert_window, A_BOLD);
-   wprintw(alert_window, "%s\n\n", alert->instruction);
-   wattroff(alert_window, A_BOLD);
+   // Nothing to do if the line on screen is the same
+   if (!(dirty & DIRTY_STATUS) && strcmp(status, shown_status) == 0) return;
 
-   wrefresh(alert_window);
+   // Configure window
+   werase(stats_window);
+   wprintw(stats_window, "%s", status);
+   wnoutrefresh(stats_window);
+
+   snprintf(shown_status, sizeof(shown_status), "%s", status);
+   dirty |= DIRTY_STATUS;
 
    zlog_debug(alog, "Exiting");
-}// End of configure_alert_window method
+}// End of configure_stats_window method
 
-static void configure_stats_window(void)
+static void configure_list_window(void)
 {
    zlog_debug(alog, "Entering");
 
-   if (!stats_window)
-   {
-      stats_window = newwin(1, wincols, winrows - 1, 0);
-   }// End of window
+   if (!list_window) return;
 
-   if (!alerts) return;
+   // Keep the selected alert in view
+   if (active_alert < list_top) list_top = active_alert;
+   if (active_alert >= list_top + list_rows) list_top = active_alert - list_rows + 1;
+   if (list_top > alert_count - list_rows) list_top = alert_count - list_rows;
+   if (list_top < 0) list_top = 0;
 
-   // Declare variables
+   if (!(dirty & DIRTY_LIST) && alerts->generation == shown_generation
+         && list_top == shown_top && active_alert == shown_selected) return;
 
-   // Configure window
-   wclear(stats_window);
+   draw_alert_list(list_window, alerts, view, alert_count, list_top, active_alert);
 
-   wprintw(stats_window, "Alerts Canada");
+   shown_generation = alerts->generation;
+   shown_top = list_top;
+   shown_selected = active_alert;
+   dirty |= DIRTY_LIST;
 
-   if (alerts->count > 0)
+   zlog_debug(alog, "Exiting");
+}// End of configure_list_window method
+
+/*
+   place_window(window, rows, cols, y, x) Makes window rows x cols at (y, x),
+                                            resizing and moving it in place.
+      PRE:  Valid window pointer (*window may be NULL)
+      POST: Returns true if the window is new or changed (and has to be
+            drawn again). *window is NULL if it has no room.
+*/
+static bool place_window(WINDOW **window, int rows, int cols, int y, int x)
+{
+   // newwin treats 0 as "up to the edge of the screen"
+   if (rows <= 0 || cols <= 0)
    {
-      wprintw(stats_window, " | %d of %d", active_alert + 1, alerts->count);
+      if (*window) delwin(*window);
+      *window = NULL;
+      return false;
    }// End of if
-   else
+
+   if (*window)
    {
-      wprintw(stats_window, " | No active alerts");
-   }// End of else
+      int current_rows = 0, current_cols = 0, current_y = 0, current_x = 0;
+      getmaxyx(*window, current_rows, current_cols);
+      getbegyx(*window, current_y, current_x);
 
-   wrefresh(stats_window);
+      if (current_rows == rows && current_cols == cols && current_y == y && current_x == x) return false;
 
-   zlog_debug(alog, "Exiting");
-}// End of configure_stats_window method
+      if (wresize(*window, rows, cols) == OK && mvwin(*window, y, x) == OK) return true;
 
-static void configure_input_window(void)
+      delwin(*window);
+   }// End of if
+
+   *window = newwin(rows, cols, y, x);
+   return true;
+}// End of place_window method
+
+/*
+   layout_windows() Places the windows for the screen size and the list.
+      PRE:  list_rows is set
+      POST: Windows are resized and moved in place, those that changed are
+            marked to be drawn again.
+*/
+static void layout_windows(void)
 {
    zlog_debug(alog, "Entering");
 
-   if (!input_window)
+   if (place_window(&list_window, list_rows, wincols, 0, 0)) dirty |= DIRTY_LIST;
+
+   // Below the list, starting with the rule that separates them
+   if (place_window(&alert_window, winrows - 1 - list_rows, wincols, list_rows, 0)) dirty |= DIRTY_ALERT;
+
+   if (place_window(&stats_window, 1, wincols, winrows - 1, 0)) dirty |= DIRTY_STATUS;
+
+   if (place_window(&input_window, 1, 1, winrows - 1, wincols - 1))
    {
-      input_window = newwin(1, 1, winrows - 1, wincols - 1);
       keypad(input_window, true);
-   }// End of window
+      nodelay(input_window, true);
+   }// End of if
 
-   // Declare variables
-   int ch = 0;
+   zlog_debug(alog, "Exiting");
+}// End of layout_windows method
 
-   // Configure window
-   wclear(input_window);
+/*
+   schedule_timer(now) Arms the timer for the next minute (clock) or the next
+                        alert expiry, whichever comes first.
+      PRE:  alerts is pinned (or NULL)
+*/
+static void schedule_timer(time_t now)
+{
+   time_t next = now - now % CLOCK_INTERVAL + CLOCK_INTERVAL;
+
+   // The next expiry only changes with the snapshot (or once it passed)
+   if (alerts && (alerts->generation != expiry_generation || next_expiry <= now))
+   {
+      next_expiry = 0;
+
+      for (int x = 0; x < alerts->count; ++x)
+      {
+         time_t expires = alert_expiry(alerts->alerts[x]);
+         if (expires > now && (next_expiry == 0 || expires < next_expiry)) next_expiry = expires;
+      }// End of for
+
+      expiry_generation = alerts->generation;
+   }// End of if
+
+   if (next_expiry > now && next_expiry < next) next = next_expiry;
+
+   struct itimerspec spec = { { 0, 0 }, { next, 0 } };
+   timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}// End of schedule_timer method
+
+/*
+   configure_search() Brings the search up to date with the search text and
+                      the pinned snapshot.
+      PRE:  alerts is pinned (not NULL)
+      POST: view and alert_count are the alerts matching the search.
+*/
+static void configure_search(void)
+{
+   zlog_debug(alog, "Entering");
+
+   if (!searching && !search_text[0])
+   {
+      if (search) clear_search();
+      return;
+   }// End of if
+
+   // Indexes refer to one snapshot, index the new one
+   bool reindexed = false;
+
+   if (search && search_generation != alerts->generation)
+   {
+      reindexed = true;
+      free_search(search);
+      free_search_index(search_index);
+      search = NULL;
+      search_index = NULL;
+   }// End of if
+
+   if (!search)
+   {
+      search_index = create_search_index(alerts);
+      search = search_index ? create_search(search_index) : NULL;
+      search_generation = alerts->generation;
+
+      if (!search)
+      {
+         clear_search();
+         return;
+      }// End of if
+   }// End of if
+
+   // Keep what the query and the text have in common, type the rest
+   const char *query = search_query(search);
+   size_t common = 0;
+
+   while (query[common] && query[common] == search_text[common]) ++common;
+
+   if (query[common] || search_text[common])
+   {
+      while (strlen(search_query(search)) > common) search_backspace(search);
+      for (const char *c = search_text + common; *c; ++c) search_append(search, *c);
 
-   ch = wgetch(input_window);
-   process_input(ch);
+      active_alert = 0;
+      dirty |= DIRTY_LIST;
+   }// End of if
+
+   view = search_results(search, &alert_count);
 
-   wrefresh(input_window);
+   // The same search on a new snapshot stays on the alert shown if it still matches
+   if (reindexed)
+   {
+      active_alert = find_alert(shown_alert);
+      if (active_alert < 0) active_alert = 0;
+   }// End of if
 
    zlog_debug(alog, "Exiting");
-}// End of configure_input_window method
+}// End of configure_search method
 
 static void configure_windows(void)
 {
-   zlog_debug(alog, "Entering")
+   zlog_debug(alog, "Entering");
+
+   uint64_t start = stats_clock();
 
    getmaxyx(stdscr, winrows, wincols);
 
-   configure_alert_window();
+   // Pin the current snapshot while rendering it, the refresher may publish
+   // a new one at any time.
+   alerts = acquire_snapshot(ui_reader);
+   alert_count = alerts ? alerts->count : 0;
+   view = NULL;
+
+   if (alerts) configure_search();
+
+   if (active_alert >= alert_count) active_alert = alert_count > 0 ? alert_count - 1 : 0;
+
+   // Split the screen between the list (a third) and the alert
+   int rows = list_visible && alert_count > 1 ? (winrows - 1) / 3 : 0;
+   if (rows > alert_count) rows = alert_count;
+
+   list_rows = rows;
+   detail_rows = winrows - 1 - (list_rows > 0 ? list_rows + 1 : 0);
+   if (detail_rows < 0) detail_rows = 0;
+
+   layout_windows();
+
+   if (alerts) configure_list_window();
+
+   // The alert only needs drawing again if a different alert (or another
+   // part of it) is shown. Unchanged alerts keep their object across snapshots.
+   time_t now = time(NULL);
+   Alert *alert = alert_count > 0 ? alerts->alerts[view ? view[active_alert] : active_alert] : NULL;
+   AlertPage *page = alert ? get_alert_page(alert, wincols) : NULL;
+   bool loading = !alerts;
+
+   // Another alert starts at its top
+   if (active_alert != shown_active) alert_scroll = 0;
+   shown_active = active_alert;
+
+   alert_lines = page ? page->lines : 0;
+   alert_expired = alert && alert_expiry(alert) <= now;
+
+   if (alert_scroll > alert_lines - detail_rows) alert_scroll = alert_lines - detail_rows;
+   if (alert_scroll < 0) alert_scroll = 0;
+
+   if ((dirty & DIRTY_ALERT) || alert != shown_alert || alert_scroll != shown_scroll || loading != shown_loading)
+   {
+      configure_alert_window(page);
+
+      free_alert(shown_alert);
+      shown_alert = alert ? retain_alert(alert) : NULL;
+      shown_scroll = alert_scroll;
+      shown_loading = loading;
+   }// End of if
+
    configure_stats_window();
-   configure_input_window();
+   schedule_timer(now);
+
+   release_snapshot(ui_reader);
+   alerts = NULL;
+
+   // Send everything that changed to the terminal at once
+   if (dirty) doupdate();
+   dirty = 0;
+
+   record_stat_since(STATS_RENDER, start);
 
    zlog_debug(alog, "Exiting");
 }// End of configure_windows method
 
-int main(void)
+static void free_windows(void)
+{
+   if (list_window) delwin(list_window);
+   if (alert_window) delwin(alert_window);
+   if (stats_window) delwin(stats_window);
+   if (input_window) delwin(input_window);
+
+   list_window = alert_window = stats_window = input_window = NULL;
+
+   free_alert(shown_alert);
+   shown_alert = NULL;
+   dirty = DIRTY_ALERT | DIRTY_STATUS | DIRTY_LIST;
+}// End of free_windows method
+
+/* EVENT HANDLERS */
+static void handle_input(int fd, uint32_t events, void *data)
+{
+   zlog_debug(alog, "Entering");
+
+   (void)fd; (void)events; (void)data;
+
+   // Drain everything ncurses has buffered, the terminal only signals once
+   int ch = 0;
+   while ((ch = wgetch(input_window)) != ERR && active_alert >= 0) process_input(ch);
+
+   if (active_alert < 0)
+   {
+      stop_event_loop();
+      return;
+   }// End of if
+
+   configure_windows();
+
+   zlog_debug(alog, "Exiting");
+}// End of handle_input method
+
+static void handle_snapshot(int fd, uint32_t events, void *data)
+{
+   (void)events; (void)data;
+
+   uint64_t published = 0;
+   if (read(fd, &published, sizeof(published)) < 0) return;
+
+   zlog_info(alog, "New snapshot published");
+   configure_windows();
+}// End of handle_snapshot method
+
+static void handle_timer(int fd, uint32_t events, void *data)
+{
+   (void)events; (void)data;
+
+   uint64_t expirations = 0;
+   if (read(fd, &expirations, sizeof(expirations)) < 0) return;
+
+   configure_windows();
+}// End of handle_timer method
+
+/*
+   write_report() Writes the last transfer of every feed, the phase timings and
+                  memory use to stderr.
+*/
+static void write_report(void)
+{
+   write_feed_stats(stderr);
+   write_stats(stderr);
+   write_memory_stats(stderr);
+}// End of write_report method
+
+static void handle_signal(int fd, uint32_t events, void *data)
 {
-   configure_log();
+   zlog_debug(alog, "Entering");
+
+   (void)events; (void)data;
+
+   // Dragging a window edge sends a burst of SIGWINCH, handle them at once
+   struct signalfd_siginfo info;
+   bool resized = false;
 
-   // Load current alerts
-   alerts = load_alerts_from_http_json_file("https://alerts.zacharyseguin.ca/api/alerts.json");
+   while (read(fd, &info, sizeof(info)) == sizeof(info))
+   {
+      if (info.ssi_signo == SIGUSR1)
+      {
+         write_report();
+         continue;
+      }// End of if
 
-   // return -1;
+      if (info.ssi_signo == SIGUSR2)
+      {
+         write_trace(trace_path);
+         continue;
+      }// End of if
+
+      if (info.ssi_signo != SIGWINCH)
+      {
+         interrupted = true;
+         stop_event_loop();
+         return;
+      }// End of if
+
+      resized = true;
+   }// End of while
+
+   struct winsize size;
+
+   if (!resized || ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) != 0) return;
+
+   zlog_info(alog, "Terminal resized to %dx%d", size.ws_col, size.ws_row);
+   resizeterm(size.ws_row, size.ws_col);
+
+   // The windows are resized and moved in place, and only the alert shown is
+   // laid out again for a new width (other pages and rows as they are shown)
+   configure_windows();
+
+   zlog_debug(alog, "Exiting");
+}// End of handle_signal method
+
+/*
+   run_interface(snapshot_fd, signal_fd) Shows the alerts until the user quits.
+*/
+static void run_interface(int snapshot_fd, int signal_fd)
+{
    // Set up ncurses
    initscr();
+   cbreak();
+   noecho();
+   curs_set(0);
+   set_escdelay(SEARCH_ESCAPE_DELAY);
    start_color();
    init_pair(HEADLINE_COLOUR, COLOR_BLACK, COLOR_RED);
 
    refresh();
+   configure_windows();
+
+   // Everything happens in response to events: keys, published snapshots,
+   // the clock/expiry timer and signals
+   add_event_source(STDIN_FILENO, EPOLLIN, handle_input, NULL);
+   add_event_source(snapshot_fd, EPOLLIN, handle_snapshot, NULL);
+   add_event_source(timer_fd, EPOLLIN, handle_timer, NULL);
+   add_event_source(signal_fd, EPOLLIN, handle_signal, NULL);
+
+   run_event_loop();
+
+   free_windows();
+   free_alert_pages();
+   free_alert_list();
+   clear_search();
+   endwin();
+}// End of run_interface method
+
+/* HEADLESS MODE */
+static OutputOptions output;
+static bool written = false;           // A single dump was written in full
+
+static void watch_snapshot(void)
+{
+   zlog_debug(alog, "Entering");
+
+   Alerts *snapshot = acquire_snapshot(ui_reader);
+
+   if (snapshot)
+   {
+      time_t next = watch_alerts(&output, snapshot, time(NULL));
+
+      // Wake up when the next alert expires, to report it
+      struct itimerspec spec = { { 0, 0 }, { next, 0 } };
+      timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+   }// End of if
+
+   release_snapshot(ui_reader);
+
+   if (!flush_output()) stop_event_loop();
+
+   zlog_debug(alog, "Exiting");
+}// End of watch_snapshot method
+
+static void handle_watch_event(int fd, uint32_t events, void *data)
+{
+   (void)events; (void)data;
+
+   uint64_t count = 0;
+   if (read(fd, &count, sizeof(count)) < 0) return;
+
+   watch_snapshot();
+}// End of handle_watch_event method
+
+static void handle_dump_event(int fd, uint32_t events, void *data)
+{
+   (void)events; (void)data;
+
+   uint64_t published = 0;
+   if (read(fd, &published, sizeof(published)) < 0) return;
+
+   // Write the first alerts received from the daemon
+   Alerts *snapshot = acquire_snapshot(ui_reader);
+
+   if (snapshot)
+   {
+      write_output_header(&output);
+      write_alerts(&output, snapshot);
+      written = flush_output();
+      stop_event_loop();
+   }// End of if
+
+   release_snapshot(ui_reader);
+}// End of handle_dump_event method
+
+static void handle_dump_timeout(int fd, uint32_t events, void *data)
+{
+   (void)events; (void)data;
+
+   uint64_t expirations = 0;
+   if (read(fd, &expirations, sizeof(expirations)) < 0) return;
+
+   fprintf(stderr, "Timed out waiting for the alerts\n");
+   stop_event_loop();
+}// End of handle_dump_timeout method
+
+static bool write_history_event(const HistoryRecord *record, void *data)
+{
+   (void)data;
+
+   write_history_record(&output, record->kind == HISTORY_REMOVED ? "removed" : "version", record->recorded, record->alert);
+   return true;
+}// End of write_history_event method
+
+/*
+   write_history(path, days, spec) Writes the records of the history in path
+                                   that match spec.
+      POST: Returns the exit status.
+*/
+static int write_history(const char *path, int days, char *spec)
+{
+   HistoryQuery query;
+
+   if (!parse_history_query(spec, &query))
+   {
+      fprintf(stderr, "Invalid history query\n");
+      return 1;
+   }// End of if
 
-   while (active_alert >= 0)
+   if (!open_history(path, days, false))
    {
-      configure_windows();
+      fprintf(stderr, "Failed to open the history in %s\n", path);
+      return 1;
+   }// End of if
+
+   output.history = true;
+   write_output_header(&output);
+
+   long matched = query_history(&query, write_history_event, NULL);
+   close_history();
+
+   return matched >= 0 && flush_output() ? 0 : 1;
+}// End of write_history method
+
+/*
+   write_feeds(feed_set) Loads the feeds once and writes every alert.
+      POST: Returns the exit status.
+*/
+static int write_feeds(FeedSet *feed_set)
+{
+   Alerts *loaded = load_alerts_from_feed_set(feed_set);
+
+   if (!loaded)
+   {
+      fprintf(stderr, "Failed to load the alerts\n");
+      return 1;
+   }// End of if
+
+   write_output_header(&output);
+   write_alerts(&output, loaded);
+   free_alerts(loaded);
+
+   return flush_output() ? 0 : 1;
+}// End of write_feeds method
+
+static void usage(const char *program)
+{
+   FetchPolicy policy = default_fetch_policy();
+
+   fprintf(stderr, "Usage: %s [options] [feed-url[,mirror-url...] ...]\n"
+                   "  -i, --interval SECONDS      Refresh the feeds every SECONDS (default %d)\n"
+                   "  -t, --timeout MS            Deadline for a whole refresh (default %ld)\n"
+                   "      --attempt-timeout MS    Deadline for one request (default %ld)\n"
+                   "      --connect-timeout MS    Deadline to connect to a server (default %ld)\n"
+                   "      --low-speed BYTES,SECS  Abort requests slower than BYTES/s for SECS (default %ld,%ld)\n"
+                   "      --hedge-delay MS        Hedge to a mirror after MS without a first byte,\n"
+                   "                              until the p95 latency is known (default %ld)\n"
+                   "      --stream URL            Follow the first feed through the event stream at URL\n"
+                   "      --daemon PATH           Load the feeds and serve them to clients at the socket PATH\n"
+                   "      --connect PATH          Show (or write) the alerts of the daemon at PATH\n"
+                   "      --shm NAME              Also publish the alerts in the shared memory segment NAME\n"
+                   "      --map NAME              Show (or write) the alerts of the shared memory segment NAME\n"
+                   "      --hook [WORDS=]TARGET   Send new and updated alerts matching WORDS to TARGET,\n"
+                   "                              exec:COMMAND (NDJSON on stdin) or unix:PATH (repeatable),\n"
+                   "                              WORDS may include geocode:CODE and event:TYPE\n"
+                   "      --history DIR           Record every version of the alerts in DIR\n"
+                   "      --history-days DAYS     Keep DAYS of history (default %d)\n"
+                   "      --history-query SPEC    Write the records of the history matching SPEC, comma\n"
+                   "                              separated from=TIME, to=TIME, identifier=ID and\n"
+                   "                              geocode=CODE (TIME is YYYY-MM-DD[THH:MM[:SS]])\n"
+                   "      --metrics [HOST:]PORT   Serve Prometheus metrics over HTTP at PORT (on HOST,\n"
+                   "                              default 127.0.0.1)\n"
+                   "      --metrics-file PATH     Write Prometheus metrics to PATH every %d seconds\n"
+                   "      --headless              Write the alerts to stdout instead of showing them\n"
+                   "      --watch                 Keep running and write add/update/expire events (headless)\n"
+                   "      --format ndjson|tsv     Headless output format (default ndjson)\n"
+                   "      --fields LIST           Headless output fields, comma separated, of identifier,\n"
+                   "                              headline, issuer, effective, expires, areas, description,\n"
+                   "                              instruction (default identifier,effective,expires,\n"
+                   "                              issuer,headline,areas)\n"
+                   "      --log FILE              Log to FILE (- for stderr, default %s)\n"
+                   "      --log-level LEVEL       Log debug, info, warn or off lines (default off, info\n"
+                   "                              with --log)\n"
+                   "      --memory-limit MB       Refuse feeds that would take the alerts over MB\n"
+                   "      --stats                 Write the last transfer of each feed, the time spent in\n"
+                   "                              each phase and the memory used to stderr on exit (and\n"
+                   "                              on SIGUSR1 when headless or a daemon)\n"
+                   "      --trace FILE            Trace the fetch, parse, convert, index, render and\n"
+                   "                              hook spans, write them to FILE as Chrome trace-event\n"
+                   "                              JSON on exit and on SIGUSR2\n"
+                   "  -h, --help                  Show this help\n",
+           program, DEFAULT_REFRESH_INTERVAL, policy.total_timeout, policy.attempt_timeout,
+           policy.connect_timeout, policy.low_speed_limit, policy.low_speed_time, policy.hedge_delay,
+           HISTORY_DEFAULT_RETENTION, METRICS_FILE_INTERVAL, LOG_DEFAULT_PATH);
+}// End of usage method
+
+int main(int argc, char **argv)
+{
+   // Parse options
+   enum { OPT_ATTEMPT_TIMEOUT = 256, OPT_CONNECT_TIMEOUT, OPT_LOW_SPEED, OPT_HEDGE_DELAY, OPT_STREAM,
+          OPT_HEADLESS, OPT_WATCH, OPT_FORMAT, OPT_FIELDS, OPT_DAEMON, OPT_CONNECT,
+          OPT_SHM, OPT_MAP, OPT_HOOK, OPT_HISTORY, OPT_HISTORY_DAYS, OPT_HISTORY_QUERY,
+          OPT_METRICS, OPT_METRICS_FILE, OPT_LOG, OPT_LOG_LEVEL, OPT_MEMORY_LIMIT, OPT_STATS, OPT_TRACE };
+
+   static const struct option options[] = {
+      { "interval",        required_argument, NULL, 'i' },
+      { "timeout",         required_argument, NULL, 't' },
+      { "attempt-timeout", required_argument, NULL, OPT_ATTEMPT_TIMEOUT },
+      { "connect-timeout", required_argument, NULL, OPT_CONNECT_TIMEOUT },
+      { "low-speed",       required_argument, NULL, OPT_LOW_SPEED },
+      { "hedge-delay",     required_argument, NULL, OPT_HEDGE_DELAY },
+      { "stream",          required_argument, NULL, OPT_STREAM },
+      { "headless",        no_argument,       NULL, OPT_HEADLESS },
+      { "watch",           no_argument,       NULL, OPT_WATCH },
+      { "format",          required_argument, NULL, OPT_FORMAT },
+      { "fields",          required_argument, NULL, OPT_FIELDS },
+      { "daemon",          required_argument, NULL, OPT_DAEMON },
+      { "connect",         required_argument, NULL, OPT_CONNECT },
+      { "shm",             required_argument, NULL, OPT_SHM },
+      { "map",             required_argument, NULL, OPT_MAP },
+      { "hook",            required_argument, NULL, OPT_HOOK },
+      { "history",         required_argument, NULL, OPT_HISTORY },
+      { "history-days",    required_argument, NULL, OPT_HISTORY_DAYS },
+      { "history-query",   required_argument, NULL, OPT_HISTORY_QUERY },
+      { "metrics",         required_argument, NULL, OPT_METRICS },
+      { "metrics-file",    required_argument, NULL, OPT_METRICS_FILE },
+      { "log",             required_argument, NULL, OPT_LOG },
+      { "log-level",       required_argument, NULL, OPT_LOG_LEVEL },
+      { "memory-limit",    required_argument, NULL, OPT_MEMORY_LIMIT },
+      { "stats",           no_argument,       NULL, OPT_STATS },
+      { "trace",           required_argument, NULL, OPT_TRACE },
+      { "help",            no_argument,       NULL, 'h' },
+      { NULL,              0,                 NULL, 0 }
+   };
+
+   FetchPolicy policy = default_fetch_policy();
+   int interval = DEFAULT_REFRESH_INTERVAL;
+   const char *stream_url = NULL;
+   const char *daemon_path = NULL;
+   const char *connect_path = NULL;
+   const char *shm_name = NULL;
+   const char *map_name = NULL;
+   const char *history_path = NULL;
+   char *history_query = NULL;
+   int history_days = HISTORY_DEFAULT_RETENTION;
+   const char *metrics_address = NULL;
+   const char *metrics_path = NULL;
+   const char *log_path = NULL;
+   LogLevel log_level = LOG_OFF;
+   bool headless = false;
+   bool stats = false;
+   long memory_limit = 0;
+   int option = 0;
+
+   output = default_output_options();
+
+   while ((option = getopt_long(argc, argv, "i:t:h", options, NULL)) != -1)
+   {
+      switch (option)
+      {
+         case 'i':            interval = atoi(optarg);
+                              break;
+
+         case 't':            policy.total_timeout = atol(optarg);
+                              break;
+
+         case OPT_ATTEMPT_TIMEOUT:
+                              policy.attempt_timeout = atol(optarg);
+                              break;
+
+         case OPT_CONNECT_TIMEOUT:
+                              policy.connect_timeout = atol(optarg);
+                              break;
+
+         case OPT_LOW_SPEED:  if (sscanf(optarg, "%ld,%ld", &policy.low_speed_limit, &policy.low_speed_time) != 2)
+                              {
+                                 usage(argv[0]);
+                                 return 1;
+                              }// End of if
+                              break;
+
+         case OPT_HEDGE_DELAY:
+                              policy.hedge_delay = atol(optarg);
+                              break;
+
+         case OPT_STREAM:     stream_url = optarg;
+                              break;
+
+         case OPT_WATCH:      output.watch = true;
+                              headless = true;
+                              break;
+
+         case OPT_HEADLESS:   headless = true;
+                              break;
+
+         case OPT_FORMAT:     if (!parse_output_format(optarg, &output))
+                              {
+                                 usage(argv[0]);
+                                 return 1;
+                              }// End of if
+                              break;
+
+         case OPT_FIELDS:     if (!parse_output_fields(optarg, &output))
+                              {
+                                 usage(argv[0]);
+                                 return 1;
+                              }// End of if
+                              break;
+
+         case OPT_DAEMON:     daemon_path = optarg;
+                              break;
+
+         case OPT_CONNECT:    connect_path = optarg;
+                              break;
+
+         case OPT_SHM:        shm_name = optarg;
+                              break;
+
+         case OPT_MAP:        map_name = optarg;
+                              break;
+
+         case OPT_HOOK:       if (!add_hook(optarg))
+                              {
+                                 fprintf(stderr, "%s: invalid hook %s\n", argv[0], optarg);
+                                 return 1;
+                              }// End of if
+                              break;
+
+         case OPT_HISTORY:    history_path = optarg;
+                              break;
+
+         case OPT_HISTORY_DAYS:
+                              history_days = atoi(optarg);
+                              break;
+
+         case OPT_HISTORY_QUERY:
+                              history_query = optarg;
+                              break;
+
+         case OPT_METRICS:    metrics_address = optarg;
+                              break;
+
+         case OPT_METRICS_FILE:
+                              metrics_path = optarg;
+                              break;
+
+         case OPT_LOG:        log_path = optarg;
+                              if (log_level == LOG_OFF) log_level = LOG_INFO;
+                              break;
+
+         case OPT_LOG_LEVEL:  if (!parse_log_level(optarg, &log_level))
+                              {
+                                 usage(argv[0]);
+                                 return 1;
+                              }// End of if
+                              break;
+
+         case OPT_MEMORY_LIMIT:
+                              memory_limit = atol(optarg);
+                              break;
+
+         case OPT_STATS:      stats = true;
+                              break;
+
+         case OPT_TRACE:      trace_path = optarg;
+                              break;
+
+         case 'h':            usage(argv[0]);
+                              return 0;
+
+         default:             usage(argv[0]);
+                              return 1;
+      }// End of switch
    }// End of while
 
-   endwin();
+   if (!configure_log(log_path ? log_path : LOG_DEFAULT_PATH, log_level))
+   {
+      fprintf(stderr, "%s: failed to open the log %s\n", argv[0], log_path ? log_path : LOG_DEFAULT_PATH);
+      return 1;
+   }// End of if
+
+   if (interval <= 0)
+   {
+      fprintf(stderr, "%s: invalid refresh interval\n", argv[0]);
+      return 1;
+   }// End of if
+
+   if (daemon_path && (connect_path || headless))
+   {
+      fprintf(stderr, "%s: --daemon cannot be combined with --connect or --headless\n", argv[0]);
+      return 1;
+   }// End of if
+
+   if (map_name && connect_path)
+   {
+      fprintf(stderr, "%s: --map cannot be combined with --connect\n", argv[0]);
+      return 1;
+   }// End of if
+
+   if (memory_limit < 0)
+   {
+      fprintf(stderr, "%s: invalid memory limit\n", argv[0]);
+      return 1;
+   }// End of if
+
+   set_memory_limit((size_t)memory_limit * 1024 * 1024);
+
+   if (trace_path)
+   {
+      enable_trace();
+      name_trace_thread("main");
+   }// End of if
+
+   if (history_days <= 0)
+   {
+      fprintf(stderr, "%s: invalid number of history days\n", argv[0]);
+      return 1;
+   }// End of if
+
+   if (history_query && !history_path)
+   {
+      fprintf(stderr, "%s: --history-query needs --history\n", argv[0]);
+      return 1;
+   }// End of if
+
+   // Querying the history needs nothing else
+   if (history_query)
+   {
+      int status = write_history(history_path, history_days, history_query);
+
+      close_log();
+      return status;
+   }// End of if
+
+   // Feeds are given on the command line (national feed by default)
+   static const char *default_feeds[] = { DEFAULT_FEED_URL };
+   const char * const *feeds = default_feeds;
+   int feed_count = 1;
+
+   if (optind < argc)
+   {
+      feeds = (const char * const *)&argv[optind];
+      feed_count = argc - optind;
+   }// End of if
+
+   // A single headless dump needs neither threads nor an event loop (unless it
+   // is recorded or exported)
+   if (headless && !output.watch && !connect_path && !map_name && !history_path
+         && !metrics_address && !metrics_path)
+   {
+      curl_global_init(CURL_GLOBAL_DEFAULT);
+
+      FeedSet *feed_set = create_feed_set(feeds, feed_count, &policy);
+      int status = feed_set ? write_feeds(feed_set) : 1;
+
+      free_feed_set(feed_set);
+      curl_global_cleanup();
+      if (stats) write_report();
+      if (trace_path) write_trace(trace_path);
+      close_trace();
+      close_log();
+
+      return status;
+   }// End of if
+
+   // Otherwise a single dump is written from the event loop (once recorded,
+   // exported or received from a daemon or a segment)
+   bool one_shot = headless && !output.watch && !daemon_path;
+   FeedSet *feed_set = NULL;
+   int status = 0;
+
+   // Signals are delivered through the event loop. They have to be blocked
+   // before any thread is started so that no other thread takes them.
+   sigset_t signals;
+   sigemptyset(&signals);
+   if (!headless && !daemon_path) sigaddset(&signals, SIGWINCH);
+   else sigaddset(&signals, SIGUSR1);
+   if (trace_path) sigaddset(&signals, SIGUSR2);
+   sigaddset(&signals, SIGINT);
+   sigaddset(&signals, SIGTERM);
+   pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+   int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+   timer_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+
+   if (signal_fd < 0 || timer_fd < 0 || !create_event_loop())
+   {
+      fprintf(stderr, "%s: failed to set up the event loop\n", argv[0]);
+      status = 1;
+      goto cleanup;
+   }// End of if
+
+   // Load alerts in the background
+   curl_global_init(CURL_GLOBAL_DEFAULT);
+   ui_reader = register_snapshot_reader();
+
+   int snapshot_fd = open_snapshot_notifier();
+
+   if (!start_hooks())
+   {
+      fprintf(stderr, "%s: failed to start the hooks\n", argv[0]);
+      status = 1;
+      goto cleanup;
+   }// End of if
+
+   // Snapshots are written to the segment as they are published
+   if (shm_name && !open_shm_publisher(shm_name))
+   {
+      fprintf(stderr, "%s: failed to create the shared memory segment %s\n", argv[0], shm_name);
+      status = 1;
+      goto cleanup;
+   }// End of if
+
+   if ((metrics_address || metrics_path) && !start_metrics(metrics_address, metrics_path))
+   {
+      fprintf(stderr, "%s: failed to export the metrics to %s\n", argv[0],
+              metrics_address ? metrics_address : metrics_path);
+      status = 1;
+      goto cleanup;
+   }// End of if
+
+   // Every version of the alerts is recorded as snapshots are published
+   if (history_path && !open_history(history_path, history_days, true))
+   {
+      fprintf(stderr, "%s: failed to open the history in %s\n", argv[0], history_path);
+      status = 1;
+      goto cleanup;
+   }// End of if
+
+   // Alerts are either received from a daemon, read from shared memory or loaded here
+   if (connect_path)
+   {
+      if (!attach_daemon(connect_path))
+      {
+         fprintf(stderr, "%s: failed to connect to the daemon at %s\n", argv[0], connect_path);
+         status = 1;
+         goto cleanup;
+      }// End of if
+
+      attached = true;
+   }// End of if
+   else if (map_name)
+   {
+      if (!follow_shm(map_name))
+      {
+         fprintf(stderr, "%s: failed to follow %s\n", argv[0], map_name);
+         status = 1;
+         goto cleanup;
+      }// End of if
+   }// End of else if
+   else if (one_shot)
+   {
+      // Load the feeds once, publishing them records and exports them
+      feed_set = create_feed_set(feeds, feed_count, &policy);
+      Alerts *loaded = feed_set ? load_alerts_from_feed_set(feed_set) : NULL;
+
+      if (!loaded)
+      {
+         fprintf(stderr, "Failed to load the alerts\n");
+         status = 1;
+         goto cleanup;
+      }// End of if
 
-   free_alerts(alerts);
+      publish_snapshot(loaded);
+   }// End of else if
+   else
+   {
+      feed_set = create_feed_set(feeds, feed_count, &policy);
+
+      if (!feed_set || !start_refresher(feed_set, interval, stream_url))
+      {
+         fprintf(stderr, "%s: failed to start the refresher\n", argv[0]);
+         status = 1;
+         goto cleanup;
+      }// End of if
+   }// End of else
+
+   if (daemon_path)
+   {
+      if (!start_daemon(daemon_path, snapshot_fd))
+      {
+         fprintf(stderr, "%s: failed to listen on %s\n", argv[0], daemon_path);
+         status = 1;
+         goto cleanup;
+      }// End of if
+
+      add_event_source(signal_fd, EPOLLIN, handle_signal, NULL);
+      run_event_loop();
+
+      stop_daemon();
+   }// End of if
+   else if (one_shot)
+   {
+      // A daemon or a segment may never publish, give up after a whole refresh
+      struct itimerspec spec = { { 0, 0 }, { policy.total_timeout / 1000, (policy.total_timeout % 1000) * 1000000 } };
+      timerfd_settime(timer_fd, 0, &spec, NULL);
+
+      add_event_source(snapshot_fd, EPOLLIN, handle_dump_event, NULL);
+      add_event_source(timer_fd, EPOLLIN, handle_dump_timeout, NULL);
+      add_event_source(signal_fd, EPOLLIN, handle_signal, NULL);
+
+      run_event_loop();
+
+      if (!written || interrupted) status = 1;
+      free_output();
+   }// End of else if
+   else if (headless)
+   {
+      // Write events as snapshots are published (and alerts expire)
+      write_output_header(&output);
+
+      add_event_source(snapshot_fd, EPOLLIN, handle_watch_event, NULL);
+      add_event_source(timer_fd, EPOLLIN, handle_watch_event, NULL);
+      add_event_source(signal_fd, EPOLLIN, handle_signal, NULL);
+
+      watch_snapshot();
+      run_event_loop();
+
+      free_output();
+   }// End of if
+   else
+   {
+      run_interface(snapshot_fd, signal_fd);
+   }// End of else
+
+   // Stop whatever was started, also when starting something failed
+cleanup:
+   detach_daemon();
+   stop_following_shm();
+   stop_refresher();
+   stop_hooks();
+   stop_metrics();
+   close_history();
+   close_shm_publisher();
+   free_event_loop();
+   close(signal_fd);
+   close(timer_fd);
+   unregister_snapshot_reader(ui_reader);
+   close_snapshot_notifier();
+   free_snapshots();
+   free_feed_set(feed_set);
+   curl_global_cleanup();
+
+   if (stats) write_report();
+   if (trace_path) write_trace(trace_path);
+   close_trace();
    close_log();
+
+   return status;
 }// End of main method
+
@@ -0,0 +1,573 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "match.h"
+
+#include "log.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#define MATCH_MIN_SUBSCRIPTIONS 1024
+#define MATCH_MIN_GEOCODES 1024
+#define MATCH_EVENT_SLOTS (MATCH_MAX_EVENTS * 2)
+
+struct Posting {
+   int *subscriptions;
+   int count;
+   int capacity;
+};
+typedef struct Posting Posting;
+
+struct GeocodePosting {
+   bool used;
+   int geocode;
+   Posting posting;
+};
+typedef struct GeocodePosting GeocodePosting;
+
+struct EventType {
+   char *name;                // Lower case
+   Posting without_geocodes;  // Subscriptions to the type without geocodes
+   uint64_t *bits;            // Subscriptions to the type
+};
+typedef struct EventType EventType;
+
+struct Subscription {
+   bool used;
+   int geocode_count;
+   int *geocodes;             // Sorted, unique
+   int event_count;
+   int *events;               // Indexes of the event types, unique
+};
+typedef struct Subscription Subscription;
+
+struct Matcher {
+   Subscription *subscriptions;
+   int subscription_count;    // Numbers given out so far
+   int capacity;
+   int words;                 // Of every bitset (capacity / 64)
+
+   int *unused;               // Removed numbers, to give out again
+   int unused_count;
+
+   GeocodePosting *geocodes;
+   unsigned long geocode_mask;
+   unsigned long geocode_count;
+
+   EventType events[MATCH_MAX_EVENTS];
+   int event_count;
+   short event_slots[MATCH_EVENT_SLOTS];     // Index + 1 of the type, 0 if free
+
+   Posting anything;          // Subscriptions without geocodes or event types
+   uint64_t *any_event;       // Subscriptions without event types
+   uint64_t *matched;         // Set while matching, cleared from the results
+};
+
+static bool test_bit(const uint64_t *bits, int bit)
+{
+   return bits[bit / 64] & (1ULL << (bit % 64));
+}// End of test_bit method
+
+static void set_bit(uint64_t *bits, int bit)
+{
+   bits[bit / 64] |= 1ULL << (bit % 64);
+}// End of set_bit method
+
+static void clear_bit(uint64_t *bits, int bit)
+{
+   bits[bit / 64] &= ~(1ULL << (bit % 64));
+}// End of clear_bit method
+
+static bool push(Posting *posting, int subscription)
+{
+   if (posting->count == posting->capacity)
+   {
+      int capacity = posting->capacity ? posting->capacity * 2 : 4;
+      int *grown = realloc(posting->subscriptions, capacity * sizeof(int));
+
+      if (!grown) return false;
+
+      posting->subscriptions = grown;
+      posting->capacity = capacity;
+   }// End of if
+
+   posting->subscriptions[posting->count++] = subscription;
+   return true;
+}// End of push method
+
+/*
+   pull(posting, subscription) Removes subscription from posting, moving the
+                               last one in its place.
+*/
+static void pull(Posting *posting, int subscription)
+{
+   for (int x = 0; x < posting->count; ++x)
+   {
+      if (posting->subscriptions[x] != subscription) continue;
+
+      posting->subscriptions[x] = posting->subscriptions[--posting->count];
+      return;
+   }// End of for
+}// End of pull method
+
+// IMPLEMENTATION: See header for details
+Matcher * create_matcher(void)
+{
+   Matcher *matcher = calloc(1, sizeof(Matcher));
+
+   if (!matcher)
+   {
+      zlog_warn(alog, "Failed to allocate memory for a matcher");
+      return NULL;
+   }// End of if
+
+   return matcher;
+}// End of create_matcher method
+
+static unsigned long hash_geocode(int geocode)
+{
+   uint64_t hash = (uint64_t)(uint32_t)geocode * 0x9e3779b97f4a7c15ULL;
+   return hash ^ (hash >> 32);
+}// End of hash_geocode method
+
+/*
+   find_geocode(matcher, geocode) Returns the posting list of geocode, or the
+                                  free slot to put it in.
+      PRE:  The table is allocated
+*/
+static GeocodePosting * find_geocode(Matcher *matcher, int geocode)
+{
+   for (unsigned long slot = hash_geocode(geocode) & matcher->geocode_mask; ; slot = (slot + 1) & matcher->geocode_mask)
+   {
+      GeocodePosting *entry = &matcher->geocodes[slot];
+      if (!entry->used || entry->geocode == geocode) return entry;
+   }// End of for
+}// End of find_geocode method
+
+/*
+   add_geocode(matcher, geocode) Returns the posting list of geocode, adding
+                                 an empty one if it has none.
+      POST: Returns NULL if memory could not be allocated.
+*/
+static GeocodePosting * add_geocode(Matcher *matcher, int geocode)
+{
+   GeocodePosting *entry = matcher->geocodes ? find_geocode(matcher, geocode) : NULL;
+   if (entry && entry->used) return entry;
+
+   if (!matcher->geocodes || (matcher->geocode_count + 1) * 2 > matcher->geocode_mask + 1)
+   {
+      unsigned long mask = matcher->geocode_mask ? matcher->geocode_mask * 2 + 1 : MATCH_MIN_GEOCODES - 1;
+      GeocodePosting *table = calloc(mask + 1, sizeof(GeocodePosting));
+
+      if (!table) return NULL;
+
+      GeocodePosting *old = matcher->geocodes;
+      unsigned long old_mask = matcher->geocode_mask;
+
+      matcher->geocodes = table;
+      matcher->geocode_mask = mask;
+
+      for (unsigned long x = 0; old && x <= old_mask; ++x)
+      {
+         if (old[x].used) *find_geocode(matcher, old[x].geocode) = old[x];
+      }// End of for
+
+      free(old);
+   }// End of if
+
+   entry = find_geocode(matcher, geocode);
+   entry->used = true;
+   entry->geocode = geocode;
+   ++matcher->geocode_count;
+
+   return entry;
+}// End of add_geocode method
+
+/*
+   fold_event(name, folded) Copies the event type name in lower case to
+                            folded (MATCH_MAX_EVENT_NAME + 1 bytes).
+      POST: Returns false if name is too long.
+*/
+static bool fold_event(const char *name, char *folded)
+{
+   size_t length = 0;
+
+   for (; name[length]; ++length)
+   {
+      if (length == MATCH_MAX_EVENT_NAME) return false;
+      folded[length] = tolower((unsigned char)name[length]);
+   }// End of for
+
+   folded[length] = '\0';
+   return true;
+}// End of fold_event method
+
+/*
+   find_event(matcher, name) Returns the index of the event type name (in
+                             lower case), or -1.
+*/
+static int find_event(const Matcher *matcher, const char *name)
+{
+   for (unsigned long slot = hash_identifier(name) % MATCH_EVENT_SLOTS; matcher->event_slots[slot]; slot = (slot + 1) % MATCH_EVENT_SLOTS)
+   {
+      int index = matcher->event_slots[slot] - 1;
+      if (strcmp(matcher->events[index].name, name) == 0) return index;
+   }// End of for
+
+   return -1;
+}// End of find_event method
+
+/*
+   add_event(matcher, name) Returns the index of the event type name, adding
+                            it if it is new.
+      POST: Returns -1 if memory could not be allocated or there are
+            MATCH_MAX_EVENTS types.
+*/
+static int add_event(Matcher *matcher, const char *name)
+{
+   char folded[MATCH_MAX_EVENT_NAME + 1];
+   if (!fold_event(name, folded)) return -1;
+
+   int index = find_event(matcher, folded);
+   if (index >= 0 || matcher->event_count == MATCH_MAX_EVENTS) return index;
+
+   EventType *event = &matcher->events[matcher->event_count];
+   event->name = strdup(folded);
+   event->bits = calloc(matcher->words > 0 ? matcher->words : 1, sizeof(uint64_t));
+
+   if (!event->name || !event->bits)
+   {
+      free(event->name);
+      free(event->bits);
+      memset(event, 0, sizeof(EventType));
+      return -1;
+   }// End of if
+
+   unsigned long slot = hash_identifier(folded) % MATCH_EVENT_SLOTS;
+   while (matcher->event_slots[slot]) slot = (slot + 1) % MATCH_EVENT_SLOTS;
+
+   matcher->event_slots[slot] = matcher->event_count + 1;
+   return matcher->event_count++;
+}// End of add_event method
+
+static bool grow_bits(uint64_t **bits, int words, int grown)
+{
+   uint64_t *data = realloc(*bits, grown * sizeof(uint64_t));
+   if (!data) return false;
+
+   memset(data + words, 0, (grown - words) * sizeof(uint64_t));
+   *bits = data;
+
+   return true;
+}// End of grow_bits method
+
+/*
+   new_subscription(matcher) Returns an unused subscription number, growing
+                             the subscriptions and bitsets if needed.
+      POST: Returns -1 if memory could not be allocated.
+*/
+static int new_subscription(Matcher *matcher)
+{
+   if (matcher->unused_count > 0) return matcher->unused[--matcher->unused_count];
+
+   if (matcher->subscription_count == matcher->capacity)
+   {
+      int capacity = matcher->capacity ? matcher->capacity * 2 : MATCH_MIN_SUBSCRIPTIONS;
+      int words = capacity / 64;
+      Subscription *subscriptions = realloc(matcher->subscriptions, capacity * sizeof(Subscription));
+
+      if (!subscriptions) return -1;
+
+      matcher->subscriptions = subscriptions;
+      memset(subscriptions + matcher->capacity, 0, (capacity - matcher->capacity) * sizeof(Subscription));
+
+      int *unused = realloc(matcher->unused, capacity * sizeof(int));
+      if (!unused) return -1;
+
+      matcher->unused = unused;
+
+      // The bitsets only grow once all of them could be grown
+      bool grown = grow_bits(&matcher->any_event, matcher->words, words)
+                     && grow_bits(&matcher->matched, matcher->words, words);
+
+      for (int x = 0; grown && x < matcher->event_count; ++x)
+      {
+         grown = grow_bits(&matcher->events[x].bits, matcher->words, words);
+      }// End of for
+
+      if (!grown) return -1;
+
+      matcher->capacity = capacity;
+      matcher->words = words;
+   }// End of if
+
+   return matcher->subscription_count++;
+}// End of new_subscription method
+
+static int compare_ints(const void *a, const void *b)
+{
+   int x = *(const int *)a;
+   int y = *(const int *)b;
+
+   return x < y ? -1 : x > y;
+}// End of compare_ints method
+
+// IMPLEMENTATION: See header for details
+int add_subscription(Matcher *matcher, const int *geocodes, int geocode_count,
+                     const char * const *events, int event_count)
+{
+   int number = new_subscription(matcher);
+   if (number < 0) return -1;
+
+   Subscription *subscription = &matcher->subscriptions[number];
+   memset(subscription, 0, sizeof(Subscription));
+
+   subscription->used = true;
+   subscription->geocodes = malloc((geocode_count > 0 ? geocode_count : 1) * sizeof(int));
+   subscription->events = malloc((event_count > 0 ? event_count : 1) * sizeof(int));
+
+   bool failed = !subscription->geocodes || !subscription->events;
+
+   for (int x = 0; !failed && x < event_count; ++x)
+   {
+      int event = add_event(matcher, events[x]);
+      bool listed = false;
+
+      for (int y = 0; y < subscription->event_count && !listed; ++y) listed = subscription->events[y] == event;
+
+      if (event < 0) failed = true;
+      else if (!listed) subscription->events[subscription->event_count++] = event;
+   }// End of for
+
+   if (!failed && geocode_count > 0)
+   {
+      memcpy(subscription->geocodes, geocodes, geocode_count * sizeof(int));
+      qsort(subscription->geocodes, geocode_count, sizeof(int), compare_ints);
+
+      for (int x = 0; x < geocode_count; ++x)
+      {
+         if (x == 0 || subscription->geocodes[x] != subscription->geocodes[x - 1])
+         {
+            subscription->geocodes[subscription->geocode_count++] = subscription->geocodes[x];
+         }// End of if
+      }// End of for
+   }// End of if
+
+   // Index it, every posting list it was pushed to is undone on failure
+   for (int x = 0; !failed && x < subscription->geocode_count; ++x)
+   {
+      GeocodePosting *entry = add_geocode(matcher, subscription->geocodes[x]);
+
+      if (!entry || !push(&entry->posting, number))
+      {
+         subscription->geocode_count = x;
+         failed = true;
+      }// End of if
+   }// End of for
+
+   for (int x = 0; !failed && subscription->geocode_count == 0 && x < subscription->event_count; ++x)
+   {
+      if (!push(&matcher->events[subscription->events[x]].without_geocodes, number))
+      {
+         subscription->event_count = x;
+         failed = true;
+      }// End of if
+   }// End of for
+
+   if (!failed && subscription->geocode_count == 0 && subscription->event_count == 0)
+   {
+      failed = !push(&matcher->anything, number);
+   }// End of if
+
+   if (failed)
+   {
+      zlog_warn(alog, "Failed to add a subscription");
+      remove_subscription(matcher, number);
+      return -1;
+   }// End of if
+
+   if (subscription->event_count == 0) set_bit(matcher->any_event, number);
+
+   for (int x = 0; x < subscription->event_count; ++x)
+   {
+      set_bit(matcher->events[subscription->events[x]].bits, number);
+   }// End of for
+
+   return number;
+}// End of add_subscription method
+
+// IMPLEMENTATION: See header for details
+bool remove_subscription(Matcher *matcher, int number)
+{
+   if (number < 0 || number >= matcher->subscription_count || !matcher->subscriptions[number].used) return false;
+
+   Subscription *subscription = &matcher->subscriptions[number];
+
+   for (int x = 0; x < subscription->geocode_count; ++x)
+   {
+      GeocodePosting *entry = find_geocode(matcher, subscription->geocodes[x]);
+      if (entry->used) pull(&entry->posting, number);
+   }// End of for
+
+   for (int x = 0; x < subscription->event_count; ++x)
+   {
+      EventType *event = &matcher->events[subscription->events[x]];
+
+      clear_bit(event->bits, number);
+      if (subscription->geocode_count == 0) pull(&event->without_geocodes, number);
+   }// End of for
+
+   if (subscription->geocode_count == 0 && subscription->event_count == 0) pull(&matcher->anything, number);
+
+   clear_bit(matcher->any_event, number);
+
+   free(subscription->geocodes);
+   free(subscription->events);
+   memset(subscription, 0, sizeof(Subscription));
+
+   matcher->unused[matcher->unused_count++] = number;
+   return true;
+}// End of remove_subscription method
+
+static bool add_result(MatchResult *result, int subscription)
+{
+   if (result->count == result->capacity)
+   {
+      int capacity = result->capacity ? result->capacity * 2 : 64;
+      int *grown = realloc(result->subscriptions, capacity * sizeof(int));
+
+      if (!grown) return false;
+
+      result->subscriptions = grown;
+      result->capacity = capacity;
+   }// End of if
+
+   result->subscriptions[result->count++] = subscription;
+   return true;
+}// End of add_result method
+
+// IMPLEMENTATION: See header for details
+int match_alert(Matcher *matcher, const Alert *alert, MatchResult *result)
+{
+   result->count = 0;
+
+   char folded[MATCH_MAX_EVENT_NAME + 1];
+   int event = alert->event && fold_event(alert->event, folded) ? find_event(matcher, folded) : -1;
+   const uint64_t *event_bits = event >= 0 ? matcher->events[event].bits : NULL;
+   bool failed = false;
+
+   // Subscriptions to a geocode of the alert, if they take its event
+   for (int x = 0; x < alert->area_count && matcher->geocodes && !failed; ++x)
+   {
+      const AlertArea *area = alert->areas[x];
+
+      for (int y = 0; area && y < area->geocode_count && !failed; ++y)
+      {
+         const GeocodePosting *entry = find_geocode(matcher, area->geocodes[y]);
+         if (!entry->used) continue;
+
+         for (int z = 0; z < entry->posting.count; ++z)
+         {
+            int subscription = entry->posting.subscriptions[z];
+
+            if (test_bit(matcher->matched, subscription)) continue;
+            if (!test_bit(matcher->any_event, subscription) && !(event_bits && test_bit(event_bits, subscription))) continue;
+
+            // Only results are cleared below, so the bit follows the result
+            if (!add_result(result, subscription))
+            {
+               failed = true;
+               break;
+            }// End of if
+
+            set_bit(matcher->matched, subscription);
+         }// End of for (z)
+      }// End of for (y)
+   }// End of for (x)
+
+   for (int x = 0; x < result->count; ++x) clear_bit(matcher->matched, result->subscriptions[x]);
+
+   // Subscriptions to its event or to anything, wherever it is
+   const Posting *everywhere[] = { event >= 0 ? &matcher->events[event].without_geocodes : NULL, &matcher->anything };
+
+   for (int x = 0; x < 2 && !failed; ++x)
+   {
+      for (int y = 0; everywhere[x] && y < everywhere[x]->count && !failed; ++y)
+      {
+         failed = !add_result(result, everywhere[x]->subscriptions[y]);
+      }// End of for (y)
+   }// End of for (x)
+
+   if (failed)
+   {
+      zlog_warn(alog, "Failed to allocate memory for matching an alert");
+      return -1;
+   }// End of if
+
+   return result->count;
+}// End of match_alert method
+
+// IMPLEMENTATION: See header for details
+void free_match_result(MatchResult *result)
+{
+   free(result->subscriptions);
+
+   result->subscriptions = NULL;
+   result->count = result->capacity = 0;
+}// End of free_match_result method
+
+// IMPLEMENTATION: See header for details
+void free_matcher(Matcher *matcher)
+{
+   if (!matcher) return;
+
+   for (int x = 0; x < matcher->subscription_count; ++x)
+   {
+      free(matcher->subscriptions[x].geocodes);
+      free(matcher->subscriptions[x].events);
+   }// End of for
+
+   for (unsigned long x = 0; matcher->geocodes && x <= matcher->geocode_mask; ++x)
+   {
+      free(matcher->geocodes[x].posting.subscriptions);
+   }// End of for
+
+   for (int x = 0; x < matcher->event_count; ++x)
+   {
+      free(matcher->events[x].name);
+      free(matcher->events[x].without_geocodes.subscriptions);
+      free(matcher->events[x].bits);
+   }// End of for
+
+   free(matcher->subscriptions);
+   free(matcher->unused);
+   free(matcher->geocodes);
+   free(matcher->anything.subscriptions);
+   free(matcher->any_event);
+   free(matcher->matched);
+   free(matcher);
+}// End of free_matcher method
@@ -0,0 +1,109 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef _MATCH
+#define _MATCH
+
+#include <stdbool.h>
+
+#include "alert.h"
+
+#define MATCH_MAX_EVENTS 256         // Distinct event types subscribed to
+#define MATCH_MAX_EVENT_NAME 63      // Longest event type subscribed to
+
+/*
+   Matcher finds the subscriptions an alert matches. A subscription lists
+   geocodes and event types, an alert matches it if one of its areas has one
+   of the geocodes and its event is one of the types (an empty list matches
+   anything). Event types are compared ignoring case.
+
+   Subscriptions are indexed instead of checked one by one:
+
+      - a posting list per geocode of the subscriptions listing it
+      - a posting list per event type of the subscriptions listing it but
+        no geocode, and one of the subscriptions listing neither
+      - a bitset per event type of the subscriptions it (or no type)
+        satisfies
+
+   so an alert only looks at the subscriptions of its geocodes, checking
+   their event in one bit, and the subscriptions of its event without
+   geocodes. Another bitset marks the subscriptions already matched, for
+   alerts with several areas in the same geocode, and is cleared from the
+   results. Subscriptions are numbered from 0 and numbers are reused once
+   removed. A matcher must not be used by two threads at once.
+*/
+struct Matcher;
+typedef struct Matcher Matcher;
+
+struct MatchResult {
+   int *subscriptions;
+   int count;
+   int capacity;
+};
+typedef struct MatchResult MatchResult;
+
+/*
+   create_matcher() Returns an empty matcher, or NULL if memory could not be
+                    allocated.
+*/
+Matcher * create_matcher(void);
+
+/*
+   add_subscription(matcher, geocodes, geocode_count, events, event_count)
+      Adds a subscription to the geocodes and the event types.
+      PRE:  Valid matcher, arrays of the given counts (NULL if 0)
+      POST: Returns the number of the subscription, or -1 if memory could not
+            be allocated, MATCH_MAX_EVENTS event types are in use or an event
+            type is longer than MATCH_MAX_EVENT_NAME.
+*/
+int add_subscription(Matcher *matcher, const int *geocodes, int geocode_count,
+                     const char * const *events, int event_count);
+
+/*
+   remove_subscription(matcher, subscription) Removes a subscription.
+      POST: Returns false if there is no such subscription. Its number may be
+            given to the next subscription added.
+*/
+bool remove_subscription(Matcher *matcher, int subscription);
+
+/*
+   match_alert(matcher, alert, result) Sets result to the subscriptions alert
+                                       matches, in no particular order.
+      PRE:  Valid pointers, result zeroed before first use
+      POST: Returns the number of subscriptions, or -1 if memory could not be
+            allocated.
+*/
+int match_alert(Matcher *matcher, const Alert *alert, MatchResult *result);
+
+/*
+   free_match_result(result) Frees the memory of a result.
+*/
+void free_match_result(MatchResult *result);
+
+/*
+   free_matcher(matcher) Frees the matcher and its subscriptions.
+*/
+void free_matcher(Matcher *matcher);
+
+#endif
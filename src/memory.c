@@ -0,0 +1,197 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+struct PhaseCounts {
+   int64_t bytes;
+   int64_t peak;
+   uint64_t allocated;
+   uint64_t calls;
+   uint64_t failures;
+};
+typedef struct PhaseCounts PhaseCounts;
+
+static PhaseCounts counts[MEMORY_PHASES + 1];     // The last one is the total
+static int64_t limit = 0;
+
+static const char *phase_names[MEMORY_PHASES + 1] = { "parse", "alerts", "strings", "index", "total" };
+
+/*
+   raise_peak(peak, bytes) Raises *peak to bytes if it is lower.
+*/
+static void raise_peak(int64_t *peak, int64_t bytes)
+{
+   int64_t current = __atomic_load_n(peak, __ATOMIC_RELAXED);
+
+   while (bytes > current
+          && !__atomic_compare_exchange_n(peak, &current, bytes, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}// End of raise_peak method
+
+/*
+   account(phase, ptr) Counts memory just allocated for phase.
+      POST: Returns ptr, or NULL (ptr freed) if the limit is exceeded.
+*/
+static void * account(MemoryPhase phase, void *ptr)
+{
+   if (!ptr) return NULL;
+
+   PhaseCounts *phase_counts = &counts[phase];
+   PhaseCounts *total = &counts[MEMORY_PHASES];
+   int64_t size = malloc_usable_size(ptr);
+   int64_t in_use = __atomic_add_fetch(&total->bytes, size, __ATOMIC_RELAXED);
+   int64_t cap = __atomic_load_n(&limit, __ATOMIC_RELAXED);
+
+   // The bytes are taken before checking, so two threads cannot both go over
+   if (cap > 0 && in_use > cap)
+   {
+      __atomic_sub_fetch(&total->bytes, size, __ATOMIC_RELAXED);
+      __atomic_add_fetch(&phase_counts->failures, 1, __ATOMIC_RELAXED);
+      __atomic_add_fetch(&total->failures, 1, __ATOMIC_RELAXED);
+      free(ptr);
+      return NULL;
+   }// End of if
+
+   raise_peak(&total->peak, in_use);
+   raise_peak(&phase_counts->peak, __atomic_add_fetch(&phase_counts->bytes, size, __ATOMIC_RELAXED));
+
+   __atomic_add_fetch(&phase_counts->allocated, size, __ATOMIC_RELAXED);
+   __atomic_add_fetch(&phase_counts->calls, 1, __ATOMIC_RELAXED);
+   __atomic_add_fetch(&total->allocated, size, __ATOMIC_RELAXED);
+   __atomic_add_fetch(&total->calls, 1, __ATOMIC_RELAXED);
+
+   return ptr;
+}// End of account method
+
+// IMPLEMENTATION: See header for details
+void set_memory_limit(size_t bytes)
+{
+   __atomic_store_n(&limit, (int64_t)bytes, __ATOMIC_RELAXED);
+}// End of set_memory_limit method
+
+// IMPLEMENTATION: See header for details
+void * account_malloc(MemoryPhase phase, size_t size)
+{
+   return account(phase, malloc(size > 0 ? size : 1));
+}// End of account_malloc method
+
+// IMPLEMENTATION: See header for details
+void * account_calloc(MemoryPhase phase, size_t count, size_t size)
+{
+   return account(phase, calloc(count > 0 ? count : 1, size > 0 ? size : 1));
+}// End of account_calloc method
+
+// IMPLEMENTATION: See header for details
+char * account_strndup(MemoryPhase phase, const char *str, size_t length)
+{
+   char *copy = account_malloc(phase, length + 1);
+   if (!copy) return NULL;
+
+   memcpy(copy, str, length);
+   copy[length] = '\0';
+
+   return copy;
+}// End of account_strndup method
+
+// IMPLEMENTATION: See header for details
+void account_free(MemoryPhase phase, void *ptr)
+{
+   if (!ptr) return;
+
+   int64_t size = malloc_usable_size(ptr);
+
+   __atomic_sub_fetch(&counts[phase].bytes, size, __ATOMIC_RELAXED);
+   __atomic_sub_fetch(&counts[MEMORY_PHASES].bytes, size, __ATOMIC_RELAXED);
+
+   free(ptr);
+}// End of account_free method
+
+static void * parse_alloc(size_t size, int zero, void *data)
+{
+   (void)data;
+
+   return zero ? account_calloc(MEMORY_PARSE, 1, size) : account_malloc(MEMORY_PARSE, size);
+}// End of parse_alloc method
+
+static void parse_free(void *ptr, void *data)
+{
+   (void)data;
+
+   account_free(MEMORY_PARSE, ptr);
+}// End of parse_free method
+
+// IMPLEMENTATION: See header for details
+json_settings accounted_json_settings(void)
+{
+   json_settings settings = { 0 };
+
+   settings.max_memory = __atomic_load_n(&limit, __ATOMIC_RELAXED);
+   settings.mem_alloc = parse_alloc;
+   settings.mem_free = parse_free;
+
+   return settings;
+}// End of accounted_json_settings method
+
+// IMPLEMENTATION: See header for details
+void read_memory_usage(MemoryPhase phase, MemoryUsage *usage)
+{
+   PhaseCounts *phase_counts = &counts[phase];
+
+   usage->bytes = __atomic_load_n(&phase_counts->bytes, __ATOMIC_RELAXED);
+   usage->peak = __atomic_load_n(&phase_counts->peak, __ATOMIC_RELAXED);
+   usage->allocated = __atomic_load_n(&phase_counts->allocated, __ATOMIC_RELAXED);
+   usage->calls = __atomic_load_n(&phase_counts->calls, __ATOMIC_RELAXED);
+   usage->failures = __atomic_load_n(&phase_counts->failures, __ATOMIC_RELAXED);
+}// End of read_memory_usage method
+
+// IMPLEMENTATION: See header for details
+const char * memory_phase_name(MemoryPhase phase)
+{
+   return phase_names[phase];
+}// End of memory_phase_name method
+
+// IMPLEMENTATION: See header for details
+void write_memory_stats(FILE *file)
+{
+   fprintf(file, "%-10s %12s %12s %14s %10s %8s\n", "memory", "bytes", "peak", "allocated", "calls", "refused");
+
+   for (int x = 0; x <= MEMORY_PHASES; ++x)
+   {
+      MemoryUsage usage;
+      read_memory_usage(x, &usage);
+
+      fprintf(file, "%-10s %12lld %12lld %14llu %10llu %8llu\n", phase_names[x], (long long)usage.bytes,
+              (long long)usage.peak, (unsigned long long)usage.allocated, (unsigned long long)usage.calls,
+              (unsigned long long)usage.failures);
+   }// End of for
+
+   int64_t cap = __atomic_load_n(&limit, __ATOMIC_RELAXED);
+   if (cap > 0) fprintf(file, "%-10s %12lld\n", "limit", (long long)cap);
+
+   fflush(file);
+}// End of write_memory_stats method
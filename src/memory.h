@@ -0,0 +1,140 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef _MEMORY
+#define _MEMORY
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "json.h"
+
+/*
+   The memory of the alerts is allocated through an accounting layer that
+   counts, per phase, the bytes in use (as malloc_usable_size reports them),
+   their peak, and the bytes and calls allocated so far. A limit can be put
+   on the bytes in use of all phases together: an allocation that would go
+   over it fails (returns NULL) as if memory had run out, so a feed too big
+   for the device is refused and the alerts already loaded are kept rather
+   than the process being killed. Only the memory of the phases below is
+   counted, everything else (curl, ncurses, buffers) is not.
+
+   Memory must be freed by account_free with the phase it was allocated
+   with. Counting is a few relaxed atomic additions, any thread can
+   allocate.
+*/
+
+enum MemoryPhase {
+   MEMORY_PARSE,                     // JSON parse trees
+   MEMORY_ALERTS,                    // Alerts, Alert and AlertArea objects, geocodes
+   MEMORY_STRINGS,                   // Strings of alerts and areas
+   MEMORY_INDEX,                     // Search indexes
+   MEMORY_PHASES
+};
+typedef enum MemoryPhase MemoryPhase;
+
+struct MemoryUsage {
+   int64_t bytes;                    // In use
+   int64_t peak;                     // Most in use at once
+   uint64_t allocated;               // Bytes allocated so far
+   uint64_t calls;                   // Allocations so far
+   uint64_t failures;                // Allocations refused by the limit
+};
+typedef struct MemoryUsage MemoryUsage;
+
+/*
+   set_memory_limit(bytes) Limits the memory in use of all phases together.
+      PRE:  true
+      POST: Allocations that would go over bytes fail. 0 removes the limit.
+*/
+void set_memory_limit(size_t bytes);
+
+/*
+   account_malloc(phase, size) Allocates size bytes for phase.
+      PRE:  phase < MEMORY_PHASES
+      POST: Returns the memory, or NULL if it could not be allocated or the
+            limit would be exceeded.
+*/
+void * account_malloc(MemoryPhase phase, size_t size);
+
+/*
+   account_calloc(phase, count, size) Allocates count zeroed objects of size
+                                      bytes for phase.
+      PRE:  phase < MEMORY_PHASES
+      POST: As account_malloc.
+*/
+void * account_calloc(MemoryPhase phase, size_t count, size_t size);
+
+/*
+   account_strndup(phase, str, length) Copies length bytes of str, and a
+                                       terminator, for phase.
+      PRE:  Valid str of at least length bytes
+      POST: As account_malloc.
+*/
+char * account_strndup(MemoryPhase phase, const char *str, size_t length);
+
+/*
+   account_free(phase, ptr) Frees memory allocated for phase.
+      PRE:  ptr is NULL or was allocated for phase by this layer
+      POST: The memory is freed and no longer counted.
+*/
+void account_free(MemoryPhase phase, void *ptr);
+
+/*
+   accounted_json_settings() Returns parser settings that allocate the parse
+                             tree for MEMORY_PARSE.
+      PRE:  true
+      POST: The tree must be freed with json_value_free_ex and the same
+            settings. A document is also refused by the parser once its
+            tree alone is over the limit.
+*/
+json_settings accounted_json_settings(void);
+
+/*
+   read_memory_usage(phase, usage) Sets usage to the counts of phase, or of
+                                   all phases for MEMORY_PHASES.
+      PRE:  phase <= MEMORY_PHASES, valid usage pointer
+      POST: usage is set (the peak of all phases is the peak of their sum).
+*/
+void read_memory_usage(MemoryPhase phase, MemoryUsage *usage);
+
+/*
+   memory_phase_name(phase) Returns the name of phase ("parse", ...), "total"
+                            for MEMORY_PHASES.
+      PRE:  phase <= MEMORY_PHASES
+      POST: The name is returned.
+*/
+const char * memory_phase_name(MemoryPhase phase);
+
+/*
+   write_memory_stats(file) Writes the counts of every phase, and the limit,
+                            to file.
+      PRE:  Valid file pointer
+      POST: The report is written to file, one line per phase.
+*/
+void write_memory_stats(FILE *file);
+
+#endif
@@ -0,0 +1,600 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "metrics.h"
+
+#include "log.h"
+#include "stats.h"
+#include "snapshot.h"
+#include "memory.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+#define REQUEST_MAX 4096
+#define FEED_READ_ATTEMPTS 16        // Copies of a feed's stats tried per read
+
+struct CounterSlot {
+   uint64_t values[METRICS_COUNTERS];
+} __attribute__((aligned(64)));
+typedef struct CounterSlot CounterSlot;
+
+struct FeedMetric {
+   char url[512];
+   int ready;                 // url is set
+   int64_t loaded;            // Time of the last load
+   uint32_t sequence;         // Odd while stats is written, 0 until it is set
+   FetchStats stats;          // Last transfer
+};
+typedef struct FeedMetric FeedMetric;
+
+static CounterSlot slots[METRICS_SLOTS];
+static int slots_taken = 0;
+static __thread int thread_slot = -1;
+
+static int64_t gauges[METRICS_GAUGES];
+static int64_t severities[ALERT_SEVERITIES];
+static FeedMetric feeds[METRICS_MAX_FEEDS];
+
+static pthread_t exporter;
+static bool started = false;
+static int stop_fd = -1;
+static int listen_fd = -1;
+static char *file_path = NULL;
+
+static const char *counter_names[METRICS_COUNTERS][2] = {
+   { "alerts_fetch_requests_total", "Feed requests completed." },
+   { "alerts_fetch_failures_total", "Feed requests that failed or were answered with an error." },
+   { "alerts_fetch_received_bytes_total", "Bytes of feed responses received over the network." },
+   { "alerts_parsed_bytes_total", "Bytes of JSON parsed." },
+   { "alerts_converted_total", "Alerts converted from JSON (documents and deltas)." },
+   { "alerts_snapshots_total", "Snapshots of the alerts published." },
+   { "alerts_hook_events_total", "Events queued to hooks." },
+   { "alerts_hook_failures_total", "Hook runs that failed." }
+};
+
+static const double histogram_bounds[] = {
+   0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30
+};
+
+static const char *feed_gauge_names[][2] = {
+   { "alerts_feed_received_bytes", "Bytes of the last load of the feed received over the network." },
+   { "alerts_feed_decoded_bytes", "Bytes of the last load of the feed after decompression." },
+   { "alerts_feed_transfer_bytes_per_second", "Bandwidth of the last load of the feed." },
+   { "alerts_feed_refresh_seconds", "Seconds from the request to the loaded alerts at the last load of the feed." }
+};
+
+#define FEED_GAUGES ((int)(sizeof(feed_gauge_names) / sizeof(feed_gauge_names[0])))
+#define BOUND_COUNT ((int)(sizeof(histogram_bounds) / sizeof(histogram_bounds[0])))
+
+// IMPLEMENTATION: See header for details
+void count_metric(MetricsCounter counter, uint64_t amount)
+{
+   if (thread_slot < 0) thread_slot = __atomic_fetch_add(&slots_taken, 1, __ATOMIC_RELAXED) % METRICS_SLOTS;
+
+   // Only shared by threads beyond METRICS_SLOTS, the add is uncontended otherwise
+   __atomic_add_fetch(&slots[thread_slot].values[counter], amount, __ATOMIC_RELAXED);
+}// End of count_metric method
+
+// IMPLEMENTATION: See header for details
+void adjust_metric(MetricsGauge gauge, int64_t amount)
+{
+   __atomic_add_fetch(&gauges[gauge], amount, __ATOMIC_RELAXED);
+}// End of adjust_metric method
+
+// IMPLEMENTATION: See header for details
+void note_feed_loaded(int feed, const char *url, const FetchStats *stats)
+{
+   if (feed < 0 || feed >= METRICS_MAX_FEEDS) return;
+
+   FeedMetric *metric = &feeds[feed];
+
+   if (!__atomic_load_n(&metric->ready, __ATOMIC_RELAXED))
+   {
+      snprintf(metric->url, sizeof(metric->url), "%s", url);
+      __atomic_store_n(&metric->ready, 1, __ATOMIC_RELEASE);
+   }// End of if
+
+   __atomic_store_n(&metric->loaded, (int64_t)time(NULL), __ATOMIC_RELAXED);
+
+   if (stats)
+   {
+      // Readers copy the stats again if the sequence changed meanwhile
+      uint32_t sequence = metric->sequence;
+
+      __atomic_store_n(&metric->sequence, sequence + 1, __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_RELEASE);
+
+      metric->stats = *stats;
+
+      __atomic_store_n(&metric->sequence, sequence + 2, __ATOMIC_RELEASE);
+   }// End of if
+}// End of note_feed_loaded method
+
+/*
+   copy_feed_stats(stats) Copies the last transfer of every feed to stats.
+      POST: Returns which feeds were fetched as bits. A feed whose stats kept
+            changing while they were copied is left out, it never waits for
+            note_feed_loaded.
+*/
+static unsigned int copy_feed_stats(FetchStats *stats)
+{
+   unsigned int fetched = 0;
+
+   for (int x = 0; x < METRICS_MAX_FEEDS; ++x)
+   {
+      for (int attempt = 0; attempt < FEED_READ_ATTEMPTS; ++attempt)
+      {
+         uint32_t sequence = __atomic_load_n(&feeds[x].sequence, __ATOMIC_ACQUIRE);
+
+         if (sequence == 0) break;
+         if (sequence & 1) continue;
+
+         stats[x] = feeds[x].stats;
+
+         // Written while it was copied
+         __atomic_thread_fence(__ATOMIC_ACQUIRE);
+         if (__atomic_load_n(&feeds[x].sequence, __ATOMIC_RELAXED) != sequence) continue;
+
+         fetched |= 1u << x;
+         break;
+      }// End of for (attempt)
+   }// End of for
+
+   return fetched;
+}// End of copy_feed_stats method
+
+// IMPLEMENTATION: See header for details
+void write_feed_stats(FILE *file)
+{
+   FetchStats stats[METRICS_MAX_FEEDS];
+   unsigned int fetched = copy_feed_stats(stats);
+
+   for (int x = 0; x < METRICS_MAX_FEEDS; ++x)
+   {
+      if (!(fetched & (1u << x))) continue;
+
+      fprintf(file, "%s: ", feeds[x].url);
+      print_fetch_stats(file, &stats[x]);
+   }// End of for
+}// End of write_feed_stats method
+
+/*
+   count_snapshot(alerts, data) Counts the alerts of a published snapshot by
+                                severity (a snapshot listener).
+*/
+static void count_snapshot(const Alerts *alerts, void *data)
+{
+   (void)data;
+
+   int64_t counts[ALERT_SEVERITIES] = { 0 };
+
+   for (int x = 0; x < alerts->count; ++x) ++counts[alerts->alerts[x]->severity];
+
+   for (int x = 0; x < ALERT_SEVERITIES; ++x) __atomic_store_n(&severities[x], counts[x], __ATOMIC_RELAXED);
+
+   count_metric(METRICS_SNAPSHOTS, 1);
+}// End of count_snapshot method
+
+/*
+   write_label(file, value) Writes a label value with \, " and line breaks
+                            escaped.
+*/
+static void write_label(FILE *file, const char *value)
+{
+   for (const char *c = value; *c; ++c)
+   {
+      if (*c == '\\' || *c == '"') fputc('\\', file);
+
+      if (*c == '\n') fputs("\\n", file);
+      else fputc(*c, file);
+   }// End of for
+}// End of write_label method
+
+/*
+   resident_memory() Returns the resident memory of the process in bytes.
+*/
+static long long resident_memory(void)
+{
+   FILE *statm = fopen("/proc/self/statm", "r");
+   long long size = 0, resident = 0;
+
+   if (!statm) return 0;
+
+   if (fscanf(statm, "%lld %lld", &size, &resident) != 2) resident = 0;
+   fclose(statm);
+
+   return resident * sysconf(_SC_PAGESIZE);
+}// End of resident_memory method
+
+/*
+   write_metrics(file) Writes every metric to file in the Prometheus text
+                       format.
+*/
+static void write_metrics(FILE *file)
+{
+   for (int x = 0; x < METRICS_COUNTERS; ++x)
+   {
+      uint64_t value = 0;
+
+      for (int y = 0; y < METRICS_SLOTS; ++y) value += __atomic_load_n(&slots[y].values[x], __ATOMIC_RELAXED);
+
+      fprintf(file, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", counter_names[x][0], counter_names[x][1],
+              counter_names[x][0], counter_names[x][0], (unsigned long long)value);
+   }// End of for (x)
+
+   fputs("# HELP alerts_feed_last_load_timestamp_seconds When the feed was last loaded.\n"
+         "# TYPE alerts_feed_last_load_timestamp_seconds gauge\n", file);
+
+   for (int x = 0; x < METRICS_MAX_FEEDS; ++x)
+   {
+      if (!__atomic_load_n(&feeds[x].ready, __ATOMIC_ACQUIRE)) continue;
+
+      fputs("alerts_feed_last_load_timestamp_seconds{feed=\"", file);
+      write_label(file, feeds[x].url);
+      fprintf(file, "\"} %lld\n", (long long)__atomic_load_n(&feeds[x].loaded, __ATOMIC_RELAXED));
+   }// End of for (x)
+
+   FetchStats stats[METRICS_MAX_FEEDS];
+   unsigned int fetched = copy_feed_stats(stats);
+
+   for (int x = 0; x < FEED_GAUGES; ++x)
+   {
+      fprintf(file, "# HELP %s %s\n# TYPE %s gauge\n", feed_gauge_names[x][0], feed_gauge_names[x][1],
+              feed_gauge_names[x][0]);
+
+      for (int y = 0; y < METRICS_MAX_FEEDS; ++y)
+      {
+         if (!(fetched & (1u << y))) continue;
+
+         double values[FEED_GAUGES] = { stats[y].wire_bytes, stats[y].body_bytes, stats[y].wire_rate,
+                                        stats[y].refresh_time };
+
+         fprintf(file, "%s{feed=\"", feed_gauge_names[x][0]);
+         write_label(file, feeds[y].url);
+         fprintf(file, "\"} %.9g\n", values[x]);
+      }// End of for (y)
+   }// End of for (x)
+
+   fputs("# HELP alerts_current Alerts of the current snapshot.\n"
+         "# TYPE alerts_current gauge\n", file);
+
+   for (int x = 0; x < ALERT_SEVERITIES; ++x)
+   {
+      fprintf(file, "alerts_current{severity=\"%s\"} %lld\n", alert_severity_name(x),
+              (long long)__atomic_load_n(&severities[x], __ATOMIC_RELAXED));
+   }// End of for (x)
+
+   fprintf(file, "# HELP alerts_hook_queue_depth Events waiting to be sent to hooks.\n"
+                 "# TYPE alerts_hook_queue_depth gauge\n"
+                 "alerts_hook_queue_depth %lld\n"
+                 "# HELP process_resident_memory_bytes Resident memory size in bytes.\n"
+                 "# TYPE process_resident_memory_bytes gauge\n"
+                 "process_resident_memory_bytes %lld\n",
+           (long long)__atomic_load_n(&gauges[METRICS_HOOK_QUEUE], __ATOMIC_RELAXED), resident_memory());
+
+   fputs("# HELP alerts_memory_bytes Memory in use by the alerts, by phase.\n"
+         "# TYPE alerts_memory_bytes gauge\n", file);
+
+   MemoryUsage usage[MEMORY_PHASES + 1];
+
+   for (int x = 0; x <= MEMORY_PHASES; ++x)
+   {
+      read_memory_usage(x, &usage[x]);
+      fprintf(file, "alerts_memory_bytes{phase=\"%s\"} %lld\n", memory_phase_name(x), (long long)usage[x].bytes);
+   }// End of for (x)
+
+   fputs("# HELP alerts_memory_peak_bytes Most memory in use by the alerts at once, by phase.\n"
+         "# TYPE alerts_memory_peak_bytes gauge\n", file);
+
+   for (int x = 0; x <= MEMORY_PHASES; ++x)
+   {
+      fprintf(file, "alerts_memory_peak_bytes{phase=\"%s\"} %lld\n", memory_phase_name(x), (long long)usage[x].peak);
+   }// End of for (x)
+
+   fprintf(file, "# HELP alerts_memory_refused_total Allocations refused by the memory limit.\n"
+                 "# TYPE alerts_memory_refused_total counter\n"
+                 "alerts_memory_refused_total %llu\n", (unsigned long long)usage[MEMORY_PHASES].failures);
+
+   fputs("# HELP alerts_phase_duration_seconds Time spent in each phase of a refresh.\n"
+         "# TYPE alerts_phase_duration_seconds histogram\n", file);
+
+   uint64_t bounds[BOUND_COUNT];
+   uint64_t below[BOUND_COUNT];
+
+   for (int x = 0; x < BOUND_COUNT; ++x) bounds[x] = (uint64_t)(histogram_bounds[x] * 1e9);
+
+   for (int x = 0; x < STATS_PHASES; ++x)
+   {
+      uint64_t total = 0;
+      uint64_t count = read_stats(x, bounds, below, BOUND_COUNT, &total);
+      const char *phase = stats_phase_name(x);
+
+      for (int y = 0; y < BOUND_COUNT; ++y)
+      {
+         fprintf(file, "alerts_phase_duration_seconds_bucket{phase=\"%s\",le=\"%g\"} %llu\n",
+                 phase, histogram_bounds[y], (unsigned long long)below[y]);
+      }// End of for (y)
+
+      fprintf(file, "alerts_phase_duration_seconds_bucket{phase=\"%s\",le=\"+Inf\"} %llu\n"
+                    "alerts_phase_duration_seconds_sum{phase=\"%s\"} %.9f\n"
+                    "alerts_phase_duration_seconds_count{phase=\"%s\"} %llu\n",
+              phase, (unsigned long long)count, phase, total / 1e9, phase, (unsigned long long)count);
+   }// End of for (x)
+}// End of write_metrics method
+
+/*
+   write_metrics_file() Replaces the metrics file.
+      POST: The metrics are written beside the file and renamed over it, so
+            the collector never reads half a file.
+*/
+static void write_metrics_file(void)
+{
+   char temporary[4096];
+   snprintf(temporary, sizeof(temporary), "%s.tmp", file_path);
+
+   FILE *file = fopen(temporary, "w");
+
+   if (!file)
+   {
+      zlog_warn(alog, "Failed to open %s: %s", temporary, strerror(errno));
+      return;
+   }// End of if
+
+   write_metrics(file);
+
+   if (fclose(file) != 0 || rename(temporary, file_path) != 0)
+   {
+      zlog_warn(alog, "Failed to write %s: %s", file_path, strerror(errno));
+      unlink(temporary);
+   }// End of if
+}// End of write_metrics_file method
+
+/*
+   serve_scrape() Answers a connection waiting on the listening socket.
+      POST: GET /metrics (or /) is answered with the metrics, anything else
+            with 404. A client gets METRICS_CLIENT_TIMEOUT to send its
+            request and read the answer.
+*/
+static void serve_scrape(void)
+{
+   int client = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+   if (client < 0) return;
+
+   struct timeval timeout = { METRICS_CLIENT_TIMEOUT, 0 };
+   setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+   setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+   // Only the request line matters, the headers are read and ignored
+   char request[REQUEST_MAX + 1];
+   size_t length = 0;
+
+   while (length < REQUEST_MAX)
+   {
+      ssize_t received = recv(client, request + length, REQUEST_MAX - length, 0);
+      if (received <= 0) break;
+
+      length += received;
+      request[length] = '\0';
+
+      if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) break;
+   }// End of while
+
+   request[length] = '\0';
+
+   char *body = NULL;
+   size_t body_length = 0;
+   FILE *out = open_memstream(&body, &body_length);
+   bool found = strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET / ", 6) == 0;
+
+   if (out)
+   {
+      if (found) write_metrics(out);
+      else fputs("Not found\n", out);
+
+      fclose(out);
+   }// End of if
+
+   char header[256];
+   int header_length = snprintf(header, sizeof(header),
+                                "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                                "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+                                !out ? "500 Internal Server Error" : found ? "200 OK" : "404 Not Found",
+                                body ? body_length : 0);
+
+   if (send(client, header, header_length, MSG_NOSIGNAL) == header_length)
+   {
+      for (size_t sent = 0; body && sent < body_length; )
+      {
+         ssize_t written = send(client, body + sent, body_length - sent, MSG_NOSIGNAL);
+         if (written <= 0) break;
+
+         sent += written;
+      }// End of for
+   }// End of if
+
+   free(body);
+   close(client);
+}// End of serve_scrape method
+
+/*
+   exporter_main(arg) Body of the exporter thread.
+      POST: Serves scrapes and writes the file until stop_metrics is called.
+*/
+static void * exporter_main(void *arg)
+{
+   zlog_debug(alog, "Entering");
+
+   (void)arg;
+
+   name_trace_thread("exporter");
+
+   struct pollfd fds[2] = { { stop_fd, POLLIN, 0 }, { listen_fd, POLLIN, 0 } };
+   time_t next_write = time(NULL) + METRICS_FILE_INTERVAL;
+
+   if (file_path) write_metrics_file();
+
+   while (true)
+   {
+      int timeout = -1;
+
+      if (file_path)
+      {
+         time_t now = time(NULL);
+         timeout = next_write > now ? (int)(next_write - now) * 1000 : 0;
+      }// End of if
+
+      if (poll(fds, listen_fd >= 0 ? 2 : 1, timeout) < 0 && errno != EINTR) break;
+
+      if (fds[0].revents) break;
+
+      if (listen_fd >= 0 && (fds[1].revents & POLLIN)) serve_scrape();
+
+      if (file_path && time(NULL) >= next_write)
+      {
+         write_metrics_file();
+         next_write = time(NULL) + METRICS_FILE_INTERVAL;
+      }// End of if
+   }// End of while
+
+   zlog_debug(alog, "Exiting");
+   return NULL;
+}// End of exporter_main method
+
+/*
+   listen_metrics(address) Listens on address, "[HOST:]PORT".
+      POST: Returns false if address is malformed or cannot be listened on.
+*/
+static bool listen_metrics(const char *address)
+{
+   char host[256] = "127.0.0.1";
+   const char *port = address;
+   const char *colon = strrchr(address, ':');
+
+   if (colon)
+   {
+      size_t length = colon - address;
+      if (length == 0 || length >= sizeof(host)) return false;
+
+      memcpy(host, address, length);
+      host[length] = '\0';
+      port = colon + 1;
+   }// End of if
+
+   struct addrinfo hints = { 0 };
+   struct addrinfo *found = NULL;
+
+   hints.ai_family = AF_UNSPEC;
+   hints.ai_socktype = SOCK_STREAM;
+   hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+
+   if (getaddrinfo(host, port, &hints, &found) != 0) return false;
+
+   for (struct addrinfo *info = found; info && listen_fd < 0; info = info->ai_next)
+   {
+      listen_fd = socket(info->ai_family, info->ai_socktype | SOCK_CLOEXEC, info->ai_protocol);
+      if (listen_fd < 0) continue;
+
+      int reuse = 1;
+      setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+      if (bind(listen_fd, info->ai_addr, info->ai_addrlen) != 0 || listen(listen_fd, 16) != 0)
+      {
+         close(listen_fd);
+         listen_fd = -1;
+      }// End of if
+   }// End of for
+
+   freeaddrinfo(found);
+
+   if (listen_fd >= 0) zlog_info(alog, "Serving metrics on %s:%s", host, port);
+   return listen_fd >= 0;
+}// End of listen_metrics method
+
+// IMPLEMENTATION: See header for details
+bool start_metrics(const char *address, const char *path)
+{
+   zlog_debug(alog, "Entering");
+
+   if (started || (!address && !path)) return false;
+
+   if (address && !listen_metrics(address))
+   {
+      zlog_warn(alog, "Failed to listen for metrics on %s", address);
+      return false;
+   }// End of if
+
+   file_path = path ? strdup(path) : NULL;
+   stop_fd = eventfd(0, EFD_CLOEXEC);
+
+   if ((path && !file_path) || stop_fd < 0 || !add_snapshot_listener(count_snapshot, NULL)
+         || pthread_create(&exporter, NULL, exporter_main, NULL) != 0)
+   {
+      zlog_warn(alog, "Failed to start the metrics exporter");
+      remove_snapshot_listener(count_snapshot, NULL);
+      if (stop_fd >= 0) close(stop_fd);
+      if (listen_fd >= 0) close(listen_fd);
+      free(file_path);
+
+      stop_fd = listen_fd = -1;
+      file_path = NULL;
+      return false;
+   }// End of if
+
+   started = true;
+
+   zlog_debug(alog, "Exiting");
+   return true;
+}// End of start_metrics method
+
+// IMPLEMENTATION: See header for details
+void stop_metrics(void)
+{
+   if (!started) return;
+
+   uint64_t one = 1;
+   if (write(stop_fd, &one, sizeof(one)) < 0) zlog_warn(alog, "Failed to stop the metrics exporter");
+
+   pthread_join(exporter, NULL);
+   remove_snapshot_listener(count_snapshot, NULL);
+
+   if (file_path) write_metrics_file();
+
+   close(stop_fd);
+   if (listen_fd >= 0) close(listen_fd);
+   free(file_path);
+
+   stop_fd = listen_fd = -1;
+   file_path = NULL;
+   started = false;
+}// End of stop_metrics method
@@ -0,0 +1,133 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef _METRICS
+#define _METRICS
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "fetch.h"
+
+/*
+   Metrics of the alert pipeline are exported in the Prometheus text format,
+   either served over HTTP (GET /metrics) or written to a file for the
+   textfile collector of the node exporter:
+
+      - fetches, failed fetches and bytes received (and per feed, when it
+        was last loaded and the bytes, bandwidth and refresh latency of that
+        load)
+      - JSON bytes parsed and alerts converted, with the phase histograms
+        of stats.h (latency of every fetch phase, parse, convert, index)
+      - snapshots published and their alerts by severity
+      - hook events queued, waiting and failed
+      - memory of the alerts by phase (memory.h), its peak and allocations
+        refused by the limit, and the resident memory of the process
+
+   Counters are kept in per-thread slots (a thread only adds to its own
+   cache line, threads beyond METRICS_SLOTS share) and summed when scraped.
+   Gauges are single atomics, the last transfer of each feed is copied under
+   a sequence counter. An exporter thread of its own serves scrapes and
+   writes the file without taking a lock, so a scrape never waits for (or
+   holds up) a refresh.
+*/
+
+#define METRICS_SLOTS 16             // Per-thread counter slots
+#define METRICS_MAX_FEEDS 16         // Feeds with a freshness gauge
+#define METRICS_FILE_INTERVAL 15     // Seconds between writes of the file
+#define METRICS_CLIENT_TIMEOUT 2     // Seconds a scrape may take
+
+enum MetricsCounter {
+   METRICS_FETCHES,                  // Requests completed
+   METRICS_FETCH_FAILURES,           // Requests failed (or answered 4xx/5xx)
+   METRICS_FETCH_BYTES,              // Bytes received over the network
+   METRICS_PARSE_BYTES,              // JSON bytes parsed
+   METRICS_CONVERTED,                // Alerts converted from JSON
+   METRICS_SNAPSHOTS,                // Snapshots published
+   METRICS_HOOK_EVENTS,              // Events queued to hooks
+   METRICS_HOOK_FAILURES,            // Hook runs that failed
+   METRICS_COUNTERS
+};
+typedef enum MetricsCounter MetricsCounter;
+
+enum MetricsGauge {
+   METRICS_HOOK_QUEUE,               // Events waiting for a hook
+   METRICS_GAUGES
+};
+typedef enum MetricsGauge MetricsGauge;
+
+/*
+   count_metric(counter, amount) Adds amount to counter.
+      PRE:  counter < METRICS_COUNTERS
+      POST: The slot of the calling thread is incremented.
+*/
+void count_metric(MetricsCounter counter, uint64_t amount);
+
+/*
+   adjust_metric(gauge, amount) Adds amount (possibly negative) to gauge.
+      PRE:  gauge < METRICS_GAUGES
+      POST: The gauge is updated.
+*/
+void adjust_metric(MetricsGauge gauge, int64_t amount);
+
+/*
+   note_feed_loaded(feed, url, stats) Records that the feed numbered feed,
+                                      named url, was loaded now, by the
+                                      transfer stats (NULL for a streamed
+                                      change).
+      PRE:  Valid url, called from one thread only
+      POST: Feeds from METRICS_MAX_FEEDS on are ignored. The url of a feed is
+            kept from its first call.
+*/
+void note_feed_loaded(int feed, const char *url, const FetchStats *stats);
+
+/*
+   write_feed_stats(file) Writes the last transfer of every feed to file, one
+                          line per feed.
+      PRE:  Valid file pointer
+      POST: Feeds never fetched are left out.
+*/
+void write_feed_stats(FILE *file);
+
+/*
+   start_metrics(address, path) Starts exporting the metrics over HTTP at
+                                address ("[HOST:]PORT", HOST defaults to
+                                127.0.0.1) and/or to the file at path.
+      PRE:  address or path is not NULL
+      POST: Returns false if the address cannot be listened on or the
+            exporter cannot be started. The file is replaced atomically
+            (written beside it and renamed) every METRICS_FILE_INTERVAL.
+*/
+bool start_metrics(const char *address, const char *path);
+
+/*
+   stop_metrics() Stops the exporter.
+      POST: The file is written a last time. Nothing happens if the exporter
+            was not started.
+*/
+void stop_metrics(void);
+
+#endif
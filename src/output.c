@@ -0,0 +1,481 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "output.h"
+
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+/* WATCHED ALERT (open addressing table keyed by identifier) */
+struct WatchEntry {
+   Alert *alert;              // Retained, NULL for a free slot
+   bool expired;              // The expire event was written
+   bool seen;                 // Still in the feed (while diffing)
+};
+typedef struct WatchEntry WatchEntry;
+
+static const char *field_names[OUTPUT_FIELD_COUNT] = {
+   "identifier", "headline", "issuer", "effective", "expires", "areas", "description", "instruction"
+};
+
+static char standard_data[OUTPUT_BUFFER_SIZE];
+static OutputBuffer standard = { standard_data, 0, OUTPUT_BUFFER_SIZE, STDOUT_FILENO, false };
+
+static WatchEntry *watched = NULL;
+static unsigned long watched_mask = 0;
+
+// IMPLEMENTATION: See header for details
+OutputOptions default_output_options(void)
+{
+   OutputOptions options = { OUTPUT_NDJSON, false, false, 6,
+                             { OUTPUT_IDENTIFIER, OUTPUT_EFFECTIVE, OUTPUT_EXPIRES,
+                               OUTPUT_ISSUER, OUTPUT_HEADLINE, OUTPUT_AREAS } };
+
+   return options;
+}// End of default_output_options method
+
+// IMPLEMENTATION: See header for details
+bool parse_output_format(const char *name, OutputOptions *options)
+{
+   if (strcmp(name, "ndjson") == 0) options->format = OUTPUT_NDJSON;
+   else if (strcmp(name, "tsv") == 0) options->format = OUTPUT_TSV;
+   else return false;
+
+   return true;
+}// End of parse_output_format method
+
+// IMPLEMENTATION: See header for details
+bool parse_output_fields(const char *list, OutputOptions *options)
+{
+   OutputField fields[OUTPUT_FIELD_COUNT];
+   int count = 0;
+
+   while (*list)
+   {
+      size_t length = strcspn(list, ",");
+      int field = 0;
+
+      while (field < OUTPUT_FIELD_COUNT
+               && !(strlen(field_names[field]) == length && strncmp(field_names[field], list, length) == 0)) ++field;
+
+      if (field == OUTPUT_FIELD_COUNT || count == OUTPUT_FIELD_COUNT) return false;
+
+      fields[count++] = field;
+      list += length + (list[length] == ',');
+   }// End of while
+
+   if (count == 0) return false;
+
+   memcpy(options->fields, fields, sizeof(fields));
+   options->field_count = count;
+
+   return true;
+}// End of parse_output_fields method
+
+/*
+   flush_buffer(out) Writes the buffered lines to the buffer's descriptor.
+      POST: Returns false if it could not be written to.
+*/
+static bool flush_buffer(OutputBuffer *out)
+{
+   size_t written = 0;
+
+   while (written < out->length)
+   {
+      ssize_t bytes = write(out->fd, out->data + written, out->length - written);
+
+      if (bytes < 0)
+      {
+         if (errno == EINTR) continue;
+
+         out->length = 0;
+         return false;
+      }// End of if
+
+      written += bytes;
+   }// End of while
+
+   out->length = 0;
+   return true;
+}// End of flush_buffer method
+
+// IMPLEMENTATION: See header for details
+bool flush_output(void)
+{
+   return flush_buffer(&standard);
+}// End of flush_output method
+
+/*
+   put(out, data, length) Appends data to out.
+*/
+static void put(OutputBuffer *out, const char *data, size_t length)
+{
+   // Buffers without a descriptor grow to hold everything
+   if (out->fd < 0 && out->length + length > out->capacity && !out->failed)
+   {
+      size_t capacity = out->capacity ? out->capacity : OUTPUT_BUFFER_SIZE;
+      while (capacity < out->length + length) capacity *= 2;
+
+      char *grown = realloc(out->data, capacity);
+
+      if (grown)
+      {
+         out->data = grown;
+         out->capacity = capacity;
+      }// End of if
+      else
+      {
+         zlog_warn(alog, "Failed to allocate memory for output");
+         out->failed = true;
+      }// End of else
+   }// End of if
+
+   if (out->failed) return;
+
+   while (length > 0)
+   {
+      if (out->length == out->capacity) flush_buffer(out);
+
+      size_t bytes = out->capacity - out->length < length ? out->capacity - out->length : length;
+
+      memcpy(out->data + out->length, data, bytes);
+      out->length += bytes;
+      data += bytes;
+      length -= bytes;
+   }// End of while
+}// End of put method
+
+/*
+   put_string(out, str) Appends str to out.
+*/
+static void put_string(OutputBuffer *out, const char *str)
+{
+   put(out, str, strlen(str));
+}// End of put_string method
+
+/*
+   put_escaped(out, format, str) Appends str escaped for format: as a JSON
+                                  string (with quotes), or without tabs and
+                                  line breaks for TSV.
+*/
+static void put_escaped(OutputBuffer *out, OutputFormat format, const char *str)
+{
+   static const char hex[] = "0123456789abcdef";
+
+   if (format == OUTPUT_NDJSON) put(out, "\"", 1);
+
+   for (const char *run = str ? str : ""; *run; )
+   {
+      // Copy the characters that need no escaping in one go
+      size_t length = 0;
+      while (run[length] && (unsigned char)run[length] >= ' ' && run[length] != '\\'
+               && !(format == OUTPUT_NDJSON && run[length] == '"')) ++length;
+
+      put(out, run, length);
+      run += length;
+
+      if (!*run) break;
+
+      char c = *run++;
+      char escape[6] = { '\\', c, 0, 0, 0, 0 };
+      size_t escape_length = 2;
+
+      if (c == '\n') escape[1] = 'n';
+      else if (c == '\t') escape[1] = 't';
+      else if (c == '\r') escape[1] = 'r';
+      else if ((unsigned char)c < ' ')
+      {
+         if (format == OUTPUT_TSV)
+         {
+            escape[0] = ' ';
+            escape_length = 1;
+         }// End of if
+         else
+         {
+            memcpy(escape, "\\u00", 4);
+            escape[4] = hex[(unsigned char)c >> 4];
+            escape[5] = hex[c & 0xf];
+            escape_length = 6;
+         }// End of else
+      }// End of else if
+
+      put(out, escape, escape_length);
+   }// End of for
+
+   if (format == OUTPUT_NDJSON) put(out, "\"", 1);
+}// End of put_escaped method
+
+/*
+   put_time(out, format, tm) Appends tm in ISO 8601 format.
+*/
+static void put_time(OutputBuffer *out, OutputFormat format, const struct tm *tm)
+{
+   char time[32];
+
+   strftime(time, sizeof(time), "%Y-%m-%dT%H:%M:%S", tm);
+   put_escaped(out, format, time);
+}// End of put_time method
+
+/*
+   put_areas(out, format, alert) Appends the area names, as an array for NDJSON.
+*/
+static void put_areas(OutputBuffer *out, OutputFormat format, const Alert *alert)
+{
+   if (format == OUTPUT_NDJSON) put(out, "[", 1);
+
+   for (int x = 0; x < alert->area_count; ++x)
+   {
+      if (x > 0) put_string(out, format == OUTPUT_NDJSON ? "," : ", ");
+      put_escaped(out, format, alert->areas[x]->name);
+   }// End of for
+
+   if (format == OUTPUT_NDJSON) put(out, "]", 1);
+}// End of put_areas method
+
+/*
+   put_record(out, options, event, recorded, alert) Appends the line of alert,
+                                                    with the event and the
+                                                    recorded time first if
+                                                    not NULL.
+*/
+static void put_record(OutputBuffer *out, const OutputOptions *options, const char *event,
+                       const struct tm *recorded, const Alert *alert)
+{
+   bool json = options->format == OUTPUT_NDJSON;
+
+   if (json) put(out, "{", 1);
+
+   if (event)
+   {
+      put_string(out, json ? "\"event\":\"" : "");
+      put_string(out, event);
+      put_string(out, json ? "\"" : "");
+   }// End of if
+
+   if (recorded)
+   {
+      put_string(out, json ? ",\"recorded\":" : "\t");
+      put_time(out, options->format, recorded);
+   }// End of if
+
+   for (int x = 0; x < options->field_count; ++x)
+   {
+      OutputField field = options->fields[x];
+
+      if (event || x > 0) put(out, json ? "," : "\t", 1);
+
+      if (json)
+      {
+         put(out, "\"", 1);
+         put_string(out, field_names[field]);
+         put(out, "\":", 2);
+      }// End of if
+
+      switch (field)
+      {
+         case OUTPUT_IDENTIFIER:    put_escaped(out, options->format, alert->identifier); break;
+         case OUTPUT_HEADLINE:      put_escaped(out, options->format, alert->headline); break;
+         case OUTPUT_ISSUER:        put_escaped(out, options->format, alert->issuer); break;
+         case OUTPUT_EFFECTIVE:     put_time(out, options->format, &alert->effective); break;
+         case OUTPUT_EXPIRES:       put_time(out, options->format, &alert->expires); break;
+         case OUTPUT_AREAS:         put_areas(out, options->format, alert); break;
+         case OUTPUT_DESCRIPTION:   put_escaped(out, options->format, alert->description); break;
+         case OUTPUT_INSTRUCTION:   put_escaped(out, options->format, alert->instruction); break;
+         default:                   break;
+      }// End of switch
+   }// End of for
+
+   put(out, json ? "}\n" : "\n", json ? 2 : 1);
+}// End of put_record method
+
+// IMPLEMENTATION: See header for details
+void write_record(OutputBuffer *out, const OutputOptions *options, const char *event, const Alert *alert)
+{
+   put_record(out, options, event, NULL, alert);
+}// End of write_record method
+
+// IMPLEMENTATION: See header for details
+void write_history_record(const OutputOptions *options, const char *event, time_t recorded, const Alert *alert)
+{
+   struct tm tm;
+   localtime_r(&recorded, &tm);
+
+   put_record(&standard, options, event, &tm, alert);
+}// End of write_history_record method
+
+// IMPLEMENTATION: See header for details
+void write_output_header(const OutputOptions *options)
+{
+   if (options->format != OUTPUT_TSV) return;
+
+   bool events = options->watch || options->history;
+
+   if (events) put_string(&standard, "event");
+   if (options->history) put_string(&standard, "\trecorded");
+
+   for (int x = 0; x < options->field_count; ++x)
+   {
+      if (events || x > 0) put(&standard, "\t", 1);
+      put_string(&standard, field_names[options->fields[x]]);
+   }// End of for
+
+   put(&standard, "\n", 1);
+}// End of write_output_header method
+
+// IMPLEMENTATION: See header for details
+void write_alerts(const OutputOptions *options, const Alerts *alerts)
+{
+   zlog_debug(alog, "Entering");
+
+   for (int x = 0; x < alerts->count; ++x) write_record(&standard, options, NULL, alerts->alerts[x]);
+
+   zlog_debug(alog, "Exiting");
+}// End of write_alerts method
+
+static const char * watched_key(const void *entry)
+{
+   const Alert *alert = ((const WatchEntry *)entry)->alert;
+   return alert ? (alert->identifier ? alert->identifier : "") : NULL;
+}// End of watched_key method
+
+/*
+   find_watched(table, mask, identifier) Returns the slot of identifier in
+                                           table, or the free slot to put it in.
+*/
+static WatchEntry * find_watched(WatchEntry *table, unsigned long mask, const char *identifier)
+{
+   return find_identifier_slot(table, sizeof(WatchEntry), mask, identifier, watched_key);
+}// End of find_watched method
+
+// IMPLEMENTATION: See header for details
+time_t watch_alerts(const OutputOptions *options, const Alerts *alerts, time_t now)
+{
+   zlog_debug(alog, "Entering");
+
+   unsigned long mask = identifier_table_mask(alerts->count);
+   WatchEntry *table = calloc(mask + 1, sizeof(WatchEntry));
+
+   if (!table)
+   {
+      zlog_warn(alog, "Failed to allocate memory for watching alerts");
+      return now + 60;
+   }// End of if
+
+   // Added and updated alerts
+   for (int x = 0; x < alerts->count; ++x)
+   {
+      Alert *alert = alerts->alerts[x];
+      const char *identifier = alert->identifier ? alert->identifier : "";
+      WatchEntry *entry = find_watched(table, mask, identifier);
+      WatchEntry *previous = watched ? find_watched(watched, watched_mask, identifier) : NULL;
+
+      if (entry->alert) continue;      // Listed twice
+
+      entry->alert = retain_alert(alert);
+
+      if (!previous || !previous->alert)
+      {
+         write_record(&standard, options, "add", alert);
+         continue;
+      }// End of if
+
+      previous->seen = true;
+
+      if (!same_alert(previous->alert, alert))
+      {
+         write_record(&standard, options, "update", alert);
+
+         // An update may push the expiry back
+         entry->expired = previous->expired && alert_expiry(alert) <= now;
+      }// End of if
+      else
+      {
+         entry->expired = previous->expired;
+      }// End of else
+   }// End of for
+
+   // Alerts that left the feed expired (unless that was already reported)
+   for (unsigned long x = 0; watched && x <= watched_mask; ++x)
+   {
+      if (!watched[x].alert) continue;
+
+      if (!watched[x].seen && !watched[x].expired) write_record(&standard, options, "expire", watched[x].alert);
+      free_alert(watched[x].alert);
+   }// End of for
+
+   free(watched);
+   watched = table;
+   watched_mask = mask;
+
+   // Alerts that are still listed but expired
+   time_t next = 0;
+
+   for (unsigned long x = 0; x <= mask; ++x)
+   {
+      WatchEntry *entry = &table[x];
+      if (!entry->alert || entry->expired) continue;
+
+      time_t expires = alert_expiry(entry->alert);
+
+      if (expires <= now)
+      {
+         write_record(&standard, options, "expire", entry->alert);
+         entry->expired = true;
+      }// End of if
+      else if (next == 0 || expires < next)
+      {
+         next = expires;
+      }// End of else if
+   }// End of for
+
+   zlog_debug(alog, "Exiting");
+   return next;
+}// End of watch_alerts method
+
+// IMPLEMENTATION: See header for details
+void free_output_buffer(OutputBuffer *out)
+{
+   free(out->data);
+
+   out->data = NULL;
+   out->length = 0;
+   out->capacity = 0;
+   out->failed = false;
+}// End of free_output_buffer method
+
+// IMPLEMENTATION: See header for details
+void free_output(void)
+{
+   flush_output();
+
+   for (unsigned long x = 0; watched && x <= watched_mask; ++x) free_alert(watched[x].alert);
+
+   free(watched);
+   watched = NULL;
+   watched_mask = 0;
+}// End of free_output method
@@ -0,0 +1,159 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef _OUTPUT
+#define _OUTPUT
+
+#include <stdbool.h>
+#include <time.h>
+
+#include "alerts.h"
+
+#define OUTPUT_BUFFER_SIZE 65536
+
+/*
+   Headless output writes alerts to stdout, one line per alert, as NDJSON or
+   TSV (with a header line). Records are formatted straight into one static
+   buffer that is written out when full or flushed, so nothing is allocated
+   per alert. In watch mode every line is an event: "add", "update" or
+   "expire" (an alert that expired or left the feed).
+*/
+enum OutputFormat {
+   OUTPUT_NDJSON,
+   OUTPUT_TSV
+};
+typedef enum OutputFormat OutputFormat;
+
+enum OutputField {
+   OUTPUT_IDENTIFIER,
+   OUTPUT_HEADLINE,
+   OUTPUT_ISSUER,
+   OUTPUT_EFFECTIVE,
+   OUTPUT_EXPIRES,
+   OUTPUT_AREAS,
+   OUTPUT_DESCRIPTION,
+   OUTPUT_INSTRUCTION,
+   OUTPUT_FIELD_COUNT
+};
+typedef enum OutputField OutputField;
+
+/*
+   OutputBuffer collects lines. With a descriptor it is written out whenever
+   it is full, without (fd -1, zeroed) it grows to hold everything.
+*/
+struct OutputBuffer {
+   char *data;
+   size_t length;
+   size_t capacity;
+   int fd;
+   bool failed;                              // Memory could not be allocated
+};
+typedef struct OutputBuffer OutputBuffer;
+
+struct OutputOptions {
+   OutputFormat format;
+   bool watch;                               // Write events instead of alerts
+   bool history;                             // Write history records (event and recorded time)
+   int field_count;
+   OutputField fields[OUTPUT_FIELD_COUNT];
+};
+typedef struct OutputOptions OutputOptions;
+
+/*
+   default_output_options() Returns NDJSON with the identifier, effective,
+                            expires, issuer, headline and areas fields.
+*/
+OutputOptions default_output_options(void);
+
+/*
+   parse_output_format(name, options) Sets the format ("ndjson" or "tsv").
+      POST: Returns false if name is not a format.
+*/
+bool parse_output_format(const char *name, OutputOptions *options);
+
+/*
+   parse_output_fields(list, options) Sets the fields from a comma separated
+                                       list of field names.
+      POST: Returns false (options unchanged) if a name is not a field.
+*/
+bool parse_output_fields(const char *list, OutputOptions *options);
+
+/*
+   write_output_header(options) Writes the TSV header line (nothing for
+                                NDJSON).
+*/
+void write_output_header(const OutputOptions *options);
+
+/*
+   write_alerts(options, alerts) Writes one line per alert.
+      PRE:  Valid pointers
+      POST: The lines are buffered (see flush_output).
+*/
+void write_alerts(const OutputOptions *options, const Alerts *alerts);
+
+/*
+   write_record(out, options, event, alert) Appends the line of alert to out,
+                                             with the event first if not NULL.
+      PRE:  Valid out, options and alert pointers
+*/
+void write_record(OutputBuffer *out, const OutputOptions *options, const char *event, const Alert *alert);
+
+/*
+   write_history_record(options, event, recorded, alert) Writes the line of
+                                                         a history record,
+                                                         the event and the
+                                                         time it was recorded
+                                                         first.
+      PRE:  Valid options and alert pointers
+      POST: The line is buffered (see flush_output).
+*/
+void write_history_record(const OutputOptions *options, const char *event, time_t recorded, const Alert *alert);
+
+/*
+   watch_alerts(options, alerts, now) Writes the events between the alerts
+                                       of the previous call and alerts.
+      PRE:  Valid pointers (alerts may be the same snapshot again, to report
+            alerts that expired since).
+      POST: Returns the next time an alert expires (0 if none). The alerts
+            are retained until the next call or free_output.
+*/
+time_t watch_alerts(const OutputOptions *options, const Alerts *alerts, time_t now);
+
+/*
+   flush_output() Writes the buffered lines to stdout.
+      POST: Returns false if stdout could not be written to.
+*/
+bool flush_output(void);
+
+/*
+   free_output_buffer(out) Frees the memory of a buffer without descriptor.
+*/
+void free_output_buffer(OutputBuffer *out);
+
+/*
+   free_output() Flushes the output and releases the watched alerts.
+*/
+void free_output(void);
+
+#endif
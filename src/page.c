@@ -0,0 +1,232 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "page.h"
+
+#include "log.h"
+
+#include <string.h>
+
+static AlertPage pages[ALERT_PAGE_CACHE];
+static int page_width = 0;
+static unsigned long page_clock = 0;
+
+/*
+   free_page(page) Frees the pad of page and releases its alert.
+*/
+static void free_page(AlertPage *page)
+{
+   if (page->pad) delwin(page->pad);
+   free_alert(page->alert);
+
+   memset(page, 0, sizeof(AlertPage));
+}// End of free_page method
+
+/*
+   print_wrapped(pad, text, attributes) Prints text, breaking lines between
+                                          words where possible.
+      PRE:  Valid pad and text
+      POST: text is printed at the cursor with attributes.
+*/
+static void print_wrapped(WINDOW *pad, const char *text, attr_t attributes)
+{
+   if (!text) return;
+
+   int width = getmaxx(pad);
+
+   wattron(pad, attributes);
+
+   while (*text)
+   {
+      if (*text == '\n')
+      {
+         waddch(pad, '\n');
+         ++text;
+         continue;
+      }// End of if
+
+      // A word and the spaces following it
+      size_t word = strcspn(text, " \n");
+      size_t spaces = strspn(text + word, " ");
+
+      // Move the word to the next line if it does not fit (and would on its own)
+      int column = getcurx(pad);
+      if (column > 0 && column + (int)word > width && (int)word <= width) waddch(pad, '\n');
+
+      waddnstr(pad, text, word);
+      text += word;
+
+      // Spaces that would spill over the end of the line are dropped
+      column = getcurx(pad);
+      if (word > 0 && column == 0) spaces = 0;
+      if ((int)spaces > width - column) spaces = width - column;
+
+      waddnstr(pad, text, spaces);
+      text += strspn(text, " ");
+   }// End of while
+
+   wattroff(pad, attributes);
+}// End of print_wrapped method
+
+/*
+   estimate_lines(alert, width) Returns an upper bound of the lines alert
+                                 needs at width columns.
+*/
+static int estimate_lines(const Alert *alert, int width)
+{
+   const char *texts[] = { alert->headline, alert->issuer, alert->description, alert->instruction };
+   size_t characters = 128;
+   int lines = 16;
+
+   for (int x = 0; x < 4; ++x)
+   {
+      if (!texts[x]) continue;
+
+      characters += strlen(texts[x]);
+      for (const char *c = texts[x]; *c; ++c) if (*c == '\n') ++lines;
+   }// End of for
+
+   for (int x = 0; x < alert->area_count; ++x)
+   {
+      characters += strlen(alert->areas[x]->name) + 2;
+   }// End of for
+
+   // Word wrapping wastes at most one word per line, so allow twice the area
+   return lines + (int)(2 * characters / width) + 1;
+}// End of estimate_lines method
+
+/*
+   layout_alert(alert, width, lines) Lays alert out in a new pad.
+      PRE:  Valid alert pointer
+      POST: Returns the pad (NULL on failure), lines is set to the lines used.
+*/
+static WINDOW * layout_alert(Alert *alert, int width, int *lines)
+{
+   zlog_debug(alog, "Entering");
+
+   WINDOW *pad = newpad(estimate_lines(alert, width), width);
+   if (!pad) return NULL;
+
+   scrollok(pad, false);
+
+   zlog_debug(alog, "Declaring and initializing variables for output");
+   char headline[strlen(alert->headline) + 11];
+   char tm[18];
+
+   zlog_debug(alog, "Upper-casing headline");
+   snprintf(headline, sizeof(headline), " *** %s *** ", alert->headline);
+   for (char *c = headline; *c; ++c)
+   {
+      if (*c >= 'a' && *c <= 'z') *c = *c - 'a' + 'A';
+   }// End of for
+
+   zlog_debug(alog, "Printing headline");
+   print_wrapped(pad, headline, COLOR_PAIR(HEADLINE_COLOUR));
+   print_wrapped(pad, "\n", A_NORMAL);
+
+   zlog_debug(alog, "Printing issuer");
+   print_wrapped(pad, "Issued by ", A_NORMAL);
+   print_wrapped(pad, alert->issuer, A_BOLD);
+
+   zlog_debug(alog, "Printing effective time");
+   print_wrapped(pad, " on ", A_NORMAL);
+   strftime(tm, sizeof(tm) - 1, "%Y-%m-%d %H:%M", &alert->effective);
+   print_wrapped(pad, tm, A_BOLD);
+
+   zlog_debug(alog, "Printing expires time");
+   print_wrapped(pad, "\nEffective until ", A_NORMAL);
+   strftime(tm, sizeof(tm) - 1, "%Y-%m-%d %H:%M", &alert->expires);
+   print_wrapped(pad, tm, A_BOLD);
+   print_wrapped(pad, ".\n\n", A_NORMAL);
+
+   zlog_debug(alog, "Printing areas");
+   print_wrapped(pad, "For ", A_NORMAL);
+   for (int x = 0; x < alert->area_count; ++x)
+   {
+      if (x > 0) print_wrapped(pad, ", ", A_NORMAL);
+      print_wrapped(pad, alert->areas[x]->name, A_BOLD);
+   }// End of for
+   print_wrapped(pad, ".\n\n\n\n", A_NORMAL);
+
+   zlog_debug(alog, "Printing description");
+   print_wrapped(pad, alert->description, A_NORMAL);
+   print_wrapped(pad, "\n\n", A_NORMAL);
+
+   zlog_debug(alog, "Printing instruction");
+   print_wrapped(pad, alert->instruction, A_BOLD);
+
+   *lines = getcury(pad) + 1;
+
+   zlog_debug(alog, "Exiting");
+   return pad;
+}// End of layout_alert method
+
+// IMPLEMENTATION: See header for details
+AlertPage * get_alert_page(Alert *alert, int width)
+{
+   zlog_debug(alog, "Entering");
+
+   if (!alert || width <= 0) return NULL;
+
+   // Pages are only valid for the width they were laid out for
+   if (width != page_width)
+   {
+      free_alert_pages();
+      page_width = width;
+   }// End of if
+
+   AlertPage *victim = &pages[0];
+
+   for (int x = 0; x < ALERT_PAGE_CACHE; ++x)
+   {
+      if (pages[x].alert == alert)
+      {
+         pages[x].used = ++page_clock;
+         return &pages[x];
+      }// End of if
+
+      if (pages[x].used < victim->used) victim = &pages[x];
+   }// End of for
+
+   zlog_info(alog, "Laying out alert %s for %d columns", alert->identifier ? alert->identifier : "", width);
+
+   free_page(victim);
+
+   victim->pad = layout_alert(alert, width, &victim->lines);
+   if (!victim->pad) return NULL;
+
+   victim->alert = retain_alert(alert);
+   victim->width = width;
+   victim->used = ++page_clock;
+
+   zlog_debug(alog, "Exiting");
+   return victim;
+}// End of get_alert_page method
+
+// IMPLEMENTATION: See header for details
+void free_alert_pages(void)
+{
+   for (int x = 0; x < ALERT_PAGE_CACHE; ++x) free_page(&pages[x]);
+   page_width = 0;
+}// End of free_alert_pages method
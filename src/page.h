@@ -0,0 +1,67 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef _PAGE
+#define _PAGE
+
+#include <ncurses.h>
+
+#include "alert.h"
+
+#define HEADLINE_COLOUR 1
+#define ALERT_PAGE_CACHE 16
+
+/*
+   AlertPage is an alert laid out (word wrapped, with attributes) for one
+   terminal width in an ncurses pad. Showing any part of it is a
+   pnoutrefresh of the pad; nothing is laid out again unless the width
+   changes.
+*/
+struct AlertPage {
+   Alert *alert;              // Retained
+   int width;
+   int lines;                 // Lines used in the pad
+   WINDOW *pad;
+   unsigned long used;        // For least recently used eviction
+};
+typedef struct AlertPage AlertPage;
+
+/*
+   get_alert_page(alert, width) Returns alert laid out for width columns.
+      PRE:  Valid alert pointer, width > 0, ncurses is initialized.
+      POST: Returns the cached page (laying it out on a miss), or NULL if the
+            pad could not be created. The page stays valid until the next call
+            with a different width or free_alert_pages. A different width
+            drops every cached page.
+*/
+AlertPage * get_alert_page(Alert *alert, int width);
+
+/*
+   free_alert_pages() Frees every cached page.
+      PRE:  true
+      POST: Pads are deleted and alerts released.
+*/
+void free_alert_pages(void);
+
+#endif
@@ -0,0 +1,232 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "refresh.h"
+
+#include "log.h"
+#include "snapshot.h"
+#include "stream.h"
+#include "trace.h"
+
+#include <time.h>
+#include <pthread.h>
+
+static pthread_t refresher;
+static pthread_mutex_t refresher_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t refresher_wakeup;
+
+static bool running = false;
+static bool stopping = false;
+static bool refresh_requested = false;
+
+static FeedSet *feed_set = NULL;
+static int refresh_interval = 0;
+static AlertStream *stream = NULL;
+
+/*
+   refresh_feeds() Loads the feed set and publishes the result.
+      PRE:  true
+      POST: A new snapshot is published if any feed changed.
+*/
+static void refresh_feeds(void)
+{
+   uint64_t start = stats_clock();
+
+   // The download and parse happen outside of the lock and off the UI thread
+   Alerts *alerts = load_alerts_from_feed_set(feed_set);
+
+   if (alerts)
+   {
+      publish_snapshot(alerts);
+   }// End of if
+   else
+   {
+      if (feed_set->failed == feed_set->count)
+      {
+         zlog_warn(alog, "Refresh failed, keeping the current snapshot");
+      }// End of if
+
+      reclaim_snapshots();
+   }// End of else
+
+   trace_span("refresh", start);
+}// End of refresh_feeds method
+
+/*
+   follow_stream() Applies streamed events until the next poll is due.
+      PRE:  stream != NULL, refresher_lock is not held
+      POST: Every change is published as it arrives. Returns when the interval
+            elapsed, a refresh was requested, the refresher is stopping or the
+            streamed feed has to be fetched in full.
+*/
+static void follow_stream(void)
+{
+   double due = fetch_clock() + refresh_interval;
+
+   for (;;)
+   {
+      pthread_mutex_lock(&refresher_lock);
+      bool interrupted = stopping || refresh_requested;
+      pthread_mutex_unlock(&refresher_lock);
+
+      long remaining = (long)((due - fetch_clock()) * 1000);
+      if (interrupted || remaining <= 0) return;
+
+      int result = wait_alert_stream(stream, remaining);
+
+      if (result > 0)
+      {
+         Alerts *alerts = merge_feed_set(feed_set);
+         if (alerts) publish_snapshot(alerts);
+      }// End of if
+      else if (result < 0)
+      {
+         // Forget the version and validator so the next load is a full fetch
+         feed_set->feeds[0].version = 0;
+         feed_set->feeds[0].etag[0] = '\0';
+         return;
+      }// End of else if
+   }// End of for
+}// End of follow_stream method
+
+/*
+   refresher_main(arg) Body of the refresher thread.
+      PRE:  true
+      POST: Feeds are loaded and published until stop_refresher is called.
+*/
+static void * refresher_main(void *arg)
+{
+   zlog_debug(alog, "Entering");
+
+   (void)arg;
+
+   name_trace_thread("refresher");
+
+   pthread_mutex_lock(&refresher_lock);
+
+   while (!stopping)
+   {
+      refresh_requested = false;
+      pthread_mutex_unlock(&refresher_lock);
+
+      refresh_feeds();
+
+      if (stream)
+      {
+         follow_stream();
+
+         pthread_mutex_lock(&refresher_lock);
+         continue;
+      }// End of if
+
+      // Sleep until the next refresh is due (or we are woken up)
+      struct timespec deadline;
+      clock_gettime(CLOCK_MONOTONIC, &deadline);
+      deadline.tv_sec += refresh_interval;
+
+      pthread_mutex_lock(&refresher_lock);
+
+      while (!stopping && !refresh_requested)
+      {
+         if (pthread_cond_timedwait(&refresher_wakeup, &refresher_lock, &deadline) != 0) break;
+      }// End of while
+   }// End of while
+
+   pthread_mutex_unlock(&refresher_lock);
+
+   zlog_debug(alog, "Exiting");
+   return NULL;
+}// End of refresher_main method
+
+// IMPLEMENTATION: See header for details
+bool start_refresher(FeedSet *feeds, int interval, const char *stream_url)
+{
+   zlog_debug(alog, "Entering");
+
+   if (running || !feeds || interval <= 0) return false;
+
+   if (stream_url && !(stream = open_alert_stream(stream_url, &feeds->feeds[0], &feeds->policy))) return false;
+
+   pthread_condattr_t attributes;
+   pthread_condattr_init(&attributes);
+   pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+   pthread_cond_init(&refresher_wakeup, &attributes);
+   pthread_condattr_destroy(&attributes);
+
+   feed_set = feeds;
+   refresh_interval = interval;
+   stopping = false;
+
+   if (pthread_create(&refresher, NULL, refresher_main, NULL) != 0)
+   {
+      zlog_warn(alog, "Failed to start the refresher thread");
+      pthread_cond_destroy(&refresher_wakeup);
+      close_alert_stream(stream);
+      stream = NULL;
+      return false;
+   }// End of if
+
+   running = true;
+
+   zlog_debug(alog, "Exiting");
+   return true;
+}// End of start_refresher method
+
+// IMPLEMENTATION: See header for details
+void request_refresh(void)
+{
+   pthread_mutex_lock(&refresher_lock);
+   refresh_requested = true;
+   pthread_cond_signal(&refresher_wakeup);
+   pthread_mutex_unlock(&refresher_lock);
+
+   // A refresh stuck on a slow server is started over
+   if (feed_set) cancel_feed_set(feed_set, false);
+   if (stream) wake_alert_stream(stream);
+}// End of request_refresh method
+
+// IMPLEMENTATION: See header for details
+void stop_refresher(void)
+{
+   zlog_debug(alog, "Entering");
+
+   if (!running) return;
+
+   pthread_mutex_lock(&refresher_lock);
+   stopping = true;
+   pthread_cond_signal(&refresher_wakeup);
+   pthread_mutex_unlock(&refresher_lock);
+
+   // Quitting does not wait for the transfers of a refresh in flight
+   cancel_feed_set(feed_set, true);
+   if (stream) wake_alert_stream(stream);
+
+   pthread_join(refresher, NULL);
+   pthread_cond_destroy(&refresher_wakeup);
+   close_alert_stream(stream);
+   stream = NULL;
+   running = false;
+
+   zlog_debug(alog, "Exiting");
+}// End of stop_refresher method
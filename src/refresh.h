@@ -0,0 +1,60 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef _REFRESH
+#define _REFRESH
+
+#include <stdbool.h>
+
+#include "feeds.h"
+
+/*
+   start_refresher(feeds, interval, stream_url) Starts the background refresher.
+      PRE:  Valid feeds pointer that outlives the refresher, interval > 0 (seconds),
+            stream_url is NULL or the event stream of the first feed.
+      POST: A thread is started that loads the feeds immediately and then every
+            interval seconds, publishing each result with publish_snapshot.
+            With a stream_url the first feed is also followed between polls and
+            every streamed change is published as it arrives.
+            Returns true if the thread was started.
+*/
+bool start_refresher(FeedSet *feeds, int interval, const char *stream_url);
+
+/*
+   request_refresh() Wakes the refresher to reload the feeds now.
+      PRE:  true
+      POST: The refresher reloads the feeds without waiting for the interval.
+            A refresh in flight is abandoned and started over.
+*/
+void request_refresh(void);
+
+/*
+   stop_refresher() Stops the background refresher.
+      PRE:  true
+      POST: The refresher thread has exited (a refresh in flight is
+            abandoned, its transfers aborted).
+*/
+void stop_refresher(void);
+
+#endif
@@ -0,0 +1,371 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "search.h"
+
+#include "log.h"
+#include "stats.h"
+#include "memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct SearchEntry {
+   const char *token;
+   int alert;
+};
+typedef struct SearchEntry SearchEntry;
+
+struct SearchIndex {
+   int alert_count;
+   int entry_count;
+   SearchEntry *entries;      // Sorted by token, then alert
+   char *pool;                // Every token, NULL terminated
+
+   unsigned int *marks;       // Per alert, for intersections
+   unsigned int mark;
+};
+
+/*
+   SearchLevel is the state after one character of the query: the range of
+   tokens matching the word being typed, and the alerts matching the query.
+*/
+struct SearchLevel {
+   int low;
+   int high;
+   int *results;              // Owned unless shared with the previous level
+   int count;
+   bool shared;
+};
+typedef struct SearchLevel SearchLevel;
+
+struct Search {
+   SearchIndex *index;
+   char query[SEARCH_MAX_QUERY + 1];
+   int length;
+   SearchLevel levels[SEARCH_MAX_QUERY + 1];
+};
+
+/*
+   token_character(c) Returns true if c is part of a token (letters, digits
+                        and every non-ASCII byte, so accented words stay whole).
+*/
+static bool token_character(char c)
+{
+   return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || (unsigned char)c >= 0x80;
+}// End of token_character method
+
+/*
+   lower(c) Returns c in lower case (ASCII only).
+*/
+static char lower(char c)
+{
+   return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}// End of lower method
+
+/*
+   compare_entries(a, b) Orders entries by token, then alert.
+*/
+static int compare_entries(const void *a, const void *b)
+{
+   const SearchEntry *left = a;
+   const SearchEntry *right = b;
+   int order = strcmp(left->token, right->token);
+
+   return order ? order : left->alert - right->alert;
+}// End of compare_entries method
+
+/*
+   add_tokens(index, pool_length, text, alert) Splits text into tokens of
+                                                 alert.
+      PRE:  The pool and entries have room for text
+*/
+static void add_tokens(SearchIndex *index, size_t *pool_length, const char *text, int alert)
+{
+   if (!text) return;
+
+   for (const char *c = text; *c; )
+   {
+      if (!token_character(*c))
+      {
+         ++c;
+         continue;
+      }// End of if
+
+      char *token = index->pool + *pool_length;
+
+      while (token_character(*c)) index->pool[(*pool_length)++] = lower(*c++);
+      index->pool[(*pool_length)++] = '\0';
+
+      index->entries[index->entry_count].token = token;
+      index->entries[index->entry_count].alert = alert;
+      ++index->entry_count;
+   }// End of for
+}// End of add_tokens method
+
+// IMPLEMENTATION: See header for details
+SearchIndex * create_search_index(const Alerts *alerts)
+{
+   zlog_debug(alog, "Entering");
+
+   uint64_t start = stats_clock();
+
+   // Every token takes at most its characters and a terminator, and there
+   // are at most half as many tokens as characters (plus one per text)
+   size_t characters = 0;
+   size_t texts = 0;
+
+   for (int x = 0; x < alerts->count; ++x)
+   {
+      Alert *alert = alerts->alerts[x];
+      const char *fields[] = { alert->headline, alert->issuer, alert->description };
+
+      for (int f = 0; f < 3; ++f)
+      {
+         if (fields[f]) characters += strlen(fields[f]);
+      }// End of for (f)
+
+      for (int a = 0; a < alert->area_count; ++a)
+      {
+         characters += strlen(alert->areas[a]->name);
+      }// End of for (a)
+
+      texts += 3 + alert->area_count;
+   }// End of for (x)
+
+   SearchIndex *index = account_calloc(MEMORY_INDEX, 1, sizeof(SearchIndex));
+   size_t max_tokens = characters / 2 + texts + 1;
+
+   if (!index
+         || !(index->pool = account_malloc(MEMORY_INDEX, characters + max_tokens))
+         || !(index->entries = account_malloc(MEMORY_INDEX, max_tokens * sizeof(SearchEntry)))
+         || !(index->marks = account_calloc(MEMORY_INDEX, alerts->count + 1, sizeof(unsigned int))))
+   {
+      zlog_warn(alog, "Failed to allocate memory for the search index");
+      free_search_index(index);
+      return NULL;
+   }// End of if
+
+   size_t pool_length = 0;
+   index->alert_count = alerts->count;
+
+   for (int x = 0; x < alerts->count; ++x)
+   {
+      Alert *alert = alerts->alerts[x];
+
+      add_tokens(index, &pool_length, alert->headline, x);
+      add_tokens(index, &pool_length, alert->issuer, x);
+      add_tokens(index, &pool_length, alert->description, x);
+
+      for (int a = 0; a < alert->area_count; ++a)
+      {
+         add_tokens(index, &pool_length, alert->areas[a]->name, x);
+      }// End of for (a)
+   }// End of for (x)
+
+   qsort(index->entries, index->entry_count, sizeof(SearchEntry), compare_entries);
+
+   // The same token may appear several times in one alert
+   int unique = 0;
+
+   for (int x = 0; x < index->entry_count; ++x)
+   {
+      if (unique > 0 && index->entries[unique - 1].alert == index->entries[x].alert
+            && strcmp(index->entries[unique - 1].token, index->entries[x].token) == 0) continue;
+
+      index->entries[unique++] = index->entries[x];
+   }// End of for
+
+   index->entry_count = unique;
+
+   zlog_info(alog, "Indexed %d alerts (%d tokens)", alerts->count, unique);
+   record_stat_since(STATS_INDEX, start);
+
+   zlog_debug(alog, "Exiting");
+   return index;
+}// End of create_search_index method
+
+// IMPLEMENTATION: See header for details
+void free_search_index(SearchIndex *index)
+{
+   if (!index) return;
+
+   account_free(MEMORY_INDEX, index->entries);
+   account_free(MEMORY_INDEX, index->pool);
+   account_free(MEMORY_INDEX, index->marks);
+   account_free(MEMORY_INDEX, index);
+}// End of free_search_index method
+
+/*
+   prefix_bound(index, low, high, prefix, length, after) Binary searches
+               [low, high) for the first token that is not before prefix
+               (after = false) or that does not start with prefix (after = true).
+*/
+static int prefix_bound(const SearchIndex *index, int low, int high, const char *prefix, size_t length, bool after)
+{
+   while (low < high)
+   {
+      int middle = low + (high - low) / 2;
+      int order = strncmp(index->entries[middle].token, prefix, length);
+
+      if (order < 0 || (after && order == 0)) low = middle + 1;
+      else high = middle;
+   }// End of while
+
+   return low;
+}// End of prefix_bound method
+
+// IMPLEMENTATION: See header for details
+Search * create_search(SearchIndex *index)
+{
+   zlog_debug(alog, "Entering");
+
+   Search *search = calloc(1, sizeof(Search));
+   int *all = malloc((index->alert_count + 1) * sizeof(int));
+
+   if (!search || !all)
+   {
+      zlog_warn(alog, "Failed to allocate memory for the search");
+      free(search);
+      free(all);
+      return NULL;
+   }// End of if
+
+   // The empty query matches every alert
+   for (int x = 0; x < index->alert_count; ++x) all[x] = x;
+
+   search->index = index;
+   search->levels[0].low = 0;
+   search->levels[0].high = index->entry_count;
+   search->levels[0].results = all;
+   search->levels[0].count = index->alert_count;
+
+   zlog_debug(alog, "Exiting");
+   return search;
+}// End of create_search method
+
+// IMPLEMENTATION: See header for details
+bool search_append(Search *search, char ch)
+{
+   if (search->length == SEARCH_MAX_QUERY || ch == '\0') return false;
+
+   SearchIndex *index = search->index;
+   SearchLevel *previous = &search->levels[search->length];
+   SearchLevel *level = &search->levels[search->length + 1];
+
+   search->query[search->length] = ch;
+   search->query[search->length + 1] = '\0';
+
+   // A separator starts a new word, which matches every token so far
+   if (!token_character(ch))
+   {
+      level->low = 0;
+      level->high = index->entry_count;
+      level->results = previous->results;
+      level->count = previous->count;
+      level->shared = true;
+
+      ++search->length;
+      return true;
+   }// End of if
+
+   // The word being typed, in lower case
+   const char *word = search->query + search->length;
+   while (word > search->query && token_character(word[-1])) --word;
+
+   size_t length = search->query + search->length + 1 - word;
+   char prefix[SEARCH_MAX_QUERY + 1];
+
+   for (size_t x = 0; x < length; ++x) prefix[x] = lower(word[x]);
+   prefix[length] = '\0';
+
+   // Tokens starting with the longer prefix are within the previous range
+   int low = prefix_bound(index, previous->low, previous->high, prefix, length, false);
+   int high = prefix_bound(index, low, previous->high, prefix, length, true);
+
+   int *results = malloc((previous->count + 1) * sizeof(int));
+
+   if (!results)
+   {
+      search->query[search->length] = '\0';
+      return false;
+   }// End of if
+
+   // Intersect the previous results with the alerts of the range
+   unsigned int mark = ++index->mark;
+   int count = 0;
+
+   for (int x = low; x < high; ++x) index->marks[index->entries[x].alert] = mark;
+
+   for (int x = 0; x < previous->count; ++x)
+   {
+      if (index->marks[previous->results[x]] == mark) results[count++] = previous->results[x];
+   }// End of for
+
+   level->low = low;
+   level->high = high;
+   level->results = results;
+   level->count = count;
+   level->shared = false;
+
+   ++search->length;
+   return true;
+}// End of search_append method
+
+// IMPLEMENTATION: See header for details
+void search_backspace(Search *search)
+{
+   if (search->length == 0) return;
+
+   SearchLevel *level = &search->levels[search->length];
+   if (!level->shared) free(level->results);
+
+   memset(level, 0, sizeof(SearchLevel));
+
+   search->query[--search->length] = '\0';
+}// End of search_backspace method
+
+// IMPLEMENTATION: See header for details
+const char * search_query(const Search *search)
+{
+   return search->query;
+}// End of search_query method
+
+// IMPLEMENTATION: See header for details
+const int * search_results(const Search *search, int *count)
+{
+   *count = search->levels[search->length].count;
+   return search->levels[search->length].results;
+}// End of search_results method
+
+// IMPLEMENTATION: See header for details
+void free_search(Search *search)
+{
+   if (!search) return;
+
+   while (search->length > 0) search_backspace(search);
+
+   free(search->levels[0].results);
+   free(search);
+}// End of free_search method
@@ -0,0 +1,108 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef _SEARCH
+#define _SEARCH
+
+#include <stdbool.h>
+
+#include "alerts.h"
+
+#define SEARCH_MAX_QUERY 128
+
+/*
+   SearchIndex maps every word (token) of a snapshot's alerts to the alerts
+   containing it. Tokens are kept sorted, so the tokens starting with a prefix
+   form one range, and the range of a longer prefix lies within it.
+*/
+struct SearchIndex;
+typedef struct SearchIndex SearchIndex;
+
+/*
+   Search is a query being typed. Every word of the query has to be the
+   prefix of a token of an alert for the alert to match. Each keystroke
+   narrows the previous results (and the previous token range) instead of
+   searching again, and the results of every shorter query are kept so that
+   deleting a character is free.
+*/
+struct Search;
+typedef struct Search Search;
+
+/*
+   create_search_index(alerts) Indexes the headline, issuer, areas and
+                                 description of every alert.
+      PRE:  Valid alerts pointer
+      POST: Returns the index (alerts may be freed afterwards), or NULL if
+            memory could not be allocated.
+*/
+SearchIndex * create_search_index(const Alerts *alerts);
+
+/*
+   free_search_index(index) Frees the index.
+      PRE:  No search uses the index anymore.
+*/
+void free_search_index(SearchIndex *index);
+
+/*
+   create_search(index) Starts an empty query (matching every alert).
+      PRE:  Valid index pointer that outlives the search.
+      POST: Returns the search, or NULL if memory could not be allocated.
+*/
+Search * create_search(SearchIndex *index);
+
+/*
+   search_append(search, ch) Adds ch to the end of the query.
+      PRE:  Valid search pointer
+      POST: The results are narrowed. Returns false if the query is full or
+            memory could not be allocated (the query is unchanged).
+*/
+bool search_append(Search *search, char ch);
+
+/*
+   search_backspace(search) Removes the last character of the query.
+      PRE:  Valid search pointer
+      POST: The results of the shorter query are restored.
+*/
+void search_backspace(Search *search);
+
+/*
+   search_query(search) Returns the query typed so far.
+*/
+const char * search_query(const Search *search);
+
+/*
+   search_results(search, count) Returns the indexes (in the snapshot the
+                                   index was created from, ascending) of the
+                                   alerts matching the query.
+      PRE:  Valid pointers
+      POST: count is set. The array is valid until the query changes.
+*/
+const int * search_results(const Search *search, int *count);
+
+/*
+   free_search(search) Frees the search.
+*/
+void free_search(Search *search);
+
+#endif
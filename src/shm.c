@@ -0,0 +1,862 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "shm.h"
+
+#include "log.h"
+#include "snapshot.h"
+#include "memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define SHM_MIN_CAPACITY (64 * 1024)
+#define SHM_READ_ATTEMPTS 16
+
+#define ALIGN(size) (((size) + 7) & ~(uint64_t)7)
+
+struct ShmReader {
+   int fd;
+   ShmHeader *segment;
+   size_t mapped;
+
+   // Alerts of the last load_alerts_from_shm and their hashes
+   Alerts *last;
+   uint64_t *hashes;
+};
+
+// Publisher
+static char publisher_name[NAME_MAX];
+static int publisher_fd = -1;
+static ShmHeader *publisher = NULL;
+static size_t publisher_mapped = 0;
+
+// Follower
+static pthread_t follower;
+static pthread_mutex_t follower_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t follower_wakeup = PTHREAD_COND_INITIALIZER;
+static char follower_name[NAME_MAX];
+static ShmReader *follower_reader = NULL;
+static bool following = false;
+static bool follower_stopping = false;
+
+static long futex(uint32_t *address, int operation, uint32_t value, const struct timespec *timeout)
+{
+   return syscall(SYS_futex, address, operation, value, timeout, NULL, 0);
+}// End of futex method
+
+static uint64_t string_size(const char *str)
+{
+   return str ? ALIGN(strlen(str) + 1) : 0;
+}// End of string_size method
+
+/*
+   alert_size(alert) Returns the bytes alert takes in a buffer.
+*/
+static uint64_t alert_size(const Alert *alert)
+{
+   uint64_t size = sizeof(ShmAlert) + string_size(alert->identifier) + string_size(alert->headline)
+                     + string_size(alert->description) + string_size(alert->instruction)
+                     + string_size(alert->issuer) + string_size(alert->event)
+                     + alert->area_count * sizeof(ShmArea);
+
+   for (int x = 0; x < alert->area_count; ++x)
+   {
+      size += string_size(alert->areas[x]->name) + ALIGN(alert->areas[x]->geocode_count * sizeof(int32_t));
+   }// End of for
+
+   return size;
+}// End of alert_size method
+
+/*
+   BufferWriter appends to the buffer being written.
+*/
+struct BufferWriter {
+   unsigned char *base;
+   uint64_t used;
+   uint64_t hash;             // Of the alert being written
+};
+typedef struct BufferWriter BufferWriter;
+
+static uint32_t put_bytes(BufferWriter *writer, const void *data, size_t length)
+{
+   uint32_t offset = writer->used;
+
+   memcpy(writer->base + offset, data, length);
+   memset(writer->base + offset + length, 0, ALIGN(length) - length);
+   writer->used += ALIGN(length);
+
+   return offset;
+}// End of put_bytes method
+
+static uint32_t put_string(BufferWriter *writer, const char *str)
+{
+   // NULL and "" differ, so the hash includes the terminator or a marker
+   if (!str)
+   {
+      writer->hash = hash_bytes(writer->hash, "\xff", 1);
+      return 0;
+   }// End of if
+
+   size_t length = strlen(str) + 1;
+   writer->hash = hash_bytes(writer->hash, str, length);
+
+   return put_bytes(writer, str, length);
+}// End of put_string method
+
+static void put_time(BufferWriter *writer, ShmTime *time, const struct tm *tm)
+{
+   ShmTime value = { tm->tm_year, tm->tm_mon, tm->tm_mday, tm->tm_hour, tm->tm_min,
+                     tm->tm_sec, tm->tm_wday, tm->tm_yday, tm->tm_isdst };
+
+   *time = value;
+   writer->hash = hash_bytes(writer->hash, &value, sizeof(value));
+}// End of put_time method
+
+/*
+   put_alert(writer, alert) Writes alert to the buffer.
+      POST: Returns the offset of the ShmAlert.
+*/
+static uint32_t put_alert(BufferWriter *writer, const Alert *alert)
+{
+   ShmAlert record = { 0 };
+   uint32_t offset = put_bytes(writer, &record, sizeof(record));
+
+   writer->hash = HASH_SEED;
+
+   record.identifier = put_string(writer, alert->identifier);
+   record.headline = put_string(writer, alert->headline);
+   record.description = put_string(writer, alert->description);
+   record.instruction = put_string(writer, alert->instruction);
+   record.issuer = put_string(writer, alert->issuer);
+   record.event = put_string(writer, alert->event);
+   record.severity = alert->severity;
+   writer->hash = hash_bytes(writer->hash, &record.severity, sizeof(record.severity));
+
+   put_time(writer, &record.effective, &alert->effective);
+   put_time(writer, &record.expires, &alert->expires);
+
+   record.area_count = alert->area_count;
+
+   if (alert->area_count > 0)
+   {
+      record.areas = writer->used;
+      writer->used += alert->area_count * sizeof(ShmArea);
+   }// End of if
+
+   for (int x = 0; x < alert->area_count; ++x)
+   {
+      const AlertArea *area = alert->areas[x];
+      ShmArea value = { 0 };
+
+      value.name = put_string(writer, area->name);
+      value.geocode_count = area->geocode_count;
+
+      if (area->geocode_count > 0)
+      {
+         value.geocodes = writer->used;
+
+         for (int y = 0; y < area->geocode_count; ++y)
+         {
+            int32_t geocode = area->geocodes[y];
+
+            memcpy(writer->base + writer->used + y * sizeof(int32_t), &geocode, sizeof(geocode));
+            writer->hash = hash_bytes(writer->hash, &geocode, sizeof(geocode));
+         }// End of for (y)
+
+         writer->used += ALIGN(area->geocode_count * sizeof(int32_t));
+      }// End of if
+
+      memcpy(writer->base + record.areas + x * sizeof(ShmArea), &value, sizeof(value));
+   }// End of for
+
+   record.hash = writer->hash;
+   memcpy(writer->base + offset, &record, sizeof(record));
+
+   return offset;
+}// End of put_alert method
+
+/*
+   grow_buffer(index, capacity) Moves the buffer index to the end of the
+                                segment, with room for capacity bytes.
+      PRE:  The buffer is not the active buffer and its sequence is odd.
+      POST: Returns false if the segment could not grow.
+*/
+static bool grow_buffer(int index, uint64_t capacity)
+{
+   // The old space may still be read by slow readers, it is not reused
+   uint64_t offset = publisher->size;
+   size_t size = offset + capacity;
+
+   void *mapping = ftruncate(publisher_fd, size) == 0
+                     ? mremap(publisher, publisher_mapped, size, MREMAP_MAYMOVE) : MAP_FAILED;
+
+   if (mapping == MAP_FAILED)
+   {
+      zlog_warn(alog, "Failed to grow the shared memory segment to %zu bytes", size);
+      return false;
+   }// End of if
+
+   publisher = mapping;
+   publisher_mapped = size;
+
+   ShmBuffer *buffer = &publisher->buffers[index];
+
+   __atomic_store_n(&buffer->offset, offset, __ATOMIC_RELAXED);
+   __atomic_store_n(&buffer->capacity, capacity, __ATOMIC_RELAXED);
+   __atomic_store_n(&publisher->size, size, __ATOMIC_RELEASE);
+
+   return true;
+}// End of grow_buffer method
+
+/*
+   write_snapshot(alerts, data) Writes alerts to the inactive buffer and
+                                makes it the active one.
+      PRE:  Called by publish_snapshot (one publisher at a time).
+*/
+static void write_snapshot(const Alerts *alerts, void *data)
+{
+   zlog_debug(alog, "Entering");
+
+   (void)data;
+
+   uint64_t needed = 8 + ALIGN(alerts->count * sizeof(uint32_t)) + 1;
+   for (int x = 0; x < alerts->count; ++x) needed += alert_size(alerts->alerts[x]);
+
+   if (needed > UINT32_MAX)
+   {
+      zlog_warn(alog, "Alerts are too large for the shared memory segment");
+      return;
+   }// End of if
+
+   int index = 1 - __atomic_load_n(&publisher->active, __ATOMIC_RELAXED);
+   ShmBuffer *buffer = &publisher->buffers[index];
+   uint64_t sequence = buffer->sequence;
+
+   // Readers that are still in this buffer (two generations old) will retry
+   __atomic_store_n(&buffer->sequence, sequence + 1, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+
+   if (buffer->capacity < needed)
+   {
+      uint64_t capacity = SHM_MIN_CAPACITY;
+      while (capacity < needed * 2) capacity *= 2;
+
+      if (!grow_buffer(index, capacity))
+      {
+         __atomic_store_n(&publisher->buffers[index].sequence, sequence + 2, __ATOMIC_RELEASE);
+         return;
+      }// End of if
+
+      buffer = &publisher->buffers[index];
+   }// End of if
+
+   // Offset 0 stands for NULL, so the buffer starts with 8 unused bytes
+   BufferWriter writer = { (unsigned char *)publisher + buffer->offset, 8, 0 };
+   uint32_t table = writer.used;
+   writer.used += ALIGN(alerts->count * sizeof(uint32_t));
+
+   for (int x = 0; x < alerts->count; ++x)
+   {
+      uint32_t offset = put_alert(&writer, alerts->alerts[x]);
+      memcpy(writer.base + table + x * sizeof(uint32_t), &offset, sizeof(offset));
+   }// End of for
+
+   buffer->generation = alerts->generation;
+   buffer->count = alerts->count;
+   buffer->alerts = table;
+
+   __atomic_store_n(&buffer->sequence, sequence + 2, __ATOMIC_RELEASE);
+   __atomic_store_n(&publisher->active, index, __ATOMIC_RELEASE);
+
+   __atomic_add_fetch(&publisher->notify, 1, __ATOMIC_RELEASE);
+   futex(&publisher->notify, FUTEX_WAKE, INT_MAX, NULL);
+
+   zlog_debug(alog, "Exiting");
+}// End of write_snapshot method
+
+// IMPLEMENTATION: See header for details
+bool open_shm_publisher(const char *name)
+{
+   zlog_debug(alog, "Entering");
+
+   if (publisher || strlen(name) >= NAME_MAX) return false;
+
+   // A segment left behind by a publisher that died is replaced
+   shm_unlink(name);
+   publisher_fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+
+   if (publisher_fd < 0 || ftruncate(publisher_fd, sizeof(ShmHeader)) != 0)
+   {
+      zlog_warn(alog, "Failed to create the shared memory segment %s", name);
+      if (publisher_fd >= 0) close(publisher_fd);
+      publisher_fd = -1;
+      return false;
+   }// End of if
+
+   publisher = mmap(NULL, sizeof(ShmHeader), PROT_READ | PROT_WRITE, MAP_SHARED, publisher_fd, 0);
+
+   if (publisher == MAP_FAILED || !add_snapshot_listener(write_snapshot, NULL))
+   {
+      if (publisher != MAP_FAILED) munmap(publisher, sizeof(ShmHeader));
+      close(publisher_fd);
+      shm_unlink(name);
+      publisher = NULL;
+      publisher_fd = -1;
+      return false;
+   }// End of if
+
+   publisher_mapped = sizeof(ShmHeader);
+   publisher->version = SHM_VERSION;
+   publisher->size = sizeof(ShmHeader);
+   __atomic_store_n(&publisher->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+
+   strcpy(publisher_name, name);
+
+   zlog_debug(alog, "Exiting");
+   return true;
+}// End of open_shm_publisher method
+
+// IMPLEMENTATION: See header for details
+void close_shm_publisher(void)
+{
+   if (!publisher) return;
+
+   remove_snapshot_listener(write_snapshot, NULL);
+
+   __atomic_store_n(&publisher->closed, 1, __ATOMIC_RELEASE);
+   __atomic_add_fetch(&publisher->notify, 1, __ATOMIC_RELEASE);
+   futex(&publisher->notify, FUTEX_WAKE, INT_MAX, NULL);
+
+   munmap(publisher, publisher_mapped);
+   close(publisher_fd);
+   shm_unlink(publisher_name);
+
+   publisher = NULL;
+   publisher_fd = -1;
+}// End of close_shm_publisher method
+
+/*
+   map_segment(reader, size) Maps size bytes of the reader's segment.
+      POST: Returns false if it could not be mapped.
+*/
+static bool map_segment(ShmReader *reader, size_t size)
+{
+   void *mapping = reader->segment
+                     ? mremap(reader->segment, reader->mapped, size, MREMAP_MAYMOVE)
+                     : mmap(NULL, size, PROT_READ, MAP_SHARED, reader->fd, 0);
+
+   if (mapping == MAP_FAILED) return false;
+
+   reader->segment = mapping;
+   reader->mapped = size;
+
+   return true;
+}// End of map_segment method
+
+// IMPLEMENTATION: See header for details
+ShmReader * open_shm_reader(const char *name)
+{
+   ShmReader *reader = calloc(1, sizeof(ShmReader));
+   if (!reader) return NULL;
+
+   struct stat status;
+   reader->fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+
+   if (reader->fd < 0 || fstat(reader->fd, &status) != 0 || (size_t)status.st_size < sizeof(ShmHeader)
+         || !map_segment(reader, status.st_size)
+         || __atomic_load_n(&reader->segment->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC
+         || reader->segment->version != SHM_VERSION)
+   {
+      close_shm_reader(reader);
+      return NULL;
+   }// End of if
+
+   return reader;
+}// End of open_shm_reader method
+
+// IMPLEMENTATION: See header for details
+bool begin_shm_read(ShmReader *reader, ShmView *view)
+{
+   for (;;)
+   {
+      uint32_t index = __atomic_load_n(&reader->segment->active, __ATOMIC_ACQUIRE) & 1;
+      const ShmBuffer *buffer = &reader->segment->buffers[index];
+      uint64_t sequence = __atomic_load_n(&buffer->sequence, __ATOMIC_ACQUIRE);
+
+      // Being written, the active buffer changes once it is done
+      if (sequence & 1) continue;
+      if (sequence == 0) return false;
+
+      uint64_t offset = __atomic_load_n(&buffer->offset, __ATOMIC_RELAXED);
+      uint64_t capacity = __atomic_load_n(&buffer->capacity, __ATOMIC_RELAXED);
+
+      // The segment grew since it was mapped
+      if (offset + capacity > reader->mapped)
+      {
+         uint64_t size = __atomic_load_n(&reader->segment->size, __ATOMIC_ACQUIRE);
+
+         if (size < offset + capacity) continue;
+         if (!map_segment(reader, size)) return false;
+
+         buffer = &reader->segment->buffers[index];
+      }// End of if
+
+      view->base = (const unsigned char *)reader->segment + offset;
+      view->capacity = capacity;
+      view->generation = buffer->generation;
+      view->count = buffer->count;
+      view->sequence = sequence;
+      view->buffer = index;
+      view->table = buffer->alerts;
+
+      return true;
+   }// End of for
+}// End of begin_shm_read method
+
+// IMPLEMENTATION: See header for details
+bool end_shm_read(ShmReader *reader, const ShmView *view)
+{
+   __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+   return __atomic_load_n(&reader->segment->buffers[view->buffer].sequence, __ATOMIC_RELAXED) == view->sequence;
+}// End of end_shm_read method
+
+// IMPLEMENTATION: See header for details
+const ShmAlert * shm_view_alert(const ShmView *view, uint32_t index)
+{
+   if (index >= view->count || view->table + (uint64_t)(index + 1) * sizeof(uint32_t) > view->capacity) return NULL;
+
+   uint32_t offset;
+   memcpy(&offset, view->base + view->table + index * sizeof(uint32_t), sizeof(offset));
+
+   if (offset == 0 || offset % 8 || offset + sizeof(ShmAlert) > view->capacity) return NULL;
+
+   return (const ShmAlert *)(view->base + offset);
+}// End of shm_view_alert method
+
+// IMPLEMENTATION: See header for details
+const char * shm_view_string(const ShmView *view, uint32_t offset)
+{
+   // The last byte of the buffer is always 0, so the string ends in the buffer
+   return offset > 0 && offset < view->capacity ? (const char *)view->base + offset : NULL;
+}// End of shm_view_string method
+
+// IMPLEMENTATION: See header for details
+const ShmArea * shm_view_areas(const ShmView *view, const ShmAlert *alert)
+{
+   uint32_t offset = alert->areas;
+
+   if (offset == 0 || offset % 8 || offset + (uint64_t)alert->area_count * sizeof(ShmArea) > view->capacity) return NULL;
+
+   return (const ShmArea *)(view->base + offset);
+}// End of shm_view_areas method
+
+// IMPLEMENTATION: See header for details
+const int32_t * shm_view_geocodes(const ShmView *view, const ShmArea *area)
+{
+   uint32_t offset = area->geocodes;
+
+   if (offset == 0 || offset % 8 || offset + (uint64_t)area->geocode_count * sizeof(int32_t) > view->capacity) return NULL;
+
+   return (const int32_t *)(view->base + offset);
+}// End of shm_view_geocodes method
+
+static uint64_t published_generation(const ShmHeader *segment)
+{
+   uint32_t index = __atomic_load_n(&segment->active, __ATOMIC_ACQUIRE) & 1;
+
+   return __atomic_load_n(&segment->buffers[index].generation, __ATOMIC_ACQUIRE);
+}// End of published_generation method
+
+// IMPLEMENTATION: See header for details
+bool wait_shm_publish(ShmReader *reader, uint64_t generation, long timeout)
+{
+   ShmHeader *segment = reader->segment;
+   uint32_t notify = __atomic_load_n(&segment->notify, __ATOMIC_ACQUIRE);
+
+   if (shm_reader_closed(reader)) return false;
+   if (published_generation(segment) != generation) return true;
+
+   // Sleeps until the publisher increments notify (or the timeout)
+   struct timespec wait = { timeout / 1000, (timeout % 1000) * 1000000 };
+   futex(&segment->notify, FUTEX_WAIT, notify, &wait);
+
+   return !shm_reader_closed(reader) && published_generation(segment) != generation;
+}// End of wait_shm_publish method
+
+// IMPLEMENTATION: See header for details
+bool shm_reader_closed(const ShmReader *reader)
+{
+   return __atomic_load_n(&reader->segment->closed, __ATOMIC_ACQUIRE) != 0;
+}// End of shm_reader_closed method
+
+static void get_time(struct tm *tm, const ShmTime *time)
+{
+   memset(tm, 0, sizeof(struct tm));
+
+   tm->tm_year = time->year;
+   tm->tm_mon = time->month;
+   tm->tm_mday = time->day;
+   tm->tm_hour = time->hour;
+   tm->tm_min = time->minute;
+   tm->tm_sec = time->second;
+   tm->tm_wday = time->weekday;
+   tm->tm_yday = time->yearday;
+   tm->tm_isdst = time->dst;
+}// End of get_time method
+
+static char * copy_string(const ShmView *view, uint32_t offset, bool *failed)
+{
+   const char *str = shm_view_string(view, offset);
+   if (!str) return NULL;
+
+   char *copy = account_strndup(MEMORY_STRINGS, str, strlen(str));
+   if (!copy) *failed = true;
+
+   return copy;
+}// End of copy_string method
+
+/*
+   copy_alert(view, record) Copies the alert out of the buffer.
+      POST: Returns the alert, or NULL if memory could not be allocated or the
+            record is torn.
+*/
+static Alert * copy_alert(const ShmView *view, const ShmAlert *record)
+{
+   Alert *alert = account_calloc(MEMORY_ALERTS, 1, sizeof(Alert));
+   if (!alert) return NULL;
+
+   bool failed = false;
+
+   alert->references = 1;
+   alert->identifier = copy_string(view, record->identifier, &failed);
+   alert->headline = copy_string(view, record->headline, &failed);
+   alert->description = copy_string(view, record->description, &failed);
+   alert->instruction = copy_string(view, record->instruction, &failed);
+   alert->issuer = copy_string(view, record->issuer, &failed);
+   alert->event = copy_string(view, record->event, &failed);
+   alert->severity = record->severity < ALERT_SEVERITIES ? (AlertSeverity)record->severity : ALERT_SEVERITY_UNKNOWN;
+
+   get_time(&alert->effective, &record->effective);
+   get_time(&alert->expires, &record->expires);
+
+   uint32_t area_count = record->area_count;
+   const ShmArea *areas = area_count > 0 ? shm_view_areas(view, record) : NULL;
+
+   if (area_count > 0 && areas) alert->areas = account_calloc(MEMORY_ALERTS, area_count, sizeof(AlertArea *));
+   if (area_count > 0 && !alert->areas) failed = true;
+
+   for (uint32_t x = 0; x < area_count && !failed; ++x)
+   {
+      AlertArea *area = account_calloc(MEMORY_ALERTS, 1, sizeof(AlertArea));
+
+      if (!area)
+      {
+         failed = true;
+         break;
+      }// End of if
+
+      alert->areas[alert->area_count++] = area;
+      area->name = copy_string(view, areas[x].name, &failed);
+
+      uint32_t geocode_count = areas[x].geocode_count;
+      const int32_t *geocodes = geocode_count > 0 ? shm_view_geocodes(view, &areas[x]) : NULL;
+
+      if (geocode_count > 0 && geocodes) area->geocodes = account_calloc(MEMORY_ALERTS, geocode_count, sizeof(int));
+      if (geocode_count > 0 && !area->geocodes) failed = true;
+
+      for (uint32_t y = 0; y < geocode_count && !failed; ++y) area->geocodes[y] = geocodes[y];
+      if (!failed) area->geocode_count = geocode_count;
+   }// End of for
+
+   if (failed)
+   {
+      free_alert(alert);
+      return NULL;
+   }// End of if
+
+   return alert;
+}// End of copy_alert method
+
+/*
+   find_last(reader, table, mask, record, view) Returns the alert of the last
+                                                 load equal to record, or NULL.
+*/
+static Alert * find_last(const ShmReader *reader, const int *table, unsigned long mask,
+                         const ShmAlert *record, const ShmView *view)
+{
+   const char *identifier = shm_view_string(view, record->identifier);
+
+   for (unsigned long slot = record->hash & mask; table[slot]; slot = (slot + 1) & mask)
+   {
+      Alert *alert = reader->last->alerts[table[slot] - 1];
+
+      if (reader->hashes[table[slot] - 1] != record->hash) continue;
+
+      if (alert->identifier == identifier
+            || (alert->identifier && identifier && strcmp(alert->identifier, identifier) == 0)) return alert;
+   }// End of for
+
+   return NULL;
+}// End of find_last method
+
+// IMPLEMENTATION: See header for details
+Alerts * load_alerts_from_shm(ShmReader *reader)
+{
+   zlog_debug(alog, "Entering");
+
+   // Hash table of the alerts of the last load (index + 1, 0 is free)
+   int *table = NULL;
+   unsigned long mask = 0;
+
+   if (reader->last && reader->last->count > 0)
+   {
+      mask = 1;
+      while (mask + 1 < (unsigned long)reader->last->count * 2) mask = (mask << 1) | 1;
+
+      table = calloc(mask + 1, sizeof(int));
+
+      for (int x = 0; table && x < reader->last->count; ++x)
+      {
+         unsigned long slot = reader->hashes[x] & mask;
+         while (table[slot]) slot = (slot + 1) & mask;
+
+         table[slot] = x + 1;
+      }// End of for
+   }// End of if
+
+   for (int attempt = 0; attempt < SHM_READ_ATTEMPTS; ++attempt)
+   {
+      ShmView view;
+
+      if (!begin_shm_read(reader, &view)) break;
+
+      Alerts *alerts = account_calloc(MEMORY_ALERTS, 1, sizeof(Alerts));
+      uint64_t *hashes = malloc((view.count > 0 ? view.count : 1) * sizeof(uint64_t));
+
+      if (alerts) alerts->alerts = account_calloc(MEMORY_ALERTS, view.count > 0 ? view.count : 1, sizeof(Alert *));
+
+      if (!alerts || !alerts->alerts || !hashes)
+      {
+         zlog_warn(alog, "Failed to allocate memory for the shared alerts");
+         free_alerts(alerts);
+         free(hashes);
+         break;
+      }// End of if
+
+      alerts->generation = view.generation;
+
+      for (uint32_t x = 0; x < view.count; ++x)
+      {
+         const ShmAlert *record = shm_view_alert(&view, x);
+         if (!record) break;
+
+         Alert *alert = table ? find_last(reader, table, mask, record, &view) : NULL;
+         alert = alert ? retain_alert(alert) : copy_alert(&view, record);
+         if (!alert) break;
+
+         hashes[alerts->count] = record->hash;
+         alerts->alerts[alerts->count++] = alert;
+      }// End of for
+
+      // Everything read has to be from the same generation
+      if (end_shm_read(reader, &view) && (uint32_t)alerts->count == view.count)
+      {
+         Alerts *last = merge_alerts(&alerts, 1);
+
+         if (last)
+         {
+            free_alerts(reader->last);
+            free(reader->hashes);
+            reader->last = last;
+            reader->hashes = hashes;
+         }// End of if
+         else
+         {
+            free(hashes);
+         }// End of else
+
+         free(table);
+
+         zlog_debug(alog, "Exiting");
+         return alerts;
+      }// End of if
+
+      free_alerts(alerts);
+      free(hashes);
+   }// End of for
+
+   free(table);
+
+   zlog_debug(alog, "Exiting");
+   return NULL;
+}// End of load_alerts_from_shm method
+
+// IMPLEMENTATION: See header for details
+void close_shm_reader(ShmReader *reader)
+{
+   if (!reader) return;
+
+   if (reader->segment) munmap(reader->segment, reader->mapped);
+   if (reader->fd >= 0) close(reader->fd);
+
+   free_alerts(reader->last);
+   free(reader->hashes);
+   free(reader);
+}// End of close_shm_reader method
+
+/*
+   segment_unlinked(reader) Returns true if the segment of reader was removed,
+                            by a publisher that went away without closing it
+                            or one that replaced it with a new segment.
+*/
+static bool segment_unlinked(const ShmReader *reader)
+{
+   struct stat status;
+
+   return fstat(reader->fd, &status) != 0 || status.st_nlink == 0;
+}// End of segment_unlinked method
+
+/*
+   follower_main(arg) Body of the follower thread.
+      POST: Every generation of the segment is published until
+            stop_following_shm is called.
+*/
+static void * follower_main(void *arg)
+{
+   zlog_debug(alog, "Entering");
+
+   (void)arg;
+
+   uint64_t generation = 0;
+   bool unlinked = false;
+
+   pthread_mutex_lock(&follower_lock);
+
+   while (!follower_stopping)
+   {
+      // (Re)open the segment, until a publisher created it
+      if (!follower_reader || unlinked || shm_reader_closed(follower_reader))
+      {
+         close_shm_reader(follower_reader);
+         follower_reader = open_shm_reader(follower_name);
+         generation = 0;
+         unlinked = false;
+
+         if (!follower_reader)
+         {
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += SHM_FOLLOW_RETRY;
+
+            pthread_cond_timedwait(&follower_wakeup, &follower_lock, &deadline);
+            continue;
+         }// End of if
+
+         zlog_info(alog, "Following the shared memory segment %s", follower_name);
+      }// End of if
+
+      ShmReader *reader = follower_reader;
+      pthread_mutex_unlock(&follower_lock);
+
+      if (wait_shm_publish(reader, generation, SHM_FOLLOW_RETRY * 1000))
+      {
+         Alerts *alerts = load_alerts_from_shm(reader);
+
+         if (alerts)
+         {
+            generation = alerts->generation;
+            publish_snapshot(alerts);
+         }// End of if
+      }// End of if
+      else
+      {
+         // A publisher that crashed never marks its segment closed
+         unlinked = segment_unlinked(reader);
+      }// End of else
+
+      pthread_mutex_lock(&follower_lock);
+   }// End of while
+
+   close_shm_reader(follower_reader);
+   follower_reader = NULL;
+
+   pthread_mutex_unlock(&follower_lock);
+
+   zlog_debug(alog, "Exiting");
+   return NULL;
+}// End of follower_main method
+
+// IMPLEMENTATION: See header for details
+bool follow_shm(const char *name)
+{
+   if (following || strlen(name) >= NAME_MAX) return false;
+
+   pthread_condattr_t attributes;
+   pthread_condattr_init(&attributes);
+   pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+   pthread_cond_init(&follower_wakeup, &attributes);
+   pthread_condattr_destroy(&attributes);
+
+   strcpy(follower_name, name);
+   follower_stopping = false;
+
+   if (pthread_create(&follower, NULL, follower_main, NULL) != 0)
+   {
+      zlog_warn(alog, "Failed to start the shared memory follower");
+      return false;
+   }// End of if
+
+   following = true;
+   return true;
+}// End of follow_shm method
+
+// IMPLEMENTATION: See header for details
+void stop_following_shm(void)
+{
+   if (!following) return;
+
+   pthread_mutex_lock(&follower_lock);
+
+   follower_stopping = true;
+   pthread_cond_signal(&follower_wakeup);
+
+   // Wake the follower if it waits for the next generation
+   if (follower_reader) futex(&follower_reader->segment->notify, FUTEX_WAKE, INT_MAX, NULL);
+
+   pthread_mutex_unlock(&follower_lock);
+
+   pthread_join(follower, NULL);
+   following = false;
+}// End of stop_following_shm method
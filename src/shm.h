@@ -0,0 +1,230 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef _SHM
+#define _SHM
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "alerts.h"
+
+/*
+   Every published snapshot can also be written into a POSIX shared memory
+   segment, so that local programs read the alerts in place instead of
+   fetching, parsing or decoding them. The segment starts with a ShmHeader
+   followed by two buffers: the publisher writes the next generation into
+   the buffer readers are not directed to, then makes it the active one.
+
+   Each buffer is guarded by a sequence number (odd while it is written), so
+   readers never lock: they read the active buffer and then check that its
+   sequence did not change, which only happens if two generations were
+   published meanwhile. Everything in a buffer is addressed by offsets from
+   the start of the buffer (0 for NULL), so the segment may be mapped at any
+   address. Readers may sleep on the notify word (a futex) until the next
+   generation is published.
+*/
+
+#define SHM_MAGIC 0x54524c41         // "ALRT"
+#define SHM_VERSION 3
+#define SHM_FOLLOW_RETRY 1           // Seconds between attempts to open the segment
+
+// Fields of a struct tm
+struct ShmTime {
+   int32_t year, month, day, hour, minute, second, weekday, yearday, dst;
+};
+typedef struct ShmTime ShmTime;
+
+struct ShmArea {
+   uint32_t name;                    // Offset of the string
+   uint32_t geocode_count;
+   uint32_t geocodes;                // Offset of geocode_count int32_t
+   uint32_t padding;
+};
+typedef struct ShmArea ShmArea;
+
+struct ShmAlert {
+   uint64_t hash;                    // Hash of the contents, equal for equal alerts
+   uint32_t identifier;              // Offsets of the strings
+   uint32_t headline;
+   uint32_t description;
+   uint32_t instruction;
+   uint32_t issuer;
+   uint32_t area_count;
+   uint32_t areas;                   // Offset of area_count ShmArea
+   uint32_t event;
+   uint32_t severity;
+   uint32_t padding;
+   ShmTime effective;
+   ShmTime expires;
+};
+typedef struct ShmAlert ShmAlert;
+
+struct ShmBuffer {
+   uint64_t sequence;                // Odd while the buffer is written
+   uint64_t generation;
+   uint64_t offset;                  // Of the buffer from the start of the segment
+   uint64_t capacity;                // The last byte is always 0
+   uint32_t count;
+   uint32_t alerts;                  // Offset of count uint32_t ShmAlert offsets
+};
+typedef struct ShmBuffer ShmBuffer;
+
+struct ShmHeader {
+   uint32_t magic;                   // Written last when the segment is created
+   uint32_t version;
+   uint64_t size;                    // Of the segment, grows with the alerts
+   uint32_t notify;                  // Incremented (and woken) on every publish
+   uint32_t active;                  // Buffer holding the latest generation
+   uint32_t closed;                  // The publisher stopped
+   uint32_t padding;
+   ShmBuffer buffers[2];
+};
+typedef struct ShmHeader ShmHeader;
+
+/*
+   ShmView is one reader's view of a buffer between begin_shm_read and
+   end_shm_read.
+*/
+struct ShmView {
+   const unsigned char *base;
+   uint64_t capacity;
+   uint64_t generation;
+   uint64_t sequence;
+   uint32_t buffer;
+   uint32_t count;
+   uint32_t table;                   // Offset of the ShmAlert offsets
+};
+typedef struct ShmView ShmView;
+
+struct ShmReader;
+typedef struct ShmReader ShmReader;
+
+/*
+   open_shm_publisher(name) Creates the shared memory segment name (as for
+                              shm_open) and writes every snapshot published
+                              from now on to it.
+      PRE:  Valid name ("/alerts")
+      POST: Returns false if the segment could not be created.
+*/
+bool open_shm_publisher(const char *name);
+
+/*
+   close_shm_publisher() Stops writing to the segment and removes it.
+      POST: Readers that still map it see it as closed.
+*/
+void close_shm_publisher(void);
+
+/*
+   open_shm_reader(name) Maps the segment name for reading.
+      PRE:  Valid name
+      POST: Returns the reader, or NULL if no publisher created the segment.
+*/
+ShmReader * open_shm_reader(const char *name);
+
+/*
+   begin_shm_read(reader, view) Starts reading the latest generation in place.
+      PRE:  Valid pointers
+      POST: Returns false if nothing was published yet. Otherwise view gives
+            access to the alerts until end_shm_read (see shm_view_alert).
+*/
+bool begin_shm_read(ShmReader *reader, ShmView *view);
+
+/*
+   end_shm_read(reader, view) Ends reading view.
+      PRE:  view was filled by begin_shm_read(reader, view)
+      POST: Returns true if everything read through view was consistent, false
+            if it has to be read again (the buffer was reused meanwhile).
+*/
+bool end_shm_read(ShmReader *reader, const ShmView *view);
+
+/*
+   shm_view_alert(view, index) Returns the index-th alert of view.
+      POST: NULL if index or the alert is out of the buffer (a torn read).
+*/
+const ShmAlert * shm_view_alert(const ShmView *view, uint32_t index);
+
+/*
+   shm_view_string(view, offset) Returns the string at offset in view.
+      POST: NULL for offset 0 or out of the buffer.
+*/
+const char * shm_view_string(const ShmView *view, uint32_t offset);
+
+/*
+   shm_view_areas(view, alert) Returns the areas of alert.
+      POST: NULL if the alert has none or they are out of the buffer.
+*/
+const ShmArea * shm_view_areas(const ShmView *view, const ShmAlert *alert);
+
+/*
+   shm_view_geocodes(view, area) Returns the geocodes of area.
+      POST: NULL if the area has none or they are out of the buffer.
+*/
+const int32_t * shm_view_geocodes(const ShmView *view, const ShmArea *area);
+
+/*
+   wait_shm_publish(reader, generation, timeout) Waits until a generation
+                                                  other than generation is
+                                                  published.
+      PRE:  Valid reader, timeout in milliseconds
+      POST: Returns false on timeout or if the publisher closed the segment.
+*/
+bool wait_shm_publish(ShmReader *reader, uint64_t generation, long timeout);
+
+/*
+   shm_reader_closed(reader) Returns true if the publisher closed the segment.
+*/
+bool shm_reader_closed(const ShmReader *reader);
+
+/*
+   load_alerts_from_shm(reader) Copies the latest generation into an Alerts
+                                  object.
+      PRE:  Valid reader
+      POST: Returns the alerts (their generation is the publisher's), sharing
+            the alerts that are unchanged since the last call with the same
+            reader. NULL is returned if nothing was published yet or memory
+            could not be allocated.
+*/
+Alerts * load_alerts_from_shm(ShmReader *reader);
+
+/*
+   close_shm_reader(reader) Unmaps the segment.
+*/
+void close_shm_reader(ShmReader *reader);
+
+/*
+   follow_shm(name) Starts a thread that publishes (with publish_snapshot)
+                    every generation written to the segment name.
+      PRE:  Valid name
+      POST: Returns true if the thread was started. The segment is opened
+            again if it does not exist yet or its publisher restarts.
+*/
+bool follow_shm(const char *name);
+
+/*
+   stop_following_shm() Stops the thread started by follow_shm.
+*/
+void stop_following_shm(void);
+
+#endif
@@ -0,0 +1,319 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "snapshot.h"
+
+#include "log.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+/*
+   RetiredSnapshot is a snapshot that was replaced while epoch was the
+   current epoch. Readers that entered at or before that epoch may still use it.
+*/
+struct RetiredSnapshot {
+   Alerts *alerts;
+   unsigned long epoch;
+};
+typedef struct RetiredSnapshot RetiredSnapshot;
+
+/*
+   ReaderSlot records the epoch a reader entered (0 while it holds nothing).
+   Each slot lives on its own cache line so readers never contend.
+*/
+struct ReaderSlot {
+   unsigned long epoch;
+   int in_use;
+   char padding[64 - sizeof(unsigned long) - sizeof(int)];
+};
+typedef struct ReaderSlot ReaderSlot;
+
+static Alerts *current = NULL;
+static unsigned long epoch = 1;
+static unsigned long generation = 0;
+static ReaderSlot readers[SNAPSHOT_MAX_READERS];
+static int notifier = -1;
+
+struct Listener {
+   SnapshotListener listener;
+   void *data;
+};
+typedef struct Listener Listener;
+
+// Writer side state
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static RetiredSnapshot *retired = NULL;
+static int retired_count = 0;
+static int retired_capacity = 0;
+static Listener listeners[SNAPSHOT_MAX_LISTENERS];
+static int listener_count = 0;
+
+/*
+   snapshot_visible(retired_epoch) Returns true if a reader may still see a
+                                     snapshot retired at retired_epoch.
+      PRE:  true
+      POST: true if some reader entered at or before retired_epoch.
+*/
+static bool snapshot_visible(unsigned long retired_epoch)
+{
+   for (int x = 0; x < SNAPSHOT_MAX_READERS; ++x)
+   {
+      unsigned long reader_epoch = __atomic_load_n(&readers[x].epoch, __ATOMIC_SEQ_CST);
+      if (reader_epoch != 0 && reader_epoch <= retired_epoch) return true;
+   }// End of for
+
+   return false;
+}// End of snapshot_visible method
+
+/*
+   reclaim_retired() Frees the retired snapshots no reader can see.
+      PRE:  writer_lock is held
+      POST: Unreachable retired snapshots are freed and removed from the list.
+*/
+static void reclaim_retired(void)
+{
+   int kept = 0;
+
+   for (int x = 0; x < retired_count; ++x)
+   {
+      if (snapshot_visible(retired[x].epoch))
+      {
+         retired[kept++] = retired[x];
+      }// End of if
+      else
+      {
+         zlog_debug(alog, "Freeing snapshot generation %lu", retired[x].alerts->generation);
+         free_alerts(retired[x].alerts);
+      }// End of else
+   }// End of for
+
+   retired_count = kept;
+}// End of reclaim_retired method
+
+// IMPLEMENTATION: See header for details
+int register_snapshot_reader(void)
+{
+   for (int x = 0; x < SNAPSHOT_MAX_READERS; ++x)
+   {
+      int expected = 0;
+
+      if (__atomic_compare_exchange_n(&readers[x].in_use, &expected, 1, false,
+                                      __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+      {
+         return x;
+      }// End of if
+   }// End of for
+
+   zlog_warn(alog, "No free snapshot reader slots");
+   return -1;
+}// End of register_snapshot_reader method
+
+// IMPLEMENTATION: See header for details
+void unregister_snapshot_reader(int reader)
+{
+   if (reader < 0 || reader >= SNAPSHOT_MAX_READERS) return;
+
+   __atomic_store_n(&readers[reader].epoch, 0, __ATOMIC_SEQ_CST);
+   __atomic_store_n(&readers[reader].in_use, 0, __ATOMIC_SEQ_CST);
+}// End of unregister_snapshot_reader method
+
+// IMPLEMENTATION: See header for details
+Alerts * acquire_snapshot(int reader)
+{
+   // Announce the epoch before loading the pointer: a writer that swaps the
+   // pointer afterwards is guaranteed to see this slot when it reclaims.
+   unsigned long entered = __atomic_load_n(&epoch, __ATOMIC_SEQ_CST);
+   __atomic_store_n(&readers[reader].epoch, entered, __ATOMIC_SEQ_CST);
+
+   return __atomic_load_n(&current, __ATOMIC_SEQ_CST);
+}// End of acquire_snapshot method
+
+// IMPLEMENTATION: See header for details
+void release_snapshot(int reader)
+{
+   __atomic_store_n(&readers[reader].epoch, 0, __ATOMIC_RELEASE);
+}// End of release_snapshot method
+
+// IMPLEMENTATION: See header for details
+void publish_snapshot(Alerts *alerts)
+{
+   zlog_debug(alog, "Entering");
+
+   if (!alerts) return;
+
+   pthread_mutex_lock(&writer_lock);
+
+   alerts->generation = __atomic_load_n(&generation, __ATOMIC_RELAXED) + 1;
+
+   Alerts *previous = __atomic_exchange_n(&current, alerts, __ATOMIC_SEQ_CST);
+   unsigned long retired_epoch = __atomic_fetch_add(&epoch, 1, __ATOMIC_SEQ_CST);
+   __atomic_store_n(&generation, alerts->generation, __ATOMIC_RELEASE);
+
+   for (int x = 0; x < listener_count; ++x)
+   {
+      listeners[x].listener(alerts, listeners[x].data);
+   }// End of for
+
+   if (notifier >= 0)
+   {
+      uint64_t one = 1;
+      if (write(notifier, &one, sizeof(one)) < 0) zlog_warn(alog, "Failed to notify the snapshot readers");
+   }// End of if
+
+   if (previous)
+   {
+      if (retired_count == retired_capacity)
+      {
+         int capacity = retired_capacity ? retired_capacity * 2 : 8;
+         RetiredSnapshot *list = realloc(retired, capacity * sizeof(RetiredSnapshot));
+
+         if (list)
+         {
+            retired = list;
+            retired_capacity = capacity;
+         }// End of if
+      }// End of if
+
+      if (retired_count < retired_capacity)
+      {
+         retired[retired_count].alerts = previous;
+         retired[retired_count].epoch = retired_epoch;
+         ++retired_count;
+      }// End of if
+      else
+      {
+         // Leaking is the only safe option if the list cannot grow
+         zlog_warn(alog, "Failed to retire snapshot generation %lu", previous->generation);
+      }// End of else
+   }// End of if
+
+   reclaim_retired();
+
+   pthread_mutex_unlock(&writer_lock);
+
+   zlog_info(alog, "Published generation %lu (%d alerts)", alerts->generation, alerts->count);
+   zlog_debug(alog, "Exiting");
+}// End of publish_snapshot method
+
+// IMPLEMENTATION: See header for details
+bool add_snapshot_listener(SnapshotListener listener, void *data)
+{
+   pthread_mutex_lock(&writer_lock);
+
+   bool added = listener_count < SNAPSHOT_MAX_LISTENERS;
+
+   if (added)
+   {
+      listeners[listener_count].listener = listener;
+      listeners[listener_count].data = data;
+      ++listener_count;
+   }// End of if
+
+   pthread_mutex_unlock(&writer_lock);
+
+   return added;
+}// End of add_snapshot_listener method
+
+// IMPLEMENTATION: See header for details
+void remove_snapshot_listener(SnapshotListener listener, void *data)
+{
+   pthread_mutex_lock(&writer_lock);
+
+   int kept = 0;
+
+   for (int x = 0; x < listener_count; ++x)
+   {
+      if (listeners[x].listener != listener || listeners[x].data != data) listeners[kept++] = listeners[x];
+   }// End of for
+
+   listener_count = kept;
+
+   pthread_mutex_unlock(&writer_lock);
+}// End of remove_snapshot_listener method
+
+// IMPLEMENTATION: See header for details
+int open_snapshot_notifier(void)
+{
+   pthread_mutex_lock(&writer_lock);
+
+   if (notifier < 0) notifier = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+   pthread_mutex_unlock(&writer_lock);
+
+   return notifier;
+}// End of open_snapshot_notifier method
+
+// IMPLEMENTATION: See header for details
+void close_snapshot_notifier(void)
+{
+   pthread_mutex_lock(&writer_lock);
+
+   if (notifier >= 0) close(notifier);
+   notifier = -1;
+
+   pthread_mutex_unlock(&writer_lock);
+}// End of close_snapshot_notifier method
+
+// IMPLEMENTATION: See header for details
+unsigned long snapshot_generation(void)
+{
+   return __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+}// End of snapshot_generation method
+
+// IMPLEMENTATION: See header for details
+void reclaim_snapshots(void)
+{
+   pthread_mutex_lock(&writer_lock);
+   reclaim_retired();
+   pthread_mutex_unlock(&writer_lock);
+}// End of reclaim_snapshots method
+
+// IMPLEMENTATION: See header for details
+void free_snapshots(void)
+{
+   zlog_debug(alog, "Entering");
+
+   pthread_mutex_lock(&writer_lock);
+
+   for (int x = 0; x < retired_count; ++x)
+   {
+      free_alerts(retired[x].alerts);
+   }// End of for
+
+   free(retired);
+   retired = NULL;
+   retired_count = 0;
+   retired_capacity = 0;
+
+   free_alerts(__atomic_exchange_n(&current, NULL, __ATOMIC_SEQ_CST));
+
+   pthread_mutex_unlock(&writer_lock);
+
+   zlog_debug(alog, "Exiting");
+}// End of free_snapshots method
@@ -0,0 +1,141 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef _SNAPSHOT
+#define _SNAPSHOT
+
+#include <stdbool.h>
+
+#include "alerts.h"
+
+#define SNAPSHOT_MAX_READERS 32
+#define SNAPSHOT_MAX_LISTENERS 8
+
+/*
+   The current Alerts object is published as an immutable snapshot. Readers
+   pin it with acquire_snapshot/release_snapshot, which never block: they only
+   record the epoch they entered in their own slot. Publishing swaps the
+   pointer atomically and retires the previous snapshot, which is freed once
+   every reader that could still see it has released it.
+*/
+
+/*
+   SnapshotListener is called by publish_snapshot with the snapshot just
+   published and the data given to add_snapshot_listener.
+*/
+typedef void (*SnapshotListener)(const Alerts *alerts, void *data);
+
+/*
+   register_snapshot_reader() Reserves a reader slot for the calling thread.
+      PRE:  true
+      POST: Returns the slot to pass to acquire_snapshot, or -1 if all
+            SNAPSHOT_MAX_READERS slots are taken.
+*/
+int register_snapshot_reader(void);
+
+/*
+   unregister_snapshot_reader(reader) Releases the reader slot.
+      PRE:  reader was returned by register_snapshot_reader and is not
+            holding a snapshot.
+      POST: The slot may be reused.
+*/
+void unregister_snapshot_reader(int reader);
+
+/*
+   acquire_snapshot(reader) Returns the current snapshot and pins it.
+      PRE:  Valid reader slot that is not already holding a snapshot.
+      POST: The returned Alerts object (NULL if nothing was published yet)
+            stays valid and unchanged until release_snapshot(reader).
+*/
+Alerts * acquire_snapshot(int reader);
+
+/*
+   release_snapshot(reader) Unpins the snapshot held by reader.
+      PRE:  Valid reader slot
+      POST: The snapshot returned by the last acquire_snapshot(reader) must no
+            longer be used by the caller.
+*/
+void release_snapshot(int reader);
+
+/*
+   publish_snapshot(alerts) Makes alerts the current snapshot.
+      PRE:  Valid alerts pointer that is not shared with anyone else.
+      POST: alerts is owned by the snapshot store, its generation is set, and
+            the previous snapshot is retired.
+*/
+void publish_snapshot(Alerts *alerts);
+
+/*
+   add_snapshot_listener(listener, data) Calls listener on every publish.
+      PRE:  Valid listener
+      POST: listener is called on the publishing thread, before publish_snapshot
+            returns and while no other snapshot can be published, so it should
+            be quick. Returns false if SNAPSHOT_MAX_LISTENERS are registered.
+*/
+bool add_snapshot_listener(SnapshotListener listener, void *data);
+
+/*
+   remove_snapshot_listener(listener, data) Stops calling listener.
+      PRE:  true
+      POST: listener is no longer called (once publish_snapshot returns).
+*/
+void remove_snapshot_listener(SnapshotListener listener, void *data);
+
+/*
+   open_snapshot_notifier() Returns a descriptor that becomes readable
+                             whenever a snapshot is published.
+      PRE:  true
+      POST: Returns a non-blocking eventfd (the same one on every call), or -1
+            on failure. Reading it clears the notification.
+*/
+int open_snapshot_notifier(void);
+
+/*
+   close_snapshot_notifier() Closes the descriptor of open_snapshot_notifier.
+      PRE:  Nothing publishes concurrently.
+*/
+void close_snapshot_notifier(void);
+
+/*
+   snapshot_generation() Returns the generation of the current snapshot.
+      PRE:  true
+      POST: Returns 0 if nothing was published yet.
+*/
+unsigned long snapshot_generation(void);
+
+/*
+   reclaim_snapshots() Frees the retired snapshots that no reader can see.
+      PRE:  true
+      POST: Retired snapshots that are no longer pinned are freed.
+*/
+void reclaim_snapshots(void);
+
+/*
+   free_snapshots() Frees the current and all retired snapshots.
+      PRE:  No reader is holding a snapshot and nothing publishes concurrently.
+      POST: All memory held by the snapshot store is freed.
+*/
+void free_snapshots(void);
+
+#endif
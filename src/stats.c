@@ -0,0 +1,209 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "stats.h"
+
+#include "trace.h"
+
+#include <time.h>
+#include <stdbool.h>
+
+#define SUB_BUCKETS (1 << STATS_SUB_BITS)
+#define BUCKETS ((STATS_MAX_EXPONENT - STATS_SUB_BITS + 1) * SUB_BUCKETS)
+#define LONGEST ((1ULL << STATS_MAX_EXPONENT) - 1)
+
+struct Histogram {
+   uint64_t counts[BUCKETS];
+   uint64_t count;
+   uint64_t total;                   // Nanoseconds, for the mean
+   uint64_t min;                     // Nanoseconds plus one, 0 before the first
+   uint64_t max;
+};
+typedef struct Histogram Histogram;
+
+static Histogram histograms[STATS_PHASES];
+
+static const char *phase_names[STATS_PHASES] = {
+   "dns", "connect", "tls", "first-byte", "transfer", "parse", "convert", "index", "render"
+};
+
+/*
+   bucket_of(value) Returns the bucket of a duration.
+*/
+static int bucket_of(uint64_t value)
+{
+   if (value < SUB_BUCKETS) return (int)value;
+
+   int exponent = 63 - __builtin_clzll(value);
+   int sub = (int)(value >> (exponent - STATS_SUB_BITS)) & (SUB_BUCKETS - 1);
+
+   return (exponent - STATS_SUB_BITS + 1) * SUB_BUCKETS + sub;
+}// End of bucket_of method
+
+/*
+   bucket_middle(bucket) Returns the duration in the middle of a bucket.
+*/
+static double bucket_middle(int bucket)
+{
+   if (bucket < SUB_BUCKETS) return bucket;
+
+   int magnitude = bucket / SUB_BUCKETS - 1;
+   uint64_t low = (uint64_t)(SUB_BUCKETS + bucket % SUB_BUCKETS) << magnitude;
+
+   return low + ((1ULL << magnitude) - 1) / 2.0;
+}// End of bucket_middle method
+
+// IMPLEMENTATION: See header for details
+uint64_t stats_clock(void)
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+
+   return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}// End of stats_clock method
+
+// IMPLEMENTATION: See header for details
+void record_stat(StatsPhase phase, uint64_t nanoseconds)
+{
+   Histogram *histogram = &histograms[phase];
+
+   if (nanoseconds > LONGEST) nanoseconds = LONGEST;
+
+   __atomic_add_fetch(&histogram->counts[bucket_of(nanoseconds)], 1, __ATOMIC_RELAXED);
+   __atomic_add_fetch(&histogram->count, 1, __ATOMIC_RELAXED);
+   __atomic_add_fetch(&histogram->total, nanoseconds, __ATOMIC_RELAXED);
+
+   uint64_t min = __atomic_load_n(&histogram->min, __ATOMIC_RELAXED);
+   while ((min == 0 || nanoseconds + 1 < min)
+          && !__atomic_compare_exchange_n(&histogram->min, &min, nanoseconds + 1, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+   uint64_t max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+   while (nanoseconds > max
+          && !__atomic_compare_exchange_n(&histogram->max, &max, nanoseconds, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}// End of record_stat method
+
+// IMPLEMENTATION: See header for details
+void record_stat_since(StatsPhase phase, uint64_t start)
+{
+   uint64_t now = stats_clock();
+
+   record_stat(phase, now > start ? now - start : 0);
+   if (trace_active()) record_span(phase_names[phase], start, now);
+}// End of record_stat_since method
+
+// IMPLEMENTATION: See header for details
+const char * stats_phase_name(StatsPhase phase)
+{
+   return phase_names[phase];
+}// End of stats_phase_name method
+
+// IMPLEMENTATION: See header for details
+uint64_t read_stats(StatsPhase phase, const uint64_t *bounds, uint64_t *below, int count, uint64_t *total)
+{
+   Histogram *histogram = &histograms[phase];
+   uint64_t seen = 0;
+   int bound = 0;
+
+   // A bucket counts below a bound if the bound falls in it or after it
+   for (int x = 0; x < BUCKETS; ++x)
+   {
+      while (bound < count && bucket_of(bounds[bound] > LONGEST ? LONGEST : bounds[bound]) < x)
+      {
+         below[bound++] = seen;
+      }// End of while
+
+      seen += __atomic_load_n(&histogram->counts[x], __ATOMIC_RELAXED);
+   }// End of for
+
+   while (bound < count) below[bound++] = seen;
+
+   *total = __atomic_load_n(&histogram->total, __ATOMIC_RELAXED);
+   return seen;
+}// End of read_stats method
+
+/*
+   percentile(counts, count, fraction, min, max) Returns the duration below
+                                                 which fraction of count
+                                                 durations fall.
+*/
+static double percentile(const uint64_t *counts, uint64_t count, double fraction, double min, double max)
+{
+   uint64_t rank = (uint64_t)(fraction * count + 0.5);
+   uint64_t seen = 0;
+
+   if (rank < 1) rank = 1;
+
+   for (int x = 0; x < BUCKETS; ++x)
+   {
+      seen += counts[x];
+      if (seen < rank) continue;
+
+      // The middle of the bucket, but never outside what was recorded
+      double value = bucket_middle(x);
+      return value < min ? min : value > max ? max : value;
+   }// End of for
+
+   return max;
+}// End of percentile method
+
+// IMPLEMENTATION: See header for details
+void write_stats(FILE *file)
+{
+   uint64_t counts[BUCKETS];
+
+   fprintf(file, "%-10s %8s %10s %10s %10s %10s %10s %10s %10s\n",
+           "phase", "count", "min", "p50", "p90", "p99", "p99.9", "max", "mean");
+
+   for (int x = 0; x < STATS_PHASES; ++x)
+   {
+      Histogram *histogram = &histograms[x];
+      uint64_t count = 0;
+
+      // Take the buckets once, others may be recording into them
+      for (int y = 0; y < BUCKETS; ++y)
+      {
+         counts[y] = __atomic_load_n(&histogram->counts[y], __ATOMIC_RELAXED);
+         count += counts[y];
+      }// End of for (y)
+
+      if (count == 0) continue;
+
+      double min = __atomic_load_n(&histogram->min, __ATOMIC_RELAXED) - 1;
+      double max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+      double mean = (double)__atomic_load_n(&histogram->total, __ATOMIC_RELAXED)
+                    / __atomic_load_n(&histogram->count, __ATOMIC_RELAXED);
+
+      fprintf(file, "%-10s %8llu %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+              phase_names[x], (unsigned long long)count, min / 1e6,
+              percentile(counts, count, 0.5, min, max) / 1e6,
+              percentile(counts, count, 0.9, min, max) / 1e6,
+              percentile(counts, count, 0.99, min, max) / 1e6,
+              percentile(counts, count, 0.999, min, max) / 1e6,
+              max / 1e6, mean / 1e6);
+   }// End of for (x)
+
+   fflush(file);
+}// End of write_stats method
@@ -0,0 +1,109 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef _STATS
+#define _STATS
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define STATS_SUB_BITS 5             // 2^5 buckets per power of two
+#define STATS_MAX_EXPONENT 40        // Longest duration recorded, 2^40ns (about 18 minutes)
+
+/*
+   The time spent in each phase of a refresh is recorded in a histogram of
+   the same layout as an HDR histogram: durations (in nanoseconds) below
+   2^STATS_SUB_BITS have a bucket each, and every power of two above is
+   split into 2^STATS_SUB_BITS buckets, so a bucket is never wider than
+   about 3% of the durations it holds whatever their magnitude. Recording
+   a duration is a few relaxed atomic additions, any thread can record
+   without a lock and the histograms are never reset.
+
+   Network phases come from the timings curl keeps for a transfer, a phase
+   that did not happen (the name was cached, the connection reused) is not
+   recorded.
+*/
+enum StatsPhase {
+   STATS_DNS,                        // Name lookup
+   STATS_CONNECT,                    // TCP connect
+   STATS_TLS,                        // TLS handshake
+   STATS_FIRST_BYTE,                 // Request sent to first byte of the response
+   STATS_TRANSFER,                   // First to last byte of the response
+   STATS_PARSE,                      // json_parse_ex of a document or event
+   STATS_CONVERT,                    // JSON to alerts (whole document or delta)
+   STATS_INDEX,                      // Search index of a snapshot
+   STATS_RENDER,                     // configure_windows
+   STATS_PHASES
+};
+typedef enum StatsPhase StatsPhase;
+
+/*
+   stats_clock() Returns the current monotonic time in nanoseconds.
+      PRE:  true
+      POST: Monotonic time is returned.
+*/
+uint64_t stats_clock(void);
+
+/*
+   record_stat(phase, nanoseconds) Adds a duration to the histogram of phase.
+      PRE:  phase < STATS_PHASES
+      POST: The duration is recorded (longer ones as the longest recordable).
+*/
+void record_stat(StatsPhase phase, uint64_t nanoseconds);
+
+/*
+   record_stat_since(phase, start) Adds the time since start (a stats_clock
+                                   value) to the histogram of phase.
+      PRE:  phase < STATS_PHASES
+      POST: The duration is recorded.
+*/
+void record_stat_since(StatsPhase phase, uint64_t start);
+
+/*
+   stats_phase_name(phase) Returns the name of phase ("dns", "parse", ...).
+      PRE:  phase < STATS_PHASES
+      POST: The name is returned.
+*/
+const char * stats_phase_name(StatsPhase phase);
+
+/*
+   read_stats(phase, bounds, below, count, total) Counts the durations of
+                                                  phase up to each bound.
+      PRE:  count bounds (nanoseconds, ascending) and below pointers
+      POST: below[x] is the number of durations up to bounds[x], to the
+            precision of a bucket. Returns the number of durations and sets
+            *total to their sum in nanoseconds.
+*/
+uint64_t read_stats(StatsPhase phase, const uint64_t *bounds, uint64_t *below, int count, uint64_t *total);
+
+/*
+   write_stats(file) Writes the count, minimum, percentiles (50, 90, 99 and
+                     99.9), maximum and mean of each phase recorded to file.
+      PRE:  Valid file pointer
+      POST: The report is written to file, one line per phase with durations
+            in milliseconds. Recording may go on while it is written.
+*/
+void write_stats(FILE *file);
+
+#endif
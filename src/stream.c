@@ -0,0 +1,475 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "stream.h"
+
+#include "log.h"
+#include "stats.h"
+#include "metrics.h"
+#include "memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <curl/curl.h>
+
+#define STREAM_IDLE_TIMEOUT 45.0     // Seconds without data (servers send keep alives)
+#define STREAM_MIN_BACKOFF 1
+#define STREAM_MAX_BACKOFF 30
+
+struct AlertStream {
+   char *url;
+   Feed *feed;
+   const FetchPolicy *policy;
+
+   CURLM *multi;
+   CURL *curl;
+   struct curl_slist *headers;
+
+   // Event parser
+   char *line;
+   size_t line_length;
+   size_t line_capacity;
+   char *data;
+   size_t data_length;
+   size_t data_capacity;
+   char event[32];
+   bool checked;              // Response status and type were checked
+   bool ndjson;               // One JSON event per line instead of SSE
+
+   int changes;               // Events applied during the current wait
+   bool resync;               // The feed has to be fetched in full
+   int woken;
+   double last_data;
+   double retry_at;
+   int backoff;
+};
+
+/*
+   append_bytes(buffer, length, capacity, bytes, count) Appends count bytes to
+                                                          the NULL terminated
+                                                          growable buffer.
+      PRE:  Valid pointers
+      POST: Returns false if memory could not be allocated.
+*/
+static bool append_bytes(char **buffer, size_t *length, size_t *capacity, const char *bytes, size_t count)
+{
+   if (*length + count + 1 > *capacity)
+   {
+      size_t grown = *capacity ? *capacity : 256;
+      while (*length + count + 1 > grown) grown *= 2;
+
+      char *data = realloc(*buffer, grown);
+      if (!data) return false;
+
+      *buffer = data;
+      *capacity = grown;
+   }// End of if
+
+   memcpy(*buffer + *length, bytes, count);
+   *length += count;
+   (*buffer)[*length] = '\0';
+
+   return true;
+}// End of append_bytes method
+
+/*
+   dispatch_event(stream, event, data) Applies one event to the feed.
+      PRE:  Valid pointers
+      POST: The feed's alerts are replaced by the result of the delta, or
+            stream->resync is set if it cannot be applied.
+*/
+static void dispatch_event(AlertStream *stream, const char *event, const char *data, size_t length)
+{
+   zlog_debug(alog, "Entering");
+
+   Feed *feed = stream->feed;
+
+   if (strcmp(event, "reset") == 0)
+   {
+      zlog_info(alog, "Stream %s asked for a reset", stream->url);
+      stream->resync = true;
+      return;
+   }// End of if
+
+   if (strcmp(event, "delta") != 0 && strcmp(event, "message") != 0) return;
+
+   char error[json_error_max] = { 0 };
+   json_settings settings = accounted_json_settings();
+   uint64_t start = stats_clock();
+   json_value *json = json_parse_ex(&settings, data, length, error);
+   record_stat_since(STATS_PARSE, start);
+   count_metric(METRICS_PARSE_BYTES, length);
+
+   if (!json || json->type != json_object)
+   {
+      zlog_warn(alog, "Stream event parse error: %s", error);
+      if (json) json_value_free_ex(&settings, json);
+      stream->resync = true;
+      return;
+   }// End of if
+
+   json_value *js_version = json_object_value(json, "version");
+   json_value *js_since = json_object_value(json, "since");
+   long version = js_version && js_version->type == json_integer ? (long)js_version->u.integer : 0;
+   long since = js_since && js_since->type == json_integer ? (long)js_since->u.integer : -1;
+
+   if (since != feed->version)
+   {
+      zlog_warn(alog, "Stream event from version %ld does not follow version %ld", since, feed->version);
+      stream->resync = true;
+   }// End of if
+   else if (version != feed->version)
+   {
+      Alerts *alerts = apply_alerts_delta(feed->alerts, json);
+
+      if (alerts)
+      {
+         free_alerts(feed->alerts);
+         feed->alerts = alerts;
+         feed->version = version;
+         ++stream->changes;
+
+         // Only an applied delta shows the stream is healthy again
+         stream->backoff = 0;
+
+         note_feed_loaded(0, feed->urls[0], NULL);
+      }// End of if
+      else
+      {
+         stream->resync = true;
+      }// End of else
+   }// End of else if
+
+   json_value_free_ex(&settings, json);
+
+   zlog_debug(alog, "Exiting");
+}// End of dispatch_event method
+
+/*
+   handle_line(stream, line, length) Handles one line of the stream.
+      PRE:  Valid pointers, line is NULL terminated without its line break.
+      POST: Complete events are dispatched.
+*/
+static void handle_line(AlertStream *stream, const char *line, size_t length)
+{
+   if (stream->ndjson)
+   {
+      if (length > 0) dispatch_event(stream, "delta", line, length);
+      return;
+   }// End of if
+
+   // A blank line ends the event
+   if (length == 0)
+   {
+      if (stream->data_length > 0 || stream->event[0])
+      {
+         dispatch_event(stream, stream->event[0] ? stream->event : "message",
+                        stream->data ? stream->data : "", stream->data_length);
+      }// End of if
+
+      stream->data_length = 0;
+      stream->event[0] = '\0';
+      return;
+   }// End of if
+
+   // Comments (keep alives)
+   if (line[0] == ':') return;
+
+   const char *colon = strchr(line, ':');
+   size_t name_length = colon ? (size_t)(colon - line) : length;
+   const char *value = colon ? colon + 1 : line + length;
+
+   if (*value == ' ') ++value;
+
+   if (name_length == 4 && strncmp(line, "data", 4) == 0)
+   {
+      if (stream->data_length > 0)
+      {
+         append_bytes(&stream->data, &stream->data_length, &stream->data_capacity, "\n", 1);
+      }// End of if
+
+      append_bytes(&stream->data, &stream->data_length, &stream->data_capacity,
+                   value, line + length - value);
+   }// End of if
+   else if (name_length == 5 && strncmp(line, "event", 5) == 0)
+   {
+      snprintf(stream->event, sizeof(stream->event), "%s", value);
+   }// End of else if
+}// End of handle_line method
+
+/*
+   stream_write(ptr, size, nmemb, stream) Splits the received data into lines.
+      PRE:  Valid pointers
+      POST: Returns the number of bytes consumed (anything else aborts).
+*/
+static size_t stream_write(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+   AlertStream *stream = userdata;
+   size_t bytes = size * nmemb;
+
+   stream->last_data = fetch_clock();
+
+   if (!stream->checked)
+   {
+      long status = 0;
+      char *type = NULL;
+
+      curl_easy_getinfo(stream->curl, CURLINFO_RESPONSE_CODE, &status);
+      curl_easy_getinfo(stream->curl, CURLINFO_CONTENT_TYPE, &type);
+
+      if (status >= 400)
+      {
+         zlog_warn(alog, "Stream %s answered with status %ld", stream->url, status);
+         stream->resync = status == 410;
+         return 0;
+      }// End of if
+
+      stream->ndjson = type && strstr(type, "event-stream") == NULL;
+      stream->checked = true;
+   }// End of if
+
+   for (size_t x = 0; x < bytes; ++x)
+   {
+      if (ptr[x] != '\n')
+      {
+         if (!append_bytes(&stream->line, &stream->line_length, &stream->line_capacity, &ptr[x], 1)) return 0;
+         continue;
+      }// End of if
+
+      if (stream->line_length > 0 && stream->line[stream->line_length - 1] == '\r')
+      {
+         stream->line[--stream->line_length] = '\0';
+      }// End of if
+
+      handle_line(stream, stream->line ? stream->line : "", stream->line_length);
+      stream->line_length = 0;
+
+      if (stream->resync) return 0;
+   }// End of for
+
+   return bytes;
+}// End of stream_write method
+
+/*
+   disconnect_stream(stream) Closes the connection of the stream.
+*/
+static void disconnect_stream(AlertStream *stream)
+{
+   if (!stream->curl) return;
+
+   curl_multi_remove_handle(stream->multi, stream->curl);
+   curl_easy_cleanup(stream->curl);
+   curl_slist_free_all(stream->headers);
+
+   stream->curl = NULL;
+   stream->headers = NULL;
+}// End of disconnect_stream method
+
+/*
+   schedule_retry(stream, now) Plans the next connection attempt with an
+                                 exponential back off.
+*/
+static void schedule_retry(AlertStream *stream, double now)
+{
+   stream->backoff = stream->backoff ? stream->backoff * 2 : STREAM_MIN_BACKOFF;
+   if (stream->backoff > STREAM_MAX_BACKOFF) stream->backoff = STREAM_MAX_BACKOFF;
+
+   stream->retry_at = now + stream->backoff;
+
+   zlog_info(alog, "Reconnecting to %s in %ds", stream->url, stream->backoff);
+}// End of schedule_retry method
+
+/*
+   connect_stream(stream, now) Opens the connection, resuming after the feed
+                                 version.
+      PRE:  Valid stream that is not connected
+      POST: Returns false if the request could not be started.
+*/
+static bool connect_stream(AlertStream *stream, double now)
+{
+   zlog_debug(alog, "Entering");
+
+   char last_event[64];
+
+   stream->curl = curl_easy_init();
+   if (!stream->curl) return false;
+
+   stream->headers = curl_slist_append(stream->headers, "Accept: text/event-stream, application/x-ndjson");
+   stream->headers = curl_slist_append(stream->headers, "Cache-Control: no-cache");
+
+   if (stream->feed->version > 0)
+   {
+      snprintf(last_event, sizeof(last_event), "Last-Event-ID: %ld", stream->feed->version);
+      stream->headers = curl_slist_append(stream->headers, last_event);
+   }// End of if
+
+   curl_easy_setopt(stream->curl, CURLOPT_URL, stream->url);
+   curl_easy_setopt(stream->curl, CURLOPT_HTTPHEADER, stream->headers);
+   curl_easy_setopt(stream->curl, CURLOPT_WRITEFUNCTION, stream_write);
+   curl_easy_setopt(stream->curl, CURLOPT_WRITEDATA, stream);
+   curl_easy_setopt(stream->curl, CURLOPT_ACCEPT_ENCODING, "");
+   curl_easy_setopt(stream->curl, CURLOPT_FOLLOWLOCATION, 1L);
+   curl_easy_setopt(stream->curl, CURLOPT_NOSIGNAL, 1L);
+   curl_easy_setopt(stream->curl, CURLOPT_TCP_KEEPALIVE, 1L);
+
+   if (stream->policy->connect_timeout > 0)
+   {
+      curl_easy_setopt(stream->curl, CURLOPT_CONNECTTIMEOUT_MS, stream->policy->connect_timeout);
+   }// End of if
+
+   stream->line_length = 0;
+   stream->data_length = 0;
+   stream->event[0] = '\0';
+   stream->checked = false;
+   stream->last_data = now;
+
+   if (curl_multi_add_handle(stream->multi, stream->curl) != CURLM_OK)
+   {
+      disconnect_stream(stream);
+      return false;
+   }// End of if
+
+   zlog_info(alog, "Streaming %s from version %ld", stream->url, stream->feed->version);
+
+   zlog_debug(alog, "Exiting");
+   return true;
+}// End of connect_stream method
+
+// IMPLEMENTATION: See header for details
+AlertStream * open_alert_stream(const char *url, Feed *feed, const FetchPolicy *policy)
+{
+   zlog_debug(alog, "Entering");
+
+   AlertStream *stream = calloc(1, sizeof(AlertStream));
+
+   if (!stream || !(stream->url = strdup(url)) || !(stream->multi = curl_multi_init()))
+   {
+      zlog_warn(alog, "Failed to allocate memory for stream");
+      if (stream) free(stream->url);
+      free(stream);
+      return NULL;
+   }// End of if
+
+   stream->feed = feed;
+   stream->policy = policy;
+
+   zlog_debug(alog, "Exiting");
+   return stream;
+}// End of open_alert_stream method
+
+// IMPLEMENTATION: See header for details
+int wait_alert_stream(AlertStream *stream, long timeout)
+{
+   zlog_debug(alog, "Entering");
+
+   double deadline = fetch_clock() + timeout / 1000.0;
+   stream->changes = 0;
+
+   for (;;)
+   {
+      double now = fetch_clock();
+
+      // The whole document is fetched at once, but a server that keeps
+      // asking for it is reconnected to with back off
+      if (stream->resync)
+      {
+         disconnect_stream(stream);
+         stream->resync = false;
+         schedule_retry(stream, now);
+         return -1;
+      }// End of if
+
+      if (__atomic_exchange_n(&stream->woken, 0, __ATOMIC_ACQ_REL)) return 0;
+
+      if (!stream->curl && now >= stream->retry_at && !connect_stream(stream, now))
+      {
+         schedule_retry(stream, now);
+      }// End of if
+
+      if (stream->curl)
+      {
+         CURLMsg *message = NULL;
+         int running = 0;
+         int queued = 0;
+
+         curl_multi_perform(stream->multi, &running);
+
+         while ((message = curl_multi_info_read(stream->multi, &queued)))
+         {
+            if (message->msg != CURLMSG_DONE) continue;
+
+            zlog_warn(alog, "Stream %s ended: %s", stream->url, curl_easy_strerror(message->data.result));
+            disconnect_stream(stream);
+            if (!stream->resync) schedule_retry(stream, now);
+         }// End of while
+      }// End of if
+
+      if (stream->resync) continue;
+      if (stream->changes > 0) return 1;
+
+      if (stream->curl && now - stream->last_data > STREAM_IDLE_TIMEOUT)
+      {
+         zlog_warn(alog, "Stream %s went quiet, reconnecting", stream->url);
+         disconnect_stream(stream);
+         stream->retry_at = now;
+         continue;
+      }// End of if
+
+      if (now >= deadline) return 0;
+
+      // Sleep until data arrives, a reconnect is due or the timeout expires
+      double wake = deadline;
+      if (stream->curl && stream->last_data + STREAM_IDLE_TIMEOUT < wake) wake = stream->last_data + STREAM_IDLE_TIMEOUT;
+      if (!stream->curl && stream->retry_at < wake) wake = stream->retry_at;
+
+      long wait = (long)((wake - now) * 1000) + 1;
+      curl_multi_poll(stream->multi, NULL, 0, (int)(wait > 0 ? wait : 0), NULL);
+   }// End of for
+}// End of wait_alert_stream method
+
+// IMPLEMENTATION: See header for details
+void wake_alert_stream(AlertStream *stream)
+{
+   __atomic_store_n(&stream->woken, 1, __ATOMIC_RELEASE);
+   curl_multi_wakeup(stream->multi);
+}// End of wake_alert_stream method
+
+// IMPLEMENTATION: See header for details
+void close_alert_stream(AlertStream *stream)
+{
+   if (!stream) return;
+
+   zlog_debug(alog, "Entering");
+
+   disconnect_stream(stream);
+   curl_multi_cleanup(stream->multi);
+
+   free(stream->line);
+   free(stream->data);
+   free(stream->url);
+   free(stream);
+
+   zlog_debug(alog, "Exiting");
+}// End of close_alert_stream method
@@ -0,0 +1,83 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef _STREAM
+#define _STREAM
+
+#include "feeds.h"
+
+/*
+   AlertStream follows a feed through a long lived HTTP connection instead of
+   polling it. The server sends one event per feed version, either as
+   Server-Sent Events:
+
+      id: 12
+      event: delta
+      data: {"version":12,"since":11,"added":[...],"updated":[...],"removed":[...]}
+
+   or as newline delimited JSON (one delta document per line). Every event is
+   applied to the feed's alerts as it arrives. After a disconnect the stream
+   reconnects with "Last-Event-ID: <feed version>" so the server can replay
+   what was missed; an "event: reset" or a delta that does not follow the feed
+   version asks for the whole document to be fetched again.
+*/
+struct AlertStream;
+typedef struct AlertStream AlertStream;
+
+/*
+   open_alert_stream(url, feed, policy) Creates a stream of the events at url
+                                          that are applied to feed.
+      PRE:  Valid url, feed and policy pointers that outlive the stream.
+      POST: Returns the stream (connected on the first wait_alert_stream), or
+            NULL if memory could not be allocated.
+*/
+AlertStream * open_alert_stream(const char *url, Feed *feed, const FetchPolicy *policy);
+
+/*
+   wait_alert_stream(stream, timeout) Follows the stream for up to timeout
+                                        milliseconds.
+      PRE:  Valid stream pointer
+      POST: Returns as soon as events changed the feed's alerts (1), the feed
+            has to be fetched in full before streaming can go on (-1), the
+            timeout expired or wake_alert_stream was called (0). The
+            connection is (re)established as needed, with back off (also
+            after -1, until a delta has been applied again).
+*/
+int wait_alert_stream(AlertStream *stream, long timeout);
+
+/*
+   wake_alert_stream(stream) Makes wait_alert_stream return now.
+      PRE:  Valid stream pointer (may be called from any thread)
+      POST: A pending or the next wait_alert_stream returns 0.
+*/
+void wake_alert_stream(AlertStream *stream);
+
+/*
+   close_alert_stream(stream) Disconnects and frees the stream.
+      PRE:  Valid stream pointer
+      POST: Memory allocated for the stream is freed.
+*/
+void close_alert_stream(AlertStream *stream);
+
+#endif
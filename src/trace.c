@@ -0,0 +1,210 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "trace.h"
+
+#include "log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+struct TraceEvent {
+   uint64_t sequence;                // Index of the span plus one, 0 while written
+   const char *name;
+   uint64_t start;
+   uint64_t end;
+};
+typedef struct TraceEvent TraceEvent;
+
+struct TraceRing {
+   struct TraceRing *next;
+   int thread;
+   const char *name;
+   uint64_t head;                    // Spans recorded
+   TraceEvent events[TRACE_RING_SIZE];
+};
+typedef struct TraceRing TraceRing;
+
+int trace_enabled = 0;
+
+static TraceRing *rings = NULL;
+static uint64_t origin = 0;          // Spans are written relative to it
+static __thread TraceRing *thread_ring = NULL;
+static __thread const char *thread_name = NULL;
+
+// IMPLEMENTATION: See header for details
+void enable_trace(void)
+{
+   origin = stats_clock();
+   __atomic_store_n(&trace_enabled, 1, __ATOMIC_RELEASE);
+}// End of enable_trace method
+
+// IMPLEMENTATION: See header for details
+void name_trace_thread(const char *name)
+{
+   thread_name = name;
+   if (thread_ring) __atomic_store_n(&thread_ring->name, name, __ATOMIC_RELAXED);
+}// End of name_trace_thread method
+
+/*
+   create_ring() Creates the ring of the calling thread and adds it to the
+                 list.
+      POST: Returns NULL if memory could not be allocated.
+*/
+static TraceRing * create_ring(void)
+{
+   TraceRing *ring = calloc(1, sizeof(TraceRing));
+   if (!ring) return NULL;
+
+   ring->thread = (int)syscall(SYS_gettid);
+   ring->name = thread_name;
+   ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+
+   while (!__atomic_compare_exchange_n(&rings, &ring->next, ring, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+   return ring;
+}// End of create_ring method
+
+// IMPLEMENTATION: See header for details
+void record_span(const char *name, uint64_t start, uint64_t end)
+{
+   if (!thread_ring && !(thread_ring = create_ring())) return;
+
+   TraceRing *ring = thread_ring;
+   uint64_t index = ring->head;
+   TraceEvent *event = &ring->events[index & (TRACE_RING_SIZE - 1)];
+
+   // Readers check the sequence before and after copying a span
+   __atomic_store_n(&event->sequence, 0, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+
+   __atomic_store_n(&event->name, name, __ATOMIC_RELAXED);
+   __atomic_store_n(&event->start, start, __ATOMIC_RELAXED);
+   __atomic_store_n(&event->end, end, __ATOMIC_RELAXED);
+
+   __atomic_store_n(&event->sequence, index + 1, __ATOMIC_RELEASE);
+   __atomic_store_n(&ring->head, index + 1, __ATOMIC_RELEASE);
+}// End of record_span method
+
+/*
+   write_ring(file, ring, pid) Writes the name and the spans of ring to file,
+                               each after a comma.
+*/
+static void write_ring(FILE *file, TraceRing *ring, int pid)
+{
+   const char *name = __atomic_load_n(&ring->name, __ATOMIC_RELAXED);
+   uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+   uint64_t index = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+   if (name)
+   {
+      fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+              pid, ring->thread, name);
+   }// End of if
+
+   for (; index < head; ++index)
+   {
+      TraceEvent *event = &ring->events[index & (TRACE_RING_SIZE - 1)];
+
+      if (__atomic_load_n(&event->sequence, __ATOMIC_ACQUIRE) != index + 1) continue;
+
+      const char *span = __atomic_load_n(&event->name, __ATOMIC_RELAXED);
+      uint64_t start = __atomic_load_n(&event->start, __ATOMIC_RELAXED);
+      uint64_t end = __atomic_load_n(&event->end, __ATOMIC_RELAXED);
+
+      // Overwritten while it was read
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(&event->sequence, __ATOMIC_RELAXED) != index + 1) continue;
+
+      // Spans from before the trace started are clipped to its start
+      double from = start > origin ? (start - origin) / 1000.0 : 0;
+      double to = end > origin ? (end - origin) / 1000.0 : 0;
+
+      fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"alerts\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+                    "\"ts\":%.3f,\"dur\":%.3f}",
+              span, pid, ring->thread, from, to > from ? to - from : 0);
+   }// End of for
+}// End of write_ring method
+
+// IMPLEMENTATION: See header for details
+bool write_trace(const char *path)
+{
+   zlog_debug(alog, "Entering");
+
+   char temporary[4096];
+   snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+
+   FILE *file = fopen(temporary, "w");
+
+   if (!file)
+   {
+      zlog_warn(alog, "Failed to open %s: %s", temporary, strerror(errno));
+      return false;
+   }// End of if
+
+   int pid = getpid();
+
+   fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+                 "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"alerts\"}}",
+           pid, pid);
+
+   for (TraceRing *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring; ring = ring->next)
+   {
+      write_ring(file, ring, pid);
+   }// End of for
+
+   fputs("\n]}\n", file);
+
+   if (fclose(file) != 0 || rename(temporary, path) != 0)
+   {
+      zlog_warn(alog, "Failed to write the trace %s: %s", path, strerror(errno));
+      unlink(temporary);
+      return false;
+   }// End of if
+
+   zlog_info(alog, "Wrote the trace to %s", path);
+   zlog_debug(alog, "Exiting");
+   return true;
+}// End of write_trace method
+
+// IMPLEMENTATION: See header for details
+void close_trace(void)
+{
+   __atomic_store_n(&trace_enabled, 0, __ATOMIC_RELAXED);
+
+   TraceRing *ring = __atomic_exchange_n(&rings, NULL, __ATOMIC_ACQ_REL);
+
+   while (ring)
+   {
+      TraceRing *next = ring->next;
+      free(ring);
+      ring = next;
+   }// End of while
+
+   thread_ring = NULL;
+}// End of close_trace method
@@ -0,0 +1,98 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef _TRACE
+#define _TRACE
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "stats.h"
+
+/*
+   Spans (a name, a start and an end in stats_clock nanoseconds) of the
+   pipeline can be traced for one-off stalls that the histograms of stats.h
+   hide. Every thread records into a ring of its own, allocated on its first
+   span, which keeps its last TRACE_RING_SIZE spans; recording takes no
+   lock and never waits. write_trace dumps the rings as Chrome trace-event
+   JSON, which Perfetto (ui.perfetto.dev) and chrome://tracing load.
+
+   Tracing is off until enable_trace. A span costs one predictable branch
+   while it is off: the phases of stats.h, which are timed anyway, are
+   traced from record_stat_since and the other spans take their start
+   from stats_clock.
+*/
+
+#define TRACE_RING_SIZE 8192         // Spans kept per thread, a power of two
+
+extern int trace_enabled;            // Spans are recorded
+
+#define trace_active() __builtin_expect(__atomic_load_n(&trace_enabled, __ATOMIC_RELAXED), 0)
+
+#define trace_span(name, start) \
+   do { \
+      if (trace_active()) record_span(name, start, stats_clock()); \
+   } while (0)
+
+/*
+   enable_trace() Starts recording spans.
+      PRE:  true
+      POST: Spans are recorded from now on.
+*/
+void enable_trace(void);
+
+/*
+   name_trace_thread(name) Names the calling thread in the trace.
+      PRE:  name is a string that outlives the trace
+      POST: The spans of the thread are shown under name.
+*/
+void name_trace_thread(const char *name);
+
+/*
+   record_span(name, start, end) Records a span of the calling thread.
+      PRE:  name is a string that outlives the trace, start <= end
+      POST: The span is kept in the ring of the thread (the oldest span is
+            overwritten once it is full). Nothing is recorded if the ring
+            cannot be allocated.
+*/
+void record_span(const char *name, uint64_t start, uint64_t end);
+
+/*
+   write_trace(path) Writes the spans of every thread to path as Chrome
+                     trace-event JSON.
+      PRE:  Valid path
+      POST: Returns false if the file could not be written. The file is
+            written beside path and renamed over it. Spans may be recorded
+            meanwhile, those overwritten while they are read are left out.
+*/
+bool write_trace(const char *path);
+
+/*
+   close_trace() Stops recording and frees the rings.
+      PRE:  No other thread records spans.
+      POST: Tracing is off.
+*/
+void close_trace(void);
+
+#endif
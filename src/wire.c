@@ -0,0 +1,510 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "wire.h"
+
+#include "log.h"
+#include "memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define WIRE_MIN_CAPACITY 4096
+
+/*
+   reserve(buffer, bytes) Makes room for bytes more bytes in buffer.
+      POST: Returns false (and sets buffer->failed) if memory could not be
+            allocated.
+*/
+static bool reserve(WireBuffer *buffer, size_t bytes)
+{
+   if (buffer->failed) return false;
+   if (buffer->length + bytes <= buffer->capacity) return true;
+
+   size_t capacity = buffer->capacity ? buffer->capacity : WIRE_MIN_CAPACITY;
+   while (capacity < buffer->length + bytes) capacity *= 2;
+
+   unsigned char *data = realloc(buffer->data, capacity);
+
+   if (!data)
+   {
+      zlog_warn(alog, "Failed to allocate memory for a wire frame");
+      buffer->failed = true;
+      return false;
+   }// End of if
+
+   buffer->data = data;
+   buffer->capacity = capacity;
+
+   return true;
+}// End of reserve method
+
+static uint64_t zigzag(int value)
+{
+   return value < 0 ? ((uint64_t)-(int64_t)value << 1) - 1 : (uint64_t)value << 1;
+}// End of zigzag method
+
+static int unzigzag(uint64_t value)
+{
+   return value & 1 ? (int)-(int64_t)((value + 1) >> 1) : (int)(value >> 1);
+}// End of unzigzag method
+
+// IMPLEMENTATION: See header for details
+void begin_wire_frame(WireBuffer *buffer, WireType type)
+{
+   if (!reserve(buffer, WIRE_HEADER_SIZE)) return;
+
+   memset(buffer->data + buffer->length, 0, WIRE_HEADER_SIZE - 1);
+   buffer->data[buffer->length + WIRE_HEADER_SIZE - 1] = type;
+   buffer->length += WIRE_HEADER_SIZE;
+}// End of begin_wire_frame method
+
+// IMPLEMENTATION: See header for details
+bool end_wire_frame(WireBuffer *buffer, size_t start)
+{
+   if (buffer->failed) return false;
+
+   size_t payload = buffer->length - start - WIRE_HEADER_SIZE;
+
+   if (payload > WIRE_MAX_FRAME)
+   {
+      zlog_warn(alog, "Wire frame of %zu bytes is too large", payload);
+      buffer->length = start;
+      return false;
+   }// End of if
+
+   for (int x = 0; x < 4; ++x)
+   {
+      buffer->data[start + x] = (payload >> (8 * x)) & 0xff;
+   }// End of for
+
+   return true;
+}// End of end_wire_frame method
+
+// IMPLEMENTATION: See header for details
+void put_wire_varint(WireBuffer *buffer, uint64_t value)
+{
+   if (!reserve(buffer, 10)) return;
+
+   while (value >= 0x80)
+   {
+      buffer->data[buffer->length++] = (value & 0x7f) | 0x80;
+      value >>= 7;
+   }// End of while
+
+   buffer->data[buffer->length++] = value;
+}// End of put_wire_varint method
+
+// IMPLEMENTATION: See header for details
+void put_wire_string(WireBuffer *buffer, const char *str)
+{
+   if (!str)
+   {
+      put_wire_varint(buffer, 0);
+      return;
+   }// End of if
+
+   size_t length = strlen(str);
+
+   put_wire_varint(buffer, length + 1);
+   if (!reserve(buffer, length)) return;
+
+   memcpy(buffer->data + buffer->length, str, length);
+   buffer->length += length;
+}// End of put_wire_string method
+
+// IMPLEMENTATION: See header for details
+void put_wire_bytes(WireBuffer *buffer, const void *data, size_t length)
+{
+   if (!reserve(buffer, length)) return;
+
+   if (data) memcpy(buffer->data + buffer->length, data, length);
+   else memset(buffer->data + buffer->length, 0, length);
+
+   buffer->length += length;
+}// End of put_wire_bytes method
+
+static void put_time(WireBuffer *buffer, const struct tm *tm)
+{
+   const int fields[] = { tm->tm_year, tm->tm_mon, tm->tm_mday, tm->tm_hour, tm->tm_min,
+                          tm->tm_sec, tm->tm_wday, tm->tm_yday, tm->tm_isdst };
+
+   for (size_t x = 0; x < sizeof(fields) / sizeof(fields[0]); ++x)
+   {
+      put_wire_varint(buffer, zigzag(fields[x]));
+   }// End of for
+}// End of put_time method
+
+// IMPLEMENTATION: See header for details
+void put_wire_alert(WireBuffer *buffer, const Alert *alert)
+{
+   put_wire_string(buffer, alert->identifier);
+   put_wire_string(buffer, alert->headline);
+   put_wire_string(buffer, alert->description);
+   put_wire_string(buffer, alert->instruction);
+   put_wire_string(buffer, alert->issuer);
+   put_wire_string(buffer, alert->event);
+   put_wire_varint(buffer, alert->severity);
+
+   put_time(buffer, &alert->effective);
+   put_time(buffer, &alert->expires);
+
+   put_wire_varint(buffer, alert->area_count);
+
+   for (int x = 0; x < alert->area_count; ++x)
+   {
+      const AlertArea *area = alert->areas[x];
+
+      put_wire_string(buffer, area->name);
+      put_wire_varint(buffer, area->geocode_count);
+
+      for (int y = 0; y < area->geocode_count; ++y)
+      {
+         put_wire_varint(buffer, zigzag(area->geocodes[y]));
+      }// End of for (y)
+   }// End of for (x)
+}// End of put_wire_alert method
+
+/*
+   find_previous(table, mask, previous, alert) Returns the index of alert in
+                                                previous, or -1.
+      PRE:  table maps the identifiers of previous (index + 1, 0 is free).
+*/
+static long find_previous(const int *table, unsigned long mask, const Alerts *previous, const Alert *alert)
+{
+   unsigned long slot = hash_identifier(alert->identifier) & mask;
+   long found = -1;
+
+   // Several alerts may share an identifier, the same object is preferred
+   for (; table[slot]; slot = (slot + 1) & mask)
+   {
+      const Alert *candidate = previous->alerts[table[slot] - 1];
+
+      if (candidate == alert) return table[slot] - 1;
+
+      if (found < 0 && same_alert(candidate, alert)) found = table[slot] - 1;
+   }// End of for
+
+   return found;
+}// End of find_previous method
+
+// IMPLEMENTATION: See header for details
+int put_wire_alerts(WireBuffer *buffer, const Alerts *alerts, const Alerts *previous)
+{
+   zlog_debug(alog, "Entering");
+
+   int *table = NULL;
+   unsigned long mask = 0;
+
+   if (previous && previous->count > 0)
+   {
+      mask = identifier_table_mask(previous->count);
+      table = calloc(mask + 1, sizeof(int));
+
+      // Without the table everything is sent in full, which is still correct
+      for (int x = 0; table && x < previous->count; ++x)
+      {
+         unsigned long slot = hash_identifier(previous->alerts[x]->identifier) & mask;
+         while (table[slot]) slot = (slot + 1) & mask;
+
+         table[slot] = x + 1;
+      }// End of for
+   }// End of if
+
+   size_t start = buffer->length;
+   int full = 0;
+
+   begin_wire_frame(buffer, WIRE_ALERTS);
+   put_wire_varint(buffer, alerts->generation);
+   put_wire_varint(buffer, alerts->count);
+
+   for (int x = 0; x < alerts->count; ++x)
+   {
+      long index = table ? find_previous(table, mask, previous, alerts->alerts[x]) : -1;
+
+      if (index < 0)
+      {
+         put_wire_varint(buffer, 1);
+         put_wire_alert(buffer, alerts->alerts[x]);
+         ++full;
+         continue;
+      }// End of if
+
+      // Unchanged alerts mostly keep their order, send them as runs
+      long run = 1;
+
+      while (x + run < alerts->count && index + run < previous->count
+               && alerts->alerts[x + run] == previous->alerts[index + run]) ++run;
+
+      put_wire_varint(buffer, (uint64_t)index << 1);
+      put_wire_varint(buffer, run);
+      x += run - 1;
+   }// End of for
+
+   free(table);
+
+   if (!end_wire_frame(buffer, start)) return -1;
+
+   zlog_debug(alog, "Exiting");
+   return full;
+}// End of put_wire_alerts method
+
+// IMPLEMENTATION: See header for details
+void free_wire_buffer(WireBuffer *buffer)
+{
+   free(buffer->data);
+
+   buffer->data = NULL;
+   buffer->length = 0;
+   buffer->capacity = 0;
+   buffer->failed = false;
+}// End of free_wire_buffer method
+
+// IMPLEMENTATION: See header for details
+long read_wire_frame(const unsigned char *data, size_t length, WireType *type, WireReader *reader)
+{
+   if (length < WIRE_HEADER_SIZE) return 0;
+
+   size_t payload = data[0] | (size_t)data[1] << 8 | (size_t)data[2] << 16 | (size_t)data[3] << 24;
+
+   if (payload > WIRE_MAX_FRAME) return -1;
+   if (length < WIRE_HEADER_SIZE + payload) return 0;
+
+   *type = data[WIRE_HEADER_SIZE - 1];
+
+   reader->data = data + WIRE_HEADER_SIZE;
+   reader->length = payload;
+   reader->offset = 0;
+   reader->failed = false;
+
+   return WIRE_HEADER_SIZE + payload;
+}// End of read_wire_frame method
+
+// IMPLEMENTATION: See header for details
+uint64_t get_wire_varint(WireReader *reader)
+{
+   uint64_t value = 0;
+
+   for (int shift = 0; shift < 64 && reader->offset < reader->length; shift += 7)
+   {
+      unsigned char byte = reader->data[reader->offset++];
+
+      value |= (uint64_t)(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) return value;
+   }// End of for
+
+   reader->failed = true;
+   return 0;
+}// End of get_wire_varint method
+
+// IMPLEMENTATION: See header for details
+char * get_wire_string(WireReader *reader)
+{
+   uint64_t length = get_wire_varint(reader);
+
+   if (length == 0 || reader->failed) return NULL;
+
+   if (length - 1 > reader->length - reader->offset)
+   {
+      reader->failed = true;
+      return NULL;
+   }// End of if
+
+   char *str = account_malloc(MEMORY_STRINGS, length);
+
+   if (!str)
+   {
+      reader->failed = true;
+      return NULL;
+   }// End of if
+
+   memcpy(str, reader->data + reader->offset, length - 1);
+   str[length - 1] = '\0';
+   reader->offset += length - 1;
+
+   return str;
+}// End of get_wire_string method
+
+static void get_time(WireReader *reader, struct tm *tm)
+{
+   int *fields[] = { &tm->tm_year, &tm->tm_mon, &tm->tm_mday, &tm->tm_hour, &tm->tm_min,
+                     &tm->tm_sec, &tm->tm_wday, &tm->tm_yday, &tm->tm_isdst };
+
+   for (size_t x = 0; x < sizeof(fields) / sizeof(fields[0]); ++x)
+   {
+      *fields[x] = unzigzag(get_wire_varint(reader));
+   }// End of for
+}// End of get_time method
+
+// IMPLEMENTATION: See header for details
+Alert * get_wire_alert(WireReader *reader)
+{
+   Alert *alert = account_calloc(MEMORY_ALERTS, 1, sizeof(Alert));
+
+   if (!alert)
+   {
+      reader->failed = true;
+      return NULL;
+   }// End of if
+
+   alert->references = 1;
+
+   alert->identifier = get_wire_string(reader);
+   alert->headline = get_wire_string(reader);
+   alert->description = get_wire_string(reader);
+   alert->instruction = get_wire_string(reader);
+   alert->issuer = get_wire_string(reader);
+   alert->event = get_wire_string(reader);
+
+   uint64_t severity = get_wire_varint(reader);
+   alert->severity = severity < ALERT_SEVERITIES ? (AlertSeverity)severity : ALERT_SEVERITY_UNKNOWN;
+
+   get_time(reader, &alert->effective);
+   get_time(reader, &alert->expires);
+
+   // Every area takes at least two bytes, which bounds a corrupt count
+   uint64_t area_count = get_wire_varint(reader);
+
+   if (!reader->failed && area_count > 0 && area_count <= (reader->length - reader->offset) / 2)
+   {
+      alert->areas = account_calloc(MEMORY_ALERTS, area_count, sizeof(AlertArea *));
+      if (!alert->areas) reader->failed = true;
+   }// End of if
+   else if (area_count > 0)
+   {
+      reader->failed = true;
+   }// End of else
+
+   for (uint64_t x = 0; x < area_count && !reader->failed; ++x)
+   {
+      AlertArea *area = account_calloc(MEMORY_ALERTS, 1, sizeof(AlertArea));
+
+      if (!area)
+      {
+         reader->failed = true;
+         break;
+      }// End of if
+
+      alert->areas[alert->area_count++] = area;
+
+      area->name = get_wire_string(reader);
+
+      uint64_t geocode_count = get_wire_varint(reader);
+      if (reader->failed) break;
+
+      if (geocode_count > reader->length - reader->offset)
+      {
+         reader->failed = true;
+         break;
+      }// End of if
+
+      if (geocode_count > 0)
+      {
+         area->geocodes = account_calloc(MEMORY_ALERTS, geocode_count, sizeof(int));
+
+         if (!area->geocodes)
+         {
+            reader->failed = true;
+            break;
+         }// End of if
+      }// End of if
+
+      area->geocode_count = geocode_count;
+
+      for (uint64_t y = 0; y < geocode_count; ++y)
+      {
+         area->geocodes[y] = unzigzag(get_wire_varint(reader));
+      }// End of for (y)
+   }// End of for (x)
+
+   if (reader->failed)
+   {
+      free_alert(alert);
+      return NULL;
+   }// End of if
+
+   return alert;
+}// End of get_wire_alert method
+
+// IMPLEMENTATION: See header for details
+Alerts * get_wire_alerts(WireReader *reader, const Alerts *previous)
+{
+   zlog_debug(alog, "Entering");
+
+   uint64_t generation = get_wire_varint(reader);
+   uint64_t count = get_wire_varint(reader);
+
+   // Every entry takes at least one byte
+   if (reader->failed || count > reader->length - reader->offset) return NULL;
+
+   Alerts *alerts = account_calloc(MEMORY_ALERTS, 1, sizeof(Alerts));
+   if (alerts) alerts->alerts = account_calloc(MEMORY_ALERTS, count > 0 ? count : 1, sizeof(Alert *));
+
+   if (!alerts || !alerts->alerts)
+   {
+      zlog_warn(alog, "Failed to allocate memory for received alerts");
+      free_alerts(alerts);
+      return NULL;
+   }// End of if
+
+   alerts->generation = generation;
+
+   while ((uint64_t)alerts->count < count)
+   {
+      // An entry is an alert in full, or a run of unchanged alerts
+      uint64_t entry = get_wire_varint(reader);
+      uint64_t run = entry & 1 ? 1 : get_wire_varint(reader);
+      uint64_t index = entry >> 1;
+      bool valid = !reader->failed && run > 0 && run <= count - alerts->count;
+
+      if (valid && (entry & 1))
+      {
+         Alert *alert = get_wire_alert(reader);
+
+         if (alert) alerts->alerts[alerts->count++] = alert;
+         else valid = false;
+      }// End of if
+      else if (valid && previous && index < (uint64_t)previous->count && run <= previous->count - index)
+      {
+         for (uint64_t x = 0; x < run; ++x)
+         {
+            alerts->alerts[alerts->count++] = retain_alert(previous->alerts[index + x]);
+         }// End of for
+      }// End of else if
+      else
+      {
+         valid = false;
+      }// End of else
+
+      if (!valid)
+      {
+         zlog_warn(alog, "Malformed alerts frame");
+         free_alerts(alerts);
+         return NULL;
+      }// End of if
+   }// End of while
+
+   zlog_debug(alog, "Exiting");
+   return alerts;
+}// End of get_wire_alerts method
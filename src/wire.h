@@ -0,0 +1,166 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef _WIRE
+#define _WIRE
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "alerts.h"
+
+/*
+   The wire format carries parsed alerts between the daemon and its clients.
+   A frame is a 4 byte little endian payload length, a 1 byte type and the
+   payload. Integers in the payload are LEB128 varints (signed ones zigzag
+   encoded) and strings are a varint length + 1 (0 for NULL) and the bytes.
+
+   An alerts frame is the generation, the alert count and one entry per
+   alert, in order. An entry is either an alert in full or, in a delta, a run
+   of alerts that are unchanged since the previous alerts frame (their index
+   there and the run length), so that a delta costs little more than the
+   alerts that changed.
+*/
+
+#define WIRE_VERSION 3
+#define WIRE_HEADER_SIZE 5
+#define WIRE_MAX_FRAME (64 * 1024 * 1024)
+
+enum WireType {
+   WIRE_HELLO = 1,            // Daemon -> client: protocol version
+   WIRE_ALERTS = 2,           // Daemon -> client: alerts (full or delta)
+   WIRE_REFRESH = 3           // Client -> daemon: reload the feeds now
+};
+typedef enum WireType WireType;
+
+struct WireBuffer {
+   unsigned char *data;
+   size_t length;
+   size_t capacity;
+   bool failed;               // Memory could not be allocated
+};
+typedef struct WireBuffer WireBuffer;
+
+struct WireReader {
+   const unsigned char *data;
+   size_t length;
+   size_t offset;
+   bool failed;               // Read past the end or malformed
+};
+typedef struct WireReader WireReader;
+
+/*
+   begin_wire_frame(buffer, type) Starts a frame at the end of buffer.
+      PRE:  Valid buffer pointer (zeroed before first use)
+      POST: The frame header is reserved, the payload follows.
+*/
+void begin_wire_frame(WireBuffer *buffer, WireType type);
+
+/*
+   end_wire_frame(buffer, start) Completes the frame started at offset start.
+      PRE:  start is the buffer length before begin_wire_frame.
+      POST: Returns false if the frame could not be written (buffer->failed)
+            or is larger than WIRE_MAX_FRAME.
+*/
+bool end_wire_frame(WireBuffer *buffer, size_t start);
+
+/*
+   put_wire_varint(buffer, value) Appends an unsigned varint.
+*/
+void put_wire_varint(WireBuffer *buffer, uint64_t value);
+
+/*
+   put_wire_string(buffer, str) Appends a string (str may be NULL).
+*/
+void put_wire_string(WireBuffer *buffer, const char *str);
+
+/*
+   put_wire_bytes(buffer, data, length) Appends length raw bytes (zeros if
+                                        data is NULL).
+*/
+void put_wire_bytes(WireBuffer *buffer, const void *data, size_t length);
+
+/*
+   put_wire_alert(buffer, alert) Appends an alert in full.
+      PRE:  Valid pointers
+*/
+void put_wire_alert(WireBuffer *buffer, const Alert *alert);
+
+/*
+   put_wire_alerts(buffer, alerts, previous) Appends an alerts frame.
+      PRE:  Valid buffer and alerts pointers, previous is NULL or the alerts
+            of the last alerts frame the receiver read.
+      POST: Alerts that are also in previous (same identifier and contents)
+            are sent as runs of indexes in previous, the others in full.
+            Returns the number of alerts sent in full, or -1 on failure.
+*/
+int put_wire_alerts(WireBuffer *buffer, const Alerts *alerts, const Alerts *previous);
+
+/*
+   free_wire_buffer(buffer) Frees the memory of buffer.
+      POST: buffer is empty and may be used again.
+*/
+void free_wire_buffer(WireBuffer *buffer);
+
+/*
+   read_wire_frame(data, length, type, reader) Reads the frame at data.
+      PRE:  Valid pointers, data holds length bytes.
+      POST: Returns the size of the frame (header included) and sets type and
+            reader to its payload, 0 if the frame is not complete yet, or -1
+            if it is larger than WIRE_MAX_FRAME.
+*/
+long read_wire_frame(const unsigned char *data, size_t length, WireType *type, WireReader *reader);
+
+/*
+   get_wire_varint(reader) Reads an unsigned varint.
+      POST: Returns 0 and sets reader->failed if there is none.
+*/
+uint64_t get_wire_varint(WireReader *reader);
+
+/*
+   get_wire_string(reader) Reads a string.
+      POST: Returns a newly allocated string (MEMORY_STRINGS, the string of
+            an alert), NULL if the string was NULL or could not be read
+            (reader->failed).
+*/
+char * get_wire_string(WireReader *reader);
+
+/*
+   get_wire_alert(reader) Reads an alert written by put_wire_alert.
+      POST: Returns a new alert (one reference), or NULL on failure.
+*/
+Alert * get_wire_alert(WireReader *reader);
+
+/*
+   get_wire_alerts(reader, previous) Reads the payload of an alerts frame.
+      PRE:  Valid reader, previous is NULL or the alerts of the last alerts
+            frame read.
+      POST: Returns a new Alerts object (sharing the unchanged alerts of
+            previous), or NULL if the frame is malformed or refers to an
+            alert previous does not have. Its generation is the daemon's.
+*/
+Alerts * get_wire_alerts(WireReader *reader, const Alerts *previous);
+
+#endif
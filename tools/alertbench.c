@@ -0,0 +1,371 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+/*
+   alertbench measures the alert pipeline on synthetic feeds (tools/feedgen.c,
+   detailed: English and French infos, area polygons, long descriptions) of
+   each size given, from 10 to 1000000 alerts:
+
+      bin/alertbench -n 10,1000,100000
+
+   For every size the feed is parsed, converted to alerts and freed several
+   times and the median of each is reported, with the memory the parse tree
+   and the alerts take. Timestamp parsing and rendering the list and an alert
+   to a terminal (written to /dev/null) are measured on their own. Every line
+   of the report is "name value unit", names end with the feed size, so the
+   reports of two versions can be compared line by line (make bench writes
+   bin/bench.txt).
+*/
+
+#include "feedgen.h"
+#include "json.h"
+#include "alerts.h"
+#include "memory.h"
+#include "list.h"
+#include "page.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <ncurses.h>
+
+#define DEFAULT_SIZES "10,100,1000,10000,100000"
+#define MAX_SIZES 16
+#define MAX_ALERTS 1000000
+#define ROUND_ALERTS 100000          // Alerts converted over the rounds of a size
+#define MIN_ROUNDS 3
+#define MAX_ROUNDS 200
+#define TIMESTAMPS 1024              // Distinct timestamps parsed
+#define TIMESTAMP_ROUNDS 200
+#define FRAMES 500                   // Frames rendered per size
+#define SCREEN_ROWS 50
+#define SCREEN_COLS 160
+#define LIST_ROWS 20
+
+static double now(void)
+{
+   struct timespec time;
+   clock_gettime(CLOCK_MONOTONIC, &time);
+
+   return time.tv_sec + time.tv_nsec / 1e9;
+}// End of now method
+
+static int compare_doubles(const void *a, const void *b)
+{
+   double x = *(const double *)a;
+   double y = *(const double *)b;
+
+   return x < y ? -1 : x > y;
+}// End of compare_doubles method
+
+/*
+   median(times, count) Returns the median of times (which are sorted).
+*/
+static double median(double *times, int count)
+{
+   qsort(times, count, sizeof(double), compare_doubles);
+
+   return count % 2 ? times[count / 2] : (times[count / 2 - 1] + times[count / 2]) / 2;
+}// End of median method
+
+/*
+   bench_timestamps() Measures parse_alert_time and alert_expiry.
+*/
+static void bench_timestamps(void)
+{
+   char (*timestamps)[32] = malloc(TIMESTAMPS * sizeof(*timestamps));
+   Alert alert;
+
+   if (!timestamps) return;
+
+   memset(&alert, 0, sizeof(alert));
+
+   for (int x = 0; x < TIMESTAMPS; ++x)
+   {
+      time_t time = 1393444860 + (time_t)x * 7919;
+      struct tm tm;
+
+      gmtime_r(&time, &tm);
+      strftime(timestamps[x], sizeof(timestamps[x]), "%Y-%m-%dT%H:%M:%S-00:00", &tm);
+   }// End of for
+
+   long total = 0;
+   double start = now();
+
+   for (int round = 0; round < TIMESTAMP_ROUNDS; ++round)
+   {
+      for (int x = 0; x < TIMESTAMPS; ++x)
+      {
+         parse_alert_time(timestamps[x], &alert.expires);
+         total += alert.expires.tm_min;
+      }// End of for (x)
+   }// End of for (round)
+
+   double elapsed = now() - start;
+   printf("parse_time %.0f ns/timestamp\n", elapsed * 1e9 / (TIMESTAMP_ROUNDS * TIMESTAMPS));
+
+   start = now();
+
+   for (int round = 0; round < TIMESTAMP_ROUNDS; ++round)
+   {
+      for (int x = 0; x < TIMESTAMPS; ++x)
+      {
+         alert.expires.tm_min = x % 60;
+         total += alert_expiry(&alert) & 1;
+      }// End of for (x)
+   }// End of for (round)
+
+   elapsed = now() - start;
+   printf("expiry %.0f ns/alert\n", elapsed * 1e9 / (TIMESTAMP_ROUNDS * TIMESTAMPS));
+
+   // Keeps the loops from being optimized away
+   if (total == -1) printf("total %ld\n", total);
+
+   free(timestamps);
+}// End of bench_timestamps method
+
+/*
+   bench_render(alerts) Renders frames of the list and the selected alert,
+                        moving the selection down one alert per frame (every
+                        alert is laid out when shown).
+      POST: Returns the time per frame in seconds, 0 if nothing was rendered.
+*/
+static double bench_render(Alerts *alerts)
+{
+   if (alerts->count == 0) return 0;
+
+   WINDOW *list = newwin(LIST_ROWS, SCREEN_COLS, 0, 0);
+   if (!list) return 0;
+
+   double start = now();
+
+   for (int frame = 0; frame < FRAMES; ++frame)
+   {
+      int selected = frame % alerts->count;
+      int top = selected >= LIST_ROWS ? selected - LIST_ROWS + 1 : 0;
+      AlertPage *page = get_alert_page(alerts->alerts[selected], SCREEN_COLS);
+
+      draw_alert_list(list, alerts, NULL, alerts->count, top, selected);
+      if (page) pnoutrefresh(page->pad, 0, 0, LIST_ROWS + 1, 0, SCREEN_ROWS - 2, SCREEN_COLS - 1);
+      doupdate();
+   }// End of for
+
+   double elapsed = now() - start;
+
+   // Pages and rows hold on to the alerts
+   free_alert_pages();
+   free_alert_list();
+   delwin(list);
+
+   return elapsed / FRAMES;
+}// End of bench_render method
+
+/*
+   bench_size(size, seed, render) Measures a feed of size alerts.
+      POST: Returns false if the feed could not be generated or loaded.
+*/
+static bool bench_size(int size, unsigned long seed, bool render)
+{
+   FeedGenOptions options = { size, seed, true };
+   size_t length = 0;
+   char *feed = generate_feed(&options, &length);
+
+   if (!feed) return false;
+
+   int rounds = ROUND_ALERTS / size;
+   if (rounds < MIN_ROUNDS) rounds = MIN_ROUNDS;
+   if (rounds > MAX_ROUNDS) rounds = MAX_ROUNDS;
+
+   double *parse_times = calloc(rounds, sizeof(double));
+   double *load_times = calloc(rounds, sizeof(double));
+   double *free_times = calloc(rounds, sizeof(double));
+   json_settings settings = accounted_json_settings();
+   MemoryUsage tree = { 0 };
+   MemoryUsage alerts_memory = { 0 };
+   MemoryUsage strings = { 0 };
+   double frame = 0;
+   int count = 0;
+   bool loaded = parse_times && load_times && free_times;
+
+   for (int round = 0; round < rounds && loaded; ++round)
+   {
+      char error[json_error_max];
+      double start = now();
+
+      json_value *json = json_parse_ex(&settings, feed, length, error);
+      parse_times[round] = now() - start;
+
+      if (!json) break;
+
+      start = now();
+      Alerts *alerts = load_alerts_from_json(json);
+      load_times[round] = now() - start;
+
+      if (round == 0)
+      {
+         read_memory_usage(MEMORY_PARSE, &tree);
+         read_memory_usage(MEMORY_ALERTS, &alerts_memory);
+         read_memory_usage(MEMORY_STRINGS, &strings);
+      }// End of if
+
+      json_value_free_ex(&settings, json);
+
+      if (!alerts)
+      {
+         loaded = false;
+         break;
+      }// End of if
+
+      count = alerts->count;
+      if (round == 0 && render) frame = bench_render(alerts);
+
+      start = now();
+      free_alerts(alerts);
+      free_times[round] = now() - start;
+   }// End of for
+
+   if (loaded)
+   {
+      double parse = median(parse_times, rounds);
+      double load = median(load_times, rounds);
+
+      printf("feed.%d %zu bytes\n", size, length);
+      printf("alerts.%d %d count\n", size, count);
+      printf("parse.%d %.3f ms\n", size, parse * 1e3);
+      printf("parse_rate.%d %.1f MB/s\n", size, length / parse / 1e6);
+      printf("parse_memory.%d %.2f bytes/byte\n", size, (double)tree.bytes / length);
+      printf("load.%d %.0f ns/alert\n", size, load * 1e9 / size);
+      printf("alert_memory.%d %.0f bytes/alert\n", size, (double)(alerts_memory.bytes + strings.bytes) / size);
+      printf("free.%d %.0f ns/alert\n", size, median(free_times, rounds) * 1e9 / size);
+      if (frame > 0) printf("render.%d %.1f us/frame\n", size, frame * 1e6);
+      fflush(stdout);
+   }// End of if
+
+   free(parse_times);
+   free(load_times);
+   free(free_times);
+   free(feed);
+
+   return loaded;
+}// End of bench_size method
+
+static void usage(const char *program)
+{
+   fprintf(stderr, "Usage: %s [options]\n"
+                   "  -n, --sizes LIST         Feed sizes in alerts, comma separated, up to %d\n"
+                   "                           (default %s)\n"
+                   "      --seed SEED          Seed of the feeds\n"
+                   "      --no-render          Do not measure rendering\n",
+           program, MAX_ALERTS, DEFAULT_SIZES);
+}// End of usage method
+
+int main(int argc, char **argv)
+{
+   enum { OPT_SEED = 256, OPT_NO_RENDER };
+
+   static const struct option long_options[] = {
+      { "sizes",     required_argument, NULL, 'n' },
+      { "seed",      required_argument, NULL, OPT_SEED },
+      { "no-render", no_argument,       NULL, OPT_NO_RENDER },
+      { "help",      no_argument,       NULL, 'h' },
+      { NULL,        0,                 NULL, 0 }
+   };
+
+   const char *list = DEFAULT_SIZES;
+   unsigned long seed = 1;
+   bool render = true;
+   int sizes[MAX_SIZES];
+   int size_count = 0;
+   int option = 0;
+
+   while ((option = getopt_long(argc, argv, "n:h", long_options, NULL)) != -1)
+   {
+      switch (option)
+      {
+         case 'n':                  list = optarg; break;
+         case OPT_SEED:             seed = strtoul(optarg, NULL, 10); break;
+         case OPT_NO_RENDER:        render = false; break;
+         case 'h':                  usage(argv[0]); return 0;
+         default:                   usage(argv[0]); return 1;
+      }// End of switch
+   }// End of while
+
+   for (const char *next = list; *next && size_count < MAX_SIZES; )
+   {
+      char *end = NULL;
+      long size = strtol(next, &end, 10);
+
+      if (end == next || size < 1 || size > MAX_ALERTS || (*end && *end != ','))
+      {
+         usage(argv[0]);
+         return 1;
+      }// End of if
+
+      sizes[size_count++] = (int)size;
+      next = *end ? end + 1 : end;
+   }// End of for
+
+   // A terminal of fixed size whose output is thrown away
+   FILE *terminal_out = render ? fopen("/dev/null", "w") : NULL;
+   FILE *terminal_in = render ? fopen("/dev/null", "r") : NULL;
+   SCREEN *screen = terminal_out && terminal_in ? newterm("xterm", terminal_out, terminal_in) : NULL;
+
+   if (screen)
+   {
+      resizeterm(SCREEN_ROWS, SCREEN_COLS);
+      start_color();
+      init_pair(HEADLINE_COLOUR, COLOR_BLACK, COLOR_RED);
+   }// End of if
+   else if (render)
+   {
+      fprintf(stderr, "%s: no xterm terminal description, rendering is not measured\n", argv[0]);
+   }// End of else if
+
+   bench_timestamps();
+
+   int status = 0;
+
+   for (int x = 0; x < size_count; ++x)
+   {
+      if (!bench_size(sizes[x], seed, screen != NULL))
+      {
+         fprintf(stderr, "%s: failed to load a feed of %d alerts\n", argv[0], sizes[x]);
+         status = 1;
+      }// End of if
+   }// End of for (x)
+
+   if (screen)
+   {
+      endwin();
+      delscreen(screen);
+   }// End of if
+
+   if (terminal_out) fclose(terminal_out);
+   if (terminal_in) fclose(terminal_in);
+
+   return status;
+}// End of main method
@@ -0,0 +1,308 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "feedgen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+static const char *events[] = {
+   "thunderstorm", "tornado", "snowfall", "blizzard", "rainfall",
+   "freezing rain", "heat", "wind", "fog", "air quality"
+};
+
+static const char *french_events[] = {
+   "orages", "tornade", "neige", "blizzard", "pluie",
+   "pluie verglaçante", "chaleur", "vents", "brouillard", "qualité de l'air"
+};
+
+static const char *severities[] = { "Extreme", "Severe", "Moderate", "Minor" };
+
+static const char *regions[] = {
+   "City of Ottawa", "City of Toronto", "Montreal", "Calgary", "Edmonton",
+   "Metro Vancouver", "Halifax Metro", "Winnipeg", "Regina", "Saskatoon",
+   "Whitehorse", "Yellowknife", "Iqaluit", "St. John's", "Fredericton"
+};
+
+// Latitude and longitude of the regions, the centres of their polygons
+static const double centres[][2] = {
+   { 45.42, -75.70 }, { 43.65, -79.38 }, { 45.50, -73.57 }, { 51.05, -114.07 }, { 53.55, -113.49 },
+   { 49.28, -123.12 }, { 44.65, -63.57 }, { 49.90, -97.14 }, { 50.45, -104.61 }, { 52.13, -106.67 },
+   { 60.72, -135.06 }, { 62.45, -114.37 }, { 63.75, -68.52 }, { 47.56, -52.71 }, { 45.96, -66.64 }
+};
+
+static const char *sentences[] = {
+   "A low pressure system approaching from the Great Lakes will spread %s across the region tonight.",
+   "Conditions are expected to deteriorate rapidly this evening and persist into Thursday.",
+   "Local amounts may be significantly higher in areas exposed to onshore flow.",
+   "The threat will diminish from west to east as the system moves away on Friday morning.",
+   "Travel is expected to be hazardous due to reduced visibility in some locations.",
+   "Utility outages and damage to buildings, such as to roof shingles and windows, may occur.",
+   "Please continue to monitor alerts and forecasts issued by Environment Canada.",
+   "Emergency management officials may issue further statements as the event unfolds."
+};
+
+static const char *french_sentences[] = {
+   "Une dépression en provenance des Grands Lacs est à l'origine de cette alerte (%s).",
+   "Les conditions devraient se détériorer rapidement ce soir et persister jusqu'à jeudi.",
+   "Les quantités pourraient être nettement plus élevées dans les secteurs exposés.",
+   "La menace diminuera d'ouest en est à mesure que le système s'éloignera vendredi matin.",
+   "Les déplacements pourraient être dangereux en raison de la visibilité réduite par endroits.",
+   "Des pannes de courant et des dommages aux bâtiments sont possibles.",
+   "Veuillez continuer de surveiller les alertes et les prévisions émises par Environnement Canada.",
+   "Les responsables des mesures d'urgence pourraient publier d'autres déclarations."
+};
+
+#define ARRAY_LENGTH(array) (sizeof(array) / sizeof((array)[0]))
+
+/*
+   next_random(state) Returns the next value of the xorshift generator.
+      PRE:  Valid state pointer holding a non-zero value
+      POST: state is advanced and a pseudo random value is returned.
+*/
+static unsigned long next_random(unsigned long *state)
+{
+   unsigned long x = *state;
+
+   x ^= x << 13;
+   x ^= x >> 7;
+   x ^= x << 17;
+
+   return *state = x;
+}// End of next_random method
+
+/*
+   format_time(buffer, size, time) Formats time in the CAP time format.
+      PRE:  Valid buffer of size bytes
+      POST: buffer holds the formatted time.
+*/
+static void format_time(char *buffer, size_t size, time_t time)
+{
+   struct tm tm;
+   gmtime_r(&time, &tm);
+   strftime(buffer, size, "%Y-%m-%dT%H:%M:%S-00:00", &tm);
+}// End of format_time method
+
+// IMPLEMENTATION: See header for details
+void format_alert_identifier(char *buffer, size_t size, const FeedGenOptions *options, int index)
+{
+   snprintf(buffer, size, "urn:oid:2.49.0.1.124.%lu.%d", options->seed, index);
+}// End of format_alert_identifier method
+
+/*
+   write_description(out, sentences, event, count, state) Writes count
+      sentences drawn from sentences (the first names event), separated by
+      spaces.
+*/
+static void write_description(FILE *out, const char **sentences, const char *event, int count,
+                              unsigned long *state)
+{
+   fprintf(out, sentences[0], event);
+
+   for (int x = 1; x < count; ++x)
+   {
+      fputc(' ', out);
+      fputs(sentences[1 + next_random(state) % 7], out);
+   }// End of for (x)
+}// End of write_description method
+
+/*
+   write_polygon(out, region, state) Writes a closed CAP polygon ("lat,lon"
+      pairs separated by spaces) of 6 to 24 points around region.
+*/
+static void write_polygon(FILE *out, int region, unsigned long *state)
+{
+   int points = 6 + next_random(state) % 19;
+   double first[2] = { 0, 0 };
+
+   for (int x = 0; x < points; ++x)
+   {
+      double radius = 0.2 + (next_random(state) % 1000) / 2000.0;
+      double angle = 6.283185307179586 * x / points;
+      double latitude = centres[region][0] + radius * sin(angle);
+      double longitude = centres[region][1] + radius * 1.5 * cos(angle);
+
+      if (x == 0)
+      {
+         first[0] = latitude;
+         first[1] = longitude;
+      }// End of if
+
+      fprintf(out, "%s%.4f,%.4f", x > 0 ? " " : "", latitude, longitude);
+   }// End of for (x)
+
+   fprintf(out, " %.4f,%.4f", first[0], first[1]);
+}// End of write_polygon method
+
+/*
+   write_detailed_alert(out, options, index, revision, state) Writes alert
+      number index with an English and a French info, each with a long
+      description and a polygon for every area.
+*/
+static void write_detailed_alert(FILE *out, const FeedGenOptions *options, int index, int revision,
+                                 unsigned long *state)
+{
+   const time_t base = 1393444860;
+
+   int type = next_random(state) % ARRAY_LENGTH(events);
+   const char *severity = severities[(next_random(state) + revision) % ARRAY_LENGTH(severities)];
+   int area_count = 1 + next_random(state) % 4;
+   int sentence_count = 3 + next_random(state) % 8;
+   int areas[4];
+
+   char identifier[64];
+   char sent[32];
+   char effective[32];
+   char expires[32];
+   time_t start = base + (time_t)(next_random(state) % (86400 * 30));
+
+   format_alert_identifier(identifier, sizeof(identifier), options, index);
+   format_time(sent, sizeof(sent), start + revision * 600);
+   format_time(effective, sizeof(effective), start);
+   format_time(expires, sizeof(expires), start + 3600 * (1 + next_random(state) % 48) + revision * 3600);
+
+   for (int x = 0; x < area_count; ++x) areas[x] = next_random(state) % ARRAY_LENGTH(regions);
+
+   fprintf(out, "{\"identifier\":\"%s\",\"status\":\"Actual\",\"sent\":\"%s\",\"infos\":[", identifier, sent);
+
+   for (int language = 0; language < 2; ++language)
+   {
+      bool french = language == 1;
+      const char *event = french ? french_events[type] : events[type];
+
+      // Both infos describe the same alert, so they draw the same numbers
+      unsigned long text_state = *state;
+
+      fprintf(out, "%s{\"language\":\"%s\",\"headline\":\"%s %s %s\","
+                   "\"event\":\"%s\",\"severity\":\"%s\",\"sender_name\":\"%s\","
+                   "\"effective\":\"%s\",\"expires\":\"%s\",\"description\":\"",
+              french ? "," : "", french ? "fr-CA" : "en-CA",
+              french ? "avertissement de" : event, french ? event : "warning",
+              french ? (revision > 0 ? "maintenu" : "en vigueur") : (revision > 0 ? "continued" : "in effect"),
+              event, severity, french ? "Environnement Canada" : "Environment Canada", effective, expires);
+
+      write_description(out, french ? french_sentences : sentences, event, sentence_count, &text_state);
+
+      fprintf(out, "\",\"instruction\":\"%s\",\"areas\":[",
+              french ? "Surveillez les alertes et les prévisions émises par Environnement Canada."
+                     : "Monitor alerts and forecasts issued by Environment Canada.");
+
+      for (int x = 0; x < area_count; ++x)
+      {
+         fprintf(out, "%s{\"description\":\"%s\",\"polygon\":\"",
+                 x > 0 ? "," : "", regions[areas[x]]);
+         write_polygon(out, areas[x], &text_state);
+         fprintf(out, "\",\"geocodes\":[\"%06d\",\"%06d\"]}",
+                 100000 + areas[x] * 1000 + (int)(next_random(&text_state) % 1000),
+                 100000 + areas[x] * 1000 + (int)(next_random(&text_state) % 1000));
+      }// End of for (x)
+
+      fputs("]}", out);
+   }// End of for (language)
+
+   fputs("]}", out);
+}// End of write_detailed_alert method
+
+// IMPLEMENTATION: See header for details
+void write_alert(FILE *out, const FeedGenOptions *options, int index, int revision)
+{
+   // Every alert has its own generator so alerts can be produced in any order
+   unsigned long state = (options->seed + 1) * 0x9E3779B97F4A7C15UL ^ ((unsigned long)index << 20);
+   if (!state) state = 0x2545F4914F6CDD1DUL;
+
+   for (int x = 0; x < 4; ++x) next_random(&state);
+
+   if (options->detailed)
+   {
+      write_detailed_alert(out, options, index, revision, &state);
+      return;
+   }// End of if
+
+   // Feeds are anchored to a fixed date so that the output is reproducible
+   const time_t base = 1393444860;
+
+   const char *event = events[next_random(&state) % ARRAY_LENGTH(events)];
+   const char *severity = severities[(next_random(&state) + revision) % ARRAY_LENGTH(severities)];
+   int area_count = 1 + next_random(&state) % 3;
+
+   char identifier[64];
+   char sent[32];
+   char effective[32];
+   char expires[32];
+   time_t start = base + (time_t)(next_random(&state) % (86400 * 30));
+
+   format_alert_identifier(identifier, sizeof(identifier), options, index);
+   format_time(sent, sizeof(sent), start + revision * 600);
+   format_time(effective, sizeof(effective), start);
+   format_time(expires, sizeof(expires), start + 3600 * (1 + next_random(&state) % 48) + revision * 3600);
+
+   fprintf(out, "{\"identifier\":\"%s\",\"status\":\"Actual\",\"sent\":\"%s\","
+                "\"infos\":[{\"language\":\"en-CA\",\"headline\":\"%s warning %s\","
+                "\"event\":\"%s\",\"severity\":\"%s\",\"sender_name\":\"Environment Canada\","
+                "\"effective\":\"%s\",\"expires\":\"%s\","
+                "\"description\":\"Conditions are favourable for %s. Synthetic alert %d, revision %d.\","
+                "\"instruction\":\"Monitor alerts and forecasts issued by Environment Canada.\","
+                "\"areas\":[",
+           identifier, sent, event, revision > 0 ? "continued" : "in effect", event, severity,
+           effective, expires, event, index, revision);
+
+   for (int x = 0; x < area_count; ++x)
+   {
+      int region = next_random(&state) % ARRAY_LENGTH(regions);
+
+      fprintf(out, "%s{\"description\":\"%s\",\"geocodes\":[\"%06d\"]}",
+              x > 0 ? "," : "", regions[region], 100000 + region * 1000 + (int)(next_random(&state) % 1000));
+   }// End of for (x)
+
+   fputs("]}]}", out);
+}// End of write_alert method
+
+// IMPLEMENTATION: See header for details
+char * generate_feed(const FeedGenOptions *options, size_t *length)
+{
+   char *feed = NULL;
+   FILE *out = open_memstream(&feed, length);
+
+   if (!out) return NULL;
+
+   fputs("{\"alerts\":[", out);
+
+   for (int i = 0; i < options->count; ++i)
+   {
+      if (i > 0) fputc(',', out);
+      write_alert(out, options, i, 0);
+   }// End of for (i)
+
+   fputs("]}", out);
+
+   if (fclose(out) != 0)
+   {
+      free(feed);
+      return NULL;
+   }// End of if
+
+   return feed;
+}// End of generate_feed method
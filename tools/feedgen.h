@@ -0,0 +1,70 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef _FEEDGEN
+#define _FEEDGEN
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+   FeedGenOptions controls the synthetic CAP-JSON feed generator. The same
+   options always produce the same feed.
+*/
+struct FeedGenOptions {
+   int count;              // Number of alerts in the feed
+   unsigned long seed;     // Seed of the pseudo random generator
+   bool detailed;          // English and French infos, area polygons and long descriptions
+};
+typedef struct FeedGenOptions FeedGenOptions;
+
+/*
+   generate_feed(options, length) Generates a synthetic alerts feed.
+      PRE:  Valid options and length pointers
+      POST: Returns a NULL terminated JSON document in the format of
+            /api/alerts.json (free with free) and stores its length in length,
+            or returns NULL if memory could not be allocated.
+*/
+char * generate_feed(const FeedGenOptions *options, size_t *length);
+
+/*
+   write_alert(out, options, index, revision) Writes synthetic alert number
+                                                index as a CAP-JSON object.
+      PRE:  Valid out and options pointers, index >= 0, revision >= 0
+      POST: The alert is written to out. The same index and revision always
+            give the same alert; a higher revision is an update of it.
+*/
+void write_alert(FILE *out, const FeedGenOptions *options, int index, int revision);
+
+/*
+   format_alert_identifier(buffer, size, options, index) Formats the CAP
+                                                           identifier of
+                                                           synthetic alert index.
+      PRE:  Valid buffer of size bytes and options pointer
+      POST: buffer holds the identifier.
+*/
+void format_alert_identifier(char *buffer, size_t size, const FeedGenOptions *options, int index);
+
+#endif
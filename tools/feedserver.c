@@ -0,0 +1,1082 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+/*
+   feedserver is a loopback stand-in for the alerts feed server. It serves a
+   recorded (-f) or synthetic (-s) feed over HTTP on 127.0.0.1 and can
+   simulate slow, throttled, chunked, compressed and failing responses so the
+   real fetch and parse pipeline can be exercised without internet access:
+
+      bin/feedserver -p 8080 -s 5000 --latency 200 --rate 65536 &
+      bin/alerts http://127.0.0.1:8080/api/alerts.json
+
+   Synthetic feeds are versioned. With --churn, alerts are added, updated and
+   removed every --churn-interval seconds, and the feed answers
+   "?since=VERSION" with only the changes since that version:
+
+      {"version":12,"since":10,"added":[...],"updated":[...],"removed":["id",...]}
+
+   Versions older than --delta-window are answered with 410 Gone.
+*/
+
+#include "feedgen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define MAX_REQUEST_SIZE 8192
+#define CHANGE_LOG_SIZE 65536
+#define STREAM_KEEPALIVE 15
+
+/* SERVER OPTIONS */
+struct ServerOptions {
+   int port;
+   int latency;            // Milliseconds before the response is sent
+   long rate;              // Bytes per second (0 for unlimited)
+   int chunk;              // Chunk size for chunked responses (0 for Content-Length)
+   bool compress;          // Offer gzip to clients that accept it
+   double error_rate;      // Fraction of requests answered with 503
+   double truncate_rate;   // Fraction of responses cut off half way
+   double stall_rate;      // Fraction of responses that stall after the headers
+   int stall_time;         // Seconds a stalled response hangs before closing
+   int churn;              // Alerts changed per churn round
+   int churn_interval;     // Seconds between churn rounds
+   long delta_window;      // Versions for which deltas are kept
+   int stream_drop;        // Seconds after which event streams are closed (0 to keep them)
+   bool quiet;
+};
+typedef struct ServerOptions ServerOptions;
+
+/* DOCUMENT (a response body, shared by the requests sending it) */
+struct Document {
+   int references;
+   char *body;
+   size_t length;
+   unsigned char *gzip;
+   size_t gzip_length;
+   char etag[48];
+};
+typedef struct Document Document;
+
+/* SYNTHETIC FEED */
+struct FeedEntry {
+   int index;
+   int revision;
+   char *json;
+};
+typedef struct FeedEntry FeedEntry;
+
+struct Change {
+   long version;
+   int index;
+   char type;              // 'a'dded, 'u'pdated or 'r'emoved
+};
+typedef struct Change Change;
+
+/* REQUEST */
+struct Request {
+   char method[8];
+   char path[1024];
+   bool accepts_gzip;
+   char if_none_match[64];
+   long last_event_id;     // -1 when not resuming a stream
+};
+typedef struct Request Request;
+
+/* THROTTLE */
+struct Throttle {
+   struct timespec start;
+   size_t sent;
+};
+typedef struct Throttle Throttle;
+
+static ServerOptions options = { 8080, 0, 0, 0, true, 0, 0, 0, 60, 0, 10, 100, 0, false };
+static FeedGenOptions generator = { 100, 1, false };
+static unsigned long request_count = 0;
+
+// Feed state, guarded by feed_lock
+static pthread_mutex_t feed_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t feed_changed = PTHREAD_COND_INITIALIZER;
+static Document *current = NULL;
+static bool synthetic = false;
+static long version = 0;
+static long oldest_delta = 0;
+static FeedEntry *entries = NULL;
+static int entry_count = 0;
+static int next_index = 0;
+static Change changes[CHANGE_LOG_SIZE];
+static long change_count = 0;
+
+/*
+   elapsed(start) Returns the seconds elapsed since start.
+*/
+static double elapsed(const struct timespec *start)
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+
+   return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1000000000.0;
+}// End of elapsed method
+
+/*
+   sleep_seconds(seconds) Sleeps for the given number of seconds.
+*/
+static void sleep_seconds(double seconds)
+{
+   if (seconds <= 0) return;
+
+   struct timespec duration = { (time_t)seconds, (long)((seconds - (time_t)seconds) * 1000000000.0) };
+   while (nanosleep(&duration, &duration) != 0 && errno == EINTR);
+}// End of sleep_seconds method
+
+/*
+   create_document(body, length) Wraps body (taken over) in a document with
+                                   its gzip encoding and ETag.
+*/
+static Document * create_document(char *body, size_t length)
+{
+   Document *document = calloc(1, sizeof(Document));
+   unsigned long hash = 2166136261UL;
+
+   if (!document)
+   {
+      free(body);
+      return NULL;
+   }// End of if
+
+   document->references = 1;
+   document->body = body;
+   document->length = length;
+
+   for (size_t x = 0; x < length; ++x)
+   {
+      hash ^= (unsigned char)body[x];
+      hash *= 16777619UL;
+   }// End of for
+
+   snprintf(document->etag, sizeof(document->etag), "\"%08lx-%zx\"", hash & 0xffffffffUL, length);
+
+   if (!options.compress) return document;
+
+   z_stream stream;
+   memset(&stream, 0, sizeof(stream));
+
+   if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+   {
+      return document;
+   }// End of if
+
+   document->gzip_length = deflateBound(&stream, length);
+   document->gzip = malloc(document->gzip_length);
+
+   if (document->gzip)
+   {
+      stream.next_in = (unsigned char *)body;
+      stream.avail_in = length;
+      stream.next_out = document->gzip;
+      stream.avail_out = document->gzip_length;
+
+      if (deflate(&stream, Z_FINISH) == Z_STREAM_END)
+      {
+         document->gzip_length = stream.total_out;
+      }// End of if
+      else
+      {
+         free(document->gzip);
+         document->gzip = NULL;
+      }// End of else
+   }// End of if
+
+   deflateEnd(&stream);
+   return document;
+}// End of create_document method
+
+/*
+   release_document(document) Drops a reference to document.
+*/
+static void release_document(Document *document)
+{
+   if (!document || __atomic_sub_fetch(&document->references, 1, __ATOMIC_ACQ_REL) > 0) return;
+
+   free(document->body);
+   free(document->gzip);
+   free(document);
+}// End of release_document method
+
+/*
+   acquire_current() Returns a reference to the current full document.
+*/
+static Document * acquire_current(void)
+{
+   pthread_mutex_lock(&feed_lock);
+
+   Document *document = current;
+   __atomic_add_fetch(&document->references, 1, __ATOMIC_RELAXED);
+
+   pthread_mutex_unlock(&feed_lock);
+   return document;
+}// End of acquire_current method
+
+/*
+   render_alert(index, revision) Returns the JSON of a synthetic alert.
+*/
+static char * render_alert(int index, int revision)
+{
+   char *json = NULL;
+   size_t length = 0;
+   FILE *out = open_memstream(&json, &length);
+
+   if (!out) return NULL;
+
+   write_alert(out, &generator, index, revision);
+   fclose(out);
+
+   return json;
+}// End of render_alert method
+
+/*
+   find_entry(index) Returns the position of alert index in entries, or -1.
+      PRE:  feed_lock is held
+*/
+static int find_entry(int index)
+{
+   for (int x = 0; x < entry_count; ++x)
+   {
+      if (entries[x].index == index) return x;
+   }// End of for
+
+   return -1;
+}// End of find_entry method
+
+/*
+   publish_feed() Rebuilds the full document from the synthetic entries.
+      PRE:  feed_lock is held
+*/
+static void publish_feed(void)
+{
+   char *body = NULL;
+   size_t length = 0;
+   FILE *out = open_memstream(&body, &length);
+
+   if (!out) return;
+
+   fprintf(out, "{\"version\":%ld,\"alerts\":[", version);
+
+   for (int x = 0; x < entry_count; ++x)
+   {
+      if (x > 0) fputc(',', out);
+      fputs(entries[x].json, out);
+   }// End of for
+
+   fputs("]}", out);
+   fclose(out);
+
+   Document *document = create_document(body, length);
+   if (!document) return;
+
+   release_document(current);
+   current = document;
+}// End of publish_feed method
+
+/*
+   record_change(type, index) Adds a change of the current version to the log.
+      PRE:  feed_lock is held
+*/
+static void record_change(char type, int index)
+{
+   Change *change = &changes[change_count % CHANGE_LOG_SIZE];
+
+   // Overwriting a change means deltas from before it can no longer be built
+   if (change_count >= CHANGE_LOG_SIZE && change->version > oldest_delta) oldest_delta = change->version;
+
+   change->version = version;
+   change->index = index;
+   change->type = type;
+   ++change_count;
+}// End of record_change method
+
+/*
+   churn_feed(seed) Adds, updates and removes options.churn alerts as one new
+                     version of the feed.
+*/
+static void churn_feed(unsigned int *seed)
+{
+   pthread_mutex_lock(&feed_lock);
+
+   ++version;
+
+   for (int x = 0; x < options.churn; ++x)
+   {
+      int action = rand_r(seed) % 4;
+
+      if (action == 0 || entry_count == 0)
+      {
+         char *json = render_alert(next_index, 0);
+         FeedEntry *list = realloc(entries, (entry_count + 1) * sizeof(FeedEntry));
+
+         if (!json || !list)
+         {
+            free(json);
+            if (list) entries = list;
+            continue;
+         }// End of if
+
+         entries = list;
+         entries[entry_count].index = next_index;
+         entries[entry_count].revision = 0;
+         entries[entry_count].json = json;
+         ++entry_count;
+
+         record_change('a', next_index++);
+      }// End of if
+      else if (action == 1)
+      {
+         int position = rand_r(seed) % entry_count;
+
+         record_change('r', entries[position].index);
+         free(entries[position].json);
+         entries[position] = entries[--entry_count];
+      }// End of else if
+      else
+      {
+         FeedEntry *entry = &entries[rand_r(seed) % entry_count];
+         char *json = render_alert(entry->index, entry->revision + 1);
+
+         if (!json) continue;
+
+         free(entry->json);
+         entry->json = json;
+         ++entry->revision;
+
+         record_change('u', entry->index);
+      }// End of else
+   }// End of for
+
+   if (version - options.delta_window > oldest_delta) oldest_delta = version - options.delta_window;
+
+   publish_feed();
+   pthread_cond_broadcast(&feed_changed);
+
+   if (!options.quiet)
+   {
+      fprintf(stderr, "Feed is now at version %ld (%d alerts)\n", version, entry_count);
+   }// End of if
+
+   pthread_mutex_unlock(&feed_lock);
+}// End of churn_feed method
+
+/*
+   churn_main(arg) Body of the churn thread.
+*/
+static void * churn_main(void *arg)
+{
+   unsigned int seed = (unsigned int)generator.seed;
+
+   (void)arg;
+
+   for (;;)
+   {
+      sleep_seconds(options.churn_interval);
+      churn_feed(&seed);
+   }// End of for
+
+   return NULL;
+}// End of churn_main method
+
+/*
+   create_delta(since, status) Builds the delta document from version since.
+      POST: Returns the document, or NULL with status set to the HTTP status
+            to answer with.
+*/
+static Document * create_delta(long since, int *status)
+{
+   pthread_mutex_lock(&feed_lock);
+
+   if (!synthetic || since > version || since < oldest_delta)
+   {
+      pthread_mutex_unlock(&feed_lock);
+      *status = 410;
+      return NULL;
+   }// End of if
+
+   // For every alert touched since the version, find its first change
+   char *first = calloc(next_index > 0 ? next_index : 1, sizeof(char));
+   long start = change_count > CHANGE_LOG_SIZE ? change_count - CHANGE_LOG_SIZE : 0;
+
+   if (!first)
+   {
+      pthread_mutex_unlock(&feed_lock);
+      *status = 500;
+      return NULL;
+   }// End of if
+
+   for (long x = start; x < change_count; ++x)
+   {
+      Change *change = &changes[x % CHANGE_LOG_SIZE];
+      if (change->version > since && !first[change->index]) first[change->index] = change->type;
+   }// End of for
+
+   char *body = NULL;
+   size_t length = 0;
+   FILE *out = open_memstream(&body, &length);
+
+   if (!out)
+   {
+      free(first);
+      pthread_mutex_unlock(&feed_lock);
+      *status = 500;
+      return NULL;
+   }// End of if
+
+   fprintf(out, "{\"version\":%ld,\"since\":%ld", version, since);
+
+   // Present now: added if it did not exist at since, updated otherwise
+   static const char *sections[] = { "added", "updated" };
+
+   for (int s = 0; s < 2; ++s)
+   {
+      int written = 0;
+      fprintf(out, ",\"%s\":[", sections[s]);
+
+      for (int x = 0; x < entry_count; ++x)
+      {
+         char type = first[entries[x].index];
+         if (!type || (s == 0) != (type == 'a')) continue;
+
+         fputs(written++ > 0 ? "," : "", out);
+         fputs(entries[x].json, out);
+      }// End of for (x)
+
+      fputc(']', out);
+   }// End of for (s)
+
+   // Gone now: removed if it existed at since
+   int written = 0;
+   fputs(",\"removed\":[", out);
+
+   for (int index = 0; index < next_index; ++index)
+   {
+      if (!first[index] || first[index] == 'a' || find_entry(index) >= 0) continue;
+
+      char identifier[64];
+      format_alert_identifier(identifier, sizeof(identifier), &generator, index);
+      fprintf(out, "%s\"%s\"", written++ > 0 ? "," : "", identifier);
+   }// End of for
+
+   fputs("]}", out);
+   fclose(out);
+   free(first);
+
+   pthread_mutex_unlock(&feed_lock);
+
+   *status = 200;
+   return create_document(body, length);
+}// End of create_delta method
+
+/*
+   send_all(fd, data, length, throttle) Sends data, pacing it to options.rate.
+      PRE:  Valid socket and pointers
+      POST: Returns false if the client went away.
+*/
+static bool send_all(int fd, const void *data, size_t length, Throttle *throttle)
+{
+   const char *ptr = data;
+   size_t slice = options.rate > 0 ? (size_t)(options.rate / 20 > 0 ? options.rate / 20 : 1) : length;
+
+   while (length > 0)
+   {
+      size_t bytes = length < slice ? length : slice;
+      ssize_t sent = send(fd, ptr, bytes, MSG_NOSIGNAL);
+
+      if (sent < 0)
+      {
+         if (errno == EINTR) continue;
+         return false;
+      }// End of if
+
+      ptr += sent;
+      length -= sent;
+      throttle->sent += sent;
+
+      if (options.rate > 0)
+      {
+         sleep_seconds((double)throttle->sent / options.rate - elapsed(&throttle->start));
+      }// End of if
+   }// End of while
+
+   return true;
+}// End of send_all method
+
+/*
+   send_body(fd, body, length, throttle) Sends the response body, chunked if
+                                           options.chunk is set.
+      PRE:  Valid socket and pointers
+      POST: Returns false if the client went away.
+*/
+static bool send_body(int fd, const void *body, size_t length, bool chunked, Throttle *throttle)
+{
+   if (!chunked) return send_all(fd, body, length, throttle);
+
+   const char *ptr = body;
+
+   while (length > 0)
+   {
+      size_t bytes = length < (size_t)options.chunk ? length : (size_t)options.chunk;
+      char header[32];
+      int header_length = snprintf(header, sizeof(header), "%zx\r\n", bytes);
+
+      if (!send_all(fd, header, header_length, throttle)
+            || !send_all(fd, ptr, bytes, throttle)
+            || !send_all(fd, "\r\n", 2, throttle)) return false;
+
+      ptr += bytes;
+      length -= bytes;
+   }// End of while
+
+   return send_all(fd, "0\r\n\r\n", 5, throttle);
+}// End of send_body method
+
+/*
+   read_request(fd, request) Reads and parses the request head.
+      PRE:  Valid socket and request pointer
+      POST: Returns false if the request could not be read.
+*/
+static bool read_request(int fd, Request *request)
+{
+   char buffer[MAX_REQUEST_SIZE + 1];
+   size_t length = 0;
+
+   buffer[0] = '\0';
+   memset(request, 0, sizeof(Request));
+   request->last_event_id = -1;
+
+   while (!strstr(buffer, "\r\n\r\n"))
+   {
+      if (length == MAX_REQUEST_SIZE) return false;
+
+      ssize_t received = recv(fd, buffer + length, MAX_REQUEST_SIZE - length, 0);
+      if (received <= 0) return false;
+
+      length += received;
+      buffer[length] = '\0';
+   }// End of while
+
+   if (sscanf(buffer, "%7s %1023s", request->method, request->path) != 2) return false;
+
+   for (char *line = strstr(buffer, "\r\n"); line; line = strstr(line, "\r\n"))
+   {
+      line += 2;
+
+      if (strncasecmp(line, "Accept-Encoding:", 16) == 0)
+      {
+         char *end = strstr(line, "\r\n");
+         char *gzip = strstr(line, "gzip");
+         request->accepts_gzip = gzip && gzip < end;
+      }// End of if
+      else if (strncasecmp(line, "If-None-Match:", 14) == 0)
+      {
+         sscanf(line + 14, " %63[^\r\n]", request->if_none_match);
+      }// End of else if
+      else if (strncasecmp(line, "Last-Event-ID:", 14) == 0)
+      {
+         request->last_event_id = atol(line + 14);
+      }// End of else if
+   }// End of for
+
+   return true;
+}// End of read_request method
+
+/*
+   chance(seed, rate) Returns true with probability rate.
+*/
+static bool chance(unsigned int *seed, double rate)
+{
+   return rate > 0 && rand_r(seed) < rate * ((double)RAND_MAX + 1);
+}// End of chance method
+
+/*
+   send_status(fd, request, status, reason, throttle) Sends a response
+                                                         without a document.
+*/
+static void send_status(int fd, const Request *request, int status, const char *reason, Throttle *throttle)
+{
+   char response[256];
+   int length = snprintf(response, sizeof(response), "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\n"
+                                                     "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+                         status, reason, strlen(reason) + 12);
+
+   if (!send_all(fd, response, length, throttle) || strcmp(request->method, "HEAD") == 0) return;
+
+   length = snprintf(response, sizeof(response), "{\"error\":\"%s\"}", reason);
+   send_all(fd, response, length, throttle);
+}// End of send_status method
+
+/*
+   send_document(fd, request, document, seed, throttle) Sends document in
+                                                          answer to request.
+      PRE:  Valid socket and pointers
+      POST: Response is sent (or deliberately broken by the error injection).
+*/
+static void send_document(int fd, const Request *request, const Document *document,
+                          unsigned int *seed, Throttle *throttle)
+{
+   char head[512];
+   int head_length = 0;
+   bool head_only = strcmp(request->method, "HEAD") == 0;
+   bool chunked = options.chunk > 0;
+
+   if (request->if_none_match[0] && strcmp(request->if_none_match, document->etag) == 0)
+   {
+      head_length = snprintf(head, sizeof(head), "HTTP/1.1 304 Not Modified\r\nETag: %s\r\n"
+                                                 "Connection: close\r\n\r\n", document->etag);
+      send_all(fd, head, head_length, throttle);
+      return;
+   }// End of if
+
+   bool gzip = request->accepts_gzip && document->gzip;
+   const void *body = gzip ? (const void *)document->gzip : (const void *)document->body;
+   size_t length = gzip ? document->gzip_length : document->length;
+
+   head_length = snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+                                              "ETag: %s\r\nVary: Accept-Encoding\r\n%s",
+                          document->etag, gzip ? "Content-Encoding: gzip\r\n" : "");
+
+   if (chunked)
+   {
+      head_length += snprintf(head + head_length, sizeof(head) - head_length,
+                              "Transfer-Encoding: chunked\r\n");
+   }// End of if
+   else
+   {
+      head_length += snprintf(head + head_length, sizeof(head) - head_length,
+                              "Content-Length: %zu\r\n", length);
+   }// End of else
+
+   head_length += snprintf(head + head_length, sizeof(head) - head_length, "Connection: close\r\n\r\n");
+
+   if (!send_all(fd, head, head_length, throttle) || head_only) return;
+
+   if (chance(seed, options.stall_rate))
+   {
+      sleep_seconds(options.stall_time);
+      return;
+   }// End of if
+
+   if (chance(seed, options.truncate_rate))
+   {
+      // Close half way through the body, the client sees a partial transfer
+      send_all(fd, body, length / 2, throttle);
+      return;
+   }// End of if
+
+   send_body(fd, body, length, chunked, throttle);
+}// End of send_document method
+
+/*
+   wait_for_version(known, seconds) Waits until the feed moves past version
+                                      known, for at most seconds.
+      POST: Returns the current version.
+*/
+static long wait_for_version(long known, int seconds)
+{
+   struct timespec deadline;
+   clock_gettime(CLOCK_REALTIME, &deadline);
+   deadline.tv_sec += seconds;
+
+   pthread_mutex_lock(&feed_lock);
+
+   while (version == known)
+   {
+      if (pthread_cond_timedwait(&feed_changed, &feed_lock, &deadline) != 0) break;
+   }// End of while
+
+   long now = version;
+   pthread_mutex_unlock(&feed_lock);
+
+   return now;
+}// End of wait_for_version method
+
+/*
+   send_stream(fd, request, throttle) Streams one delta per feed version, as
+                                        Server-Sent Events or (with
+                                        format=ndjson) one JSON line each.
+      PRE:  Valid socket and pointers
+      POST: Returns when the client goes away, the stream falls too far behind
+            or options.stream_drop seconds passed.
+*/
+static void send_stream(int fd, const Request *request, Throttle *throttle)
+{
+   bool ndjson = strstr(request->path, "format=ndjson") != NULL;
+
+   pthread_mutex_lock(&feed_lock);
+   long sent = request->last_event_id >= 0 ? request->last_event_id : version;
+   bool resumable = synthetic ? sent >= oldest_delta && sent <= version : sent == version;
+   pthread_mutex_unlock(&feed_lock);
+
+   // Resuming from a version without a delta needs a full fetch first
+   if (!resumable)
+   {
+      send_status(fd, request, 410, "Gone", throttle);
+      return;
+   }// End of if
+
+   char head[256];
+   int head_length = snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Type: %s\r\n"
+                                                  "Cache-Control: no-cache\r\nConnection: close\r\n\r\n",
+                              ndjson ? "application/x-ndjson" : "text/event-stream");
+
+   if (!send_all(fd, head, head_length, throttle) || strcmp(request->method, "HEAD") == 0) return;
+
+   for (;;)
+   {
+      int wait = STREAM_KEEPALIVE;
+
+      if (options.stream_drop > 0)
+      {
+         double left = options.stream_drop - elapsed(&throttle->start);
+         if (left <= 0) return;
+         if (left < wait) wait = (int)left + 1;
+      }// End of if
+
+      if (wait_for_version(sent, wait) == sent)
+      {
+         // Nothing new, keep intermediaries (and the client's watchdog) happy
+         if (!send_all(fd, ndjson ? "\n" : ": keepalive\n\n", ndjson ? 1 : 13, throttle)) return;
+         continue;
+      }// End of if
+
+      int status = 0;
+      Document *delta = create_delta(sent, &status);
+
+      if (!delta)
+      {
+         if (!ndjson) send_all(fd, "event: reset\ndata: {}\n\n", 24, throttle);
+         return;
+      }// End of if
+
+      long delta_version = sent;
+      sscanf(delta->body, "{\"version\":%ld", &delta_version);
+
+      char event[64];
+      int event_length = ndjson ? 0 : snprintf(event, sizeof(event), "id: %ld\nevent: delta\ndata: ", delta_version);
+
+      bool ok = send_all(fd, event, event_length, throttle)
+                && send_all(fd, delta->body, delta->length, throttle)
+                && send_all(fd, ndjson ? "\n" : "\n\n", ndjson ? 1 : 2, throttle);
+
+      release_document(delta);
+      if (!ok) return;
+
+      sent = delta_version;
+   }// End of for
+}// End of send_stream method
+
+/*
+   serve_request(fd, request, seed) Answers request.
+*/
+static void serve_request(int fd, const Request *request, unsigned int *seed)
+{
+   Throttle throttle = { { 0 }, 0 };
+   clock_gettime(CLOCK_MONOTONIC, &throttle.start);
+
+   if (chance(seed, options.error_rate))
+   {
+      send_status(fd, request, 503, "Service Unavailable", &throttle);
+      return;
+   }// End of if
+
+   if (strstr(request->path, "/stream"))
+   {
+      send_stream(fd, request, &throttle);
+      return;
+   }// End of if
+
+   const char *since = strstr(request->path, "since=");
+   Document *document = NULL;
+
+   if (since)
+   {
+      int status = 0;
+      document = create_delta(atol(since + 6), &status);
+
+      if (!document)
+      {
+         send_status(fd, request, status, status == 410 ? "Gone" : "Internal Server Error", &throttle);
+         return;
+      }// End of if
+   }// End of if
+   else
+   {
+      document = acquire_current();
+   }// End of else
+
+   send_document(fd, request, document, seed, &throttle);
+   release_document(document);
+}// End of serve_request method
+
+/*
+   serve_connection(arg) Handles one client connection.
+*/
+static void * serve_connection(void *arg)
+{
+   int fd = (int)(long)arg;
+   unsigned long number = __atomic_add_fetch(&request_count, 1, __ATOMIC_RELAXED);
+   unsigned int seed = (unsigned int)number * 2654435761U;
+
+   Request request;
+   struct timespec start;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+
+   if (read_request(fd, &request))
+   {
+      sleep_seconds(options.latency / 1000.0);
+      serve_request(fd, &request, &seed);
+
+      if (!options.quiet)
+      {
+         fprintf(stderr, "#%lu %s %s%s %.3fs\n", number, request.method, request.path,
+                 request.accepts_gzip ? " (gzip)" : "", elapsed(&start));
+      }// End of if
+   }// End of if
+
+   close(fd);
+   return NULL;
+}// End of serve_connection method
+
+/*
+   load_feed_file(path) Reads a recorded feed and publishes it.
+*/
+static bool load_feed_file(const char *path)
+{
+   FILE *file = fopen(path, "rb");
+   if (!file) return false;
+
+   fseek(file, 0, SEEK_END);
+   long length = ftell(file);
+   rewind(file);
+
+   char *body = malloc(length + 1);
+
+   if (!body || fread(body, 1, length, file) != (size_t)length)
+   {
+      free(body);
+      fclose(file);
+      return false;
+   }// End of if
+
+   body[length] = '\0';
+   fclose(file);
+
+   current = create_document(body, length);
+   return current != NULL;
+}// End of load_feed_file method
+
+/*
+   create_synthetic_feed() Generates the initial synthetic feed (version 1).
+*/
+static bool create_synthetic_feed(void)
+{
+   entries = calloc(generator.count > 0 ? generator.count : 1, sizeof(FeedEntry));
+   if (!entries) return false;
+
+   for (next_index = 0; next_index < generator.count; ++next_index)
+   {
+      entries[next_index].index = next_index;
+      entries[next_index].json = render_alert(next_index, 0);
+
+      if (!entries[next_index].json) return false;
+   }// End of for
+
+   entry_count = generator.count;
+   synthetic = true;
+   version = 1;
+   oldest_delta = 1;
+
+   publish_feed();
+   return current != NULL;
+}// End of create_synthetic_feed method
+
+static void usage(const char *program)
+{
+   fprintf(stderr, "Usage: %s [options]\n"
+                   "  -p, --port PORT          Port to listen on, 0 picks a free one (default 8080)\n"
+                   "  -f, --file FILE          Serve the recorded feed in FILE\n"
+                   "  -s, --synthetic COUNT    Serve a synthetic feed of COUNT alerts (default 100)\n"
+                   "      --seed SEED          Seed of the synthetic feed\n"
+                   "      --detailed           Give synthetic alerts English and French infos, area\n"
+                   "                           polygons and long descriptions\n"
+                   "      --churn COUNT        Change COUNT synthetic alerts every churn interval\n"
+                   "      --churn-interval S   Seconds between changes (default 10)\n"
+                   "      --delta-window N     Serve deltas for the last N versions (default 100)\n"
+                   "      --stream-drop S      Close event streams after S seconds\n"
+                   "      --latency MS         Delay every response by MS milliseconds\n"
+                   "      --rate BYTES         Limit responses to BYTES per second\n"
+                   "      --chunk BYTES        Use chunked transfer encoding with BYTES per chunk\n"
+                   "      --no-gzip            Never compress responses\n"
+                   "      --error-rate P       Answer a fraction P of requests with 503\n"
+                   "      --truncate-rate P    Cut a fraction P of responses off half way\n"
+                   "      --stall-rate P       Stall a fraction P of responses after the headers\n"
+                   "      --stall-time SECONDS How long stalled responses hang (default 60)\n"
+                   "  -q, --quiet              Do not log requests\n",
+           program);
+}// End of usage method
+
+int main(int argc, char **argv)
+{
+   enum { OPT_SEED = 256, OPT_CHURN, OPT_CHURN_INTERVAL, OPT_DELTA_WINDOW, OPT_STREAM_DROP, OPT_LATENCY, OPT_RATE,
+          OPT_CHUNK, OPT_NO_GZIP, OPT_ERROR_RATE, OPT_TRUNCATE_RATE, OPT_STALL_RATE, OPT_STALL_TIME, OPT_DETAILED };
+
+   static const struct option long_options[] = {
+      { "port",           required_argument, NULL, 'p' },
+      { "file",           required_argument, NULL, 'f' },
+      { "synthetic",      required_argument, NULL, 's' },
+      { "seed",           required_argument, NULL, OPT_SEED },
+      { "detailed",       no_argument,       NULL, OPT_DETAILED },
+      { "churn",          required_argument, NULL, OPT_CHURN },
+      { "churn-interval", required_argument, NULL, OPT_CHURN_INTERVAL },
+      { "delta-window",   required_argument, NULL, OPT_DELTA_WINDOW },
+      { "stream-drop",    required_argument, NULL, OPT_STREAM_DROP },
+      { "latency",        required_argument, NULL, OPT_LATENCY },
+      { "rate",           required_argument, NULL, OPT_RATE },
+      { "chunk",          required_argument, NULL, OPT_CHUNK },
+      { "no-gzip",        no_argument,       NULL, OPT_NO_GZIP },
+      { "error-rate",     required_argument, NULL, OPT_ERROR_RATE },
+      { "truncate-rate",  required_argument, NULL, OPT_TRUNCATE_RATE },
+      { "stall-rate",     required_argument, NULL, OPT_STALL_RATE },
+      { "stall-time",     required_argument, NULL, OPT_STALL_TIME },
+      { "quiet",          no_argument,       NULL, 'q' },
+      { "help",           no_argument,       NULL, 'h' },
+      { NULL,             0,                 NULL, 0 }
+   };
+
+   const char *path = NULL;
+   int option = 0;
+
+   while ((option = getopt_long(argc, argv, "p:f:s:qh", long_options, NULL)) != -1)
+   {
+      switch (option)
+      {
+         case 'p':                  options.port = atoi(optarg); break;
+         case 'f':                  path = optarg; break;
+         case 's':                  generator.count = atoi(optarg); break;
+         case OPT_SEED:             generator.seed = strtoul(optarg, NULL, 10); break;
+         case OPT_DETAILED:         generator.detailed = true; break;
+         case OPT_CHURN:            options.churn = atoi(optarg); break;
+         case OPT_CHURN_INTERVAL:   options.churn_interval = atoi(optarg); break;
+         case OPT_DELTA_WINDOW:     options.delta_window = atol(optarg); break;
+         case OPT_STREAM_DROP:      options.stream_drop = atoi(optarg); break;
+         case OPT_LATENCY:          options.latency = atoi(optarg); break;
+         case OPT_RATE:             options.rate = atol(optarg); break;
+         case OPT_CHUNK:            options.chunk = atoi(optarg); break;
+         case OPT_NO_GZIP:          options.compress = false; break;
+         case OPT_ERROR_RATE:       options.error_rate = atof(optarg); break;
+         case OPT_TRUNCATE_RATE:    options.truncate_rate = atof(optarg); break;
+         case OPT_STALL_RATE:       options.stall_rate = atof(optarg); break;
+         case OPT_STALL_TIME:       options.stall_time = atoi(optarg); break;
+         case 'q':                  options.quiet = true; break;
+         case 'h':                  usage(argv[0]); return 0;
+         default:                   usage(argv[0]); return 1;
+      }// End of switch
+   }// End of while
+
+   // Prepare the feed
+   if (path ? !load_feed_file(path) : !create_synthetic_feed())
+   {
+      fprintf(stderr, "%s: failed to %s the feed\n", argv[0], path ? "read" : "generate");
+      return 1;
+   }// End of if
+
+   // Listen on the loopback interface only
+   signal(SIGPIPE, SIG_IGN);
+
+   int server = socket(AF_INET, SOCK_STREAM, 0);
+   int reuse = 1;
+   struct sockaddr_in address;
+   socklen_t address_length = sizeof(address);
+
+   memset(&address, 0, sizeof(address));
+   address.sin_family = AF_INET;
+   address.sin_port = htons(options.port);
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+   if (server < 0 || bind(server, (struct sockaddr *)&address, sizeof(address)) != 0
+         || listen(server, 128) != 0)
+   {
+      perror("feedserver");
+      return 1;
+   }// End of if
+
+   getsockname(server, (struct sockaddr *)&address, &address_length);
+
+   printf("Serving %zu bytes (%zu gzipped) on http://127.0.0.1:%d/api/alerts.json\n",
+          current->length, current->gzip_length, ntohs(address.sin_port));
+   fflush(stdout);
+
+   pthread_t thread;
+
+   if (synthetic && options.churn > 0 && options.churn_interval > 0)
+   {
+      pthread_create(&thread, NULL, churn_main, NULL);
+      pthread_detach(thread);
+   }// End of if
+
+   // Serve every connection on its own thread
+   for (;;)
+   {
+      int client = accept(server, NULL, NULL);
+
+      if (client < 0)
+      {
+         if (errno == EINTR) continue;
+         perror("feedserver");
+         break;
+      }// End of if
+
+      if (pthread_create(&thread, NULL, serve_connection, (void *)(long)client) != 0)
+      {
+         close(client);
+         continue;
+      }// End of if
+
+      pthread_detach(thread);
+   }// End of for
+
+   close(server);
+   return 0;
+}// End of main method
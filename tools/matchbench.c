@@ -0,0 +1,306 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+/*
+   matchbench measures the subscription matcher (src/match.c) with many
+   subscribers, and checks its results against testing every subscription:
+
+      bin/matchbench -n 100000 -a 10000
+
+   Subscriptions and alerts are drawn from the same geocodes and event types
+   as the synthetic feed (15 regions of 1000 geocodes, 10 event types). Most
+   subscriptions list a few geocodes and event types, some only one of them
+   and a few neither. Every line of the report is "name value unit".
+*/
+
+#include "match.h"
+#include "memory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <getopt.h>
+#include <time.h>
+
+#define REGION_COUNT 15
+#define NAIVE_ALERTS 200             // Alerts checked against every subscription
+#define CHURN_ROUNDS 10000           // Subscriptions removed and added again
+
+static const char *events[] = {
+   "thunderstorm", "tornado", "snowfall", "blizzard", "rainfall",
+   "freezing rain", "heat", "wind", "fog", "air quality"
+};
+
+#define EVENT_COUNT ((int)(sizeof(events) / sizeof(events[0])))
+
+// Kept to check the matcher against
+struct Subscriber {
+   int geocode_count;
+   int geocodes[8];
+   int event_count;
+   const char *events[3];
+};
+typedef struct Subscriber Subscriber;
+
+static unsigned long state = 0x2545F4914F6CDD1DUL;
+
+static unsigned long next_random(void)
+{
+   state ^= state << 13;
+   state ^= state >> 7;
+   state ^= state << 17;
+
+   return state;
+}// End of next_random method
+
+static int random_geocode(void)
+{
+   return 100000 + (next_random() % REGION_COUNT) * 1000 + next_random() % 1000;
+}// End of random_geocode method
+
+static double now(void)
+{
+   struct timespec time;
+   clock_gettime(CLOCK_MONOTONIC, &time);
+
+   return time.tv_sec + time.tv_nsec / 1e9;
+}// End of now method
+
+static void random_subscriber(Subscriber *subscriber)
+{
+   unsigned long kind = next_random() % 100;
+
+   // 80% geocodes and event types, 10% geocodes only, 8% event types only, 2% anything
+   subscriber->geocode_count = kind < 90 ? 1 + next_random() % 8 : 0;
+   subscriber->event_count = kind < 80 || (kind >= 90 && kind < 98) ? 1 + next_random() % 3 : 0;
+
+   for (int x = 0; x < subscriber->geocode_count; ++x) subscriber->geocodes[x] = random_geocode();
+   for (int x = 0; x < subscriber->event_count; ++x) subscriber->events[x] = events[next_random() % EVENT_COUNT];
+}// End of random_subscriber method
+
+static Alert * random_alert(void)
+{
+   const char *event = events[next_random() % EVENT_COUNT];
+   Alert *alert = account_calloc(MEMORY_ALERTS, 1, sizeof(Alert));
+
+   alert->references = 1;
+   alert->event = account_strndup(MEMORY_STRINGS, event, strlen(event));
+   alert->area_count = 1 + next_random() % 3;
+   alert->areas = account_calloc(MEMORY_ALERTS, alert->area_count, sizeof(AlertArea *));
+
+   for (int x = 0; x < alert->area_count; ++x)
+   {
+      AlertArea *area = account_calloc(MEMORY_ALERTS, 1, sizeof(AlertArea));
+
+      area->geocode_count = 1;
+      area->geocodes = account_malloc(MEMORY_ALERTS, sizeof(int));
+      area->geocodes[0] = random_geocode();
+      alert->areas[x] = area;
+   }// End of for
+
+   return alert;
+}// End of random_alert method
+
+/*
+   naive_match(subscriber, alert) Tests one subscription the slow way.
+*/
+static bool naive_match(const Subscriber *subscriber, const Alert *alert)
+{
+   bool event = subscriber->event_count == 0;
+   bool geocode = subscriber->geocode_count == 0;
+
+   for (int x = 0; x < subscriber->event_count && !event; ++x)
+   {
+      event = strcasecmp(subscriber->events[x], alert->event) == 0;
+   }// End of for
+
+   for (int x = 0; x < alert->area_count && !geocode; ++x)
+   {
+      for (int y = 0; y < subscriber->geocode_count && !geocode; ++y)
+      {
+         geocode = alert->areas[x]->geocodes[0] == subscriber->geocodes[y];
+      }// End of for (y)
+   }// End of for (x)
+
+   return event && geocode;
+}// End of naive_match method
+
+static int compare_ints(const void *a, const void *b)
+{
+   int x = *(const int *)a;
+   int y = *(const int *)b;
+
+   return x < y ? -1 : x > y;
+}// End of compare_ints method
+
+static void usage(const char *program)
+{
+   fprintf(stderr, "Usage: %s [options]\n"
+                   "  -n, --subscribers COUNT  Subscriptions to index (default 100000)\n"
+                   "  -a, --alerts COUNT       Alerts to match (default 10000)\n"
+                   "      --seed SEED          Seed of the subscriptions and alerts\n",
+           program);
+}// End of usage method
+
+int main(int argc, char **argv)
+{
+   static const struct option long_options[] = {
+      { "subscribers", required_argument, NULL, 'n' },
+      { "alerts",      required_argument, NULL, 'a' },
+      { "seed",        required_argument, NULL, 's' },
+      { "help",        no_argument,       NULL, 'h' },
+      { NULL,          0,                 NULL, 0 }
+   };
+
+   int subscriber_count = 100000;
+   int alert_count = 10000;
+   int option = 0;
+
+   while ((option = getopt_long(argc, argv, "n:a:h", long_options, NULL)) != -1)
+   {
+      switch (option)
+      {
+         case 'n':                  subscriber_count = atoi(optarg); break;
+         case 'a':                  alert_count = atoi(optarg); break;
+         case 's':                  state ^= strtoul(optarg, NULL, 10) * 0x9E3779B97F4A7C15UL; break;
+         case 'h':                  usage(argv[0]); return 0;
+         default:                   usage(argv[0]); return 1;
+      }// End of switch
+   }// End of while
+
+   if (subscriber_count <= 0 || alert_count <= 0 || !state)
+   {
+      usage(argv[0]);
+      return 1;
+   }// End of if
+
+   Subscriber *subscribers = calloc(subscriber_count, sizeof(Subscriber));
+   Alert **alerts = calloc(alert_count, sizeof(Alert *));
+   Matcher *matcher = create_matcher();
+   MatchResult result = { 0 };
+
+   if (!subscribers || !alerts || !matcher)
+   {
+      fprintf(stderr, "%s: failed to allocate memory\n", argv[0]);
+      return 1;
+   }// End of if
+
+   for (int x = 0; x < subscriber_count; ++x) random_subscriber(&subscribers[x]);
+   for (int x = 0; x < alert_count; ++x) alerts[x] = random_alert();
+
+   MemoryUsage usage;
+   read_memory_usage(MEMORY_PHASES, &usage);
+   printf("alert_memory %.0f bytes/alert\n", (double)usage.bytes / alert_count);
+
+   // Index every subscription
+   double start = now();
+
+   for (int x = 0; x < subscriber_count; ++x)
+   {
+      const Subscriber *subscriber = &subscribers[x];
+
+      if (add_subscription(matcher, subscriber->geocodes, subscriber->geocode_count,
+                           subscriber->events, subscriber->event_count) != x)
+      {
+         fprintf(stderr, "%s: failed to add subscription %d\n", argv[0], x);
+         return 1;
+      }// End of if
+   }// End of for
+
+   double elapsed = now() - start;
+
+   printf("subscriptions %d count\n", subscriber_count);
+   printf("add %.0f ns/subscription\n", elapsed * 1e9 / subscriber_count);
+
+   // Match every alert
+   long matched = 0;
+   start = now();
+
+   for (int x = 0; x < alert_count; ++x) matched += match_alert(matcher, alerts[x], &result);
+
+   elapsed = now() - start;
+
+   printf("match %.0f ns/alert\n", elapsed * 1e9 / alert_count);
+   printf("match_per_result %.1f ns/subscription\n", matched ? elapsed * 1e9 / matched : 0.0);
+   printf("matches %.1f subscriptions/alert\n", (double)matched / alert_count);
+
+   // The same alerts, testing every subscription
+   int naive_alerts = alert_count < NAIVE_ALERTS ? alert_count : NAIVE_ALERTS;
+   int *expected = malloc(subscriber_count * sizeof(int));
+   int mismatches = 0;
+   double naive = 0;
+
+   for (int x = 0; x < naive_alerts && expected; ++x)
+   {
+      int count = 0;
+      start = now();
+
+      for (int y = 0; y < subscriber_count; ++y)
+      {
+         if (naive_match(&subscribers[y], alerts[x])) expected[count++] = y;
+      }// End of for (y)
+
+      naive += now() - start;
+      match_alert(matcher, alerts[x], &result);
+      qsort(result.subscriptions, result.count, sizeof(int), compare_ints);
+
+      if (result.count != count || memcmp(result.subscriptions, expected, count * sizeof(int)) != 0) ++mismatches;
+   }// End of for (x)
+
+   printf("naive %.0f ns/alert\n", naive * 1e9 / naive_alerts);
+   printf("mismatches %d alerts\n", mismatches);
+
+   // Remove subscriptions and add them again
+   start = now();
+
+   for (int x = 0; x < CHURN_ROUNDS; ++x)
+   {
+      int number = next_random() % subscriber_count;
+      const Subscriber *subscriber = &subscribers[number];
+
+      remove_subscription(matcher, number);
+
+      if (add_subscription(matcher, subscriber->geocodes, subscriber->geocode_count,
+                           subscriber->events, subscriber->event_count) != number)
+      {
+         fprintf(stderr, "%s: subscription %d was not given back its number\n", argv[0], number);
+         return 1;
+      }// End of if
+   }// End of for
+
+   elapsed = now() - start;
+   printf("churn %.0f ns/subscription\n", elapsed * 1e9 / CHURN_ROUNDS);
+
+   free(expected);
+   free_match_result(&result);
+   free_matcher(matcher);
+
+   for (int x = 0; x < alert_count; ++x) free_alert(alerts[x]);
+   free(alerts);
+   free(subscribers);
+
+   return mismatches > 0;
+}// End of main method
@@ -0,0 +1,185 @@
+/*
+   The MIT License (MIT)
+
+   Copyright (c) 2014 Zachary Seguin
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+/*
+   wirecheck sends alerts through the wire format (src/wire.c) the way the
+   daemon does, in full and then as deltas against what the client decoded,
+   and checks that the client ends up with the alerts that were sent:
+
+      bin/wirecheck
+
+   Each case changes one part of an alert (or nothing) between two feeds, the
+   changed alert must be sent in full and the unchanged ones as runs. It
+   prints one line per failed check and exits with 1 if any failed (make
+   check).
+*/
+
+#include "wire.h"
+#include "alerts.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define FEED_SIZE 4096
+
+// An alert of the feed, the fields a case changes are arguments
+#define ALERT_FORMAT \
+   "{\"identifier\":\"%s\",\"status\":\"Actual\",\"sent\":\"2014-02-26T15:41:00-05:00\",\"infos\":[" \
+   "{\"language\":\"en-CA\",\"event\":\"snowfall\",\"severity\":\"Moderate\"," \
+   "\"headline\":\"%s\",\"sender_name\":\"Environment Canada\"," \
+   "\"effective\":\"2014-02-26T15:41:00-05:00\",\"expires\":\"%s\"," \
+   "\"description\":\"Snowfall with total amounts of about 15 cm is expected.\",\"instruction\":\"\"," \
+   "\"areas\":[{\"description\":\"%s\",\"geocodes\":[\"%s\"]}]}]}"
+
+struct AlertFields {
+   const char *headline;
+   const char *expires;
+   const char *area;
+   const char *geocode;
+};
+typedef struct AlertFields AlertFields;
+
+static const AlertFields base = {
+   "snowfall warning in effect", "2014-02-27T15:41:00-05:00", "City of Ottawa", "061110"
+};
+
+static int failures = 0;
+
+static void check(bool condition, const char *name, const char *what)
+{
+   if (condition) return;
+
+   printf("FAIL %s: %s\n", name, what);
+   failures++;
+}// End of check method
+
+/*
+   load_feed(changed) Loads a feed of three alerts, the second one with the
+   fields of changed.
+*/
+static Alerts * load_feed(const AlertFields *changed)
+{
+   static const char *identifiers[] = { "urn:oid:1", "urn:oid:2", "urn:oid:3" };
+   char feed[FEED_SIZE];
+   int length = snprintf(feed, sizeof(feed), "{\"alerts\":[");
+
+   for (int i = 0; i < 3; i++)
+   {
+      const AlertFields *fields = i == 1 ? changed : &base;
+
+      length += snprintf(feed + length, sizeof(feed) - length, ALERT_FORMAT "%s", identifiers[i],
+                         fields->headline, fields->expires, fields->area, fields->geocode, i < 2 ? "," : "]}");
+   }// End of for (i)
+
+   return load_alerts_from_json_buffer(feed, length);
+}// End of load_feed method
+
+/*
+   send_alerts(alerts, previous, sent, decoded) Encodes alerts as a delta
+   against previous and decodes the frame against decoded, as the client of
+   a daemon would. Returns the decoded alerts (NULL on failure) and sets sent
+   to the number of alerts sent in full.
+*/
+static Alerts * send_alerts(const Alerts *alerts, const Alerts *previous, const Alerts *decoded, int *sent)
+{
+   WireBuffer buffer = { 0 };
+   Alerts *received = NULL;
+
+   *sent = put_wire_alerts(&buffer, alerts, previous);
+
+   if (*sent >= 0)
+   {
+      WireType type;
+      WireReader reader;
+
+      if (read_wire_frame(buffer.data, buffer.length, &type, &reader) == (long)buffer.length && type == WIRE_ALERTS)
+         received = get_wire_alerts(&reader, decoded);
+   }// End of if
+
+   free_wire_buffer(&buffer);
+   return received;
+}// End of send_alerts method
+
+static void check_case(const char *name, const AlertFields *changed, int expected_sent)
+{
+   Alerts *first = load_feed(&base);
+   Alerts *second = load_feed(changed);
+
+   if (!first || !second)
+   {
+      check(false, name, "feed did not load");
+      if (first) free_alerts(first);
+      if (second) free_alerts(second);
+      return;
+   }// End of if
+
+   int sent;
+   Alerts *decoded_first = send_alerts(first, NULL, NULL, &sent);
+   check(decoded_first != NULL, name, "full frame did not decode");
+   check(sent == first->count, name, "full frame did not send every alert in full");
+
+   if (decoded_first)
+   {
+      Alerts *decoded_second = send_alerts(second, first, decoded_first, &sent);
+      check(decoded_second != NULL, name, "delta did not decode");
+      check(sent == expected_sent, name, "delta sent the wrong number of alerts in full");
+
+      if (decoded_second)
+      {
+         check(decoded_second->count == second->count, name, "delta decoded the wrong number of alerts");
+
+         for (int i = 0; i < second->count && i < decoded_second->count; i++)
+            check(same_alert(decoded_second->alerts[i], second->alerts[i]), name, "decoded alert differs from the one sent");
+
+         free_alerts(decoded_second);
+      }// End of if
+
+      free_alerts(decoded_first);
+   }// End of if
+
+   free_alerts(first);
+   free_alerts(second);
+}// End of check_case method
+
+int main(void)
+{
+   AlertFields headline = base, expires = base, area = base, geocode = base;
+
+   headline.headline = "snowfall warning ended";
+   expires.expires = "2014-02-27T18:00:00-05:00";
+   area.area = "Gatineau";
+   geocode.geocode = "024410";
+
+   check_case("unchanged", &base, 0);
+   check_case("headline", &headline, 1);
+   check_case("expires", &expires, 1);
+   check_case("area", &area, 1);
+   check_case("geocode", &geocode, 1);
+
+   if (failures == 0) printf("wirecheck: all checks passed\n");
+
+   return failures == 0 ? 0 : 1;
+}// End of main method